@@ -9,35 +9,91 @@ CONFIG += c++17
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
 SOURCES += \
+    amodeacquisitionworker.cpp \
     amodeconfig.cpp \
     amodeconnection.cpp \
     amodedatamanipulator.cpp \
+    amodedownsampler.cpp \
+    amodeenvelopedetector.cpp \
+    amodeframe.cpp \
+    amodeframeparser.cpp \
+    amodeframepool.cpp \
+    amodeframequeue.cpp \
+    amodegroupplot.cpp \
+    amodeminmaxdecimator.cpp \
+    amodepeaktracker.cpp \
+    amoderecorder.cpp \
+    amoderenderscheduler.cpp \
+    amodereplaysource.cpp \
+    amodeseparatorscanner.cpp \
+    amodestreamstatistics.cpp \
+    amodewaterfallplot.cpp \
     bmode3dvisualizer.cpp \
+    bmodecameraenumerator.cpp \
     bmodeconnection.cpp \
+    bmodeframe.cpp \
+    bmodeframepool.cpp \
+    bmodegrabworker.cpp \
+    bmodegrayconverter.cpp \
+    bmodeopencvcapture.cpp \
+    bmoderoidetector.cpp \
+    bmodev4l2capture.cpp \
+    clockmodel.cpp \
     main.cpp \
     mainwindow.cpp \
     mhareader.cpp \
     mhawriter.cpp \
+    posehistory.cpp \
     qcustomplot.cpp \
     qcustomplotintervalwindow.cpp \
     qualisysconnection.cpp \
-    qualisystransformationmanager.cpp \
+    rigidbodyframe.cpp \
+    rigidbodyframepool.cpp \
     volume3dcontroller.cpp \
     volumeamodecontroller.cpp
 
 HEADERS += \
+    amodeacquisitionworker.h \
     amodeconfig.h \
     amodeconnection.h \
     amodedatamanipulator.h \
+    amodedownsampler.h \
+    amodeenvelopedetector.h \
+    amodeframe.h \
+    amodeframeparser.h \
+    amodeframepool.h \
+    amodeframequeue.h \
+    amodegroupplot.h \
+    amodeminmaxdecimator.h \
+    amodepeaktracker.h \
+    amoderecorder.h \
+    amoderenderscheduler.h \
+    amodereplaysource.h \
+    amodeseparatorscanner.h \
+    amodesource.h \
+    amodestreamstatistics.h \
+    amodewaterfallplot.h \
     bmode3dvisualizer.h \
+    bmodecameraenumerator.h \
+    bmodecapturedevice.h \
     bmodeconnection.h \
+    bmodeframe.h \
+    bmodeframepool.h \
+    bmodegrabworker.h \
+    bmodegrayconverter.h \
+    bmodeopencvcapture.h \
+    bmoderoidetector.h \
+    bmodev4l2capture.h \
+    clockmodel.h \
     mainwindow.h \
     mhareader.h \
     mhawriter.h \
+    posehistory.h \
     qcustomplot.h \
     qcustomplotintervalwindow.h \
     qualisysconnection.h \
-    qualisystransformationmanager.h \
+    rigidbodyframe.h \
+    rigidbodyframepool.h \
     ultrasoundconfig.h \
     volume3dcontroller.h \
     volumeamodecontroller.h
@@ -76,3 +132,16 @@ else: unix:!android: target.path = /opt/$${TARGET}/bin
 
 
 QMAKE_CXXFLAGS += -Wa,-mbig-obj
+
+# OpenMP, for processing the A-mode probes in parallel (AmodeEnvelopeDetector)
+QMAKE_CXXFLAGS += -fopenmp
+LIBS += -fopenmp
+
+# OpenGL for the plots, off by default, build with: qmake CONFIG+=amode_opengl
+# QCustomPlot paints into a frame buffer object (QCUSTOMPLOT_USE_OPENGL, see AmodeGroupPlot). Since Qt 6 the frame
+# buffer object is in the opengl module.
+amode_opengl {
+    DEFINES += QCUSTOMPLOT_USE_OPENGL
+    greaterThan(QT_MAJOR_VERSION, 5): QT += opengl
+    win32: LIBS += -lopengl32
+}
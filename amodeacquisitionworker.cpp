@@ -0,0 +1,248 @@
+#include "amodeacquisitionworker.h"
+
+#include <QDebug>
+#include <QElapsedTimer>
+#include <chrono>
+#include <cstring>
+
+namespace {
+// Host monotonic time [ns]. The same clock for everything (statistics and recording), so it can be compared later
+int64_t steadyNanoseconds()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+}
+
+AmodeAcquisitionWorker::AmodeAcquisitionWorker(const std::vector<uint16_t>& separator, int headersize, int indexsize, int datasize,
+                                               std::shared_ptr<AmodeFramePool> pool, AmodeFrameQueue *queue)
+    : QObject{nullptr}, parser_(separator, headersize, indexsize, datasize), pool_(std::move(pool)), queue_(queue)
+{
+}
+
+AmodeAcquisitionWorker::~AmodeAcquisitionWorker()
+{
+    disconnectFromServer();
+}
+
+int AmodeAcquisitionWorker::connectToServer(const QString &ip, quint16 port)
+{
+    // The socket has to be created here (not in the constructor), so that it belongs to the worker thread
+    if (tcpSocket == nullptr)
+    {
+        tcpSocket = new QTcpSocket(this);
+        connect(tcpSocket, &QTcpSocket::readyRead, this, &AmodeAcquisitionWorker::readData);
+        connect(tcpSocket, &QTcpSocket::errorOccurred, this, &AmodeAcquisitionWorker::handleError);
+    }
+
+    tcpSocket->connectToHost(ip, port);
+
+    if(tcpSocket->waitForConnected(5000)) { // Wait for up to 5 seconds
+        qDebug() << "Successfully connected to" << ip << "on port" << port;
+        return 1;
+    } else {
+        qDebug() << "Failed to connect to" << ip << "on port" << port;
+        return 0;
+    }
+}
+
+int AmodeAcquisitionWorker::measureDataSize(int timeout_ms)
+{
+    if (tcpSocket == nullptr || !tcpSocket->isOpen()) return 0;
+
+    // Fill the parser storage (nothing is consumed) until the parser recognizes the frame size. If the storage is full
+    // and it still doesn't, the frames are much bigger than expected or the stream is garbage, we give up.
+    QElapsedTimer timer;
+    timer.start();
+    while (true)
+    {
+        while (tcpSocket->bytesAvailable() > 0)
+        {
+            // writePointer() first, it makes the room that writableBytes() counts
+            char *dst = parser_.writePointer();
+            std::size_t writable = parser_.writableBytes();
+            if (writable == 0) break;
+            qint64 nbytes = tcpSocket->read(dst, static_cast<qint64>(writable));
+            if (nbytes <= 0) break;
+            parser_.commitWrite(nbytes);
+        }
+
+        std::size_t datasize = parser_.measureDataSize();
+        if (datasize > 0) return static_cast<int>(datasize);
+
+        qint64 remaining = timeout_ms - timer.elapsed();
+        parser_.writePointer();
+        if (parser_.writableBytes() == 0 || remaining <= 0) return 0;
+        tcpSocket->waitForReadyRead(remaining);
+    }
+}
+
+void AmodeAcquisitionWorker::setGeometry(int datasize, std::shared_ptr<AmodeFramePool> pool)
+{
+    parser_.setDataSize(datasize);
+    pool_ = std::move(pool);
+}
+
+void AmodeAcquisitionWorker::startStreaming()
+{
+    streaming_ = true;
+    clockmodel_.reset();
+    clockmodel_.setReceivedCounter(!clockuseindex_);
+    hasindex_ = false;
+    unwrappedindex_ = 0;
+
+    // Whatever came in the meantime (also the bytes used by measureDataSize()) is parsed right away
+    readData();
+}
+
+void AmodeAcquisitionWorker::disconnectFromServer()
+{
+    if (tcpSocket && tcpSocket->isOpen()) {
+        qDebug() << "Closing tcpsocket";
+        tcpSocket->flush();
+        tcpSocket->disconnect();
+        tcpSocket->close();
+    }
+}
+
+void AmodeAcquisitionWorker::acknowledgeFrame()
+{
+    notifypending_.store(false, std::memory_order_release);
+}
+
+uint64_t AmodeAcquisitionWorker::getFramesStreamed() const
+{
+    return count_streameddata_.load(std::memory_order_relaxed);
+}
+
+uint64_t AmodeAcquisitionWorker::getFramesDiscarded() const
+{
+    return count_discardeddata_.load(std::memory_order_relaxed);
+}
+
+void AmodeAcquisitionWorker::useDataIndex(bool flag)
+{
+    usedataindex_.store(flag, std::memory_order_relaxed);
+}
+
+void AmodeAcquisitionWorker::useEnvelope(bool flag)
+{
+    useenvelope_.store(flag, std::memory_order_relaxed);
+}
+
+void AmodeAcquisitionWorker::setRecorder(AmodeRecorder *recorder)
+{
+    recorder_ = recorder;
+}
+
+void AmodeAcquisitionWorker::handleError(QAbstractSocket::SocketError socketError)
+{
+    Q_UNUSED(socketError);
+
+    // tell the user there is something wrong
+    QString message = tcpSocket->errorString();
+    qDebug() << "Socket Error:" << message;
+
+    // perform cleanup
+    disconnectFromServer();
+
+    // notify AmodeConnection, it lives in another thread
+    emit errorOccurred(message);
+}
+
+void AmodeAcquisitionWorker::readData()
+{
+    // For clarity, here is how the data looks like:
+    // ...[arrayheader_1][separator_1][index_1][data_1][arrayheader_2][separator_2][index_2][data_2]...
+    //
+    // The socket writes directly into the storage of the parser, and the parser hands out a view of every
+    // complete frame inside its storage. See AmodeFrameParser for the detail.
+    //
+    // Why loop? The socket can contain more bytes than the free space in the parser, so we read as much as we can,
+    // take all the complete frames, then read again until the socket is empty. The first round doesn't read, it takes
+    // the frames which are already in the parser (see startStreaming()).
+    if (!streaming_) return;
+
+    bool isDataReceived = false;
+    bool useindex = usedataindex_.load(std::memory_order_relaxed);
+    bool useenvelope = useenvelope_.load(std::memory_order_relaxed);
+    bool isFirstRound = true;
+    while (isFirstRound || tcpSocket->bytesAvailable() > 0)
+    {
+        // read the socket directly to the parser storage
+        if (!isFirstRound)
+        {
+            // writePointer() first, it makes the room that writableBytes() counts
+            char *dst = parser_.writePointer();
+            qint64 nbytes = tcpSocket->read(dst, static_cast<qint64>(parser_.writableBytes()));
+            if (nbytes <= 0) break;
+            parser_.commitWrite(nbytes);
+        }
+        isFirstRound = false;
+
+        // publish all the complete frames to the queue. The view is only valid until the next writePointer() call,
+        // so we copy the data right away to a frame from the pool. This is the only copy, the consumers share it.
+        AmodeFrameParser::FrameView frame;
+        int64_t arrival_ns = steadyNanoseconds();
+        while (parser_.nextFrame(frame))
+        {
+            statistics_.addFrame(frame.index, arrival_ns, parser_.getFrameSize(), useindex);
+            if (recorder_) recorder_->pushFrame(frame.data, frame.index, arrival_ns);
+            uint64_t sequence = count_streameddata_.fetch_add(1, std::memory_order_relaxed) + 1;
+
+            // The time of the frame. The A-mode PC sends no timestamp, but it sends at a steady rate, and the index
+            // counts its frames (our count if the index is not used). All the frames of a TCP burst have the same
+            // arrival, the model puts them back one period apart, see ClockModel. Our count misses the frames that
+            // were lost (e.g. a resync of the parser), the model finds them in the arrival times.
+            if (useindex != clockuseindex_)
+            {
+                clockmodel_.reset();
+                clockmodel_.setReceivedCounter(!useindex);
+                clockuseindex_ = useindex;
+            }
+            if (hasindex_) unwrappedindex_ += static_cast<uint16_t>(frame.index - lastindex_);
+            hasindex_ = true;
+            lastindex_ = frame.index;
+            int64_t frametime_ns = clockmodel_.update(useindex ? unwrappedindex_ : static_cast<int64_t>(sequence), arrival_ns);
+
+            // the consumers still hold all the frames of the pool, skip this one for them (it is still recorded)
+            AmodeFramePtr output = pool_->acquire();
+            if (!output)
+            {
+                count_discardeddata_.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+            std::memcpy(output.writable()->writableData(), frame.data, frame.datasize);
+            output.writable()->setIndex(frame.index);
+            output.writable()->setTimestamp(frametime_ns);
+            output.writable()->setSequence(sequence);
+
+            // the envelope is computed before anybody sees the frame (the frame is immutable after publish)
+            if (useenvelope)
+            {
+                int64_t start_ns = steadyNanoseconds();
+                envelope_.process(output.writable());
+                envelopetime_ns_ += steadyNanoseconds() - start_ns;
+                envelopesamples_ += static_cast<uint64_t>(output->getNprobe()) * output->getNsample();
+            }
+            queue_->publish(output);
+            isDataReceived = true;
+        }
+    }
+
+    // Notify the GUI thread, but only if it already took the previous notification. The GUI always reads the latest
+    // frame from the queue, so one pending notification is enough no matter how many frames came in the meantime.
+    if (isDataReceived && !notifypending_.exchange(true, std::memory_order_acq_rel))
+        emit frameAvailable();
+
+    // Publish the statistics once in a while
+    int64_t now_ns = steadyNanoseconds();
+    if (statistics_.getWindowStart() >= 0 && now_ns - statistics_.getWindowStart() >= statisticsperiod_ns_)
+    {
+        AmodeStreamStatistics::Summary summary = statistics_.summarize(now_ns);
+        summary.envelopeTime = (envelopesamples_ > 0) ? static_cast<double>(envelopetime_ns_) / envelopesamples_ : 0.0;
+        summary.clock = clockmodel_.getEstimate();
+        envelopetime_ns_ = 0;
+        envelopesamples_ = 0;
+        emit statisticsUpdated(summary);
+    }
+}
@@ -0,0 +1,181 @@
+#ifndef AMODEACQUISITIONWORKER_H
+#define AMODEACQUISITIONWORKER_H
+
+#include <QObject>
+#include <QTcpSocket>
+
+#include <atomic>
+
+#include "amodeenvelopedetector.h"
+#include "amodeframeparser.h"
+#include "amodeframepool.h"
+#include "amodeframequeue.h"
+#include "amoderecorder.h"
+#include "amodestreamstatistics.h"
+
+Q_DECLARE_METATYPE(AmodeStreamStatistics::Summary)
+
+/**
+ * @class AmodeAcquisitionWorker
+ * @brief Owns the QTcpSocket to the A-mode PC and does the framing, lives in its own thread.
+ *
+ * For the context. Previously AmodeConnection owned the socket on the GUI thread, so every replot of the 2D
+ * plots or the 3D signal stalled the draining of the socket. AmodeConnection now moves this worker to its own
+ * QThread. The worker reads the socket, cuts the stream into frames (AmodeFrameParser), copies every frame once
+ * into an AmodeFrame from the AmodeFramePool, and publishes it to the AmodeFrameQueue. The consumers read the latest
+ * frame from the queue whenever they are ready, they all share the same frame.
+ *
+ * Every frame also goes to AmodeStreamStatistics (index gaps/duplicates, inter-arrival time, throughput), and a
+ * summary is emitted once per second with statisticsUpdated().
+ *
+ * If useEnvelope() is set, the worker also computes the log-compressed envelope of every frame (AmodeEnvelopeDetector)
+ * before it is published, so the consumers get both. The time it takes is in the statistics (ns per sample).
+ *
+ * If a recorder is attached (setRecorder()), every frame also goes to the AmodeRecorder together with its arrival time.
+ * The recorder never blocks, so recording doesn't slow down the parsing.
+ *
+ * The size of the frames (how many samples the machine sends) can be measured from the stream right after connecting
+ * (measureDataSize()), AmodeConnection then sizes the pool for it and gives it to the worker with setGeometry(). Nothing
+ * is parsed until startStreaming(), so the bytes which were used for measuring are not lost.
+ *
+ * To tell the GUI thread that there is something new, the worker emits frameAvailable(). It only emits it
+ * again after the GUI acknowledged the previous one (acknowledgeFrame()), so the event queue of the GUI thread
+ * never piles up with notifications when the GUI is slower than the acquisition.
+ *
+ */
+
+class AmodeAcquisitionWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    /**
+     * @brief Constructor function. The sizes follows AmodeFrameParser, the frames are taken from pool and go to queue.
+     */
+    AmodeAcquisitionWorker(const std::vector<uint16_t>& separator, int headersize, int indexsize, int datasize,
+                           std::shared_ptr<AmodeFramePool> pool, AmodeFrameQueue *queue);
+
+    /**
+     * @brief Destructor function, making sure the socket is closed properly
+     */
+    ~AmodeAcquisitionWorker();
+
+    /**
+     * @brief Tells the worker that the GUI thread took the notification, so the next frame may notify again. Thread-safe.
+     */
+    void acknowledgeFrame();
+
+    /**
+     * @brief GET the number of frames parsed from the socket since the beginning. Thread-safe.
+     */
+    uint64_t getFramesStreamed() const;
+
+    /**
+     * @brief GET the number of frames that were parsed but not published, because the pool had no free frame. Thread-safe.
+     */
+    uint64_t getFramesDiscarded() const;
+
+    /**
+     * @brief Set true to check the index of the frames for gaps and duplicates. Thread-safe.
+     */
+    void useDataIndex(bool flag);
+
+    /**
+     * @brief Set true to compute the envelope of every frame. Thread-safe.
+     */
+    void useEnvelope(bool flag);
+
+    /**
+     * @brief Attach (or detach with nullptr) the recorder. Needs to be invoked in the worker thread, so that it never
+     * changes in the middle of readData(). The recorder is owned by AmodeConnection.
+     */
+    void setRecorder(AmodeRecorder *recorder);
+
+    /**
+     * @brief Change the number of bytes of the data of a frame, and the pool (sized for it). Needs to be invoked in
+     * the worker thread, before startStreaming().
+     */
+    void setGeometry(int datasize, std::shared_ptr<AmodeFramePool> pool);
+
+public slots:
+    /**
+     * @brief Connect to the server, blocks up to 5 seconds. Needs to be invoked in the worker thread.
+     *
+     * @return 1 if connected, 0 otherwise.
+     */
+    int connectToServer(const QString &ip, quint16 port);
+
+    /**
+     * @brief Wait for the first frames and measure the number of bytes of the data (see AmodeFrameParser::measureDataSize()).
+     * Needs to be invoked in the worker thread, after connectToServer() and before startStreaming().
+     *
+     * @return The number of bytes of the data of a frame, 0 if it couldn't be measured within timeout_ms.
+     */
+    int measureDataSize(int timeout_ms);
+
+    /**
+     * @brief Start parsing and publishing the frames. Needs to be invoked in the worker thread.
+     */
+    void startStreaming();
+
+    /**
+     * @brief Close the connection. Needs to be invoked in the worker thread.
+     */
+    void disconnectFromServer();
+
+private slots:
+    /**
+     * @brief Will be called whenever data is ready to read (a signal emitted by QTcpSocket)
+     */
+    void readData();
+
+    /**
+     * @brief Will be called whenever there is an error in the connection
+     */
+    void handleError(QAbstractSocket::SocketError socketError);
+
+private:
+    QTcpSocket *tcpSocket = nullptr;            //!< Object to handle the tcp connection, created in the worker thread
+    AmodeFrameParser parser_;                   //!< Cuts the stream into frames
+    std::shared_ptr<AmodeFramePool> pool_;      //!< Where the frames come from
+    AmodeFrameQueue *queue_;                    //!< Where the frames are published, owned by AmodeConnection
+    AmodeRecorder *recorder_ = nullptr;         //!< Where the frames are recorded (if not nullptr), owned by AmodeConnection
+
+    bool streaming_ = false;                    //!< False until startStreaming(), readData() leaves the bytes in the socket
+    std::atomic<bool> notifypending_{false};    //!< True if frameAvailable() was emitted and the GUI didn't take it yet
+    std::atomic<uint64_t> count_streameddata_{0}; //!< Counting variable for how much data is streamed from the beginning
+    std::atomic<uint64_t> count_discardeddata_{0}; //!< Counting variable for the frames that couldn't get a frame from the pool
+    std::atomic<bool> usedataindex_{false};     //!< Flag for using index, see AmodeConnection::useDataIndex()
+    std::atomic<bool> useenvelope_{false};      //!< Flag for computing the envelope, see useEnvelope()
+
+    AmodeEnvelopeDetector envelope_;            //!< Computes the envelope of the frames
+    int64_t envelopetime_ns_ = 0;               //!< Time spent in the envelope stage, in the current statistics window [ns]
+    uint64_t envelopesamples_ = 0;              //!< Samples processed by the envelope stage, in the current statistics window
+
+    AmodeStreamStatistics statistics_;          //!< Running statistics of the stream
+
+    ClockModel clockmodel_{0.0};                //!< The time of the frames from their index and arrival, the period is the scale
+    bool clockuseindex_ = false;                //!< The source time of clockmodel_ is the index (else the sequence)
+    bool hasindex_ = false;                     //!< False until the first frame for unwrappedindex_
+    uint16_t lastindex_ = 0;                    //!< The index of the previous frame
+    int64_t unwrappedindex_ = 0;                //!< The index without the wrap around after 65535
+    const qint64 statisticsperiod_ns_ = 1000000000; //!< How often the statistics are published [ns]
+
+signals:
+    /**
+     * @brief Emitted when there is a new frame in the queue (at most one pending notification at a time)
+     */
+    void frameAvailable();
+
+    /**
+     * @brief Emitted when the socket is broken
+     */
+    void errorOccurred(const QString &message);
+
+    /**
+     * @brief Emitted once per second with the statistics of the stream
+     */
+    void statisticsUpdated(const AmodeStreamStatistics::Summary &summary);
+};
+
+#endif // AMODEACQUISITIONWORKER_H
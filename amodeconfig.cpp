@@ -145,6 +145,12 @@ std::vector<std::string> AmodeConfig::getAllGroupNames() const {
     return std::vector<std::string>(groupNamesSet.begin(), groupNamesSet.end());
 }
 
+int AmodeConfig::getNprobe() const {
+    // dataMap is sorted by the probe number, the last one is the highest
+    if (dataMap.empty()) return 0;
+    return dataMap.rbegin()->second.number;
+}
+
 void AmodeConfig::setWindowByNumber(int number, std::array<std::optional<double>, 3> window)
 {
     // Check if the key exists in the map
@@ -174,6 +180,13 @@ AmodeConfig::Window AmodeConfig::getWindowByNumber(int number)
     }
 }
 
+std::vector<AmodeConfig::Window> AmodeConfig::getAllWindows() const
+{
+    std::vector<Window> windows;
+    for (const auto& entry : dataWindow) windows.push_back(entry.second);
+    return windows;
+}
+
 // Function to get the current date and time as a formatted string
 std::string AmodeConfig::getCurrentDateTime()
 {
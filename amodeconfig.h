@@ -81,6 +81,12 @@ public:
      */
     std::vector<std::string> getAllGroupNames() const;
 
+    /**
+     * @brief To GET the number of probes of the machine, that is the highest probe number in the configuration file
+     * (the file lists every probe, also the ones without a group). 0 if the file is empty.
+     */
+    int getNprobe() const;
+
     /**
      * @brief To SET the window configuration data with the provided probe number
      */
@@ -91,6 +97,11 @@ public:
      */
     Window getWindowByNumber(int number);
 
+    /**
+     * @brief To GET the window configuration data of all probes (also the ones which are not set, see Window::isset)
+     */
+    std::vector<Window> getAllWindows() const;
+
     /**
      * @brief To export dataWindow to a csv file in the directory provided by filename_
      */
@@ -1,30 +1,52 @@
 #include "AmodeConnection.h"
 #include <QDir>
-#include <QtEndian>
+#include <QDateTime>
+#include <algorithm>
 
-AmodeConnection::AmodeConnection(QObject *parent, std::string ip, std::string port)
-    : QObject{parent}, ip_(ip), port_(port), tcpSocket(new QTcpSocket(this))
+AmodeConnection::AmodeConnection(QObject *parent, std::string ip, std::string port, int nprobe, int nsample)
+    : AmodeSource{parent}, ip_(ip), port_(port)
 {
-    // try to connect with server through socket
-    if(!connectToServer()) return;
+    // the geometry, if nsample is not given we start with the default and measure it when connecting
+    probes_         = std::max(nprobe, 1);
+    samples_        = (nsample > 0) ? nsample : UltrasoundConfig::N_SAMPLE;
+    datalength_     = samples_ * probes_;
+    detectgeometry_ = (nsample <= 0);
+
+    // the statistics and the frames are sent across threads, Qt needs to know the type
+    qRegisterMetaType<AmodeStreamStatistics::Summary>();
+    qRegisterMetaType<AmodeFramePtr>();
 
-    // initialize data
+    // initialize data, this also prepares the frame queue and the acquisition worker
     initializeData();
 
-    // connect the signal readyRead to our slot readData, so that the streaming starts right away
-    connect(tcpSocket, &QTcpSocket::readyRead, this, &AmodeConnection::readData);
-    connect(tcpSocket, &QTcpSocket::errorOccurred, this, &AmodeConnection::handleError);
+    // the worker (socket and framing) lives in its own thread, so that the GUI never stalls the acquisition
+    worker_->moveToThread(&m_workerThread);
+    connect(&m_workerThread, &QThread::finished, worker_, &QObject::deleteLater);
+    connect(worker_, &AmodeAcquisitionWorker::frameAvailable, this, &AmodeConnection::onFrameAvailable, Qt::QueuedConnection);
+    connect(worker_, &AmodeAcquisitionWorker::errorOccurred, this, &AmodeConnection::handleError, Qt::QueuedConnection);
+    connect(worker_, &AmodeAcquisitionWorker::statisticsUpdated, this, &AmodeConnection::onStatisticsUpdated, Qt::QueuedConnection);
+    m_workerThread.start();
+
+    // try to connect with server through socket, the streaming starts right away
+    if(!connectToServer()) return;
 }
 
 AmodeConnection::~AmodeConnection()
 {
     qDebug() << "Destroying AmodeConnection";
-    if (tcpSocket && tcpSocket->isOpen()) {
-        qDebug() << "Closing tcpsocket";
-        tcpSocket->flush();
-        tcpSocket->disconnect();
-        tcpSocket->close();
+
+    // finish the file if we are still recording
+    setRecord(false);
+
+    // close the socket in the worker thread, then stop the thread (the worker is deleted when the thread finished)
+    if (m_workerThread.isRunning())
+    {
+        QMetaObject::invokeMethod(worker_, "disconnectFromServer", Qt::BlockingQueuedConnection);
+        m_workerThread.quit();
+        m_workerThread.wait();
     }
+    delete queue_;
+    delete recorder_;
 }
 
 int AmodeConnection::connectToServer() {
@@ -32,25 +54,53 @@ int AmodeConnection::connectToServer() {
     QString host_ip   = QString::fromStdString(ip_);
     quint16 host_port = QString::fromStdString(port_).toUShort(&ok, 10);
 
-    tcpSocket->connectToHost(host_ip, host_port);
+    // the socket belongs to the worker thread, so we ask the worker to connect and wait for the answer
+    int status = 0;
+    QMetaObject::invokeMethod(worker_, "connectToServer", Qt::BlockingQueuedConnection,
+                              Q_RETURN_ARG(int, status), Q_ARG(QString, host_ip), Q_ARG(quint16, host_port));
+    if (!status) return status;
 
-    if(tcpSocket->waitForConnected(5000)) { // Wait for up to 5 seconds
-        qDebug() << "Successfully connected to" << host_ip << "on port" << host_port;
-        return 1;
-    } else {
-        qDebug() << "Failed to connect to" << host_ip << "on port" << host_port;
+    // size everything for what the machine actually sends, then let the worker parse
+    if (detectgeometry_) detectGeometry();
+    QMetaObject::invokeMethod(worker_, "startStreaming", Qt::BlockingQueuedConnection);
+    return status;
+}
+
+int AmodeConnection::detectGeometry()
+{
+    // the worker waits for the first frames (the machine sends ~100 fps, so this is quick)
+    int datasize = 0;
+    QMetaObject::invokeMethod(worker_, "measureDataSize", Qt::BlockingQueuedConnection,
+                              Q_RETURN_ARG(int, datasize), Q_ARG(int, 2000));
+
+    // the data is probes_ x samples_ words, if it can't be divided by probes_ the number of probes is wrong
+    int nwords = datasize / static_cast<int>(sizeof(uint16_t));
+    if (datasize <= 0 || datasize % sizeof(uint16_t) != 0 || nwords % probes_ != 0)
+    {
+        qDebug() << "AmodeConnection: unable to measure the frame size (" << datasize << "bytes for" << probes_
+                 << "probes ), using" << samples_ << "samples";
         return 0;
     }
+    detectgeometry_ = false;
+    if (nwords / probes_ == samples_) return 1;
+
+    // resize everything, this is the only moment we allocate for a new geometry
+    samples_    = nwords / probes_;
+    datalength_ = samples_ * probes_;
+    usdata_framesize_ = headersize_ + separatorsize_ + indexsize_ + (sizeof(uint16_t) * datalength_);
+    usdata_datasize_  = (sizeof(uint16_t) * datalength_);
+    pool_ = AmodeFramePool::create(probes_, samples_);
+    std::shared_ptr<AmodeFramePool> pool = pool_;
+    int newdatasize = usdata_datasize_;
+    QMetaObject::invokeMethod(worker_, [this, newdatasize, pool]{ worker_->setGeometry(newdatasize, pool); }, Qt::BlockingQueuedConnection);
+
+    qDebug() << "AmodeConnection: the machine sends" << probes_ << "probes x" << samples_ << "samples";
+    return 1;
 }
 
-void AmodeConnection::handleError(QTcpSocket::SocketError socketError) {
-    // tell the user there is something wrong
-    qDebug() << "Socket Error:" << tcpSocket->errorString();
-
-    // perform cleanup
-    tcpSocket->flush();
-    tcpSocket->disconnect();
-    tcpSocket->close();
+void AmodeConnection::handleError(const QString &message) {
+    // tell the user there is something wrong, the worker already closed the socket
+    qDebug() << "Socket Error:" << message;
 
     // notify the application
     emit errorOccured();
@@ -66,22 +116,6 @@ void AmodeConnection::letsdelete()
     qDebug() << "yesy";
 }
 
-QByteArray AmodeConnection::convertSTDVectorToQByteArray(const std::vector<uint16_t>& vector) {
-    QByteArray byteArray;
-    byteArray.reserve(vector.size() * sizeof(uint16_t)); // Reserve space to improve performance
-
-    for (uint16_t value : vector) {
-        // Convert the uint16_t to a byte array (2 bytes)
-        char bytes[2];
-        qToLittleEndian(value, reinterpret_cast<uchar*>(bytes));
-
-        // Append the bytes to the QByteArray
-        byteArray.append(bytes, sizeof(bytes));
-    }
-
-    return byteArray;
-}
-
 void AmodeConnection::initializeData()
 {
     // Just to clarify, here is how the data looks like:
@@ -91,19 +125,18 @@ void AmodeConnection::initializeData()
     // It is basically the ASCII number of START, then i add 10000
     separator_int16 = {10083, 10084, 10065, 10082, 10084};
     for (int16_t num : separator_int16) separator_uint16.push_back(static_cast<uint16_t>(num));
-    // I need to convert it into QByteArray, because later when i want to search the separator,
-    // the data that is acquired from QTcpSocket is in QByteArray
-    separator_qbyte  = convertSTDVectorToQByteArray(separator_uint16);
-    separatorsize_   = separator_qbyte.size();
+    separatorsize_   = separator_uint16.size() * sizeof(uint16_t);
 
     // Initialize the number of bytes of all variables related to data
     usdata_framesize_     = headersize_ + separatorsize_ + indexsize_ + (sizeof(uint16_t) * datalength_);
     usdata_allheadersize_ = separatorsize_ + indexsize_;
     usdata_datasize_      = (sizeof(uint16_t) * datalength_);
 
-    // Initialize the size of usdata_uint16_ and usdata_int16_
-    usdata_uint16_.resize(datalength_);
-    usdata_int16_.resize(datalength_);
+    // Initialize the frame pool and queue (the frames are shared with the consumers) and the worker which owns the socket
+    // and the parser. The parser and the pool allocate their storage once, so that we never reallocate while streaming
+    pool_   = AmodeFramePool::create(probes_, samples_);
+    queue_  = new AmodeFrameQueue();
+    worker_ = new AmodeAcquisitionWorker(separator_uint16, headersize_, indexsize_, usdata_datasize_, pool_, queue_);
 
     /*
     // Initial size of the header, this always exist because the amode machine sends an array
@@ -175,130 +208,54 @@ void AmodeConnection::startStream()
     // if you want to start stream separately do this
 }
 
-void AmodeConnection::readData() {
-    // Retrieve all the data inside the socket, store it to buffer
-    buffer.append(tcpSocket->readAll());
-
-    // Initialize the startIndex and endIndex. For clarity:
-    // startIndex is the starting bytes of the first separator,
-    // endIndex is the starting bytes of the second separator.
-    int startIndex = 0;
-    int endIndex   = 0;
-
-    // First, let's find our first separator in the buffer. Since endIndex=0, we search from the beginning of buffer.
-    // If we find no separator (function indexOf() returns -1) we skip it and wait for more data.
-    // If we find a separator, we will execute the loop. Why loop? Because there can be multiple separators in the buffer.
-    // We will process the data as long as there are separators inside our buffer until there is no next separator.
-    while ((startIndex = buffer.indexOf(separator_qbyte, endIndex)) != -1)
-    {
-        // At this point, we found a separator. Now, lets search for another separator inside our buffer.
-        // Search in the buffer but with a different starting point, we exclude the first separator.
-        endIndex = buffer.indexOf(separator_qbyte, startIndex + separatorsize_);
-
-        // If endIndex == -1, we don't see another separator yet. It means that it is an incomplete frame.
-        // So, let's get out from the loop and wait for more data
-        if (endIndex == -1) break;
-
-        // At this point, we found another separator. Let's take the data now. For reminder, the data looks like this:
-        // ...[arrayheader_1][separator_1][index_1][data_1][arrayheader_2][separator_2][index_2][data_2]...
-        //                    ^                     ^                      ^
-        //                    startIndex            actualData             endIndex
-        //
-        // To get data, the starting point should be:
-        // startIndex + separator + index
-        //
-        // The amount of bytes we should take will be:
-        // (endIndex - startIndex) <== The whole frame, this includes separator & data (at the front), and arrayheader (at the rear)
-        // (endIndex - startIndex) - (separator+index+headerarray) <== This is pure data
-        QByteArray frame = buffer.mid( (startIndex-sizeof(uint16_t)) + separatorsize_ + indexsize_, (endIndex - startIndex) - (separatorsize_ + indexsize_ + headersize_));
-
-        // Let's process the frame here
-        memcpy(usdata_uint16_.data(), frame.constData(), usdata_datasize_);
-        // memcpy(usdata_int16_.data(), usdata_uint16_.data(), usdata_datasize_);
-        isDataReceived = true;
-        // emit dataReceived(usdata_uint16_);
-        // qDebug() << usdata_uint16_.size();
-        // QString output;
-        // for (size_t i = 0; i < usdata_int16_.size() && i < 50; i++) {
-        //     output += QString::number(usdata_int16_[i]) + " ";
-        // }
-        // qDebug().noquote() << output.trimmed();
-
-        // Remove the processed frame from the buffer, mid() function will return the bytes starting at endIndex,
-        // which is the starting bytes of the second separator. So after this process, the frame will looks like this
-        // [separator_2][index_2][data_2][header_2][separator_3][index_3]...
-        buffer = buffer.mid(endIndex);
-        // Reset endIndex for the next iteration
-        endIndex = 0;
-
-        // Note:
-        // >> In the next iteration, the buffer will still have [separator_2] in the beginning.
-        // >> Consequently, it will fulfil the condition of while loop. It will execute the line inside the loop.
-        // >> However, if there is no next separator found in the buffer ([separator_3]), it will break the loop,
-        //    and the code continues.
-        // >> Subsequenly, there will be new data availabe in the buffer and this function will be called again.
-        // >> As the [separator_2] is still in the buffer, the code still go inside this while loop.
-        // >> If this time we found the next separator ([separator_3]), the process will go further like previous loop.
-        // >> The code in this while loop also generalize if there is more then 2 separators inside the buffer.
-        //    The proccess repeated multiple times within the loop until we don't find the next separator.
-    }
+void AmodeConnection::onFrameAvailable() {
+    // take the notification first, so that the worker can notify again if a new frame comes while we are busy
+    worker_->acknowledgeFrame();
 
-    if (isDataReceived) emit dataReceived(usdata_uint16_);
-    isDataReceived = false;
+    // take the latest frame from the queue (no copy). If the worker published several frames since the last time,
+    // we only take the latest one, the plots can't show them all anyway (they are counted as dropped)
+    AmodeFramePtr frame = queue_->readLatest(guireader_);
+    if (frame) emit dataReceived(frame);
+}
 
-    /*
-    std::vector<uint16_t> buffer_uint16;
-    buffer_uint16.reserve(buffer.size()/ sizeof(uint16_t));
-    memcpy(buffer_uint16.data(), buffer.constData(), buffer.size());
+void AmodeConnection::onStatisticsUpdated(const AmodeStreamStatistics::Summary &summary) {
+    statistics_ = summary;
+    emit statisticsUpdated(statistics_);
+}
 
-    auto startIt = buffer_uint16.begin();
-    auto endIt = buffer_uint16.end();
+void AmodeConnection::setRecord(bool flag)
+{
+    if (flag == setrecord_) return;
 
-    while (true)
+    if (flag)
     {
-        // Find the start of the frame
-        auto frameStartIt = std::search(startIt, endIt, separator_uint16.begin(), separator_uint16.end());
-        if (frameStartIt == endIt) break; // Separator not found, incomplete frame
-
-        // Move the iterator past the separator to find the end of the frame
-        auto frameEndIt = std::search(frameStartIt + separator_uint16.size(), endIt, separator_uint16.begin(), separator_uint16.end());
-        if (frameEndIt == endIt) break; // End separator not found, incomplete frame
+        if (recorddirectory_.empty())
+        {
+            qDebug() << "AmodeConnection::setRecord() Please specify the directory first with setDirectory()";
+            return;
+        }
 
-        // Extract the frame data
-        std::vector<uint16_t> frame(frameStartIt + separator_uint16.size(), frameEndIt);
+        // the recorder preallocates a lot of memory, so we keep it for the next recording
+        if (recorder_ == nullptr) recorder_ = new AmodeRecorder(probes_, samples_);
 
-        // Process the frame here
+        QString datetime = QDateTime::currentDateTime().toString("yyyy-MM-dd_HH-mm-ss");
+        recordfilename_  = QDir(QString::fromStdString(recorddirectory_)).filePath("AmodeRecording_" + datetime + ".bin").toStdString();
+        if (!recorder_->start(recordfilename_)) return;
 
-        // Prepare for the next iteration
-        startIt = frameEndIt;
+        // attach the recorder in the worker thread, so it never changes in the middle of parsing
+        AmodeRecorder *recorder = recorder_;
+        QMetaObject::invokeMethod(worker_, [this, recorder]{ worker_->setRecorder(recorder); }, Qt::BlockingQueuedConnection);
     }
-
-    // Remove the processed data from the vector
-    buffer_uint16.erase(separator_uint16.begin(), startIt);
-    */
-
-    /*
-    static QByteArray buffer;
-    buffer.append(tcpSocket->readAll());
-
-    // This loop is making sure that i will only process the data if it has the right amount of byte
-    while (buffer.size() >= usdata_receivebuffersize_) {
-
-        // get the first (left) usdata_receivebuffersize_ bytes
-        QByteArray frame = buffer.left(usdata_receivebuffersize_);
-        // remove first usdata_receivebuffersize_ bytes from the buffer
-        buffer.remove(0, usdata_receivebuffersize_);
-
-        // Process the complete frame
-        memcpy(usdata_uint16_.data(), frame.constData()+usdata_headerindexsize_, usdata_datasize_);
+    else
+    {
+        // detach first, after this the worker doesn't touch the recorder anymore, then finish the file
+        if (m_workerThread.isRunning())
+            QMetaObject::invokeMethod(worker_, [this]{ worker_->setRecorder(nullptr); }, Qt::BlockingQueuedConnection);
+        recorder_->stop();
+        count_recordeddata_ = recorder_->getRecordedFrames();
+        qDebug() << "A-mode recording saved to" << QString::fromStdString(recordfilename_);
     }
 
-    emit dataReceived(usdata_uint16_);
-    */
-}
-
-void AmodeConnection::setRecord(bool flag)
-{
     setrecord_ = flag;
 }
 
@@ -306,6 +263,13 @@ void AmodeConnection::setRecord(bool flag)
 void AmodeConnection::useDataIndex(bool flag)
 {
     usedataindex_ = flag;
+    worker_->useDataIndex(flag);
+}
+
+
+void AmodeConnection::useEnvelope(bool flag)
+{
+    worker_->useEnvelope(flag);
 }
 
 
@@ -337,21 +301,39 @@ int AmodeConnection::getNprobe()
     return probes_;
 }
 
+AmodeFrameQueue* AmodeConnection::getFrameQueue()
+{
+    return queue_;
+}
 
+uint64_t AmodeConnection::getStreamedFrames()
+{
+    return worker_->getFramesStreamed();
+}
 
+uint64_t AmodeConnection::getDroppedFrames()
+{
+    return guireader_.dropped;
+}
 
+uint64_t AmodeConnection::getOverrunFrames()
+{
+    return guireader_.overruns;
+}
 
 
+AmodeStreamStatistics::Summary AmodeConnection::getStatistics()
+{
+    return statistics_;
+}
 
+uint64_t AmodeConnection::getRecordedFrames()
+{
+    if (setrecord_) return recorder_->getRecordedFrames();
+    return count_recordeddata_;
+}
 
-
-
-
-
-
-
-
-
-
-
-
+std::string AmodeConnection::getRecordFilename()
+{
+    return recordfilename_;
+}
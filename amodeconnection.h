@@ -1,8 +1,14 @@
 #ifndef AMODECONNECTIONQTCP_H
 #define AMODECONNECTIONQTCP_H
 
-#include <QTcpSocket>
 #include <QObject>
+#include <QThread>
+
+#include "amodeacquisitionworker.h"
+#include "amodeframequeue.h"
+#include "amoderecorder.h"
+#include "amodesource.h"
+#include "ultrasoundconfig.h"
 
 /**
  * @class AmodeConnection
@@ -19,17 +25,32 @@
  * of data. It starts with array header (4 bytes) and data header (10 bytes). This class ensuring you get a right
  * interpretation of the data.
  *
+ * The socket itself is handled by AmodeAcquisitionWorker in a separate thread. Every frame goes into an AmodeFrameQueue
+ * (as a shared AmodeFrame, no copy), and this class (in the GUI thread) reads the latest frame from it and emits
+ * dataReceived(). Other consumers can read the queue at their own rate with getFrameQueue().
+ *
+ * The number of probes comes from the user (the A-mode config, see AmodeConfig::getNprobe()), the number of samples
+ * is measured from the stream right after connecting (the distance between the separators and the array header), so
+ * the same software works with rigs with another number of probes or another depth setting. Everything (the pool,
+ * the parser, the recorder) is sized once at that moment, getNsample() and getNprobe() tell the rest of the software.
+ *
+ * Recording (setDirectory() then setRecord(true)) is done by AmodeRecorder, which receives every frame straight from
+ * the worker thread and writes it to a binary file in setDirectory() (see AmodeRecorder for the file format).
+ *
  */
 
-class AmodeConnection : public QObject
+class AmodeConnection : public AmodeSource
 {
     Q_OBJECT
 
 public:
     /**
      * @brief Constructor function, it connect to the server directly by calling connectToServer() function
+     *
+     * @param nprobe   The number of probes the machine sends.
+     * @param nsample  The number of samples of each probe, 0 means measure it from the stream when connecting.
      */
-    explicit AmodeConnection(QObject *parent, std::string ip, std::string port);
+    explicit AmodeConnection(QObject *parent, std::string ip, std::string port, int nprobe = UltrasoundConfig::N_UST, int nsample = 0);
 
     /**
      * @brief Destructor function, making sure anything is closed properly
@@ -49,9 +70,11 @@ public:
 
     /**
      * @brief A function to set the program to record the streamed A-mode signal.
+     * Every frame is recorded to AmodeRecording_<date>_<time>.bin inside the directory of setDirectory(),
+     * setRecord(false) finishes the file.
      * @param flag          Set true to record.
      */
-    void setRecord(bool flag);
+    void setRecord(bool flag) override;
 
     /**
      * @brief A function to set the program to name the streamed A-mode signal with index.
@@ -59,9 +82,19 @@ public:
      * This index is used for tracking if there any data loss, you can notice it if there is a
      * gap between the index. This is usefull for debugging the code.
      *
+     * When set, the gaps and duplicates of the index are counted in the statistics (see getStatistics()).
+     *
      * @param flag          Set true to use undex.
      */
-    void useDataIndex(bool flag);
+    void useDataIndex(bool flag) override;
+
+    /**
+     * @brief A function to compute the envelope of every frame in the worker thread (see AmodeEnvelopeDetector).
+     * The consumers read it with AmodeFrame::envelope().
+     *
+     * @param flag          Set true to compute the envelope.
+     */
+    void useEnvelope(bool flag) override;
 
     /**
      * @brief A function to specify the where the streamed data will be stored.
@@ -69,7 +102,7 @@ public:
      * @param directory     Path to the directory.
      * @return              A flag indicating the status. -1 if there is something wrong.
      */
-    int setDirectory(std::string directory);
+    int setDirectory(std::string directory) override;
 
     /**
      * @brief This function is intended to perform preparation before we start streaming the data, such as
@@ -83,41 +116,90 @@ public:
      */
     void startStream();
 
+    /**
+     * @brief Measure the number of samples from the stream (the number of probes is given), and resize everything
+     * accordingly. Called by connectToServer() if the constructor got nsample = 0.
+     *
+     * @return 1 if the geometry is measured, 0 if not (we keep the default geometry).
+     */
+    int detectGeometry();
+
     /**
      * @brief A function to get how many sample (element) within the signal.
      */
-    int getNsample();
+    int getNsample() override;
 
 
     /**
      * @brief A function to get how many probe used by the machine.
      */
-    int getNprobe();
+    int getNprobe() override;
+
+    /**
+     * @brief GET the frame queue, for consumers which want to read the latest frame at their own rate.
+     */
+    AmodeFrameQueue* getFrameQueue();
+
+    /**
+     * @brief GET the number of frames streamed from the A-mode machine since the connection started.
+     */
+    uint64_t getStreamedFrames();
+
+    /**
+     * @brief GET the number of frames that never reached dataReceived() because a newer frame arrived first.
+     */
+    uint64_t getDroppedFrames() override;
+
+    /**
+     * @brief GET the number of times dataReceived() had to read the latest frame again, because the worker went
+     * around all the slots of the queue while it was taking it (see AmodeFrameQueue).
+     */
+    uint64_t getOverrunFrames() override;
+
+
+    /**
+     * @brief GET the latest statistics of the stream (frames, index gaps and duplicates, inter-arrival time, throughput).
+     */
+    AmodeStreamStatistics::Summary getStatistics();
+
+    /**
+     * @brief GET the number of frames written to the file by the current (or the last) recording.
+     */
+    uint64_t getRecordedFrames();
+
+    /**
+     * @brief GET the full path of the file of the current (or the last) recording.
+     */
+    std::string getRecordFilename();
 
     void letsdelete();
 
 
 private slots:
     /**
-     * @brief Will be called whenever data is ready to read (a signal emitted by QTcpSocket)
+     * @brief Will be called whenever the worker published a new frame to the queue
      */
-    void readData();
+    void onFrameAvailable();
 
     /**
      * @brief Will be called whenever there is an error in the connection
      */
-    void handleError(QTcpSocket::SocketError socketError);
+    void handleError(const QString &message);
 
-private:
-    QByteArray convertSTDVectorToQByteArray(const std::vector<uint16_t>& vector);
+    /**
+     * @brief Will be called once per second by the worker with the statistics of the stream
+     */
+    void onStatisticsUpdated(const AmodeStreamStatistics::Summary &summary);
 
+private:
     // variables that stores the connection spec
     std::string ip_;                        //!< IP address of Ultrasound Machine
     std::string port_;                      //!< Port number of Ultrasound Machine
 
     // variables that stores amode spesifications
-    int samples_       = 3500;              //!< The number of sample points in the signal (default 1500)
-    int probes_        = 30;                //!< The number of ultrasound probes being used in the experiment (default 30)
+    int samples_       = UltrasoundConfig::N_SAMPLE; //!< The number of sample points in the signal (measured when connecting)
+    int probes_        = UltrasoundConfig::N_UST;    //!< The number of ultrasound probes being used in the experiment
+    bool detectgeometry_ = true;            //!< Flag for measuring samples_ from the stream when connecting
     int datalength_    = samples_*probes_;  //!< samples_ * probes_
     int headersize_    = 4;                 //!< The number of bytes of the header of the data packet (the array, it has 4 bytes of header)
     int separatorsize_ = 10;                //!< The number of bytes of the separator (check amode machine for detail)
@@ -126,12 +208,12 @@ private:
     // variables that stores the information of the separators
     std::vector<int16_t>  separator_int16;  //!< Separators in int16 (each elements = 2bytes)
     std::vector<uint16_t> separator_uint16; //!< Separators in uint16 (each elements = 2bytes)
-    QByteArray            separator_qbyte;  //!< Separators in qbytes (each elements = 1byte)
 
     // all variables that handle the receiving data
-    QByteArray            buffer;           //!< A temporary array to store the data from QTcpSocket
-    std::vector<uint16_t> usdata_uint16_;   //!< The real array/vector that store the raw data of the amode machine
-    std::vector<int16_t>  usdata_int16_;    //!< The same as usdata_uint16_ just different datatype
+    std::shared_ptr<AmodeFramePool> pool_;  //!< Preallocated frames, filled by the worker, shared by the consumers
+    AmodeFrameQueue      *queue_  = nullptr; //!< Hands the latest frame from the worker to the consumers
+    AmodeFrameQueue::Reader guireader_;     //!< State of the dataReceived() consumer (which frame it read, dropped, overruns)
+    AmodeStreamStatistics::Summary statistics_; //!< The latest statistics of the stream, published by the worker
     int usdata_framesize_     = 0;          //!< A frame defined as all the bytes from single timeframe of amode measurement (array header, separator, index, data)
     int usdata_allheadersize_ = 0;          //!< The number of bytes of all headers (array header, separator, and index)
     int usdata_datasize_      = 0;          //!< The number of bytes of only data
@@ -148,19 +230,15 @@ private:
     bool usedataindex_ = false;             //!< Flag for using index. False means i dont want the index, skip those bytes
     std::string fullpath_;                  //!< Full path to the directory where the data is stored
     std::string recorddirectory_;           //!< Local directory where the data is stored
-
-    bool isDataReceived = false;
+    std::string recordfilename_;            //!< Full path of the file of the current (or the last) recording
+    AmodeRecorder *recorder_ = nullptr;     //!< Writes the frames to the disk, created on the first setRecord(true)
 
     // for counting the data streamed
-    int count_streameddata_ = 0;            //!< Counting variable for how much data is streamed from the beginning of the program
-    int count_recordeddata_ = 0;            //!< Counting variable for how much data is recorded
-
-    QTcpSocket *tcpSocket;                  //!< Object to handle the tcp connection
-
-signals:
-    void dataReceived(const std::vector<uint16_t> &usdata_uint16_);
-    void errorOccured();
+    uint64_t count_recordeddata_ = 0;       //!< Counting variable for how much data is recorded (updated when the recording stops)
 
+    // variables that handles multithreading for the acquisition
+    AmodeAcquisitionWorker *worker_ = nullptr; //!< Owns the socket and the parser, lives in m_workerThread
+    QThread m_workerThread;                 //!< The worker thread to run the acquisition
 };
 
 #endif // AMODECONNECTIONQTCP_H
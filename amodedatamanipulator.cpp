@@ -76,5 +76,3 @@ Eigen::VectorXd AmodeDataManipulator::downsampleVector(const Eigen::VectorXd& in
 
     return output;
 }
-
-
@@ -0,0 +1,58 @@
+#include "amodedownsampler.h"
+#include "ultrasoundconfig.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+// The gathering loop with the size known at compile time (NTARGET > 0), or at runtime (NTARGET == 0)
+template <int NTARGET>
+void gather(const int16_t *input, const int *index, double *output, std::ptrdiff_t stride, double scale, int ntarget)
+{
+    const int n = (NTARGET > 0) ? NTARGET : ntarget;
+    for (int i = 0; i < n; i++) output[i * stride] = input[index[i]] * scale;
+}
+}
+
+AmodeDownsampler::AmodeDownsampler(int nsample, int ntarget)
+    : nsample_(std::max(nsample, 0)), ntarget_(std::max(ntarget, 0))
+{
+    // The same indices as AmodeDataManipulator::downsampleVector(), nearest sample with a fractional step
+    index_.resize(ntarget_);
+    double step = (ntarget_ > 1) ? static_cast<double>(nsample_ - 1) / (ntarget_ - 1) : 0.0;
+    for (int n = 0; n < ntarget_; n++)
+        index_[n] = std::min<int>(static_cast<int>(std::round(n * step)), std::max(nsample_ - 1, 0));
+
+    // The usual sizes: all samples, and the downsampled size of VolumeAmodeController (half). The 2d plots of
+    // MainWindow don't use this anymore (see AmodeMinMaxDecimator).
+    constexpr int full    = UltrasoundConfig::N_SAMPLE;
+    constexpr int half    = (UltrasoundConfig::N_SAMPLE + 1) / 2;
+    isfixedsize_ = true;
+    switch (ntarget_)
+    {
+    case full:    kernel_ = &gather<full>;    break;
+    case half:    kernel_ = &gather<half>;    break;
+    default:      kernel_ = &gather<0>; isfixedsize_ = false; break;
+    }
+}
+
+void AmodeDownsampler::apply(const int16_t *input, double *output, std::ptrdiff_t stride, double scale) const
+{
+    if (ntarget_ == 0 || nsample_ == 0) return;
+    kernel_(input, index_.data(), output, stride, scale, ntarget_);
+}
+
+int AmodeDownsampler::getNsample() const
+{
+    return nsample_;
+}
+
+int AmodeDownsampler::getNtarget() const
+{
+    return ntarget_;
+}
+
+bool AmodeDownsampler::isFixedSize() const
+{
+    return isfixedsize_;
+}
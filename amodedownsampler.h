@@ -0,0 +1,68 @@
+#ifndef AMODEDOWNSAMPLER_H
+#define AMODEDOWNSAMPLER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @class AmodeDownsampler
+ * @brief Downsamples a single probe of an A-mode frame to a fixed number of samples, with a precomputed table.
+ *
+ * For the context. The 3D signal (VolumeAmodeController) used to pick every n-th sample like
+ * AmodeDataManipulator::downsampleVector() does (now it keeps the minimum and the maximum, see AmodeMinMaxDecimator,
+ * and this class only takes all the samples when it doesn't downsample). That function computes the index with std::round() for every
+ * sample of every probe of every frame, and returns a new QVector. Here the indices are computed
+ * once (when the number of samples is known, at connect time), and apply() only gathers the samples into the output.
+ *
+ * The number of samples is not fixed anymore (it comes from the stream, see AmodeConnection), but most of the time it
+ * is still the usual one (UltrasoundConfig::N_SAMPLE, and half of it for the 3D signal). For those sizes the
+ * gathering loop is a template with the size known at compile time, so the compiler can unroll it. Any other size uses
+ * the same loop with the size at runtime.
+ *
+ * The output can have a stride, so that the samples can go directly to where they are needed (the value of every
+ * QCPGraphData of a plot, or a row of a column-major Eigen matrix).
+ *
+ */
+
+class AmodeDownsampler
+{
+public:
+
+    /**
+     * @brief Constructor function. Picks ntarget samples out of nsample, the same way as AmodeDataManipulator::downsampleVector().
+     */
+    AmodeDownsampler(int nsample = 0, int ntarget = 0);
+
+    /**
+     * @brief Take the samples from input (nsample samples) and write ntarget samples to output, multiplied by scale.
+     *
+     * @param input   The samples of a probe (see AmodeFrame::probe()), at least getNsample() samples.
+     * @param output  Where the first sample goes.
+     * @param stride  The distance between two samples in the output, in doubles.
+     * @param scale   Every sample is multiplied by this.
+     */
+    void apply(const int16_t *input, double *output, std::ptrdiff_t stride = 1, double scale = 1.0) const;
+
+    /**
+     * @brief GET the number of samples of the input, and of the output
+     */
+    int getNsample() const;
+    int getNtarget() const;
+
+    /**
+     * @brief GET true if apply() uses one of the compile-time sizes
+     */
+    bool isFixedSize() const;
+
+private:
+    using Kernel = void (*)(const int16_t*, const int*, double*, std::ptrdiff_t, double, int);
+
+    int nsample_ = 0;               //!< The number of samples of the input
+    int ntarget_ = 0;               //!< The number of samples of the output
+    std::vector<int> index_;        //!< Which input sample goes to every output sample
+    Kernel kernel_ = nullptr;       //!< The gathering loop for ntarget_, picked in the constructor
+    bool isfixedsize_ = false;      //!< True if kernel_ is one of the compile-time sizes
+};
+
+#endif // AMODEDOWNSAMPLER_H
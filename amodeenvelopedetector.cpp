@@ -0,0 +1,200 @@
+#include "amodeenvelopedetector.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define AMODE_ENVELOPE_SSE2
+#include <emmintrin.h>
+#endif
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace {
+// 0.01 dB per LSB of the output: 100 * 10*log10(|x|^2) = 1000*log10(2) * log2(|x|^2)
+const float CENTIDB_PER_LOG2 = 301.029996f;
+// The width of the cosine taper at both edges of the band [Hz]
+const double TAPER_WIDTH = 1.0e6;
+
+#ifdef AMODE_ENVELOPE_SSE2
+// log2 of 4 floats (x >= 1). x = m * 2^e with m in [1,2), log2(m) = 2/ln2 * atanh(t) with t = (m-1)/(m+1) < 1/3,
+// the series up to t^7 is good to ~2e-5, that is ~0.005 dB, plenty for the display
+inline __m128 log2Fast(__m128 x)
+{
+    const __m128 one = _mm_set1_ps(1.0f);
+    __m128i bits = _mm_castps_si128(x);
+    __m128 e = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(127)));
+    __m128 m = _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x007FFFFF)), _mm_set1_epi32(0x3F800000)));
+
+    __m128 t  = _mm_div_ps(_mm_sub_ps(m, one), _mm_add_ps(m, one));
+    __m128 t2 = _mm_mul_ps(t, t);
+    __m128 p  = _mm_set1_ps(0.412198581f);                                // 2/(7 ln2)
+    p = _mm_add_ps(_mm_mul_ps(p, t2), _mm_set1_ps(0.577078016f));         // 2/(5 ln2)
+    p = _mm_add_ps(_mm_mul_ps(p, t2), _mm_set1_ps(0.961796694f));         // 2/(3 ln2)
+    p = _mm_add_ps(_mm_mul_ps(p, t2), _mm_set1_ps(2.885390082f));         // 2/ln2
+    return _mm_add_ps(e, _mm_mul_ps(p, t));
+}
+#endif
+}
+
+AmodeEnvelopeDetector::AmodeEnvelopeDetector(double samplingrate, double lowcut, double highcut, double floor)
+    : samplingrate_(samplingrate), lowcut_(lowcut), highcut_(highcut), floor_centidb_(static_cast<float>(floor * 100.0))
+{
+}
+
+AmodeEnvelopeDetector::~AmodeEnvelopeDetector()
+{
+}
+
+void AmodeEnvelopeDetector::setBand(double lowcut, double highcut)
+{
+    lowcut_  = lowcut;
+    highcut_ = highcut;
+    plans_.clear();
+    current_ = nullptr;
+}
+
+void AmodeEnvelopeDetector::setFloor(double floor)
+{
+    floor_centidb_ = static_cast<float>(floor * 100.0);
+}
+
+void AmodeEnvelopeDetector::setThreads(int nthreads)
+{
+    nthreads_ = std::max(nthreads, 0);
+    plans_.clear();
+    current_ = nullptr;
+}
+
+void AmodeEnvelopeDetector::prepare(int nsample)
+{
+    if (current_ != nullptr && current_->nsample == nsample) return;
+
+    std::unique_ptr<Plan> &plan = plans_[nsample];
+    if (!plan)
+    {
+        plan.reset(new Plan);
+        plan->nsample = nsample;
+        plan->nfft = 1;
+        while (plan->nfft < nsample) plan->nfft *= 2;
+        const int nfft = plan->nfft;
+
+        // The weight of every bin of the half spectrum: the band (with a cosine taper at both edges), times 2 for the
+        // positive frequencies (analytic signal). DC and Nyquist are not doubled, but the band removes them anyway.
+        int nhalf = nfft / 2 + 1;
+        plan->weight.resize(2 * nhalf);
+        for (int k = 0; k < nhalf; k++)
+        {
+            double f = k * samplingrate_ / nfft;
+            double band = 0.0;
+            if (f >= lowcut_ && f <= highcut_)
+                band = 1.0;
+            else if (f > lowcut_ - TAPER_WIDTH && f < lowcut_)
+                band = 0.5 * (1.0 + std::cos(M_PI * (lowcut_ - f) / TAPER_WIDTH));
+            else if (f > highcut_ && f < highcut_ + TAPER_WIDTH)
+                band = 0.5 * (1.0 + std::cos(M_PI * (f - highcut_) / TAPER_WIDTH));
+
+            bool isEdge = (k == 0) || (k == nfft / 2);
+            float w = static_cast<float>(band * (isEdge ? 1.0 : 2.0));
+            plan->weight[2 * k]     = w;
+            plan->weight[2 * k + 1] = w;
+        }
+
+        // One workspace for every thread, the FFT creates its plan (twiddles) for this size right away
+        int nthreads = 1;
+#ifdef _OPENMP
+        nthreads = (nthreads_ > 0) ? nthreads_ : omp_get_max_threads();
+#endif
+        for (int i = 0; i < nthreads; i++)
+        {
+            std::unique_ptr<Workspace> ws(new Workspace);
+            ws->fft.SetFlag(Eigen::FFT<float>::HalfSpectrum);
+            ws->input.assign(nfft, 0.0f);
+            ws->spectrum.assign(nhalf, Complex(0, 0));
+            ws->analytic.assign(nfft, Complex(0, 0));
+            ws->output.assign(nfft, Complex(0, 0));
+            ws->fft.fwd(ws->spectrum.data(), ws->input.data(), nfft);
+            ws->fft.inv(ws->output.data(), ws->analytic.data(), nfft);
+            plan->workspaces.push_back(std::move(ws));
+        }
+    }
+    current_ = plan.get();
+}
+
+void AmodeEnvelopeDetector::process(AmodeFrame *frame)
+{
+    int nprobe  = frame->getNprobe();
+    int nsample = frame->getNsample();
+    if (nprobe <= 0 || nsample <= 1) return;
+
+    prepare(nsample);
+    const Plan &plan = *current_;
+    const int16_t *input = frame->data();
+    int16_t *output = frame->writableEnvelope();
+
+#ifdef _OPENMP
+    int nthreads = static_cast<int>(plan.workspaces.size());
+    #pragma omp parallel for num_threads(nthreads) schedule(static)
+    for (int p = 0; p < nprobe; p++)
+    {
+        Workspace &ws = *plan.workspaces[omp_get_thread_num()];
+        processProbe(plan, ws, input + static_cast<std::size_t>(p) * nsample, output + static_cast<std::size_t>(p) * nsample);
+    }
+#else
+    for (int p = 0; p < nprobe; p++)
+        processProbe(plan, *plan.workspaces[0], input + static_cast<std::size_t>(p) * nsample, output + static_cast<std::size_t>(p) * nsample);
+#endif
+}
+
+void AmodeEnvelopeDetector::processProbe(const Plan &plan, Workspace &ws, const int16_t *input, int16_t *output) const
+{
+    const int nsample = plan.nsample;
+    const int nfft    = plan.nfft;
+    const int nhalf   = nfft / 2 + 1;
+
+    // 1. FFT of the signal, only the half spectrum (the signal is real). The padding after nsample stays zero.
+    for (int i = 0; i < nsample; i++) ws.input[i] = input[i];
+    ws.fft.fwd(ws.spectrum.data(), ws.input.data(), nfft);
+
+    // 2. Bandpass and analytic signal, the weights are already (re, im) pairs so this is a plain multiplication.
+    //    The upper half of ws.analytic (the negative frequencies) is never written, it stays zero.
+    const float *weight = plan.weight.data();
+    const float *spectrum = reinterpret_cast<const float*>(ws.spectrum.data());
+    float *analytic = reinterpret_cast<float*>(ws.analytic.data());
+    for (int i = 0; i < 2 * nhalf; i++) analytic[i] = spectrum[i] * weight[i];
+
+    // 3. Inverse FFT, the magnitude of the analytic signal is the envelope (we only need the first nsample)
+    ws.fft.inv(ws.output.data(), ws.analytic.data(), nfft);
+
+    // 4. Log compression. We never need the envelope itself, 20*log10(|x|) = 10*log10(|x|^2), so no sqrt.
+    //    Below 1 LSB is 0 dB, then the floor is subtracted.
+    const float *z = reinterpret_cast<const float*>(ws.output.data());
+    int i = 0;
+#ifdef AMODE_ENVELOPE_SSE2
+    const __m128 one   = _mm_set1_ps(1.0f);
+    const __m128 zero  = _mm_setzero_ps();
+    const __m128 scale = _mm_set1_ps(CENTIDB_PER_LOG2);
+    const __m128 floordb = _mm_set1_ps(floor_centidb_);
+    for (; i + 4 <= nsample; i += 4)
+    {
+        // [re0 im0 re1 im1] [re2 im2 re3 im3] -> [|z0|^2 |z1|^2 |z2|^2 |z3|^2]
+        __m128 a = _mm_loadu_ps(z + 2 * i);
+        __m128 b = _mm_loadu_ps(z + 2 * i + 4);
+        a = _mm_mul_ps(a, a);
+        b = _mm_mul_ps(b, b);
+        __m128 mag2 = _mm_add_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)), _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+
+        __m128 db = _mm_max_ps(_mm_sub_ps(_mm_mul_ps(log2Fast(_mm_max_ps(mag2, one)), scale), floordb), zero);
+        __m128i db32 = _mm_cvtps_epi32(db);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(output + i), _mm_packs_epi32(db32, db32));
+    }
+#endif
+    for (; i < nsample; i++)
+    {
+        float mag2 = std::max(z[2 * i] * z[2 * i] + z[2 * i + 1] * z[2 * i + 1], 1.0f);
+        float db = std::max(CENTIDB_PER_LOG2 * std::log2(mag2) - floor_centidb_, 0.0f);
+        output[i] = static_cast<int16_t>(std::min(std::lround(db), 32767L));
+    }
+}
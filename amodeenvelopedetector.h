@@ -0,0 +1,127 @@
+#ifndef AMODEENVELOPEDETECTOR_H
+#define AMODEENVELOPEDETECTOR_H
+
+#include <unsupported/Eigen/FFT>
+
+#include <complex>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "amodeframe.h"
+#include "ultrasoundconfig.h"
+
+/**
+ * @class AmodeEnvelopeDetector
+ * @brief Computes the log-compressed envelope of every probe of an A-mode frame (bandpass, Hilbert envelope, log).
+ *
+ * For the context. The A-mode machine sends the raw RF signal, the 2D plots and the 3D signal (VolumeAmodeController)
+ * showed exactly that. What we actually want to look at is the envelope, the echo of the bone is much easier to see
+ * there. This class computes it for every probe of a frame, in place (into AmodeFrame::writableEnvelope()):
+ *
+ *  1. FFT of the signal (real to half spectrum)
+ *  2. Bandpass and analytic signal at once, by multiplying the half spectrum with a weight (cosine tapered band,
+ *     x2 for the positive frequencies, the negative frequencies are zero)
+ *  3. Inverse FFT, the magnitude of the analytic signal is the envelope
+ *  4. Log compression, 20*log10(envelope) with 1 LSB as 0 dB, minus a floor (the noise, 40 dB by default), stored
+ *     as int16 in 0.01 dB (so ~0..5000). Everything below the floor is 0.
+ *
+ * The FFT is the one from Eigen (unsupported/Eigen/FFT, kissfft). The signal is zero-padded to the next power of two
+ * (3500 -> 4096), kissfft is several times faster there than with the odd factors of 3500 (5x5x5x7), and the padding
+ * also keeps the echoes at the end from wrapping around to the beginning. Everything that depends on the number of
+ * samples (the weights, the FFT plans, the buffers) is a Plan, created once for every number of samples and cached,
+ * so process() doesn't allocate after the first frame. The magnitude and the log are
+ * done with SSE2 (4 samples at once, the log is a polynomial, much faster than std::log10).
+ *
+ * The probes are processed in parallel with OpenMP (if enabled at compile time), every thread has its own FFT and
+ * buffers inside the Plan.
+ *
+ */
+
+class AmodeEnvelopeDetector
+{
+public:
+
+    /**
+     * @brief Constructor function.
+     *
+     * @param samplingrate  The sampling rate of the signal [Hz]
+     * @param lowcut        The lower edge of the band [Hz]
+     * @param highcut       The upper edge of the band [Hz]
+     * @param floor         Everything below this is 0 in the output [dB re 1 LSB]
+     */
+    AmodeEnvelopeDetector(double samplingrate = UltrasoundConfig::FREQ, double lowcut = 2.5e6, double highcut = 12.5e6, double floor = 40.0);
+
+    /**
+     * @brief Destructor function
+     */
+    ~AmodeEnvelopeDetector();
+
+    /**
+     * @brief Compute the envelope of all probes of the frame, into frame->writableEnvelope().
+     * Only the producer calls this, before the frame is shared (see AmodeFramePtr::writable()).
+     */
+    void process(AmodeFrame *frame);
+
+    /**
+     * @brief Create the plan for nsample samples, if it doesn't exist yet (it allocates). process() does this on the
+     * first frame, call it earlier if you know the number of samples.
+     */
+    void prepare(int nsample);
+
+    /**
+     * @brief SET the band of the bandpass [Hz]. The cached plans are thrown away.
+     */
+    void setBand(double lowcut, double highcut);
+
+    /**
+     * @brief SET the floor of the log compression [dB re 1 LSB]
+     */
+    void setFloor(double floor);
+
+    /**
+     * @brief SET the maximum number of threads used for the probes, 0 means as many as OpenMP wants
+     */
+    void setThreads(int nthreads);
+
+private:
+    using Complex = std::complex<float>;
+
+    /**
+     * @struct Workspace
+     * @brief The FFT and the buffers for one thread
+     */
+    struct Workspace {
+        Eigen::FFT<float> fft;              //!< Caches its own twiddles for the size
+        std::vector<float> input;           //!< The signal of one probe, as float
+        std::vector<Complex> spectrum;      //!< Half spectrum of input
+        std::vector<Complex> analytic;      //!< The weighted spectrum, the upper half stays zero
+        std::vector<Complex> output;        //!< The analytic signal
+    };
+
+    /**
+     * @struct Plan
+     * @brief Everything that depends on the number of samples
+     */
+    struct Plan {
+        int nsample = 0;                    //!< The number of samples
+        int nfft = 0;                       //!< The size of the FFT, nsample rounded up to a power of two
+        std::vector<float> weight;          //!< Bandpass x analytic weight of the half spectrum, every weight twice (re, im)
+        std::vector<std::unique_ptr<Workspace>> workspaces; //!< One for every thread
+    };
+
+    /**
+     * @brief The envelope of a single probe, with the workspace of the calling thread
+     */
+    void processProbe(const Plan &plan, Workspace &ws, const int16_t *input, int16_t *output) const;
+
+    double samplingrate_;                   //!< [Hz]
+    double lowcut_;                         //!< [Hz]
+    double highcut_;                        //!< [Hz]
+    float floor_centidb_;                   //!< The floor of the log compression [0.01 dB]
+    int nthreads_ = 0;                      //!< Maximum number of threads, 0 means OpenMP decides
+    std::map<int, std::unique_ptr<Plan>> plans_; //!< The plans, for every number of samples
+    Plan *current_ = nullptr;               //!< The plan of the latest frame, so we don't look it up every time
+};
+
+#endif // AMODEENVELOPEDETECTOR_H
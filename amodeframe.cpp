@@ -0,0 +1,178 @@
+#include "amodeframe.h"
+#include "amodeframepool.h"
+
+AmodeFrame::AmodeFrame(int nprobe, int nsample)
+    : data_(static_cast<std::size_t>(nprobe) * nsample, 0), nprobe_(nprobe), nsample_(nsample)
+{
+}
+
+AmodeFrame::~AmodeFrame()
+{
+}
+
+AmodeFrame::ProbeView AmodeFrame::probe(int p) const
+{
+    ProbeView view;
+    if (p < 0 || p >= nprobe_) return view;
+    view.data = data_.data() + static_cast<std::size_t>(p) * nsample_;
+    view.size = nsample_;
+    return view;
+}
+
+const int16_t* AmodeFrame::data() const
+{
+    return data_.data();
+}
+
+AmodeFrame::ProbeView AmodeFrame::envelope(int p) const
+{
+    ProbeView view;
+    if (!hasenvelope_ || p < 0 || p >= nprobe_) return view;
+    view.data = envelope_.data() + static_cast<std::size_t>(p) * nsample_;
+    view.size = nsample_;
+    return view;
+}
+
+bool AmodeFrame::hasEnvelope() const
+{
+    return hasenvelope_;
+}
+
+int AmodeFrame::getNprobe() const
+{
+    return nprobe_;
+}
+
+int AmodeFrame::getNsample() const
+{
+    return nsample_;
+}
+
+uint16_t AmodeFrame::getIndex() const
+{
+    return index_;
+}
+
+int64_t AmodeFrame::getTimestamp() const
+{
+    return timestamp_ns_;
+}
+
+uint64_t AmodeFrame::getSequence() const
+{
+    return sequence_;
+}
+
+int16_t* AmodeFrame::writableData()
+{
+    return data_.data();
+}
+
+int16_t* AmodeFrame::writableEnvelope()
+{
+    if (envelope_.size() != data_.size()) envelope_.assign(data_.size(), 0);
+    hasenvelope_ = true;
+    return envelope_.data();
+}
+
+void AmodeFrame::setIndex(uint16_t index)
+{
+    index_ = index;
+}
+
+void AmodeFrame::setTimestamp(int64_t timestamp_ns)
+{
+    timestamp_ns_ = timestamp_ns;
+}
+
+void AmodeFrame::setSequence(uint64_t sequence)
+{
+    sequence_ = sequence;
+}
+
+AmodeFramePtr::AmodeFramePtr(AmodeFrame *frame)
+    : frame_(frame)
+{
+    if (frame_) frame_->refcount_.fetch_add(1, std::memory_order_relaxed);
+}
+
+AmodeFramePtr AmodeFramePtr::adopt(AmodeFrame *frame)
+{
+    AmodeFramePtr pointer;
+    pointer.frame_ = frame;
+    return pointer;
+}
+
+AmodeFramePtr AmodeFramePtr::share(AmodeFrame *frame)
+{
+    if (frame == nullptr) return AmodeFramePtr();
+
+    // increment, unless it is 0: a frame back in the pool belongs to the pool only
+    int count = frame->refcount_.load(std::memory_order_relaxed);
+    while (count != 0)
+    {
+        if (frame->refcount_.compare_exchange_weak(count, count + 1, std::memory_order_acquire, std::memory_order_relaxed))
+            return adopt(frame);
+    }
+    return AmodeFramePtr();
+}
+
+AmodeFrame* AmodeFramePtr::release()
+{
+    AmodeFrame *frame = frame_;
+    frame_ = nullptr;
+    return frame;
+}
+
+AmodeFramePtr::AmodeFramePtr(const AmodeFramePtr& other)
+    : frame_(other.frame_)
+{
+    if (frame_) frame_->refcount_.fetch_add(1, std::memory_order_relaxed);
+}
+
+AmodeFramePtr::AmodeFramePtr(AmodeFramePtr&& other) noexcept
+    : frame_(other.frame_)
+{
+    other.frame_ = nullptr;
+}
+
+AmodeFramePtr& AmodeFramePtr::operator=(const AmodeFramePtr& other)
+{
+    if (frame_ != other.frame_)
+    {
+        AmodeFramePtr copy(other);
+        std::swap(frame_, copy.frame_);
+    }
+    return *this;
+}
+
+AmodeFramePtr& AmodeFramePtr::operator=(AmodeFramePtr&& other) noexcept
+{
+    if (this != &other)
+    {
+        reset();
+        frame_ = other.frame_;
+        other.frame_ = nullptr;
+    }
+    return *this;
+}
+
+AmodeFramePtr::~AmodeFramePtr()
+{
+    reset();
+}
+
+void AmodeFramePtr::reset()
+{
+    if (frame_ == nullptr) return;
+
+    // The last one gives the frame back to the pool. The pool is moved out of the frame first, because giving back
+    // the last frame of a pool whose owner is already gone destroys the pool (and this frame with it).
+    AmodeFrame *frame = frame_;
+    frame_ = nullptr;
+    if (frame->refcount_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        std::shared_ptr<AmodeFramePool> pool = std::move(frame->pool_);
+        pool->recycle(frame);
+    }
+}
@@ -0,0 +1,189 @@
+#ifndef AMODEFRAME_H
+#define AMODEFRAME_H
+
+#include <QMetaType>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class AmodeFramePool;
+
+/**
+ * @class AmodeFrame
+ * @brief One A-mode frame (all probes), shared by all the consumers without copying.
+ *
+ * For the context. Previously dataReceived() emitted a std::vector<uint16_t>, and every consumer made its own copy
+ * (QVector<int16_t> of the whole frame, then getRow(), then downsampleVector(), then QVector<double>...). That is
+ * several allocations and copies of 105k samples per frame before anything is drawn.
+ *
+ * Now the acquisition writes the frame once into an AmodeFrame taken from an AmodeFramePool, and hands out an
+ * AmodeFramePtr. Everybody who holds the pointer reads the same memory. The frame is read-only for the consumers
+ * (they only get a const AmodeFrame), and when the last AmodeFramePtr is gone, the frame goes back to the pool and
+ * is reused. So in steady state there is no allocation at all.
+ *
+ * The samples are stored as int16, because that's how the consumers interpret them (the wire sends uint16 words).
+ * probe() gives a view of the samples of a single probe, no copy.
+ *
+ * If the producer computed the envelope (see AmodeEnvelopeDetector), envelope() gives the same kind of view of the
+ * log-compressed envelope of a probe [0.01 dB]. The envelope storage is allocated the first time a frame of the pool
+ * gets an envelope, and is reused after that.
+ *
+ */
+
+class AmodeFrame
+{
+public:
+
+    /**
+     * @struct ProbeView
+     * @brief A view of the samples of a single probe inside the frame, valid as long as the frame is held.
+     */
+    struct ProbeView {
+        const int16_t *data = nullptr;  //!< The first sample
+        int size = 0;                   //!< The number of samples
+
+        const int16_t* begin() const { return data; }
+        const int16_t* end() const { return data + size; }
+        int16_t operator[](int i) const { return data[i]; }
+        bool isEmpty() const { return size == 0; }
+    };
+
+    /**
+     * @brief GET the samples of the probe number p (starting from 0). Empty view if p is out of range.
+     */
+    ProbeView probe(int p) const;
+
+    /**
+     * @brief GET all the samples, probe after probe (nprobe x nsample)
+     */
+    const int16_t* data() const;
+
+    /**
+     * @brief GET the log-compressed envelope of the probe number p [0.01 dB]. Empty view if there is no envelope.
+     */
+    ProbeView envelope(int p) const;
+
+    /**
+     * @brief GET true if the producer computed the envelope of this frame
+     */
+    bool hasEnvelope() const;
+
+    /**
+     * @brief GET the number of probes, and the number of samples of each probe
+     */
+    int getNprobe() const;
+    int getNsample() const;
+
+    /**
+     * @brief GET the index of the frame (sent by the A-mode machine)
+     */
+    uint16_t getIndex() const;
+
+    /**
+     * @brief GET the host monotonic time of the frame [ns], from the arrival times through the clock model of the
+     * A-mode PC (see ClockModel), so without the jitter of the network
+     */
+    int64_t getTimestamp() const;
+
+    /**
+     * @brief GET the number of the frame, counted by the producer
+     */
+    uint64_t getSequence() const;
+
+    /**
+     * @brief [Producer only] Fill the frame, before it is handed to anybody else.
+     */
+    int16_t* writableData();
+    int16_t* writableEnvelope();
+    void setIndex(uint16_t index);
+    void setTimestamp(int64_t timestamp_ns);
+    void setSequence(uint64_t sequence);
+
+    ~AmodeFrame();
+
+private:
+    friend class AmodeFramePool;
+    friend class AmodeFramePtr;
+    friend class AmodeFrameQueue;
+
+    /**
+     * @brief Constructor function, only the pool creates frames
+     */
+    AmodeFrame(int nprobe, int nsample);
+
+    std::vector<int16_t> data_;             //!< The samples, allocated once
+    std::vector<int16_t> envelope_;         //!< The envelope, allocated the first time it is needed
+    bool hasenvelope_ = false;              //!< True if envelope_ belongs to the current content of the frame
+    int nprobe_  = 0;                       //!< The number of probes
+    int nsample_ = 0;                       //!< The number of samples of each probe
+    uint16_t index_ = 0;                    //!< The index from the A-mode machine
+    int64_t timestamp_ns_ = 0;              //!< Host time of the frame [ns]
+    uint64_t sequence_ = 0;                 //!< Frame number from the producer
+
+    std::atomic<int> refcount_{0};          //!< The number of AmodeFramePtr pointing to this frame
+    std::shared_ptr<AmodeFramePool> pool_;  //!< Where the frame goes back, keeps the pool alive while the frame is out
+};
+
+/**
+ * @class AmodeFramePtr
+ * @brief Reference-counted pointer to a const AmodeFrame. Copying it is cheap (no copy of the samples).
+ */
+
+class AmodeFramePtr
+{
+public:
+    AmodeFramePtr() = default;
+    AmodeFramePtr(const AmodeFramePtr& other);
+    AmodeFramePtr(AmodeFramePtr&& other) noexcept;
+    AmodeFramePtr& operator=(const AmodeFramePtr& other);
+    AmodeFramePtr& operator=(AmodeFramePtr&& other) noexcept;
+    ~AmodeFramePtr();
+
+    const AmodeFrame* get() const { return frame_; }
+    const AmodeFrame* operator->() const { return frame_; }
+    const AmodeFrame& operator*() const { return *frame_; }
+    explicit operator bool() const { return frame_ != nullptr; }
+
+    /**
+     * @brief Let go of the frame (it goes back to the pool if nobody else holds it)
+     */
+    void reset();
+
+    /**
+     * @brief [Producer only] Writable access, only before the pointer is shared with anybody.
+     */
+    AmodeFrame* writable() const { return frame_; }
+
+private:
+    friend class AmodeFramePool;
+    friend class AmodeFrameQueue;
+
+    /**
+     * @brief Only the pool makes a pointer from a raw frame
+     */
+    explicit AmodeFramePtr(AmodeFrame *frame);
+
+    /**
+     * @brief [AmodeFrameQueue] Makes a pointer which takes over a reference that was already counted (see release())
+     */
+    static AmodeFramePtr adopt(AmodeFrame *frame);
+
+    /**
+     * @brief [AmodeFrameQueue] Makes a pointer with a new reference, only if somebody still holds the frame (the
+     * count is not 0), otherwise an empty pointer. The frame itself must still exist (its pool is alive).
+     */
+    static AmodeFramePtr share(AmodeFrame *frame);
+
+    /**
+     * @brief [AmodeFrameQueue] Lets go of the frame without giving back the reference, see adopt()
+     */
+    AmodeFrame* release();
+
+    AmodeFrame *frame_ = nullptr;           //!< The frame, nullptr if none
+};
+
+Q_DECLARE_METATYPE(AmodeFramePtr)
+
+#endif // AMODEFRAME_H
@@ -0,0 +1,228 @@
+#include "amodeframeparser.h"
+
+#include <algorithm>
+#include <cstring>
+
+AmodeFrameParser::AmodeFrameParser(const std::vector<uint16_t>& separator, int headersize, int indexsize, int datasize, int capacityframes)
+    : separator_(toBytes(separator)), scanner_(separator_), headersize_(headersize), indexsize_(indexsize), datasize_(datasize)
+{
+    separatorsize_ = separator_.size();
+
+    // The distance between two separators is always the same, that is the whole frame:
+    // ...[separator_1][index_1][data_1][arrayheader_2][separator_2]...
+    //    ^                                            ^
+    //    separator_1                                  separator_1 + framesize_
+    framesize_ = headersize_ + separatorsize_ + indexsize_ + datasize_;
+
+    // The data is taken at the same offset as the previous QByteArray implementation did it in AmodeConnection::readData(),
+    // that is (startIndex - sizeof(uint16_t)) + separatorsize_ + indexsize_, i don't want to change what the plots are showing.
+    dataoffset_ = separatorsize_ + indexsize_ - sizeof(uint16_t);
+
+    // We need at least two frames, one that is being parsed and one that is being written by the socket
+    capacityframes_ = std::max(capacityframes, 2);
+    storage_.resize(capacityframes_ * framesize_);
+}
+
+char* AmodeFrameParser::writePointer()
+{
+    // If everything is consumed, just start from the beginning again, no need to move anything
+    if (readpos_ == writepos_)
+    {
+        readpos_  = 0;
+        writepos_ = 0;
+    }
+
+    // If there is not enough space at the end of the storage for a full frame, move the unconsumed bytes to the front.
+    // The unconsumed bytes are at most one incomplete frame, so this is cheap and happens once every few frames.
+    if (storage_.size() - writepos_ < framesize_ && readpos_ > 0)
+    {
+        compact();
+    }
+
+    return storage_.data() + writepos_;
+}
+
+std::size_t AmodeFrameParser::writableBytes() const
+{
+    return storage_.size() - writepos_;
+}
+
+void AmodeFrameParser::commitWrite(std::size_t n)
+{
+    n = std::min(n, writableBytes());
+    writepos_    += n;
+    bytesparsed_ += n;
+}
+
+std::size_t AmodeFrameParser::append(const char *bytes, std::size_t size)
+{
+    char *dst = writePointer();
+    std::size_t n = std::min(size, writableBytes());
+    std::memcpy(dst, bytes, n);
+    commitWrite(n);
+    return n;
+}
+
+bool AmodeFrameParser::nextFrame(FrameView& view)
+{
+    while (true)
+    {
+        // If we don't know where the frame starts, let's search the separator.
+        if (!locked_)
+        {
+            std::ptrdiff_t pos = findSeparator(readpos_);
+
+            // No separator, we throw away the bytes, except the last few bytes which can be the beginning of a separator
+            if (pos < 0)
+            {
+                std::size_t available = writepos_ - readpos_;
+                std::size_t keep = std::min(available, separatorsize_ - 1);
+                bytesdropped_ += available - keep;
+                readpos_      += available - keep;
+                return false;
+            }
+
+            // Found one, everything before the separator is useless (array header or garbage)
+            bytesdropped_ += pos - readpos_;
+            readpos_ = pos;
+            locked_  = true;
+        }
+
+        // At this point readpos_ should point to a separator. We wait until the whole frame and the next separator arrives:
+        // [separator_1][index_1][data_1][arrayheader_2][separator_2]
+        // ^                                            ^
+        // readpos_                                     readpos_ + framesize_
+        if (writepos_ - readpos_ < framesize_ + separatorsize_) return false;
+
+        // Verify both separators. If one of them is not where it should be, the frame is truncated or we lost the sync.
+        // Skip this separator and search again.
+        if (!isSeparatorAt(readpos_) || !isSeparatorAt(readpos_ + framesize_))
+        {
+            locked_        = false;
+            bytesdropped_ += separatorsize_;
+            readpos_      += separatorsize_;
+            continue;
+        }
+
+        // This is a complete frame, hand out the view of it.
+        view.frame    = storage_.data() + readpos_;
+        view.data     = view.frame + dataoffset_;
+        view.datasize = datasize_;
+
+        // The index comes right after the separator, a little endian word
+        view.index = 0;
+        if (indexsize_ >= sizeof(uint16_t))
+        {
+            const unsigned char *index = reinterpret_cast<const unsigned char*>(view.frame + separatorsize_);
+            view.index = static_cast<uint16_t>(index[0] | (index[1] << 8));
+        }
+
+        // Jump directly to the next separator, no need to search
+        readpos_ += framesize_;
+        framesparsed_++;
+        return true;
+    }
+}
+
+void AmodeFrameParser::reset()
+{
+    readpos_  = 0;
+    writepos_ = 0;
+    locked_   = false;
+}
+
+std::size_t AmodeFrameParser::measureDataSize() const
+{
+    // Three separators in a row, that gives us two distances:
+    // [separator_1]...[arrayheader_2][separator_2]...[arrayheader_3][separator_3]
+    std::ptrdiff_t pos[3];
+    std::size_t from = readpos_;
+    for (int i = 0; i < 3; i++)
+    {
+        pos[i] = findSeparator(from);
+        if (pos[i] < 0) break;
+        from = pos[i] + separatorsize_;
+    }
+    if (pos[0] < 0 || pos[1] < 0) return 0;
+
+    // The frame is everything between two separators, the data is what's left without the headers
+    std::size_t distance = pos[1] - pos[0];
+    if (distance <= headersize_ + separatorsize_ + indexsize_) return 0;
+    std::size_t datasize = distance - headersize_ - separatorsize_ - indexsize_;
+
+    // The array header (LabView) is the number of words of separator + index + data, big endian
+    if (headersize_ >= sizeof(uint32_t))
+    {
+        const unsigned char *header = reinterpret_cast<const unsigned char*>(storage_.data() + pos[1] - headersize_);
+        uint32_t nwords = (uint32_t(header[0]) << 24) | (uint32_t(header[1]) << 16) | (uint32_t(header[2]) << 8) | uint32_t(header[3]);
+        if (std::size_t(nwords) * sizeof(uint16_t) == separatorsize_ + indexsize_ + datasize) return datasize;
+    }
+
+    // The header doesn't tell us anything, then the next frame should have the same size
+    if (pos[2] >= 0 && std::size_t(pos[2] - pos[1]) == distance) return datasize;
+    return 0;
+}
+
+void AmodeFrameParser::setDataSize(int datasize)
+{
+    datasize_  = datasize;
+    framesize_ = headersize_ + separatorsize_ + indexsize_ + datasize_;
+
+    // Keep the bytes that are already inside, at the beginning of the storage
+    compact();
+    storage_.resize(std::max(capacityframes_ * framesize_, writepos_));
+    locked_ = false;
+}
+
+std::size_t AmodeFrameParser::getFrameSize() const
+{
+    return framesize_;
+}
+
+uint64_t AmodeFrameParser::getBytesParsed() const
+{
+    return bytesparsed_;
+}
+
+uint64_t AmodeFrameParser::getFramesParsed() const
+{
+    return framesparsed_;
+}
+
+uint64_t AmodeFrameParser::getBytesDropped() const
+{
+    return bytesdropped_;
+}
+
+std::vector<char> AmodeFrameParser::toBytes(const std::vector<uint16_t>& words)
+{
+    // The separator is sent as words in little endian
+    std::vector<char> bytes;
+    for (uint16_t word : words)
+    {
+        bytes.push_back(static_cast<char>(word & 0xFF));
+        bytes.push_back(static_cast<char>((word >> 8) & 0xFF));
+    }
+    return bytes;
+}
+
+std::ptrdiff_t AmodeFrameParser::findSeparator(std::size_t from) const
+{
+    std::size_t size = writepos_ - from;
+    std::size_t pos  = scanner_.find(storage_.data() + from, size);
+    if (pos == size) return -1;
+    return from + pos;
+}
+
+bool AmodeFrameParser::isSeparatorAt(std::size_t pos) const
+{
+    return std::memcmp(storage_.data() + pos, separator_.data(), separatorsize_) == 0;
+}
+
+void AmodeFrameParser::compact()
+{
+    std::size_t remaining = writepos_ - readpos_;
+    std::memmove(storage_.data(), storage_.data() + readpos_, remaining);
+    readpos_  = 0;
+    writepos_ = remaining;
+}
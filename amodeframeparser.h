@@ -0,0 +1,170 @@
+#ifndef AMODEFRAMEPARSER_H
+#define AMODEFRAMEPARSER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#include "amodeseparatorscanner.h"
+
+/**
+ * @class AmodeFrameParser
+ * @brief A fixed-capacity ring buffer that cuts the A-mode TCP byte stream into frames, in place.
+ *
+ * For the context. The A-mode PC sends a long stream of bytes which looks like this:
+ * ...[arrayheader][separator][index][data][arrayheader][separator][index][data]...
+ * Previously AmodeConnection appended everything to a QByteArray, searched the separator twice per frame,
+ * and copied the frame and the rest of the buffer with QByteArray::mid(). With ~210 KB per frame that is a
+ * lot of copying on the GUI thread.
+ *
+ * This class allocates its storage once (a few frames worth of bytes). The socket writes directly into it
+ * (see writePointer() and commitWrite()), and nextFrame() hands out a FrameView which points inside the
+ * storage, no copy, no reallocation. The separator is only searched when we lose track of the stream (at the
+ * start, or after garbage). Once we are locked, we know where the next separator should be because the frame
+ * size is fixed (usdata_framesize_ in AmodeConnection), so we just jump there and verify it.
+ *
+ * The search itself is done by AmodeSeparatorScanner (SIMD if the CPU supports it), and it always resumes where the
+ * previous search stopped, the bytes which were already searched are thrown away (except the last few bytes which
+ * can be the beginning of a separator).
+ *
+ * The frame size doesn't have to be known in advance. measureDataSize() looks at the bytes that are already in the
+ * storage and measures the distance between the separators (cross-checked with the array header, which is the length
+ * of the array), and setDataSize() resizes the storage for it, keeping the bytes that are already there.
+ *
+ * The "ring" wraps by moving the unconsumed tail (at most one incomplete frame) back to the beginning of the
+ * storage whenever the free space at the end gets too small, so every frame is always contiguous in memory.
+ *
+ */
+
+class AmodeFrameParser
+{
+public:
+
+    /**
+     * @struct FrameView
+     * @brief A view of a single frame inside the parser storage. Valid until the next call of writePointer().
+     */
+    struct FrameView {
+        const char *frame = nullptr;    //!< Points to the first byte of the separator of this frame
+        const char *data  = nullptr;    //!< Points to the first byte of the ultrasound data
+        std::size_t datasize = 0;       //!< The number of bytes of the ultrasound data
+        uint16_t index = 0;             //!< The index of the frame (sent right after the separator), 0 if there is no index
+    };
+
+    /**
+     * @brief Constructor function. Sizes are in bytes, the separator is in words (2 bytes, little endian on the wire).
+     *
+     * @param separator      The separator words (START+10000, see AmodeConnection::initializeData()).
+     * @param headersize     The number of bytes of the array header (sent before the separator).
+     * @param indexsize      The number of bytes of the index (sent after the separator).
+     * @param datasize       The number of bytes of the ultrasound data of a single frame.
+     * @param capacityframes How many frames the storage can hold at once.
+     */
+    AmodeFrameParser(const std::vector<uint16_t>& separator, int headersize, int indexsize, int datasize, int capacityframes = 8);
+
+    /**
+     * @brief GET the pointer where new bytes from the socket should be written. Makes room if necessary.
+     */
+    char* writePointer();
+
+    /**
+     * @brief GET how many bytes can be written to writePointer(). Call writePointer() first, it is what makes the room.
+     */
+    std::size_t writableBytes() const;
+
+    /**
+     * @brief Tells the parser that n bytes were written to writePointer()
+     */
+    void commitWrite(std::size_t n);
+
+    /**
+     * @brief Convenience function, copies bytes to the storage (writePointer() + commitWrite()).
+     *
+     * @return The number of bytes that was accepted. Less than size if the storage is full, call nextFrame() first.
+     */
+    std::size_t append(const char *bytes, std::size_t size);
+
+    /**
+     * @brief GET the next complete frame from the storage.
+     *
+     * @return true if there is a complete frame, view is filled. false if we need more bytes.
+     */
+    bool nextFrame(FrameView& view);
+
+    /**
+     * @brief Forget everything inside the storage, the next frame will be searched from scratch.
+     */
+    void reset();
+
+    /**
+     * @brief Measure the number of bytes of the ultrasound data from the bytes inside the storage (nothing is consumed).
+     *
+     * The distance between two separators is the whole frame. It is accepted if the array header in front of the second
+     * separator agrees with it (LabView puts the length of the array there, in words, big endian), or if the next
+     * distance is the same (in case the header is something else).
+     *
+     * @return The number of bytes of the ultrasound data, 0 if we need more bytes (or the stream makes no sense).
+     */
+    std::size_t measureDataSize() const;
+
+    /**
+     * @brief Change the number of bytes of the ultrasound data. The storage grows if needed, the bytes inside are kept
+     * and the next frame is searched from scratch. This allocates, so only do this once (at connect time).
+     */
+    void setDataSize(int datasize);
+
+    /**
+     * @brief GET the number of bytes of a single frame (array header, separator, index, data)
+     */
+    std::size_t getFrameSize() const;
+
+    /**
+     * @brief GET the statistics of the parser, number of bytes parsed, frames found, and bytes thrown away.
+     */
+    uint64_t getBytesParsed() const;
+    uint64_t getFramesParsed() const;
+    uint64_t getBytesDropped() const;
+
+private:
+
+    /**
+     * @brief Convert the separator words to bytes (little endian), that is what we receive from the socket
+     */
+    static std::vector<char> toBytes(const std::vector<uint16_t>& words);
+
+    /**
+     * @brief Search the separator between readpos_ and writepos_. Returns the offset of the separator or -1.
+     */
+    std::ptrdiff_t findSeparator(std::size_t from) const;
+
+    /**
+     * @brief Check whether the bytes at position pos are the separator
+     */
+    bool isSeparatorAt(std::size_t pos) const;
+
+    /**
+     * @brief Move the unconsumed bytes to the beginning of the storage
+     */
+    void compact();
+
+    std::vector<char> separator_;           //!< Separator in bytes (little endian), what we search in the stream
+    AmodeSeparatorScanner scanner_;         //!< Searches separator_ in the storage
+    std::size_t headersize_    = 4;         //!< The number of bytes of the array header
+    std::size_t separatorsize_ = 10;        //!< The number of bytes of the separator
+    std::size_t indexsize_     = 2;         //!< The number of bytes of the index
+    std::size_t datasize_      = 0;         //!< The number of bytes of the ultrasound data
+    std::size_t framesize_     = 0;         //!< header + separator + index + data, this is also the distance between two separators
+    std::size_t dataoffset_    = 0;         //!< The offset of the ultrasound data relative to the separator
+    std::size_t capacityframes_ = 8;        //!< How many frames the storage can hold at once
+
+    std::vector<char> storage_;             //!< The storage, allocated once in the constructor
+    std::size_t readpos_  = 0;              //!< Everything before readpos_ is already consumed
+    std::size_t writepos_ = 0;              //!< Everything before writepos_ is already written by the socket
+    bool locked_ = false;                   //!< True if readpos_ points to a separator that we already verified
+
+    uint64_t bytesparsed_  = 0;             //!< Counting variable for the bytes that goes into the parser
+    uint64_t framesparsed_ = 0;             //!< Counting variable for the frames that comes out from the parser
+    uint64_t bytesdropped_ = 0;             //!< Counting variable for the bytes that are thrown away (garbage, lost sync)
+};
+
+#endif // AMODEFRAMEPARSER_H
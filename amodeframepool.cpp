@@ -0,0 +1,80 @@
+#include "amodeframepool.h"
+
+#include <algorithm>
+
+std::shared_ptr<AmodeFramePool> AmodeFramePool::create(int nprobe, int nsample, int nframes, int maxframes)
+{
+    return std::shared_ptr<AmodeFramePool>(new AmodeFramePool(nprobe, nsample, nframes, maxframes));
+}
+
+AmodeFramePool::AmodeFramePool(int nprobe, int nsample, int nframes, int maxframes)
+    : nprobe_(nprobe), nsample_(nsample), maxframes_(std::max(maxframes, nframes))
+{
+    // Allocate everything now, recycle() never allocates because free_ already has the room for all frames
+    frames_.reserve(maxframes_);
+    free_.reserve(maxframes_);
+    for (int i = 0; i < nframes; i++)
+    {
+        frames_.emplace_back(new AmodeFrame(nprobe_, nsample_));
+        free_.push_back(frames_.back().get());
+    }
+}
+
+AmodeFramePtr AmodeFramePool::acquire()
+{
+    AmodeFrame *frame = nullptr;
+    {
+        QMutexLocker locker(&mutex_);
+        if (free_.empty())
+        {
+            // All the frames are out, grow if we still may
+            if (static_cast<int>(frames_.size()) >= maxframes_)
+            {
+                exhausted_.fetch_add(1, std::memory_order_relaxed);
+                return AmodeFramePtr();
+            }
+            frames_.emplace_back(new AmodeFrame(nprobe_, nsample_));
+            free_.push_back(frames_.back().get());
+            allocations_.fetch_add(1, std::memory_order_relaxed);
+        }
+        frame = free_.back();
+        free_.pop_back();
+    }
+
+    // the envelope (if any) belongs to the previous content of the frame
+    frame->hasenvelope_ = false;
+    frame->pool_ = shared_from_this();
+    return AmodeFramePtr(frame);
+}
+
+void AmodeFramePool::recycle(AmodeFrame *frame)
+{
+    QMutexLocker locker(&mutex_);
+    free_.push_back(frame);
+}
+
+int AmodeFramePool::getNframes() const
+{
+    QMutexLocker locker(&mutex_);
+    return static_cast<int>(frames_.size());
+}
+
+uint64_t AmodeFramePool::getAllocations() const
+{
+    return allocations_.load(std::memory_order_relaxed);
+}
+
+uint64_t AmodeFramePool::getExhausted() const
+{
+    return exhausted_.load(std::memory_order_relaxed);
+}
+
+int AmodeFramePool::getNprobe() const
+{
+    return nprobe_;
+}
+
+int AmodeFramePool::getNsample() const
+{
+    return nsample_;
+}
@@ -0,0 +1,83 @@
+#ifndef AMODEFRAMEPOOL_H
+#define AMODEFRAMEPOOL_H
+
+#include <QMutex>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "amodeframe.h"
+
+/**
+ * @class AmodeFramePool
+ * @brief Preallocated AmodeFrame objects, which are given out with acquire() and come back automatically.
+ *
+ * For the context. See AmodeFrame. The producer (the acquisition worker or the replay) calls acquire() for every
+ * frame, fills it, and shares the AmodeFramePtr. When the last AmodeFramePtr of a frame is gone, the frame comes
+ * back here. If all frames are out (consumers hold on to a lot of frames), the pool grows up to maxframes, after
+ * that acquire() returns an empty pointer and the producer has to skip the frame.
+ *
+ * The pool is always held by a std::shared_ptr (use create()), and every frame which is out holds the pool too, so
+ * the pool is only destroyed when the owner and all the frames are gone, no matter in which order.
+ *
+ */
+
+class AmodeFramePool : public std::enable_shared_from_this<AmodeFramePool>
+{
+public:
+
+    /**
+     * @brief Create a pool with nframes frames of nprobe x nsample samples, it can grow up to maxframes.
+     */
+    static std::shared_ptr<AmodeFramePool> create(int nprobe, int nsample, int nframes = 8, int maxframes = 64);
+
+    /**
+     * @brief GET a free frame, or an empty pointer if there is none. Thread-safe.
+     */
+    AmodeFramePtr acquire();
+
+    /**
+     * @brief GET the number of frames allocated by the pool (they never go away until the pool is destroyed)
+     */
+    int getNframes() const;
+
+    /**
+     * @brief GET the number of times acquire() had to allocate a new frame, 0 in steady state after the start
+     */
+    uint64_t getAllocations() const;
+
+    /**
+     * @brief GET the number of times acquire() returned an empty pointer
+     */
+    uint64_t getExhausted() const;
+
+    int getNprobe() const;
+    int getNsample() const;
+
+private:
+    friend class AmodeFramePtr;
+
+    /**
+     * @brief Constructor function, use create()
+     */
+    AmodeFramePool(int nprobe, int nsample, int nframes, int maxframes);
+
+    /**
+     * @brief Will be called when the last AmodeFramePtr of a frame is gone. Thread-safe.
+     */
+    void recycle(AmodeFrame *frame);
+
+    int nprobe_;                                        //!< The number of probes of every frame
+    int nsample_;                                       //!< The number of samples of each probe
+    int maxframes_;                                     //!< The pool doesn't grow beyond this
+
+    mutable QMutex mutex_;                              //!< Protects frames_ and free_
+    std::vector<std::unique_ptr<AmodeFrame>> frames_;   //!< All the frames, owned by the pool
+    std::vector<AmodeFrame*> free_;                     //!< The frames which are not used, reserved up to maxframes_
+
+    std::atomic<uint64_t> allocations_{0};              //!< Counting variable for new frames after the constructor
+    std::atomic<uint64_t> exhausted_{0};                //!< Counting variable for the empty acquire()
+};
+
+#endif // AMODEFRAMEPOOL_H
@@ -0,0 +1,68 @@
+#include "amodeframequeue.h"
+#include "amodeframepool.h"
+
+AmodeFrameQueue::AmodeFrameQueue(int nslots)
+    : slots_(nslots < 2 ? 2 : nslots)
+{
+}
+
+AmodeFrameQueue::~AmodeFrameQueue()
+{
+    // give back the references of the slots (the consumers are gone by now)
+    for (Slot &slot : slots_)
+        AmodeFramePtr::adopt(slot.frame.exchange(nullptr, std::memory_order_acquire));
+}
+
+void AmodeFrameQueue::publish(const AmodeFramePtr& frame)
+{
+    if (!frame) return;
+
+    // the slot keeps its own reference to the frame, and we keep its pool (see readLatest, why)
+    AmodeFrame *incoming = AmodeFramePtr(frame).release();
+    if (pools_.empty() || pools_.back() != incoming->pool_) pools_.push_back(incoming->pool_);
+
+    const uint64_t number = written_ + 1;
+    Slot &slot = slots_[number % slots_.size()];
+
+    // seqlock: odd while we swap the pointer
+    slot.sequence.store(2 * number - 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    AmodeFrame *previous = slot.frame.exchange(incoming, std::memory_order_relaxed);
+    slot.sequence.store(2 * number, std::memory_order_release);
+
+    written_ = number;
+    latest_.store(number, std::memory_order_release);
+
+    // the previous frame of this slot is released here (it may go back to the pool)
+    AmodeFramePtr::adopt(previous);
+}
+
+AmodeFramePtr AmodeFrameQueue::readLatest(Reader& reader) const
+{
+    while (true)
+    {
+        const uint64_t number = latest_.load(std::memory_order_acquire);
+        if (number == 0 || number == reader.lastframe) return AmodeFramePtr();
+
+        const Slot &slot = slots_[number % slots_.size()];
+        const uint64_t before = slot.sequence.load(std::memory_order_acquire);
+        if (before != 2 * number) { reader.overruns++; continue; }
+
+        // take a reference, but only if somebody still holds the frame. If the producer already released it, it
+        // may be in the pool (refcount 0, we must not touch it) or even acquired again for the next frame (then our
+        // reference is legit, we just give it back below). Either way the sequence has changed.
+        AmodeFramePtr frame = AmodeFramePtr::share(slot.frame.load(std::memory_order_relaxed));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (!frame || slot.sequence.load(std::memory_order_relaxed) != before) { reader.overruns++; continue; }
+
+        // count the frames this reader skipped, then remember where we are
+        if (reader.lastframe != 0 && number > reader.lastframe + 1) reader.dropped += number - reader.lastframe - 1;
+        reader.lastframe = number;
+        return frame;
+    }
+}
+
+uint64_t AmodeFrameQueue::getFramesWritten() const
+{
+    return latest_.load(std::memory_order_acquire);
+}
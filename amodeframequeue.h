@@ -0,0 +1,106 @@
+#ifndef AMODEFRAMEQUEUE_H
+#define AMODEFRAMEQUEUE_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "amodeframe.h"
+
+class AmodeFramePool;
+
+/**
+ * @class AmodeFrameQueue
+ * @brief Hands the latest A-mode frame from the acquisition to any number of consumers, without locks.
+ *
+ * For the context. The A-mode acquisition runs on its own thread (see AmodeAcquisitionWorker), while the
+ * consumers (2D plots, 3D signal, recorder) run at their own rate. None of them should ever block the
+ * acquisition, and the acquisition should never wait for them.
+ *
+ * The producer publishes every frame as an AmodeFramePtr (see AmodeFrame, the frames come from a pool and are
+ * never modified after they are published). A consumer only asks for the latest frame, it gets its own reference
+ * to the same frame, no copy.
+ *
+ * The frames are handed over through a few slots, like before, but a slot now only holds a pointer to the frame
+ * (and one reference to it) together with a sequence number, a seqlock over the pointer:
+ *  - the producer makes the sequence odd, swaps the pointer, makes the sequence even again (2 x the frame number),
+ *    and then tells everybody which frame is the latest. It never waits for anybody.
+ *  - the consumer reads the sequence, the pointer, takes a reference to the frame (only if the frame is still
+ *    referenced by somebody, a frame back in the pool is never touched) and reads the sequence again. If it
+ *    changed, the producer went around all the slots in the meantime, the reference is given back and we try again
+ *    with the newest frame. That is an overrun, it is counted per consumer.
+ *
+ * Frames that were published but never read by a consumer are counted as dropped for that consumer. The queue keeps
+ * the pools of the frames it has seen, so the frame a consumer is looking at is never freed under its feet (the pool
+ * only changes when the geometry changes, at connection time).
+ *
+ */
+
+class AmodeFrameQueue
+{
+public:
+
+    /**
+     * @struct Reader
+     * @brief Stores the state of one consumer. Every consumer should have its own.
+     */
+    struct Reader {
+        uint64_t lastframe = 0;     //!< The frame number of the last frame this consumer read (frame numbers start from 1)
+        uint64_t dropped   = 0;     //!< The number of frames this consumer never saw, because a newer frame came before it read
+        uint64_t overruns  = 0;     //!< The number of times the producer overwrote the slot while this consumer was reading it
+    };
+
+    /**
+     * @brief Constructor function.
+     *
+     * @param nslots    The number of slots. A consumer only has to retry when the producer publishes this many frames
+     *                  while it takes one, so a few are plenty.
+     */
+    explicit AmodeFrameQueue(int nslots = 4);
+
+    /**
+     * @brief Destructor function, gives the frames in the slots back to their pool.
+     */
+    ~AmodeFrameQueue();
+
+    AmodeFrameQueue(const AmodeFrameQueue&) = delete;
+    AmodeFrameQueue& operator=(const AmodeFrameQueue&) = delete;
+
+    /**
+     * @brief [Producer] Publish a frame, it becomes the latest frame. The frame must not be modified anymore.
+     * There must be only one producer. An empty pointer is ignored.
+     */
+    void publish(const AmodeFramePtr& frame);
+
+    /**
+     * @brief [Consumer] GET the latest frame, if there is a newer frame than the one this reader read before.
+     *
+     * @param reader    The state of the consumer.
+     * @return          The frame, or an empty pointer if there is nothing new.
+     */
+    AmodeFramePtr readLatest(Reader& reader) const;
+
+    /**
+     * @brief GET the number of frames published by the producer since the beginning
+     */
+    uint64_t getFramesWritten() const;
+
+private:
+
+    /**
+     * @struct Slot
+     * @brief One published frame. The slot holds one reference to the frame, until the producer overwrites it.
+     */
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> sequence{0};      //!< Odd while the producer writes, 2 x frame number after
+        std::atomic<AmodeFrame*> frame{nullptr};//!< The frame
+    };
+
+    std::vector<Slot> slots_;                   //!< The slots, the frame n goes in the slot n % size
+    alignas(64) std::atomic<uint64_t> latest_{0}; //!< The frame number of the latest frame (0 means no frame yet)
+    uint64_t written_ = 0;                      //!< [Producer only] The frame number of the latest frame
+    std::vector<std::shared_ptr<AmodeFramePool>> pools_; //!< [Producer only] The pools of the frames we have published
+};
+
+#endif // AMODEFRAMEQUEUE_H
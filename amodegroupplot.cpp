@@ -0,0 +1,90 @@
+#include "amodegroupplot.h"
+
+#include <algorithm>
+
+AmodeGroupPlot::AmodeGroupPlot(QWidget *parent) : QCustomPlot(parent)
+{
+    xAxis->setLabel("Depth (mm)");
+    yAxis->setLabel("Probe");
+    setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding);
+
+    // If QCustomPlot is compiled with OpenGL, paint into a frame buffer object. If it fails, QCustomPlot tells us
+    // and continues in software, nothing else to do.
+#ifdef QCUSTOMPLOT_USE_OPENGL
+    setOpenGl(true);
+#endif
+}
+
+void AmodeGroupPlot::setGroup(const std::vector<AmodeConfig::Data> &group)
+{
+    group_ = group;
+
+    // one graph for every probe, with a few colors so that the neighbours are easy to tell apart
+    clearGraphs();
+    const QColor colors[] = {QColor(31, 119, 180), QColor(255, 127, 14), QColor(44, 160, 44), QColor(214, 39, 40)};
+    for (std::size_t i = 0; i < group_.size(); i++)
+    {
+        QCPGraph *graph = addGraph();
+        graph->setPen(QPen(colors[i % 4]));
+        graph->setAdaptiveSampling(false); // the data is already one column per pixel
+    }
+    updateYAxis();
+}
+
+void AmodeGroupPlot::setDepth(const Eigen::VectorXd &depth)
+{
+    depth_ = depth;
+    if (depth_.size() > 0) xAxis->setRange(0, depth_.coeff(depth_.size() - 1));
+
+    // the keys change, plotFrame() puts them again
+    decimator_ = AmodeMinMaxDecimator();
+    for (int i = 0; i < graphCount(); i++) graph(i)->data()->clear();
+}
+
+void AmodeGroupPlot::setSpacing(double spacing)
+{
+    spacing_ = spacing;
+    updateYAxis();
+}
+
+void AmodeGroupPlot::updateYAxis()
+{
+    QSharedPointer<QCPAxisTickerText> ticker(new QCPAxisTickerText);
+    for (std::size_t i = 0; i < group_.size(); i++)
+        ticker->addTick(i * spacing_, QString("#%1").arg(group_.at(i).number));
+    yAxis->setTicker(ticker);
+    yAxis->setRange(-spacing_, std::max<std::size_t>(group_.size(), 1) * spacing_);
+}
+
+void AmodeGroupPlot::plotFrame(const AmodeFramePtr &frame)
+{
+    int nsample = frame->getNsample();
+    if (nsample != depth_.size()) return;
+
+    // One column for every pixel, the same for every probe. When the width changes, the keys change.
+    int ncolumn = std::min(std::max(axisRect()->width(), 1), nsample);
+    bool newkeys = false;
+    if (decimator_.getNsample() != nsample || decimator_.getNcolumn() != ncolumn)
+    {
+        decimator_ = AmodeMinMaxDecimator(nsample, ncolumn);
+        newkeys = true;
+    }
+
+    const std::ptrdiff_t stride = sizeof(QCPGraphData) / sizeof(double);
+    for (std::size_t i = 0; i < group_.size() && static_cast<int>(i) < graphCount(); i++)
+    {
+        AmodeFrame::ProbeView probe = frame->probe(group_.at(i).number - 1);
+        if (probe.isEmpty()) continue;
+
+        QSharedPointer<QCPGraphDataContainer> data = graph(i)->data();
+        if (newkeys || data->size() != decimator_.getNoutput())
+        {
+            QVector<QCPGraphData> points(decimator_.getNoutput());
+            decimator_.keys(depth_.data(), &points[0].key, stride);
+            data->set(points, true);
+        }
+
+        // the values go directly into the data of the graph, around i x spacing
+        decimator_.apply(probe.data, &data->begin()->value, stride, 1.0, i * spacing_);
+    }
+}
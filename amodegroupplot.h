@@ -0,0 +1,75 @@
+#ifndef AMODEGROUPPLOT_H
+#define AMODEGROUPPLOT_H
+
+#include "qcustomplot.h"
+
+#include <Eigen/Dense>
+#include <vector>
+
+#include "amodeconfig.h"
+#include "amodeframe.h"
+#include "amodeminmaxdecimator.h"
+
+/**
+ * @class AmodeGroupPlot
+ * @brief Inherits QCustomPlot, shows all the probes of an A-mode group in one plot, stacked on top of each other.
+ *
+ * For the context. For a group of up to 4 probes MainWindow shows one QCustomPlotIntervalWindow for every probe. For
+ * the bigger groups (8 to 30 probes) that doesn't work, the plots get too small, and every plot is a separate widget
+ * that paints itself in software, with its own axes, labels and buffers, so the painting time grows with the number
+ * of probes. Here all the probes are graphs of a single plot, probe i is drawn around i x spacing (the y-axis shows
+ * the probe numbers instead of the amplitude), so there is only one widget, one set of axes and one paint.
+ *
+ * The plot paints with OpenGL if QCustomPlot is compiled with QCUSTOMPLOT_USE_OPENGL (see the .pro file), into a
+ * frame buffer object, otherwise (or if the system has no OpenGL) it falls back to the software paint buffer.
+ * Every trace is decimated to the width of the plot (AmodeMinMaxDecimator), and written directly into the data of
+ * its graph, the same as MainWindow::plotAmodeProbe().
+ *
+ * The interval windows can't be edited here, use a group with 4 probes or less for that.
+ *
+ */
+
+class AmodeGroupPlot : public QCustomPlot
+{
+    Q_OBJECT
+
+public:
+    /**
+     * @brief Default constructor.
+     */
+    explicit AmodeGroupPlot(QWidget *parent = nullptr);
+
+    /**
+     * @brief SET the probes to show, one graph for every probe, from the bottom to the top
+     */
+    void setGroup(const std::vector<AmodeConfig::Data> &group);
+
+    /**
+     * @brief SET the depth of every sample [mm], the x-axis. The number of samples of the frames must be the same.
+     */
+    void setDepth(const Eigen::VectorXd &depth);
+
+    /**
+     * @brief SET the distance between two probes on the y-axis, in the unit of the samples
+     */
+    void setSpacing(double spacing);
+
+    /**
+     * @brief Put the probes of the frame into the graphs, it doesn't replot
+     */
+    void plotFrame(const AmodeFramePtr &frame);
+
+private:
+
+    /**
+     * @brief Set the range and the ticks (the probe numbers) of the y-axis
+     */
+    void updateYAxis();
+
+    std::vector<AmodeConfig::Data> group_;  //!< The probes, one for every graph
+    Eigen::VectorXd depth_;                 //!< [mm] The depth of every sample
+    double spacing_ = 8000.0;               //!< The distance between two probes on the y-axis
+    AmodeMinMaxDecimator decimator_;        //!< For the current width of the plot, the same for every probe
+};
+
+#endif // AMODEGROUPPLOT_H
@@ -0,0 +1,129 @@
+#include "amodeminmaxdecimator.h"
+
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define AMODE_MINMAX_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace {
+// One level of the sparse table from the previous one: out[i] = min(in[i], in[i+half]), max the same, for i < n
+void nextLevel(const int16_t *inmin, const int16_t *inmax, int half, int16_t *outmin, int16_t *outmax, int n)
+{
+    int i = 0;
+#ifdef AMODE_MINMAX_SSE2
+    for (; i + 8 <= n; i += 8)
+    {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(inmin + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(inmin + i + half));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(outmin + i), _mm_min_epi16(a, b));
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(inmax + i));
+        __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(inmax + i + half));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(outmax + i), _mm_max_epi16(c, d));
+    }
+#endif
+    for (; i < n; i++)
+    {
+        outmin[i] = std::min(inmin[i], inmin[i + half]);
+        outmax[i] = std::max(inmax[i], inmax[i + half]);
+    }
+}
+}
+
+AmodeMinMaxDecimator::AmodeMinMaxDecimator(int nsample, int ncolumn)
+    : nsample_(std::max(nsample, 0)), ncolumn_(std::min(std::max(ncolumn, 0), std::max(nsample, 0)))
+{
+    if (ncolumn_ == 0) return;
+
+    // Column c is [start_[c], start_[c+1]), the columns differ by at most one sample
+    start_.resize(ncolumn_ + 1);
+    for (int c = 0; c <= ncolumn_; c++) start_[c] = static_cast<int>(static_cast<int64_t>(c) * nsample_ / ncolumn_);
+
+    // The level of every column is the largest power of two that fits inside it
+    level_.resize(ncolumn_);
+    for (int c = 0; c < ncolumn_; c++)
+    {
+        int width = start_[c + 1] - start_[c];
+        int k = 0;
+        while ((2 << k) <= width) k++;
+        level_[c] = k;
+        nlevel_ = std::max(nlevel_, k);
+    }
+
+    tablemin_.resize(static_cast<std::size_t>(nlevel_) * nsample_);
+    tablemax_.resize(static_cast<std::size_t>(nlevel_) * nsample_);
+    colmin_.resize(ncolumn_);
+    colmax_.resize(ncolumn_);
+}
+
+void AmodeMinMaxDecimator::computeColumns(const int16_t *input)
+{
+    // Level 0 is the input itself, level k is stored at (k-1)*nsample_, only the first nsample_-2^k+1 are valid
+    for (int k = 1; k <= nlevel_; k++)
+    {
+        const int16_t *inmin = (k == 1) ? input : &tablemin_[static_cast<std::size_t>(k - 2) * nsample_];
+        const int16_t *inmax = (k == 1) ? input : &tablemax_[static_cast<std::size_t>(k - 2) * nsample_];
+        int half = 1 << (k - 1);
+        nextLevel(inmin, inmax, half, &tablemin_[static_cast<std::size_t>(k - 1) * nsample_], &tablemax_[static_cast<std::size_t>(k - 1) * nsample_], nsample_ - 2 * half + 1);
+    }
+
+    // Every column is covered by two entries of its level, one from the start and one that ends at the end
+    for (int c = 0; c < ncolumn_; c++)
+    {
+        int k = level_[c];
+        int first = start_[c];
+        int second = start_[c + 1] - (1 << k);
+        const int16_t *levelmin = (k == 0) ? input : &tablemin_[static_cast<std::size_t>(k - 1) * nsample_];
+        const int16_t *levelmax = (k == 0) ? input : &tablemax_[static_cast<std::size_t>(k - 1) * nsample_];
+        colmin_[c] = std::min(levelmin[first], levelmin[second]);
+        colmax_[c] = std::max(levelmax[first], levelmax[second]);
+    }
+}
+
+void AmodeMinMaxDecimator::apply(const int16_t *input, double *output, std::ptrdiff_t stride, double scale, double offset)
+{
+    if (ncolumn_ == 0) return;
+    computeColumns(input);
+    for (int c = 0; c < ncolumn_; c++)
+    {
+        output[(2 * c) * stride]     = colmin_[c] * scale + offset;
+        output[(2 * c + 1) * stride] = colmax_[c] * scale + offset;
+    }
+}
+
+void AmodeMinMaxDecimator::apply(const int16_t *input, int16_t *output)
+{
+    if (ncolumn_ == 0) return;
+    computeColumns(input);
+    for (int c = 0; c < ncolumn_; c++)
+    {
+        output[2 * c]     = colmin_[c];
+        output[2 * c + 1] = colmax_[c];
+    }
+}
+
+void AmodeMinMaxDecimator::keys(const double *axis, double *output, std::ptrdiff_t stride) const
+{
+    for (int c = 0; c < ncolumn_; c++)
+    {
+        double key = 0.5 * (axis[start_[c]] + axis[start_[c + 1] - 1]);
+        output[(2 * c) * stride]     = key;
+        output[(2 * c + 1) * stride] = key;
+    }
+}
+
+int AmodeMinMaxDecimator::getNsample() const
+{
+    return nsample_;
+}
+
+int AmodeMinMaxDecimator::getNcolumn() const
+{
+    return ncolumn_;
+}
+
+int AmodeMinMaxDecimator::getNoutput() const
+{
+    return 2 * ncolumn_;
+}
@@ -0,0 +1,90 @@
+#ifndef AMODEMINMAXDECIMATOR_H
+#define AMODEMINMAXDECIMATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @class AmodeMinMaxDecimator
+ * @brief Decimates a single probe of an A-mode frame for a plot, keeping the minimum and the maximum of every pixel column.
+ *
+ * For the context. The 2d plots (MainWindow) used to show every 4th sample (AmodeDownsampler, the same as
+ * AmodeDataManipulator::downsampleVector()). The echoes are only a few samples wide, so picking samples makes them
+ * flicker or disappear completely, depending on where the picked sample falls. A plot can't show more than one value
+ * per pixel column anyway, so here the samples are divided into one column for every pixel of the plot, and for every
+ * column we output two points, the minimum and the maximum (like M4, without the first and the last sample). Drawn as
+ * a line, this looks exactly like plotting all the samples, no echo is lost, and there are only 2x width points.
+ * The 3D signal (VolumeAmodeController) downsamples the same way, with columns of a few samples instead of pixels.
+ *
+ * The columns are computed once (in the constructor, for the number of samples and the width of the plot). The
+ * minimum and the maximum are done with a sparse table: level k is the minimum (maximum) of 2^k samples starting at
+ * every sample, and every level is computed from the previous one with SSE2, 8 int16 at once. The minimum of a column
+ * is then the minimum of two (overlapping) entries of one level. This is the same amount of work whatever the width of
+ * the columns (a few samples each for a normal plot), where a SIMD loop inside every column would be mostly remainder.
+ *
+ * The levels are kept inside the object, so apply() doesn't allocate, but it also means that one object can't be
+ * used by two threads at the same time.
+ *
+ */
+
+class AmodeMinMaxDecimator
+{
+public:
+
+    /**
+     * @brief Constructor function. Divides nsample samples into ncolumn columns (at most nsample).
+     */
+    AmodeMinMaxDecimator(int nsample = 0, int ncolumn = 0);
+
+    /**
+     * @brief Write the minimum and the maximum of every column of input (nsample samples) to output, 2 x ncolumn values.
+     *
+     * @param input   The samples of a probe (see AmodeFrame::probe()), at least getNsample() samples.
+     * @param output  Where the first value goes.
+     * @param stride  The distance between two values in the output, in doubles (see AmodeDownsampler::apply()).
+     * @param scale   Every value is multiplied by this.
+     * @param offset  And then this is added (e.g. to stack several probes in one plot, see AmodeGroupPlot).
+     */
+    void apply(const int16_t *input, double *output, std::ptrdiff_t stride = 1, double scale = 1.0, double offset = 0.0);
+
+    /**
+     * @brief The same, without conversion, output has to have getNoutput() samples
+     */
+    void apply(const int16_t *input, int16_t *output);
+
+    /**
+     * @brief Write the key (x-axis) of every output value, both values of a column are at the middle of the column.
+     *
+     * @param axis    The key of every input sample (e.g. the depth), nsample values.
+     * @param output  Where the first key goes.
+     * @param stride  The distance between two keys in the output, in doubles.
+     */
+    void keys(const double *axis, double *output, std::ptrdiff_t stride = 1) const;
+
+    /**
+     * @brief GET the number of samples of the input, the number of columns, and the number of output values (2 x columns)
+     */
+    int getNsample() const;
+    int getNcolumn() const;
+    int getNoutput() const;
+
+private:
+
+    /**
+     * @brief Compute the minimum and the maximum of every column into colmin_ and colmax_
+     */
+    void computeColumns(const int16_t *input);
+
+    int nsample_ = 0;                   //!< The number of samples of the input
+    int ncolumn_ = 0;                   //!< The number of columns
+    int nlevel_ = 0;                    //!< The number of levels of the sparse table, without level 0 (the input)
+    std::vector<int> start_;            //!< The first sample of every column, ncolumn_+1 values (the last one is nsample_)
+    std::vector<int> level_;            //!< The level used for every column, the largest 2^k that fits inside the column
+    std::vector<int16_t> tablemin_;     //!< The levels 1..nlevel_ of the minimum, nsample_ each
+    std::vector<int16_t> tablemax_;     //!< The same for the maximum
+    std::vector<int16_t> colmin_;       //!< The minimum of every column
+    std::vector<int16_t> colmax_;       //!< The maximum of every column
+};
+
+#endif // AMODEMINMAXDECIMATOR_H
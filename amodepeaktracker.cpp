@@ -0,0 +1,150 @@
+#include "amodepeaktracker.h"
+#include "ultrasoundconfig.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+
+namespace {
+// Host monotonic time [ns], the same clock as the acquisition
+int64_t steadyNanoseconds()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+}
+
+AmodePeakTracker::AmodePeakTracker(QObject *parent, double ds)
+    : QObject{parent}, ds_(ds > 0 ? ds : UltrasoundConfig::DS)
+{
+    windows_.reserve(MAX_PEAKS);
+}
+
+void AmodePeakTracker::setWindow(int probe, double lowerbound, double upperbound)
+{
+    Window window;
+    window.probe      = probe;
+    window.lowerbound = std::min(lowerbound, upperbound);
+    window.upperbound = std::max(lowerbound, upperbound);
+    updateIndices(window, nsample_);
+
+    // replace the window of this probe if there is one already
+    for (Window &existing : windows_)
+    {
+        if (existing.probe == probe)
+        {
+            existing = window;
+            return;
+        }
+    }
+    if (static_cast<int>(windows_.size()) < MAX_PEAKS) windows_.push_back(window);
+}
+
+void AmodePeakTracker::removeWindow(int probe)
+{
+    windows_.erase(std::remove_if(windows_.begin(), windows_.end(), [probe](const Window &w) { return w.probe == probe; }), windows_.end());
+}
+
+void AmodePeakTracker::setWindows(const std::vector<AmodeConfig::Window> &windows)
+{
+    for (const AmodeConfig::Window &window : windows)
+    {
+        if (window.isset) setWindow(window.number, window.lowerbound, window.upperbound);
+    }
+}
+
+void AmodePeakTracker::clearWindows()
+{
+    windows_.clear();
+}
+
+int AmodePeakTracker::getNwindows() const
+{
+    return static_cast<int>(windows_.size());
+}
+
+double AmodePeakTracker::getProcessingTime() const
+{
+    return processing_us_;
+}
+
+void AmodePeakTracker::updateIndices(Window &window, int nsample) const
+{
+    // The depth of sample i is (i+1)*ds, the same as the x-axis of the plots (us_dvector_ in MainWindow)
+    window.first = static_cast<int>(std::ceil(window.lowerbound / ds_)) - 1;
+    window.last  = static_cast<int>(std::floor(window.upperbound / ds_)) - 1;
+    window.first = std::max(window.first, 0);
+    if (nsample > 0) window.last = std::min(window.last, nsample - 1);
+}
+
+void AmodePeakTracker::onAmodeSignalReceived(const AmodeFramePtr &frame)
+{
+    if (windows_.empty() || !frame) return;
+    int64_t start_ns = steadyNanoseconds();
+
+    // the indices depend on the number of samples (the end of the signal), only recompute if it changed
+    if (frame->getNsample() != nsample_)
+    {
+        nsample_ = frame->getNsample();
+        for (Window &window : windows_) updateIndices(window, nsample_);
+    }
+
+    peakframe_.timestamp  = frame->getTimestamp();
+    peakframe_.sequence   = frame->getSequence();
+    peakframe_.isEnvelope = frame->hasEnvelope();
+    peakframe_.npeak      = 0;
+
+    for (const Window &window : windows_)
+    {
+        AmodeFrame::ProbeView signal = peakframe_.isEnvelope ? frame->envelope(window.probe - 1) : frame->probe(window.probe - 1);
+        if (signal.isEmpty() || window.last < window.first) continue;
+
+        // the highest sample inside the window, only the window is scanned
+        const int16_t *data = signal.data;
+        int best = window.first;
+        int bestvalue = std::abs(data[best]);
+        for (int i = window.first + 1; i <= window.last; i++)
+        {
+            int value = std::abs(data[i]);
+            if (value > bestvalue)
+            {
+                bestvalue = value;
+                best = i;
+            }
+        }
+
+        // a parabola through the peak and its neighbours, the vertex is the sub-sample position of the peak
+        double delta = 0.0;
+        double amplitude = bestvalue;
+        if (best > 0 && best < signal.size - 1)
+        {
+            double ym1 = std::abs(data[best - 1]);
+            double yp1 = std::abs(data[best + 1]);
+            double denominator = ym1 - 2.0 * bestvalue + yp1;
+            if (denominator < 0.0)
+            {
+                delta     = 0.5 * (ym1 - yp1) / denominator;
+                amplitude = bestvalue - 0.25 * (ym1 - yp1) * delta;
+            }
+        }
+
+        Peak &peak = peakframe_.peaks[peakframe_.npeak++];
+        peak.probe     = window.probe;
+        peak.depth     = static_cast<float>((best + delta + 1.0) * ds_);
+        peak.amplitude = static_cast<float>(peakframe_.isEnvelope ? amplitude / 100.0 : amplitude); // the envelope is in 0.01 dB
+    }
+
+    // how long this takes (without the consumers of peaksDetected()), averaged over a second
+    int64_t done_ns = steadyNanoseconds();
+    processing_ns_ += done_ns - start_ns;
+    processing_frames_++;
+    if (done_ns - window_start_ns_ >= 1000000000)
+    {
+        processing_us_     = processing_ns_ / 1000.0 / processing_frames_;
+        processing_ns_     = 0;
+        processing_frames_ = 0;
+        window_start_ns_   = done_ns;
+    }
+
+    emit peaksDetected(peakframe_);
+}
@@ -0,0 +1,147 @@
+#ifndef AMODEPEAKTRACKER_H
+#define AMODEPEAKTRACKER_H
+
+#include <QObject>
+#include <QMetaType>
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "amodeconfig.h"
+#include "amodeframe.h"
+
+/**
+ * @class AmodePeakTracker
+ * @brief Finds the peak of every probe inside its interval window, for every frame.
+ *
+ * For the context. The user draws a window for every probe in the 2D plots (QCustomPlotIntervalWindow, lower, middle
+ * and upper line, in mm), and AmodeConfig stores it. The window is where the echo of the bone is expected. This class
+ * takes every frame (connect it to AmodeSource::dataReceived()), looks for the highest sample of the envelope inside
+ * the window of every probe, refines the position with a parabola through the peak and its two neighbours (sub-sample
+ * depth), and emits a PeakFrame with all the peaks of the frame.
+ *
+ * The windows are converted from mm to sample indices once, when they are set (setWindow()), so for every frame we
+ * only scan the samples inside the windows, nothing else. A PeakFrame is a fixed-size struct, no allocation.
+ *
+ * If the frame has the envelope (AmodeSource::useEnvelope()), the peak is searched there and the amplitude is in
+ * dB above the floor of AmodeEnvelopeDetector. Otherwise we use the rectified raw signal (|sample|).
+ *
+ */
+
+class AmodePeakTracker : public QObject
+{
+    Q_OBJECT
+
+public:
+
+    //! The maximum number of peaks in one PeakFrame (one per probe)
+    static const int MAX_PEAKS = 64;
+
+    /**
+     * @struct Peak
+     * @brief The peak of one probe
+     */
+    struct Peak {
+        int probe = 0;          //!< The probe number (as in the A-mode config, starting from 1)
+        float depth = 0;        //!< [mm] Depth of the peak, with the sub-sample interpolation
+        float amplitude = 0;    //!< Amplitude of the peak, [dB] above the floor for the envelope, raw otherwise
+    };
+
+    /**
+     * @struct PeakFrame
+     * @brief All the peaks of one frame
+     */
+    struct PeakFrame {
+        int64_t timestamp = 0;  //!< [ns] Arrival time of the frame (AmodeFrame::getTimestamp())
+        uint64_t sequence = 0;  //!< The number of the frame (AmodeFrame::getSequence())
+        bool isEnvelope = false; //!< True if the peaks are from the envelope
+        int npeak = 0;          //!< The number of valid peaks in peaks
+        std::array<Peak, MAX_PEAKS> peaks; //!< The peaks, in the order of the windows
+    };
+
+    /**
+     * @brief Constructor function.
+     *
+     * @param ds        The distance between two samples [mm], see UltrasoundConfig::DS
+     */
+    explicit AmodePeakTracker(QObject *parent = nullptr, double ds = 0.0);
+
+    /**
+     * @brief SET the window of a probe [mm], from the lower and the upper line of QCustomPlotIntervalWindow.
+     * A probe can only have one window, setting it again replaces it.
+     */
+    void setWindow(int probe, double lowerbound, double upperbound);
+
+    /**
+     * @brief Remove the window of a probe, its peak is not searched anymore
+     */
+    void removeWindow(int probe);
+
+    /**
+     * @brief SET the windows of all probes which have a window in the config (AmodeConfig::Window::isset)
+     */
+    void setWindows(const std::vector<AmodeConfig::Window> &windows);
+
+    /**
+     * @brief Remove all the windows
+     */
+    void clearWindows();
+
+    /**
+     * @brief GET the number of windows
+     */
+    int getNwindows() const;
+
+    /**
+     * @brief GET the average time of onAmodeSignalReceived() over the last second [us]
+     */
+    double getProcessingTime() const;
+
+public slots:
+
+    /**
+     * @brief slot function, will be called when an amode frame is received, needs to be connected to AmodeSource::dataReceived
+     */
+    void onAmodeSignalReceived(const AmodeFramePtr &frame);
+
+signals:
+
+    /**
+     * @brief Emitted for every frame with at least one window
+     */
+    void peaksDetected(const AmodePeakTracker::PeakFrame &peaks);
+
+private:
+
+    /**
+     * @struct Window
+     * @brief The window of a probe in sample indices, [first, last]
+     */
+    struct Window {
+        int probe;              //!< The probe number (starting from 1)
+        double lowerbound;      //!< [mm]
+        double upperbound;      //!< [mm]
+        int first;              //!< The first sample inside the window
+        int last;               //!< The last sample inside the window
+    };
+
+    /**
+     * @brief Convert the window from mm to sample indices for nsample samples
+     */
+    void updateIndices(Window &window, int nsample) const;
+
+    double ds_;                             //!< [mm] The distance between two samples
+    int nsample_ = 0;                       //!< The number of samples the indices are computed for
+    std::vector<Window> windows_;           //!< The windows, reserved for MAX_PEAKS
+    PeakFrame peakframe_;                   //!< The output, reused for every frame
+
+    int64_t processing_ns_ = 0;             //!< Time spent in onAmodeSignalReceived() in the current second [ns]
+    int processing_frames_ = 0;             //!< Frames in the current second
+    int64_t window_start_ns_ = 0;           //!< Start of the current second [ns]
+    double processing_us_ = 0;              //!< The average of the last second [us]
+};
+
+Q_DECLARE_METATYPE(AmodePeakTracker::PeakFrame)
+
+#endif // AMODEPEAKTRACKER_H
@@ -0,0 +1,231 @@
+#include "amoderecorder.h"
+
+#include <QDebug>
+#include <algorithm>
+#include <cstring>
+
+AmodeRecorder::AmodeRecorder(int nprobe, int nsample, int framesperchunk, int nblocks)
+    : nprobe_(nprobe), nsample_(nsample), framesperchunk_(std::max(framesperchunk, 1))
+{
+    datasize_   = static_cast<std::size_t>(nprobe_) * nsample_ * sizeof(uint16_t);
+    recordsize_ = RECORDHEADER_SIZE + datasize_;
+
+    // One block holds one full chunk
+    blocksize_  = CHUNKHEADER_SIZE + framesperchunk_ * recordsize_;
+
+    // Allocate everything now, nothing is allocated anymore while recording
+    nblocks = std::max(nblocks, 2);
+    blocks_.resize(nblocks);
+    for (Block& block : blocks_)
+    {
+        block.data = new char[blocksize_];
+        std::memset(block.data, 0, blocksize_);
+    }
+    freeblocks_.init(nblocks);
+    fullblocks_.init(nblocks);
+}
+
+AmodeRecorder::~AmodeRecorder()
+{
+    stop();
+    for (Block& block : blocks_)
+        delete[] block.data;
+}
+
+bool AmodeRecorder::start(const std::string& filename)
+{
+    if (isRecording_.load()) return false;
+
+    // No buffering from the stream, we already write in big blocks (the OS still caches them)
+    file_.rdbuf()->pubsetbuf(nullptr, 0);
+    file_.open(filename, std::ios::binary | std::ios::trunc);
+    if (!file_.is_open())
+    {
+        qDebug() << "AmodeRecorder::start() Unable to open file:" << QString::fromStdString(filename);
+        return false;
+    }
+
+    // Write the file header
+    char header[FILEHEADER_SIZE] = {0};
+    uint32_t fields[5] = {1, static_cast<uint32_t>(nprobe_), static_cast<uint32_t>(nsample_),
+                          static_cast<uint32_t>(recordsize_), static_cast<uint32_t>(framesperchunk_)};
+    std::memcpy(header, "AMODEREC", 8);
+    std::memcpy(header + 8, fields, sizeof(fields));
+    file_.write(header, FILEHEADER_SIZE);
+
+    // Every block is free at the beginning
+    freeblocks_.head.store(0);
+    freeblocks_.tail.store(0);
+    fullblocks_.head.store(0);
+    fullblocks_.tail.store(0);
+    for (int i = 0; i < static_cast<int>(blocks_.size()); i++)
+    {
+        blocks_[i].nframes = 0;
+        freeblocks_.push(i);
+    }
+    fullcount_.acquire(fullcount_.available());
+    currentblock_ = -1;
+
+    chunknumber_ = 0;
+    framenumber_ = 0;
+    recordedframes_.store(0);
+    droppedframes_.store(0);
+    byteswritten_.store(FILEHEADER_SIZE);
+
+    // Start the writer thread
+    stopRequested_.store(false);
+    writerThread_ = QThread::create([this]{ writeLoop(); });
+    writerThread_->start();
+
+    isRecording_.store(true);
+    return true;
+}
+
+void AmodeRecorder::stop()
+{
+    if (!isRecording_.exchange(false)) return;
+
+    // The incomplete chunk needs to be written too. The producer has to be detached before calling stop(),
+    // so we are the only one touching currentblock_ here.
+    submitCurrentBlock();
+
+    // Wake the writer thread up one more time, it will finish all the remaining blocks first
+    stopRequested_.store(true);
+    fullcount_.release();
+    writerThread_->wait();
+    delete writerThread_;
+    writerThread_ = nullptr;
+
+    file_.close();
+    qDebug() << "AmodeRecorder::stop() Recorded" << recordedframes_.load() << "frames, dropped" << droppedframes_.load() << "frames";
+}
+
+bool AmodeRecorder::pushFrame(const char *data, uint16_t index, int64_t timestamp_ns)
+{
+    if (!isRecording_.load(std::memory_order_relaxed)) return false;
+
+    // Take a new block if we don't have one. If there is no free block, the disk is too slow, drop the frame.
+    if (currentblock_ < 0 && !freeblocks_.pop(currentblock_))
+    {
+        currentblock_ = -1;
+        droppedframes_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    // Write the record at the end of the block
+    Block& block   = blocks_[currentblock_];
+    char *record   = block.data + CHUNKHEADER_SIZE + block.nframes * recordsize_;
+    uint16_t reserved = 0;
+    std::memcpy(record,      &timestamp_ns, sizeof(int64_t));
+    std::memcpy(record + 8,  &index,        sizeof(uint16_t));
+    std::memcpy(record + 10, &reserved,     sizeof(uint16_t));
+    std::memcpy(record + 12, &framenumber_, sizeof(uint32_t));
+    std::memcpy(record + RECORDHEADER_SIZE, data, datasize_);
+    block.nframes++;
+    framenumber_++;
+
+    // The block is full, give it to the writer thread
+    if (block.nframes == static_cast<uint32_t>(framesperchunk_)) submitCurrentBlock();
+    return true;
+}
+
+void AmodeRecorder::submitCurrentBlock()
+{
+    if (currentblock_ < 0) return;
+
+    // Nothing inside, just keep it for the next time
+    if (blocks_[currentblock_].nframes == 0) return;
+
+    // The full ring has room for every block, so this can't fail
+    fullblocks_.push(currentblock_);
+    fullcount_.release();
+    currentblock_ = -1;
+}
+
+void AmodeRecorder::writeLoop()
+{
+    while (true)
+    {
+        // Sleep until there is a full block (or stop() wakes us up)
+        fullcount_.acquire();
+
+        int idx;
+        if (!fullblocks_.pop(idx))
+        {
+            if (stopRequested_.load()) break;
+            continue;
+        }
+
+        // Fill the chunk header and write the used part of the block at once
+        Block& block = blocks_[idx];
+        std::memcpy(block.data, "CHNK", 4);
+        std::memcpy(block.data + 4, &block.nframes, sizeof(uint32_t));
+        std::memcpy(block.data + 8, &chunknumber_, sizeof(uint64_t));
+        std::size_t size = CHUNKHEADER_SIZE + block.nframes * recordsize_;
+
+        file_.write(block.data, size);
+        if (file_.good())
+        {
+            recordedframes_.fetch_add(block.nframes, std::memory_order_relaxed);
+            byteswritten_.fetch_add(size, std::memory_order_relaxed);
+        }
+        else
+        {
+            qDebug() << "AmodeRecorder::writeLoop() Error in writing chunk" << chunknumber_;
+            droppedframes_.fetch_add(block.nframes, std::memory_order_relaxed);
+            file_.clear();
+        }
+        chunknumber_++;
+
+        // Give the block back to the producer
+        block.nframes = 0;
+        freeblocks_.push(idx);
+    }
+}
+
+bool AmodeRecorder::isRecording() const
+{
+    return isRecording_.load();
+}
+
+uint64_t AmodeRecorder::getRecordedFrames() const
+{
+    return recordedframes_.load(std::memory_order_relaxed);
+}
+
+uint64_t AmodeRecorder::getDroppedFrames() const
+{
+    return droppedframes_.load(std::memory_order_relaxed);
+}
+
+uint64_t AmodeRecorder::getBytesWritten() const
+{
+    return byteswritten_.load(std::memory_order_relaxed);
+}
+
+void AmodeRecorder::IndexRing::init(std::size_t capacity)
+{
+    // one extra item, so that full and empty can be told apart
+    items.assign(capacity + 1, -1);
+    head.store(0);
+    tail.store(0);
+}
+
+bool AmodeRecorder::IndexRing::push(int item)
+{
+    std::size_t t    = tail.load(std::memory_order_relaxed);
+    std::size_t next = (t + 1) % items.size();
+    if (next == head.load(std::memory_order_acquire)) return false;
+    items[t] = item;
+    tail.store(next, std::memory_order_release);
+    return true;
+}
+
+bool AmodeRecorder::IndexRing::pop(int& item)
+{
+    std::size_t h = head.load(std::memory_order_relaxed);
+    if (h == tail.load(std::memory_order_acquire)) return false;
+    item = items[h];
+    head.store((h + 1) % items.size(), std::memory_order_release);
+    return true;
+}
@@ -0,0 +1,154 @@
+#ifndef AMODERECORDER_H
+#define AMODERECORDER_H
+
+#include <QThread>
+#include <QSemaphore>
+
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+/**
+ * @class AmodeRecorder
+ * @brief Streams raw A-mode frames to a chunked binary file from a background writer thread.
+ *
+ * For the context. We want to record every single frame from the A-mode machine (30 probes x 3500 samples of
+ * uint16 at the device frame rate) for sessions of an hour or more. Storing them in memory (like MHAWriter does
+ * for the B-mode images) is not an option, and writing to the disk from the acquisition thread would stall the
+ * parser whenever the disk is slow.
+ *
+ * So this class preallocates a fixed number of blocks. The acquisition thread (producer) copies every frame
+ * into the current block, and when the block is full it hands the block to the writer thread, which writes the block
+ * to the file in one go and gives the block back. The producer never waits: if there is no free block (the disk can't
+ * keep up), the frame is dropped and counted. The memory usage never grows, no matter how long the recording is.
+ *
+ * The file looks like this (everything little endian):
+ * [file header, 64 bytes][chunk][chunk]...
+ *
+ * file header  : char magic[8] = "AMODEREC", uint32 version, uint32 nprobe, uint32 nsample, uint32 recordsize,
+ *                uint32 framesperchunk, the rest is zero.
+ * chunk        : [chunk header, 16 bytes][record][record]...
+ * chunk header : char magic[4] = "CHNK", uint32 nframes (records in this chunk), uint64 chunk number.
+ * record       : int64 timestamp [ns] (host monotonic clock, at arrival), uint16 index (from the stream),
+ *                uint16 reserved, uint32 frame number (counted by us), then nprobe*nsample uint16 data.
+ *
+ */
+
+class AmodeRecorder
+{
+public:
+
+    static constexpr std::size_t FILEHEADER_SIZE   = 64;   //!< The number of bytes of the file header
+    static constexpr std::size_t CHUNKHEADER_SIZE  = 16;   //!< The number of bytes of the chunk header
+    static constexpr std::size_t RECORDHEADER_SIZE = 16;   //!< The number of bytes of the record header (before the data)
+
+    /**
+     * @brief Constructor function, preallocates all the blocks. Nothing is opened yet.
+     *
+     * @param nprobe            The number of probes in a frame
+     * @param nsample           The number of samples of each probe
+     * @param framesperchunk    The number of frames in one chunk (one block, written at once)
+     * @param nblocks           The number of blocks, the more, the longer the disk can stall without dropping frames
+     */
+    AmodeRecorder(int nprobe, int nsample, int framesperchunk = 32, int nblocks = 16);
+
+    /**
+     * @brief Destructor function, stops the recording (if any) and frees the blocks
+     */
+    ~AmodeRecorder();
+
+    /**
+     * @brief Opens the file, writes the header, and starts the writer thread.
+     *
+     * @return true if success, false if the file can't be opened
+     */
+    bool start(const std::string& filename);
+
+    /**
+     * @brief Writes the incomplete chunk, waits until everything is on the disk, and closes the file.
+     */
+    void stop();
+
+    /**
+     * @brief [Producer] Add one frame to the recording. Never blocks, the frame is dropped if there is no free block.
+     *
+     * @param data          nprobe*nsample uint16, little endian (straight from the stream)
+     * @param index         The index from the stream
+     * @param timestamp_ns  Host monotonic time of arrival [ns]
+     * @return true if the frame is recorded, false if it is dropped
+     */
+    bool pushFrame(const char *data, uint16_t index, int64_t timestamp_ns);
+
+    /**
+     * @brief GET the status of the recording
+     */
+    bool isRecording() const;
+
+    /**
+     * @brief GET the statistics of the recording
+     */
+    uint64_t getRecordedFrames() const;
+    uint64_t getDroppedFrames() const;
+    uint64_t getBytesWritten() const;
+
+private:
+
+    /**
+     * @struct Block
+     * @brief A buffer that holds one chunk
+     */
+    struct Block {
+        char *data = nullptr;   //!< Chunk header + framesperchunk records
+        uint32_t nframes = 0;   //!< The number of records inside
+    };
+
+    /**
+     * @brief A tiny lock-free single-producer/single-consumer ring of block indices
+     */
+    struct IndexRing {
+        std::vector<int> items;
+        std::atomic<std::size_t> head{0};   //!< Where the consumer reads
+        std::atomic<std::size_t> tail{0};   //!< Where the producer writes
+        void init(std::size_t capacity);
+        bool push(int item);
+        bool pop(int& item);
+    };
+
+    /**
+     * @brief The loop of the writer thread
+     */
+    void writeLoop();
+
+    /**
+     * @brief [Producer] Hands the current block to the writer thread
+     */
+    void submitCurrentBlock();
+
+    int nprobe_;                            //!< The number of probes
+    int nsample_;                           //!< The number of samples of each probe
+    std::size_t datasize_;                  //!< The number of bytes of data of one frame
+    std::size_t recordsize_;                //!< The number of bytes of one record (header + data)
+    int framesperchunk_;                    //!< The number of records in one full chunk
+    std::size_t blocksize_;                 //!< The number of bytes of one block (one full chunk)
+
+    std::vector<Block> blocks_;             //!< All the blocks, allocated in the constructor
+    IndexRing freeblocks_;                  //!< Blocks which are ready to be filled (writer -> producer)
+    IndexRing fullblocks_;                  //!< Blocks which are ready to be written (producer -> writer)
+    QSemaphore fullcount_;                  //!< Wakes the writer thread up when there is a full block
+    int currentblock_ = -1;                 //!< [Producer only] The block that is being filled, -1 if none
+
+    std::ofstream file_;                    //!< The file, only used by the writer thread while recording
+    QThread *writerThread_ = nullptr;       //!< The writer thread
+    std::atomic<bool> isRecording_{false};  //!< The status of the recording
+    std::atomic<bool> stopRequested_{false};//!< Tells the writer thread to finish
+
+    uint64_t chunknumber_ = 0;              //!< [Writer only] Counting variable for the chunk
+    uint32_t framenumber_ = 0;              //!< [Producer only] Counting variable for the frame
+    std::atomic<uint64_t> recordedframes_{0};   //!< Frames which are written to the file
+    std::atomic<uint64_t> droppedframes_{0};    //!< Frames which are dropped because there was no free block
+    std::atomic<uint64_t> byteswritten_{0};     //!< Bytes which are written to the file
+};
+
+#endif // AMODERECORDER_H
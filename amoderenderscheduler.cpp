@@ -0,0 +1,88 @@
+#include "amoderenderscheduler.h"
+
+#include <QGuiApplication>
+#include <QScreen>
+
+#include <algorithm>
+#include <cmath>
+
+AmodeRenderScheduler::AmodeRenderScheduler(QObject *parent, double refreshrate)
+    : QObject{parent}
+{
+    // the interval is only a few ms, the default coarse timer can be 5% off which is almost a whole refresh
+    timer_.setTimerType(Qt::PreciseTimer);
+    connect(&timer_, &QTimer::timeout, this, &AmodeRenderScheduler::onTimeout);
+    setRefreshRate(refreshrate);
+}
+
+void AmodeRenderScheduler::setRefreshRate(double refreshrate)
+{
+    if (refreshrate <= 0.0)
+    {
+        QScreen *screen = QGuiApplication::primaryScreen();
+        refreshrate = (screen != nullptr && screen->refreshRate() > 0.0) ? screen->refreshRate() : 60.0;
+    }
+    refreshrate_ = refreshrate;
+    interval_ms_ = std::max(1, static_cast<int>(std::floor(1000.0 / refreshrate_)));
+    timer_.setInterval(interval_ms_);
+}
+
+double AmodeRenderScheduler::getRefreshRate() const
+{
+    return refreshrate_;
+}
+
+uint64_t AmodeRenderScheduler::getSkippedFrames() const
+{
+    return skipped_;
+}
+
+uint64_t AmodeRenderScheduler::getRenderedFrames() const
+{
+    return rendered_;
+}
+
+void AmodeRenderScheduler::clear()
+{
+    pending_.reset();
+    timer_.stop();
+}
+
+void AmodeRenderScheduler::submit(const AmodeFramePtr &frame)
+{
+    if (!frame) return;
+
+    // the previous frame is not rendered yet, it never will be
+    if (pending_) skipped_++;
+    pending_ = frame;
+
+    // If we didn't render during the last interval, there is no reason to wait, render now and start the timer
+    // so that the next frames are rendered at most once per interval. Otherwise the timer takes care of it.
+    if (!timer_.isActive())
+    {
+        if (!lastrender_.isValid() || lastrender_.elapsed() >= interval_ms_)
+            render();
+        timer_.start();
+    }
+}
+
+void AmodeRenderScheduler::onTimeout()
+{
+    // nothing came during the last interval, stop until the next frame
+    if (!pending_)
+    {
+        timer_.stop();
+        return;
+    }
+    render();
+}
+
+void AmodeRenderScheduler::render()
+{
+    // hand over the frame before emitting, so the pending frame is free for the next submit()
+    AmodeFramePtr frame = std::move(pending_);
+    pending_.reset();
+    lastrender_.start();
+    rendered_++;
+    emit renderRequested(frame);
+}
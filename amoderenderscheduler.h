@@ -0,0 +1,106 @@
+#ifndef AMODERENDERSCHEDULER_H
+#define AMODERENDERSCHEDULER_H
+
+#include <QObject>
+#include <QTimer>
+#include <QElapsedTimer>
+
+#include <cstdint>
+
+#include "amodeframe.h"
+
+/**
+ * @class AmodeRenderScheduler
+ * @brief Passes the A-mode frames to the plots at most once per screen refresh, always the latest one.
+ *
+ * For the context. MainWindow::displayUSsignal() was connected directly to AmodeSource::dataReceived(), so every frame
+ * that reached the GUI thread was plotted and replotted, even if the frames came faster than the screen can show
+ * them. Painting is by far the most expensive part of the GUI thread, and the plots which were painted but never
+ * shown only delay the next frame.
+ *
+ * This class sits in between. Every frame goes to submit(), it only keeps the latest one (a reference, no copy). A
+ * timer with the refresh interval of the screen passes the latest frame to renderRequested(), so there is at most one
+ * render for every refresh. A frame that is replaced before it was rendered is counted as skipped (getSkippedFrames()).
+ * If the frames are slower than the refresh, every frame is rendered right away when it arrives, and when no frame
+ * comes the timer stops, so the GUI thread doesn't wake up for nothing.
+ *
+ * Nothing here ever blocks the acquisition, the acquisition only hands frames to the GUI through AmodeFrameQueue.
+ *
+ */
+
+class AmodeRenderScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+
+    /**
+     * @brief Constructor function.
+     *
+     * @param refreshrate   How many renders per second at most [Hz], 0 means the refresh rate of the primary screen
+     */
+    explicit AmodeRenderScheduler(QObject *parent = nullptr, double refreshrate = 0.0);
+
+    /**
+     * @brief SET the refresh rate [Hz], 0 means the refresh rate of the primary screen
+     */
+    void setRefreshRate(double refreshrate);
+
+    /**
+     * @brief GET the refresh rate [Hz]
+     */
+    double getRefreshRate() const;
+
+    /**
+     * @brief GET the number of frames that were submitted but never rendered, because a newer frame came first
+     */
+    uint64_t getSkippedFrames() const;
+
+    /**
+     * @brief GET the number of renders
+     */
+    uint64_t getRenderedFrames() const;
+
+    /**
+     * @brief Forget the pending frame (e.g. when the source is disconnected), it is not counted as skipped
+     */
+    void clear();
+
+public slots:
+
+    /**
+     * @brief slot function, needs to be connected to AmodeSource::dataReceived
+     */
+    void submit(const AmodeFramePtr &frame);
+
+signals:
+
+    /**
+     * @brief Emitted at most once per refresh interval, with the latest frame
+     */
+    void renderRequested(const AmodeFramePtr &frame);
+
+private slots:
+
+    /**
+     * @brief Called by the timer, renders the pending frame if there is one, otherwise the timer stops
+     */
+    void onTimeout();
+
+private:
+
+    /**
+     * @brief Emit the pending frame
+     */
+    void render();
+
+    QTimer timer_;                      //!< Fires every refresh interval while frames are coming
+    QElapsedTimer lastrender_;          //!< Time since the last render
+    int interval_ms_ = 16;              //!< The refresh interval [ms]
+    double refreshrate_ = 60.0;         //!< [Hz]
+    AmodeFramePtr pending_;             //!< The latest frame that is not rendered yet
+    uint64_t skipped_ = 0;              //!< Frames that were replaced by a newer frame before they were rendered
+    uint64_t rendered_ = 0;             //!< Number of renders
+};
+
+#endif // AMODERENDERSCHEDULER_H
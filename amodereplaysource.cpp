@@ -0,0 +1,241 @@
+#include "amodereplaysource.h"
+#include "amoderecorder.h"
+
+#include <QDebug>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+// Host monotonic time [ns], the same clock as the live frames (see AmodeAcquisitionWorker)
+int64_t steadyNanoseconds()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// The timestamp of the record (the first 8 bytes of the record header, see AmodeRecorder)
+int64_t recordTimestamp(const uchar *record)
+{
+    int64_t timestamp_ns;
+    std::memcpy(&timestamp_ns, record, sizeof(int64_t));
+    return timestamp_ns;
+}
+}
+
+AmodeReplaySource::AmodeReplaySource(QObject *parent, const std::string& filename)
+    : AmodeSource{parent}, file_(QString::fromStdString(filename))
+{
+    if (!file_.open(QIODevice::ReadOnly))
+        throw std::runtime_error("Unable to open file: " + filename);
+
+    qint64 filesize = file_.size();
+    if (filesize < static_cast<qint64>(AmodeRecorder::FILEHEADER_SIZE))
+        throw std::runtime_error("Not an A-mode recording: " + filename);
+
+    map_ = file_.map(0, filesize);
+    if (map_ == nullptr)
+        throw std::runtime_error("Unable to map file: " + filename);
+
+    // Read the file header, see AmodeRecorder for the format
+    uint32_t fields[5];
+    std::memcpy(fields, map_ + 8, sizeof(fields));
+    if (std::memcmp(map_, "AMODEREC", 8) != 0 || fields[0] != 1)
+        throw std::runtime_error("Not an A-mode recording: " + filename);
+    nprobe_   = fields[1];
+    nsample_  = fields[2];
+    datasize_ = static_cast<std::size_t>(nprobe_) * nsample_ * sizeof(uint16_t);
+    std::size_t recordsize = fields[3];
+    if (recordsize != AmodeRecorder::RECORDHEADER_SIZE + datasize_)
+        throw std::runtime_error("Invalid record size in: " + filename);
+
+    // Walk through the chunk headers and remember where every record is. We only touch the chunk headers here,
+    // the data itself is loaded by the OS when it is emitted. A truncated chunk at the end (the program crashed
+    // while recording) is used as far as the records are complete.
+    std::size_t pos = AmodeRecorder::FILEHEADER_SIZE;
+    while (pos + AmodeRecorder::CHUNKHEADER_SIZE <= static_cast<std::size_t>(filesize))
+    {
+        if (std::memcmp(map_ + pos, "CHNK", 4) != 0)
+        {
+            qDebug() << "AmodeReplaySource: invalid chunk at byte" << pos << ", ignoring the rest of the file";
+            break;
+        }
+        uint32_t nframes;
+        std::memcpy(&nframes, map_ + pos + 4, sizeof(uint32_t));
+        pos += AmodeRecorder::CHUNKHEADER_SIZE;
+
+        for (uint32_t i = 0; i < nframes && pos + recordsize <= static_cast<std::size_t>(filesize); i++)
+        {
+            records_.push_back(map_ + pos);
+            pos += recordsize;
+        }
+    }
+    if (records_.empty())
+        throw std::runtime_error("No frame in: " + filename);
+
+    qDebug() << "AmodeReplaySource: loaded" << records_.size() << "frames," << nprobe_ << "probes x" << nsample_ << "samples";
+
+    pool_ = AmodeFramePool::create(nprobe_, nsample_);
+
+    timer_.setSingleShot(true);
+    timer_.setTimerType(Qt::PreciseTimer);
+    connect(&timer_, &QTimer::timeout, this, &AmodeReplaySource::emitNextFrame);
+    clock_.start();
+}
+
+AmodeReplaySource::~AmodeReplaySource()
+{
+    timer_.stop();
+    if (map_ != nullptr) file_.unmap(const_cast<uchar*>(map_));
+    file_.close();
+}
+
+void AmodeReplaySource::start()
+{
+    if (current_ >= records_.size()) current_ = 0;
+
+    // The timing is relative to the frame where we start, so pausing or changing the speed doesn't make us jump
+    playstart_host_ns_ = steadyNanoseconds();
+    playstart_file_ns_ = recordTimestamp(records_[current_]);
+    scheduleNextFrame();
+}
+
+void AmodeReplaySource::stop()
+{
+    timer_.stop();
+}
+
+void AmodeReplaySource::setSpeed(double speed)
+{
+    speed_ = std::max(speed, 0.0);
+    if (timer_.isActive()) start();
+}
+
+void AmodeReplaySource::useEnvelope(bool flag)
+{
+    useenvelope_ = flag;
+}
+
+void AmodeReplaySource::setLoop(bool flag)
+{
+    loop_ = flag;
+}
+
+void AmodeReplaySource::scheduleNextFrame()
+{
+    // As fast as possible (or the end of the recording), the timer fires as soon as the event loop is free
+    if (speed_ <= 0 || current_ >= records_.size())
+    {
+        timer_.start(0);
+        return;
+    }
+
+    // When the frame is due according to the recorded timestamps. If we are already late, emit it right away.
+    int64_t remaining_ns = dueTime(current_) - steadyNanoseconds();
+    timer_.start(static_cast<int>(std::max<int64_t>(remaining_ns / 1000000, 0)));
+}
+
+int64_t AmodeReplaySource::dueTime(std::size_t i) const
+{
+    return playstart_host_ns_ + static_cast<int64_t>((recordTimestamp(records_[i]) - playstart_file_ns_) / speed_);
+}
+
+void AmodeReplaySource::emitNextFrame()
+{
+    // The end of the recording
+    if (current_ >= records_.size())
+    {
+        if (!loop_)
+        {
+            qDebug() << "AmodeReplaySource: end of the recording," << count_emitteddata_ << "frames emitted";
+            return;
+        }
+        current_ = 0;
+        playstart_host_ns_ = steadyNanoseconds();
+        playstart_file_ns_ = recordTimestamp(records_[current_]);
+    }
+
+    // The consumers still hold all the frames of the pool, try again when the event loop is free
+    AmodeFramePtr frame = pool_->acquire();
+    if (!frame)
+    {
+        timer_.start(0);
+        return;
+    }
+
+    // Copy the frame from the map, see AmodeRecorder for the record format
+    const uchar *record = records_[current_];
+    uint16_t index;
+    std::memcpy(&index, record + 8, sizeof(uint16_t));
+    std::memcpy(frame.writable()->writableData(), record + AmodeRecorder::RECORDHEADER_SIZE, datasize_);
+    frame.writable()->setIndex(index);
+    // The host time of now, not the one of the recording session, so that the consumers find the live poses of the
+    // mocap (PoseHistory) and the time doesn't go back when the recording loops. The due time, without the jitter
+    // of the timer, or now if there is no due time.
+    frame.writable()->setTimestamp((speed_ > 0) ? dueTime(current_) : steadyNanoseconds());
+    frame.writable()->setSequence(count_emitteddata_ + 1);
+    if (useenvelope_)
+    {
+        int64_t start_ns = clock_.nsecsElapsed();
+        envelope_.process(frame.writable());
+        envelope_ns_ += clock_.nsecsElapsed() - start_ns;
+    }
+
+    // Everything that is connected directly runs inside the emit, measure it
+    int64_t emit_ns = clock_.nsecsElapsed();
+    emit dataReceived(frame);
+    int64_t done_ns = clock_.nsecsElapsed();
+    processing_ns_ += done_ns - emit_ns;
+    processing_frames_++;
+    count_emitteddata_++;
+    statistics_.addFrame(index, emit_ns, datasize_, true);
+
+    // Publish the statistics once per second, like AmodeConnection
+    if (done_ns - statistics_.getWindowStart() >= 1000000000)
+    {
+        AmodeStreamStatistics::Summary summary = statistics_.summarize(done_ns);
+        summary.envelopeTime = envelope_ns_ / (double(processing_frames_) * nprobe_ * nsample_);
+
+        processing_ms_ = processing_ns_ / 1e6 / processing_frames_;
+        processing_ns_ = 0;
+        processing_frames_ = 0;
+        envelope_ns_ = 0;
+
+        qDebug() << "AmodeReplaySource:" << summary.frameRate << "fps, consumers" << processing_ms_ << "ms/frame (max" << getMaxFrameRate() << "fps)";
+        emit statisticsUpdated(summary);
+    }
+
+    current_++;
+    scheduleNextFrame();
+}
+
+int AmodeReplaySource::getNsample()
+{
+    return nsample_;
+}
+
+int AmodeReplaySource::getNprobe()
+{
+    return nprobe_;
+}
+
+std::size_t AmodeReplaySource::getNframes()
+{
+    return records_.size();
+}
+
+uint64_t AmodeReplaySource::getEmittedFrames()
+{
+    return count_emitteddata_;
+}
+
+double AmodeReplaySource::getProcessingTime()
+{
+    return processing_ms_;
+}
+
+double AmodeReplaySource::getMaxFrameRate()
+{
+    if (processing_ms_ <= 0) return 0;
+    return 1000.0 / processing_ms_;
+}
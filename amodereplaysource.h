@@ -0,0 +1,154 @@
+#ifndef AMODEREPLAYSOURCE_H
+#define AMODEREPLAYSOURCE_H
+
+#include <QObject>
+#include <QFile>
+#include <QTimer>
+#include <QElapsedTimer>
+
+#include <string>
+#include <vector>
+
+#include "amodeenvelopedetector.h"
+#include "amodeframepool.h"
+#include "amodesource.h"
+#include "amodestreamstatistics.h"
+
+/**
+ * @class AmodeReplaySource
+ * @brief Plays back a file recorded by AmodeRecorder, and emits the frames like AmodeConnection does.
+ *
+ * For the context. Until now we could only test with the real A-mode PC (the LabView machine). This class maps the
+ * recording into memory (no reading the whole file, the OS loads the pages when we need them) and emits every frame
+ * with dataReceived(), so the plots, VolumeAmodeController, the recorders, etc. can be tested without the machine.
+ *
+ * The speed can be set with setSpeed():
+ *  - 1.0 : real-time, the frames are emitted with the same timing as they were recorded
+ *  - N   : N times faster (or slower if N < 1) than real-time
+ *  - 0.0 : as fast as possible, the next frame is emitted as soon as the event loop is free again
+ *
+ * The frames get the host time when they are due (now, as fast as possible), like the live frames, not the time of
+ * the recording session. So the poses of a live mocap are found for them (PoseHistory), and the time doesn't go back
+ * when the recording loops.
+ *
+ * Everything connected to dataReceived() with a direct connection runs inside the emit, so we measure the time
+ * spent there. With the as-fast-as-possible mode, this tells us the maximum frame rate the connected stages can
+ * sustain (connect one stage at a time to get the number for each stage). It is printed once per second together
+ * with the usual statistics (statisticsUpdated()).
+ *
+ */
+
+class AmodeReplaySource : public AmodeSource
+{
+    Q_OBJECT
+
+public:
+    /**
+     * @brief Constructor function, maps the file and indexes all the frames. Throws std::runtime_error if the file
+     * can't be opened or is not an A-mode recording.
+     */
+    explicit AmodeReplaySource(QObject *parent, const std::string& filename);
+
+    /**
+     * @brief Destructor function, unmaps the file
+     */
+    ~AmodeReplaySource();
+
+    /**
+     * @brief Start (or continue) the playback from the current frame
+     */
+    void start();
+
+    /**
+     * @brief Pause the playback, start() continues from the same frame
+     */
+    void stop();
+
+    /**
+     * @brief Set the speed of the playback, 1.0 is real-time, 0.0 is as fast as possible. See the class description.
+     */
+    void setSpeed(double speed);
+
+    /**
+     * @brief Set true to start again from the first frame when the recording ends
+     */
+    void setLoop(bool flag);
+
+    /**
+     * @brief GET the number of sample of each probe, and the number of probes, from the recording
+     */
+    int getNsample() override;
+    int getNprobe() override;
+
+    /**
+     * @brief Set true to compute the envelope of every frame before it is emitted
+     */
+    void useEnvelope(bool flag) override;
+
+    /**
+     * @brief GET the number of frames in the recording
+     */
+    std::size_t getNframes();
+
+    /**
+     * @brief GET the number of frames emitted since the constructor
+     */
+    uint64_t getEmittedFrames();
+
+    /**
+     * @brief GET the average time spent by the consumers of dataReceived() for one frame [ms]
+     */
+    double getProcessingTime();
+
+    /**
+     * @brief GET the maximum frame rate the consumers of dataReceived() can sustain [Hz], 1000/getProcessingTime()
+     */
+    double getMaxFrameRate();
+
+private slots:
+    /**
+     * @brief Will be called by the timer, emits the current frame and schedules the next one
+     */
+    void emitNextFrame();
+
+private:
+
+    /**
+     * @brief Schedule the timer for the current frame, according to the speed
+     */
+    void scheduleNextFrame();
+
+    /**
+     * @brief GET the host time when the frame number i is due, according to the speed [ns]. Only with speed_ > 0.
+     */
+    int64_t dueTime(std::size_t i) const;
+
+    QFile file_;                            //!< The recording
+    const uchar *map_ = nullptr;            //!< The whole recording, mapped into memory
+    std::vector<const uchar*> records_;     //!< Points to the beginning of every record inside map_
+
+    int nprobe_  = 0;                       //!< The number of probes, from the file header
+    int nsample_ = 0;                       //!< The number of samples of each probe, from the file header
+    std::size_t datasize_ = 0;              //!< The number of bytes of the data of one frame
+
+    double speed_ = 1.0;                    //!< Playback speed, 0 means as fast as possible
+    bool loop_    = false;                  //!< Flag for starting again when the recording ends
+    std::size_t current_ = 0;               //!< The frame that will be emitted next
+
+    QTimer timer_;                          //!< Fires when the next frame is due
+    QElapsedTimer clock_;                   //!< Measures the time spent by the consumers
+    int64_t playstart_host_ns_ = 0;         //!< Host monotonic time (steady_clock) when the playback started (or restarted) [ns]
+    int64_t playstart_file_ns_ = 0;         //!< Recorded time of the frame where the playback started [ns]
+
+    std::shared_ptr<AmodeFramePool> pool_;  //!< The frames that are emitted
+    AmodeEnvelopeDetector envelope_;        //!< Computes the envelope of the frames, if useenvelope_
+    bool useenvelope_ = false;              //!< Flag for computing the envelope
+    int64_t envelope_ns_ = 0;               //!< Time spent in the envelope stage, since the last summary [ns]
+    AmodeStreamStatistics statistics_;      //!< Statistics of the emitted frames, like AmodeConnection
+    uint64_t count_emitteddata_ = 0;        //!< Counting variable for the emitted frames
+    int64_t processing_ns_ = 0;             //!< Time spent inside the emit, since the last summary [ns]
+    uint64_t processing_frames_ = 0;        //!< Frames emitted, since the last summary
+    double processing_ms_ = 0;              //!< The average of the last summary [ms]
+};
+
+#endif // AMODEREPLAYSOURCE_H
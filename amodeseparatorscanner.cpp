@@ -0,0 +1,244 @@
+#include "amodeseparatorscanner.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define AMODE_SCANNER_X86
+#include <immintrin.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// GCC and Clang only generate AVX2 instructions inside functions that are marked for it, the rest of the program
+// stays compatible with every CPU. MSVC generates them anyway.
+#if defined(__GNUC__)
+#define AMODE_TARGET_SSE2 __attribute__((target("sse2")))
+#define AMODE_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define AMODE_TARGET_SSE2
+#define AMODE_TARGET_AVX2
+#endif
+
+namespace {
+// The position of the lowest bit that is set, mask must not be 0
+inline int countTrailingZeros(unsigned int mask)
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+inline int countTrailingZeros64(uint64_t mask)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+    unsigned long index;
+    _BitScanForward64(&index, mask);
+    return static_cast<int>(index);
+#elif defined(_MSC_VER)
+    return (static_cast<uint32_t>(mask) != 0) ? countTrailingZeros(static_cast<uint32_t>(mask)) : 32 + countTrailingZeros(static_cast<uint32_t>(mask >> 32));
+#else
+    return __builtin_ctzll(mask);
+#endif
+}
+}
+
+AmodeSeparatorScanner::AmodeSeparatorScanner(const std::vector<char>& separator)
+    : separator_(separator), implementation_(Scalar)
+{
+    // once per process, the separator is always the same
+    static const Implementation fastest = measureFastest();
+    implementation_ = fastest;
+}
+
+AmodeSeparatorScanner::Implementation AmodeSeparatorScanner::measureFastest()
+{
+    // A block like the samples between two separators, 16 bits noise of a few hundred. What matters for the scalar
+    // version is how often the first byte of the separator shows up, for the SIMD ones it doesn't matter.
+    std::vector<char> block(256 * 1024);
+    uint32_t state = 1;
+    for (std::size_t i = 0; i + 1 < block.size(); i += 2)
+    {
+        state = state * 1664525u + 1013904223u;
+        int16_t sample = static_cast<int16_t>(static_cast<int>(state >> 16) % 1024 - 512);
+        std::memcpy(block.data() + i, &sample, sizeof(sample));
+    }
+
+    // The best of a few runs each, one implementation after the other in every round, so that the CPU getting up to
+    // speed (and the caches) doesn't favour the last one. A SIMD version has to beat the scalar one by 10%, when they
+    // are that close the timing noise would pick one or the other from run to run.
+    const Implementation implementations[3] = {Scalar, SSE2, AVX2};
+    double best_s[3] = {1.0, 1.0, 1.0};
+    for (int run = 0; run < 7; run++)
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            if (!isSupported(implementations[i])) continue;
+            implementation_ = implementations[i];
+
+            auto start = std::chrono::steady_clock::now();
+            volatile std::size_t found = find(block.data(), block.size());
+            (void)found;
+            best_s[i] = std::min(best_s[i], std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        }
+    }
+
+    Implementation fastest = Scalar;
+    double fastest_s = best_s[0];
+    for (int i = 1; i < 3; i++)
+    {
+        if (isSupported(implementations[i]) && best_s[i] < 0.9 * fastest_s)
+        {
+            fastest = implementations[i];
+            fastest_s = best_s[i];
+        }
+    }
+    return fastest;
+}
+
+std::size_t AmodeSeparatorScanner::find(const char *data, std::size_t size) const
+{
+    if (size < separator_.size()) return size;
+
+    switch (implementation_)
+    {
+    case AVX2: return findAVX2(data, size);
+    case SSE2: return findSSE2(data, size);
+    default:   return findScalar(data, size);
+    }
+}
+
+void AmodeSeparatorScanner::setImplementation(Implementation implementation)
+{
+    implementation_ = isSupported(implementation) ? implementation : Scalar;
+}
+
+AmodeSeparatorScanner::Implementation AmodeSeparatorScanner::getImplementation() const
+{
+    return implementation_;
+}
+
+const char* AmodeSeparatorScanner::getImplementationName() const
+{
+    switch (implementation_)
+    {
+    case AVX2: return "AVX2";
+    case SSE2: return "SSE2";
+    default:   return "Scalar";
+    }
+}
+
+std::size_t AmodeSeparatorScanner::findScalar(const char *data, std::size_t size) const
+{
+    // memchr for the first byte is already quite fast, then verify the rest
+    const std::size_t n = separator_.size();
+    std::size_t pos = 0;
+    while (pos + n <= size)
+    {
+        const void *candidate = std::memchr(data + pos, separator_[0], size - n + 1 - pos);
+        if (candidate == nullptr) break;
+
+        pos = static_cast<const char*>(candidate) - data;
+        if (std::memcmp(data + pos, separator_.data(), n) == 0) return pos;
+        pos++;
+    }
+    return size;
+}
+
+AMODE_TARGET_SSE2
+std::size_t AmodeSeparatorScanner::findSSE2(const char *data, std::size_t size) const
+{
+#ifdef AMODE_SCANNER_X86
+    // For 16 positions at once: does the first byte match, and does the last byte match (n-1 bytes later)?
+    // Only the positions where both match are verified.
+    const std::size_t n = separator_.size();
+    const __m128i first = _mm_set1_epi8(separator_.front());
+    const __m128i last  = _mm_set1_epi8(separator_.back());
+
+    std::size_t pos = 0;
+    for (; pos + n - 1 + 16 <= size; pos += 16)
+    {
+        __m128i blockfirst = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+        __m128i blocklast  = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos + n - 1));
+        unsigned int mask  = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(blockfirst, first), _mm_cmpeq_epi8(blocklast, last)));
+
+        while (mask != 0)
+        {
+            int bit = countTrailingZeros(mask);
+            if (std::memcmp(data + pos + bit + 1, separator_.data() + 1, n - 2) == 0) return pos + bit;
+            mask &= mask - 1;
+        }
+    }
+
+    // The last few bytes
+    return pos + findScalar(data + pos, size - pos);
+#else
+    return findScalar(data, size);
+#endif
+}
+
+AMODE_TARGET_AVX2
+std::size_t AmodeSeparatorScanner::findAVX2(const char *data, std::size_t size) const
+{
+#ifdef AMODE_SCANNER_X86
+    // The same as findSSE2(), but 64 positions at once (two 32 bytes blocks)
+    const std::size_t n = separator_.size();
+    const __m256i first = _mm256_set1_epi8(separator_.front());
+    const __m256i last  = _mm256_set1_epi8(separator_.back());
+
+    std::size_t pos = 0;
+    for (; pos + n - 1 + 64 <= size; pos += 64)
+    {
+        // two blocks per iteration, most of the time there is no candidate at all in 64 bytes
+        __m256i match0 = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + pos)), first),
+                                          _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + pos + n - 1)), last));
+        __m256i match1 = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + pos + 32)), first),
+                                          _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + pos + 32 + n - 1)), last));
+        if (_mm256_testz_si256(_mm256_or_si256(match0, match1), _mm256_or_si256(match0, match1))) continue;
+
+        uint64_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(match0)) | (static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(match1))) << 32);
+        while (mask != 0)
+        {
+            int bit = countTrailingZeros64(mask);
+            if (std::memcmp(data + pos + bit + 1, separator_.data() + 1, n - 2) == 0) return pos + bit;
+            mask &= mask - 1;
+        }
+    }
+
+    // The last few bytes
+    return pos + findScalar(data + pos, size - pos);
+#else
+    return findScalar(data, size);
+#endif
+}
+
+bool AmodeSeparatorScanner::isSupported(Implementation implementation)
+{
+    if (implementation == Scalar) return true;
+
+#if defined(AMODE_SCANNER_X86) && defined(__GNUC__)
+    if (implementation == SSE2) return __builtin_cpu_supports("sse2");
+    if (implementation == AVX2) return __builtin_cpu_supports("avx2");
+#elif defined(AMODE_SCANNER_X86) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    bool sse2    = (info[3] & (1 << 26)) != 0;
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    if (implementation == SSE2) return sse2;
+
+    // AVX2 needs the CPU flag and the OS saving the ymm registers
+    __cpuidex(info, 7, 0);
+    bool avx2 = (info[1] & (1 << 5)) != 0;
+    if (implementation == AVX2) return avx2 && osxsave && (_xgetbv(0) & 0x6) == 0x6;
+#endif
+
+    return false;
+}
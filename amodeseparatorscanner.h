@@ -0,0 +1,95 @@
+#ifndef AMODESEPARATORSCANNER_H
+#define AMODESEPARATORSCANNER_H
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * @class AmodeSeparatorScanner
+ * @brief Finds the separator ("START+10000") in a block of bytes, with SIMD when the CPU supports it.
+ *
+ * For the context. When AmodeFrameParser loses track of the stream (at the start, or after garbage), it needs to
+ * search the separator in everything that is in its storage, which can be a few frames of ~210 KB each. A generic
+ * byte search (std::search, QByteArray::indexOf) compares one byte after another.
+ *
+ * This class compares 64 (AVX2, two 32 bytes blocks per iteration) or 16 (SSE2) positions at once. For every position it checks the first and the last
+ * byte of the separator, only the positions where both match are verified with memcmp. We compare bytes and not
+ * words, because after garbage the separator can start at an odd offset. There is always the scalar version as
+ * fallback (non-x86 or old CPUs).
+ *
+ * More lanes is not always faster: the scalar version is memchr() of the first byte, which the C library already
+ * vectorizes, and on some CPUs it beats both (see tools/bench, "scanner"). So the implementation is not chosen from
+ * the CPU flags alone, the first scanner of the process times the ones the CPU supports on a block of noise like the
+ * samples (measureFastest(), well below a millisecond), and all the scanners use the fastest. A SIMD version has to
+ * be clearly faster than the scalar one.
+ *
+ */
+
+class AmodeSeparatorScanner
+{
+public:
+
+    /**
+     * @brief The implementations
+     */
+    enum Implementation {
+        Scalar,
+        SSE2,
+        AVX2
+    };
+
+    /**
+     * @brief Constructor function, picks the fastest implementation on this CPU (measured once, see the class description).
+     *
+     * @param separator     The separator in bytes (as it is on the wire), at least 2 bytes
+     */
+    explicit AmodeSeparatorScanner(const std::vector<char>& separator);
+
+    /**
+     * @brief Search the separator in data.
+     *
+     * @return The offset of the first separator, or size if there is none.
+     */
+    std::size_t find(const char *data, std::size_t size) const;
+
+    /**
+     * @brief Force an implementation (it falls back to Scalar if the CPU doesn't support it). Used for comparing them.
+     */
+    void setImplementation(Implementation implementation);
+
+    /**
+     * @brief GET the implementation that is used
+     */
+    Implementation getImplementation() const;
+
+    /**
+     * @brief GET the name of the implementation that is used, for logging
+     */
+    const char* getImplementationName() const;
+
+private:
+
+    /**
+     * @brief The implementations, all of them return the offset of the first separator, or size if there is none
+     */
+    std::size_t findScalar(const char *data, std::size_t size) const;
+    std::size_t findSSE2(const char *data, std::size_t size) const;
+    std::size_t findAVX2(const char *data, std::size_t size) const;
+
+    /**
+     * @brief Time find() with every implementation the CPU supports, on a frame of noise without separator
+     *
+     * @return The fastest implementation
+     */
+    Implementation measureFastest();
+
+    /**
+     * @brief Check whether the CPU supports the implementation
+     */
+    static bool isSupported(Implementation implementation);
+
+    std::vector<char> separator_;           //!< The separator in bytes
+    Implementation implementation_;         //!< The implementation used by find()
+};
+
+#endif // AMODESEPARATORSCANNER_H
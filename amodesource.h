@@ -0,0 +1,77 @@
+#ifndef AMODESOURCE_H
+#define AMODESOURCE_H
+
+#include <QObject>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "amodeframe.h"
+#include "amodestreamstatistics.h"
+
+/**
+ * @class AmodeSource
+ * @brief The interface of everything that produces A-mode frames (the A-mode PC, or a recording).
+ *
+ * For the context. MainWindow, VolumeAmodeController, etc. only care about the frames, not where they come from.
+ * AmodeConnection streams them from the A-mode PC, AmodeReplaySource plays them back from a file recorded by
+ * AmodeRecorder, so that we can test the whole pipeline without the A-mode machine. Both emit the same signals.
+ *
+ */
+
+class AmodeSource : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit AmodeSource(QObject *parent = nullptr) : QObject{parent} {}
+    virtual ~AmodeSource() {}
+
+    /**
+     * @brief A function to get how many sample (element) within the signal.
+     */
+    virtual int getNsample() = 0;
+
+    /**
+     * @brief A function to get how many probe used by the machine.
+     */
+    virtual int getNprobe() = 0;
+
+    /**
+     * @brief GET the number of frames that never reached dataReceived() because a newer frame arrived first.
+     */
+    virtual uint64_t getDroppedFrames() { return 0; }
+
+    /**
+     * @brief GET the number of times dataReceived() had to read the latest frame again, because it was overwritten.
+     */
+    virtual uint64_t getOverrunFrames() { return 0; }
+
+    /**
+     * @brief Set true to check the index of the frames for gaps and duplicates.
+     */
+    virtual void useDataIndex(bool flag) { Q_UNUSED(flag); }
+
+    /**
+     * @brief Set true to compute the log-compressed envelope of every frame (see AmodeFrame::envelope()).
+     */
+    virtual void useEnvelope(bool flag) { Q_UNUSED(flag); }
+
+    /**
+     * @brief Set true to record the frames, only if the source supports it (see setDirectory()).
+     */
+    virtual void setRecord(bool flag) { Q_UNUSED(flag); }
+
+    /**
+     * @brief Specify where the recording is stored. Returns 0 if the source can't record.
+     */
+    virtual int setDirectory(std::string directory) { Q_UNUSED(directory); return 0; }
+
+signals:
+    void dataReceived(const AmodeFramePtr &frame);
+    void errorOccured();
+    void statisticsUpdated(const AmodeStreamStatistics::Summary &summary);
+};
+
+#endif // AMODESOURCE_H
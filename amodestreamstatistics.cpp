@@ -0,0 +1,103 @@
+#include "amodestreamstatistics.h"
+
+#include <algorithm>
+
+AmodeStreamStatistics::AmodeStreamStatistics(int binwidth_us, int nbins)
+    : binwidth_us_(std::max(binwidth_us, 1)), histogram_(std::max(nbins, 1), 0)
+{
+}
+
+void AmodeStreamStatistics::addFrame(uint16_t index, int64_t arrival_ns, std::size_t bytes, bool useindex)
+{
+    summary_.framesReceived++;
+    window_frames_++;
+    window_bytes_ += bytes;
+    if (window_start_ns_ < 0) window_start_ns_ = arrival_ns;
+
+    if (hasprevious_)
+    {
+        // Check the index. It is a 16 bit counter, so the difference is computed with wrap around (65535 -> 0 is not a gap)
+        if (useindex)
+        {
+            uint16_t difference = static_cast<uint16_t>(index - previousindex_);
+            if (difference == 0)
+            {
+                summary_.duplicates++;
+            }
+            else if (difference > 1)
+            {
+                summary_.gaps++;
+                summary_.framesMissing += difference - 1;
+            }
+        }
+
+        // Inter-arrival time, goes to the histogram for the percentile
+        double interval_ms = (arrival_ns - previousarrival_ns_) / 1e6;
+        window_intervals_++;
+        window_intervalsum_ += interval_ms;
+        std::size_t bin = std::min<std::size_t>(static_cast<std::size_t>(std::max(interval_ms, 0.0) * 1000.0 / binwidth_us_), histogram_.size() - 1);
+        histogram_[bin]++;
+    }
+
+    hasprevious_        = true;
+    previousindex_      = index;
+    previousarrival_ns_ = arrival_ns;
+    summary_.lastIndex  = index;
+}
+
+AmodeStreamStatistics::Summary AmodeStreamStatistics::summarize(int64_t now_ns)
+{
+    Summary result = summary_;
+
+    // Timing of the window
+    double elapsed_s = (window_start_ns_ < 0) ? 0.0 : (now_ns - window_start_ns_) / 1e9;
+    if (elapsed_s > 0)
+    {
+        result.frameRate  = window_frames_ / elapsed_s;
+        result.throughput = window_bytes_ / elapsed_s / (1024.0 * 1024.0);
+    }
+    if (window_intervals_ > 0)
+    {
+        result.interarrivalMean = window_intervalsum_ / window_intervals_;
+
+        // Walk the histogram until we pass 99% of the samples, report the upper edge of that bin
+        uint64_t target = static_cast<uint64_t>(0.99 * window_intervals_);
+        uint64_t cumulative = 0;
+        for (std::size_t i = 0; i < histogram_.size(); ++i)
+        {
+            cumulative += histogram_[i];
+            if (cumulative > target)
+            {
+                result.interarrivalP99 = (i + 1) * binwidth_us_ / 1000.0;
+                break;
+            }
+        }
+    }
+
+    // Start a new window, the counters keep accumulating
+    std::fill(histogram_.begin(), histogram_.end(), 0);
+    window_frames_      = 0;
+    window_intervals_   = 0;
+    window_intervalsum_ = 0;
+    window_bytes_       = 0;
+    window_start_ns_    = now_ns;
+
+    return result;
+}
+
+int64_t AmodeStreamStatistics::getWindowStart() const
+{
+    return window_start_ns_;
+}
+
+void AmodeStreamStatistics::reset()
+{
+    summary_ = Summary();
+    std::fill(histogram_.begin(), histogram_.end(), 0);
+    window_frames_      = 0;
+    window_intervals_   = 0;
+    window_intervalsum_ = 0;
+    window_bytes_       = 0;
+    window_start_ns_    = -1;
+    hasprevious_        = false;
+}
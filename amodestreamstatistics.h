@@ -0,0 +1,98 @@
+#ifndef AMODESTREAMSTATISTICS_H
+#define AMODESTREAMSTATISTICS_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#include "clockmodel.h"
+
+/**
+ * @class AmodeStreamStatistics
+ * @brief Keeps running statistics of the A-mode stream: dropped/duplicated frames, jitter, and throughput.
+ *
+ * For the context. Every frame sent by the A-mode PC carries a 2-byte index right after the separator, which
+ * counts up for every frame (and wraps around after 65535). If the index jumps, the LabVIEW sender skipped frames
+ * (or we lost them), if it repeats, the same frame was sent twice. Together with the inter-arrival time of the
+ * frames on our side and the throughput, this tells us who can't keep up under load, the sender or us.
+ *
+ * The counters (frames, gaps, duplicates) accumulate since the beginning. The timing (inter-arrival mean/p99 and
+ * throughput) is computed over a window, the window restarts every time summarize() is called. The p99 uses a
+ * fixed histogram, so adding a frame never allocates.
+ *
+ */
+
+class AmodeStreamStatistics
+{
+public:
+
+    /**
+     * @struct Summary
+     * @brief A snapshot of the statistics, this is what is published to the rest of the software.
+     */
+    struct Summary {
+        uint64_t framesReceived   = 0;  //!< Number of frames received since the beginning
+        uint64_t gaps             = 0;  //!< Number of times the index jumped (one gap can contain several missing frames)
+        uint64_t framesMissing    = 0;  //!< Number of frames missing according to the index
+        uint64_t duplicates       = 0;  //!< Number of frames with the same index as the previous frame
+        uint16_t lastIndex        = 0;  //!< The index of the latest frame
+        double interarrivalMean   = 0;  //!< [ms] Mean of the time between two frames, in the last window
+        double interarrivalP99    = 0;  //!< [ms] 99th percentile of the time between two frames, in the last window
+        double frameRate          = 0;  //!< [Hz] Frames per second, in the last window
+        double throughput         = 0;  //!< [MB/s] Bytes per second, in the last window
+        double envelopeTime       = 0;  //!< [ns] Time of the envelope stage per sample, in the last window (0 if it is off)
+        ClockModel::Estimate clock;     //!< The clock of the A-mode PC, see ClockModel (filled by the producer, not here)
+    };
+
+    /**
+     * @brief Constructor function.
+     *
+     * @param binwidth_us   The width of a histogram bin of the inter-arrival time [us]
+     * @param nbins         The number of bins, anything above nbins*binwidth_us falls to the last bin
+     */
+    AmodeStreamStatistics(int binwidth_us = 50, int nbins = 4000);
+
+    /**
+     * @brief Add one frame to the statistics.
+     *
+     * @param index         The index of the frame (from the stream)
+     * @param arrival_ns    The time of arrival of the frame, from a monotonic clock [ns]
+     * @param bytes         The number of bytes of the frame
+     * @param useindex      Set false if the index should not be checked for gaps and duplicates
+     */
+    void addFrame(uint16_t index, int64_t arrival_ns, std::size_t bytes, bool useindex = true);
+
+    /**
+     * @brief GET the summary of the statistics and start a new window for the timing statistics.
+     *
+     * @param now_ns        The current time, from the same clock as addFrame() [ns]
+     */
+    Summary summarize(int64_t now_ns);
+
+    /**
+     * @brief GET the start of the current window [ns], useful to decide when to call summarize()
+     */
+    int64_t getWindowStart() const;
+
+    /**
+     * @brief Reset everything
+     */
+    void reset();
+
+private:
+    Summary summary_;                       //!< The accumulated counters
+
+    int binwidth_us_;                       //!< Width of the histogram bin [us]
+    std::vector<uint32_t> histogram_;       //!< Histogram of the inter-arrival time of the current window
+    uint64_t window_frames_       = 0;      //!< Number of frames in the current window
+    uint64_t window_intervals_    = 0;      //!< Number of inter-arrival samples in the current window
+    double   window_intervalsum_  = 0;      //!< Sum of the inter-arrival time in the current window [ms]
+    uint64_t window_bytes_        = 0;      //!< Number of bytes in the current window
+    int64_t  window_start_ns_     = -1;     //!< Start of the current window [ns], -1 if no frame yet
+
+    bool     hasprevious_         = false;  //!< True if we already received a frame before
+    uint16_t previousindex_       = 0;      //!< The index of the previous frame
+    int64_t  previousarrival_ns_  = 0;      //!< The arrival time of the previous frame [ns]
+};
+
+#endif // AMODESTREAMSTATISTICS_H
@@ -0,0 +1,155 @@
+#include "amodewaterfallplot.h"
+
+#include <algorithm>
+#include <cmath>
+
+/**
+ * @class AmodeWaterfallMap
+ * @brief A QCPColorMap whose image is a circular buffer of rows, only the new row is colorized (see AmodeWaterfallPlot)
+ */
+class AmodeWaterfallMap : public QCPColorMap
+{
+public:
+    AmodeWaterfallMap(QCPAxis *keyAxis, QCPAxis *valueAxis) : QCPColorMap(keyAxis, valueAxis) {}
+
+    // The image is the history, ncolumn depth bins x nrow rows
+    void resizeHistory(int ncolumn, int nrow)
+    {
+        mMapImage = QImage(std::max(ncolumn, 1), std::max(nrow, 1), QImage::Format_ARGB32_Premultiplied);
+        clearHistory();
+    }
+
+    void clearHistory()
+    {
+        mMapImage.fill(mGradient.color(mDataRange.lower, mDataRange));
+        head_ = 0;
+    }
+
+    // The newest row goes just before the previous newest row, so that from head_ to the end of the image (and then
+    // from the beginning) the rows go from the newest to the oldest, the same order as they are painted
+    void addRow(const double *row)
+    {
+        head_ = (head_ - 1 + mMapImage.height()) % mMapImage.height();
+        mGradient.colorize(row, mDataRange, reinterpret_cast<QRgb*>(mMapImage.scanLine(head_)), mMapImage.width());
+    }
+
+    std::size_t sizeInBytes() const
+    {
+        return static_cast<std::size_t>(mMapImage.bytesPerLine()) * mMapImage.height();
+    }
+
+protected:
+    // The rows are colorized when they are added, never all at once. Changing the gradient or the data range only
+    // changes the new rows.
+    void updateMapImage() override
+    {
+        mMapImageInvalidated = false;
+    }
+
+    void draw(QCPPainter *painter) override
+    {
+        if (mMapImage.isNull() || !mKeyAxis || !mValueAxis) return;
+
+        // the whole history goes from the newest (value 0, top) to the oldest (bottom)
+        QRectF rect = QRectF(coordsToPixels(mMapData->keyRange().lower, mMapData->valueRange().lower),
+                             coordsToPixels(mMapData->keyRange().upper, mMapData->valueRange().upper)).normalized();
+        const int nrow = mMapImage.height();
+        const int ncolumn = mMapImage.width();
+        const double rowheight = rect.height() / nrow;
+
+        // [head_, nrow) at the top, then [0, head_)
+        const int ntop = nrow - head_;
+        painter->drawImage(QRectF(rect.left(), rect.top(), rect.width(), ntop * rowheight), mMapImage, QRectF(0, head_, ncolumn, ntop));
+        if (head_ > 0)
+            painter->drawImage(QRectF(rect.left(), rect.top() + ntop * rowheight, rect.width(), head_ * rowheight), mMapImage, QRectF(0, 0, ncolumn, head_));
+    }
+
+private:
+    int head_ = 0;  //!< The row of the newest frame
+};
+
+
+AmodeWaterfallPlot::AmodeWaterfallPlot(QWidget *parent, double seconds, double rowrate, int ndepth) : QCustomPlot(parent)
+{
+    xAxis->setLabel("Depth (mm)");
+    yAxis->setLabel("Time (s)");
+    setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding);
+
+    // the map belongs to the plot, it is deleted with it
+    map_ = new AmodeWaterfallMap(xAxis, yAxis);
+    map_->setGradient(QCPColorGradient::gpGrayscale);
+    map_->setInterpolate(false);
+    map_->setSelectable(QCP::stNone);
+    setLevels(0.0, 4000.0);
+
+    setHistory(seconds, rowrate, ndepth);
+}
+
+void AmodeWaterfallPlot::setHistory(double seconds, double rowrate, int ndepth)
+{
+    seconds_ = std::max(seconds, 0.1);
+    rowrate_ = std::max(rowrate, 1.0);
+    ndepth_  = std::max(ndepth, 1);
+
+    nrow_    = static_cast<int>(std::ceil(seconds_ * rowrate_));
+    yAxis->setRange(-seconds_, 0);
+    map_->data()->setValueRange(QCPRange(-seconds_, 0));
+
+    // the image is allocated there, it depends on the depth bins
+    setDepth(depth_);
+}
+
+void AmodeWaterfallPlot::setDepth(const Eigen::VectorXd &depth)
+{
+    depth_ = depth;
+    int nsample = static_cast<int>(depth_.size());
+    decimator_ = AmodeMinMaxDecimator(nsample, ndepth_);
+    minmax_.assign(decimator_.getNoutput(), 0);
+    row_.assign(decimator_.getNcolumn(), 0.0);
+
+    if (nsample > 0)
+    {
+        xAxis->setRange(0, depth_.coeff(nsample - 1));
+        map_->data()->setKeyRange(QCPRange(depth_.coeff(0), depth_.coeff(nsample - 1)));
+    }
+
+    // less samples than ndepth_ means less bins, the image has one column for every bin
+    map_->resizeHistory(decimator_.getNcolumn(), nrow_);
+    lastrow_ = 0;
+}
+
+void AmodeWaterfallPlot::setLevels(double black, double white)
+{
+    map_->setDataRange(QCPRange(black, white));
+}
+
+void AmodeWaterfallPlot::addFrame(const AmodeFrame::ProbeView &envelope, int64_t timestamp)
+{
+    if (envelope.isEmpty() || envelope.size != decimator_.getNsample() || decimator_.getNcolumn() == 0) return;
+
+    // At most rowrate_ rows per second, the frames in between are skipped. The next row is due one period after the
+    // last one was due, not after the frame that made it, otherwise a 60 Hz stream and 50 rows/s give a row every
+    // other frame (30 rows/s). If the time went back (a replay starting again) or we are more than a period behind
+    // (the frames came slower), the grid starts again at this frame.
+    const int64_t period = static_cast<int64_t>(1.0e9 / rowrate_);
+    if (timestamp < lastrow_) lastrow_ = 0;
+    if (lastrow_ != 0 && timestamp - lastrow_ < period) return;
+    lastrow_ = (lastrow_ == 0 || timestamp - lastrow_ >= 2 * period) ? timestamp : lastrow_ + period;
+
+    // the maximum of every depth bin (the envelope is positive, the maximum is the echo), then the colors of the row
+    decimator_.apply(envelope.data, minmax_.data());
+    const int ncolumn = decimator_.getNcolumn();
+    for (int c = 0; c < ncolumn; c++) row_[c] = minmax_[2 * c + 1];
+    map_->addRow(row_.data());
+}
+
+void AmodeWaterfallPlot::clear()
+{
+    map_->clearHistory();
+    lastrow_ = 0;
+}
+
+std::size_t AmodeWaterfallPlot::getMemoryBytes() const
+{
+    return map_->sizeInBytes() + minmax_.size() * sizeof(int16_t) + row_.size() * sizeof(double);
+}
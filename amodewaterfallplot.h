@@ -0,0 +1,97 @@
+#ifndef AMODEWATERFALLPLOT_H
+#define AMODEWATERFALLPLOT_H
+
+#include "qcustomplot.h"
+
+#include <Eigen/Dense>
+#include <cstdint>
+#include <vector>
+
+#include "amodeframe.h"
+#include "amodeminmaxdecimator.h"
+
+class AmodeWaterfallMap;
+
+/**
+ * @class AmodeWaterfallPlot
+ * @brief Inherits QCustomPlot, shows the history of the envelope of one probe (M-mode), the newest row on top.
+ *
+ * For the context. The 2d plots (QCustomPlotIntervalWindow) only show the latest trace, but for navigation we want to
+ * see how the echoes move over time. This plot has the same x-axis (depth), and the y-axis is the time, the last
+ * few seconds. Every row is the envelope of one frame (log-compressed, see AmodeEnvelopeDetector) in gray levels.
+ *
+ * The history is a circular buffer of rows, which is directly the image that is painted (a QImage inside a
+ * QCPColorMap). When a frame is added, only its row is colorized into the image (QCPColorMap would colorize the whole
+ * map again whenever one cell changes), nothing is moved, and the image is painted in two parts, from the newest row
+ * to the end of the buffer and then from the beginning, so that it scrolls.
+ *
+ * The memory is bounded: the number of rows is the history length times the row rate (a row is only added when the
+ * next one is due, every 1/rowrate, the extra frames are skipped), and every row has a fixed number of depth bins
+ * (the maximum of the samples of every bin, so that narrow echoes don't disappear). See getMemoryBytes(). The time
+ * axis assumes that every row is 1/rowrate, if the frames come slower than that the history is longer than it says.
+ * The rows are due on a grid of 1/rowrate (not 1/rowrate after the frame that made the last row), so frames that
+ * come faster give exactly rowrate rows per second, whatever their own rate.
+ *
+ */
+
+class AmodeWaterfallPlot : public QCustomPlot
+{
+    Q_OBJECT
+
+public:
+    /**
+     * @brief Constructor function.
+     *
+     * @param seconds   How many seconds of history to keep
+     * @param rowrate   How many rows per second at most [Hz]
+     * @param ndepth    The number of depth bins of every row
+     */
+    explicit AmodeWaterfallPlot(QWidget *parent = nullptr, double seconds = 10.0, double rowrate = 50.0, int ndepth = 512);
+
+    /**
+     * @brief SET the length of the history, the history is cleared
+     */
+    void setHistory(double seconds, double rowrate, int ndepth);
+
+    /**
+     * @brief SET the depth of every sample [mm], the x-axis. The number of samples of the frames must be the same.
+     */
+    void setDepth(const Eigen::VectorXd &depth);
+
+    /**
+     * @brief SET the levels that are black and white, in the unit of the envelope (0.01 dB above the floor)
+     */
+    void setLevels(double black, double white);
+
+    /**
+     * @brief Add the envelope of the probe as the newest row, if the next row is due. It doesn't replot.
+     *
+     * @param envelope  The envelope of the probe (see AmodeFrame::envelope())
+     * @param timestamp [ns] The time of the frame (see AmodeFrame::getTimestamp())
+     */
+    void addFrame(const AmodeFrame::ProbeView &envelope, int64_t timestamp);
+
+    /**
+     * @brief Clear the history
+     */
+    void clear();
+
+    /**
+     * @brief GET the memory used by the history [bytes]
+     */
+    std::size_t getMemoryBytes() const;
+
+private:
+    AmodeWaterfallMap *map_;                //!< The history, owned by the plot
+    double seconds_;                        //!< [s] Length of the history
+    double rowrate_;                        //!< [Hz] Rows per second at most
+    int ndepth_;                            //!< The number of depth bins of every row
+    int nrow_ = 1;                          //!< The number of rows, seconds_ x rowrate_
+    Eigen::VectorXd depth_;                 //!< [mm] The depth of every sample
+    AmodeMinMaxDecimator decimator_;        //!< From the samples to the depth bins
+    std::vector<int16_t> minmax_;           //!< The output of decimator_, the minimum and the maximum of every bin
+    std::vector<double> row_;               //!< The maximum of every bin, the input of the colorization
+    int64_t lastrow_ = 0;                   //!< [ns] When the newest row was due, the next one is due 1/rowrate later
+};
+
+#endif // AMODEWATERFALLPLOT_H
@@ -261,16 +261,34 @@ void Bmode3DVisualizer::initializeScene()
     view->setRootEntity(rootEntity);
 }
 
-void Bmode3DVisualizer::onImageReceived(const cv::Mat &image) {
-    currentImage = image;
+void Bmode3DVisualizer::setPoseHistory(std::shared_ptr<const PoseHistory> posehistory)
+{
+    posehistory_ = posehistory;
+}
+
+void Bmode3DVisualizer::onImageReceived(const BmodeFramePtr &frame) {
+    // with the history we don't wait for the next pose, the probe pose at the grab time is already there (or it's
+    // the newest one, if the mocap is a bit behind)
+    if (posehistory_) {
+        if (!posehistory_->poseAt(probeHandle_, frame->getTimestamp(), currentTransform)) return;
+        currentImage = frame;
+        visualizeImage();
+        return;
+    }
+
+    currentImage = frame;
     imageReady = true;
     if (rigidbodyReady) {
         visualizeImage();
     }
 }
 
-void Bmode3DVisualizer::onRigidBodyReceived(const QualisysTransformationManager &tmanager) {
-    currentTransform = tmanager.getTransformationById("B_PROBE");
+void Bmode3DVisualizer::onRigidBodyReceived(const RigidBodyFramePtr &frame) {
+    // the images take their pose from the history, see onImageReceived()
+    if (posehistory_) return;
+
+    // no B_PROBE in the settings of QTM, nothing to show
+    if (!frame->getTransformation(probeHandle_, currentTransform)) return;
     rigidbodyReady = true;
     if (imageReady) {
         visualizeImage();
@@ -284,8 +302,8 @@ void Bmode3DVisualizer::visualizeImage() {
 
     if (firstData)
     {
-        // Convert the OpenCV image to a QImage
-        QImage qtImage = cvMatToQImage(currentImage);
+        // The QImage of the frame, shared with it (no copy), currentImage holds the frame as long as the texture has it
+        QImage qtImage = BmodeFrame::toQImage(currentImage);
         // Convert Eigen Matrix to QMatrix and store it in QTransform
         currentQTransform = new Qt3DCore::QTransform();
         currentQTransform->setMatrix(eigenToQMatrix(currentTransform));
@@ -314,8 +332,8 @@ void Bmode3DVisualizer::visualizeImage() {
         // Creating Plane Entity for B-mode image in 3D space
         // 1) Plane Mesh
         planeMesh = new Qt3DExtras::QPlaneMesh();
-        planeMesh->setWidth(VIZ_SCALE*(4.0/90.0)*currentImage.cols);  // i put scale VIZ_SCALE because pix2mm (4.0/90.0) is in mm, i want it to be visualized in VIZ_SCALE
-        planeMesh->setHeight(VIZ_SCALE*(4.0/90.0)*currentImage.rows); // same here
+        planeMesh->setWidth(VIZ_SCALE*(4.0/90.0)*currentImage->getWidth());  // i put scale VIZ_SCALE because pix2mm (4.0/90.0) is in mm, i want it to be visualized in VIZ_SCALE
+        planeMesh->setHeight(VIZ_SCALE*(4.0/90.0)*currentImage->getHeight()); // same here
         // 2) Plane Texture (it is a but workaround, i want texture from QImage instead of external image file)
         // 2.a) Create an instance of PaintedTextureImage and set the QImage
         paintedTextureImage = new PaintedTextureImage();
@@ -352,8 +370,8 @@ void Bmode3DVisualizer::visualizeImage() {
 
     else
     {
-        // Convert the OpenCV image to a QImagete
-        QImage qtImage = cvMatToQImage(currentImage);
+        // A QImage on the pixels of the frame, no copy
+        QImage qtImage = BmodeFrame::toQImage(currentImage);
         // Convert Eigen Matrix to QMatrix and store it in QTransform
         currentQTransform->setMatrix(eigenToQMatrix(currentTransform));
 
@@ -22,7 +22,8 @@
 
 #include "bmodeconnection.h"
 #include "qualisysconnection.h"
-#include "qualisystransformationmanager.h"
+#include "posehistory.h"
+#include "rigidbodyframe.h"
 
 
 /**
@@ -75,17 +76,23 @@ public:
      */
     Bmode3DVisualizer(QWidget *parent = nullptr, QString calibconfig_path="");
 
+    /**
+     * @brief SET the pose history of QualisysConnection (see QualisysConnection::getPoseHistory()). With it, every
+     * image is shown with the pose of the probe at the time it was grabbed, without it with the latest pose.
+     */
+    void setPoseHistory(std::shared_ptr<const PoseHistory> posehistory);
+
 public slots:
 
     /**
      * @brief slot function, will be called when an image is received, needs to be connected to signal from BmodeConnection::imageProcessed
      */
-    void onImageReceived(const cv::Mat &image);
+    void onImageReceived(const BmodeFramePtr &frame);
 
     /**
      * @brief slot function, will be called when transformations in a timestamp are received, needs to be connected to signal from QualisysConnection::dataReceived class
      */
-    void onRigidBodyReceived(const QualisysTransformationManager &tmanager);
+    void onRigidBodyReceived(const RigidBodyFramePtr &frame);
 
 private:
 
@@ -147,8 +154,10 @@ private:
 
 
     // Variables for storing current image and current transformation
-    cv::Mat             currentImage;                   //!< Stores the current image from BmodeConnection::imageProcessed
+    BmodeFramePtr       currentImage;                   //!< Stores the current image from BmodeConnection::imageProcessed (shared, no copy)
     Eigen::Isometry3d   currentTransform;               //!< Stores the current transformation from QualisysConnection::dataReceived, specifically B_PROBE transformation
+    RigidBodyFrame::Handle probeHandle_{"B_PROBE"};     //!< Where B_PROBE is in the frames of QualisysConnection
+    std::shared_ptr<const PoseHistory> posehistory_;    //!< The poses from QualisysConnection, nullptr to pair with the latest pose
     Qt3DCore::QTransform *currentQTransform;            //!< Same as currentTransform but with Qt3DCore::QTransform class instead of Eigen::Isometry3d
 
     // Variables to controling the class if both of the data are ready
@@ -0,0 +1,240 @@
+#include "bmodecameraenumerator.h"
+
+#include <QDebug>
+#include <QMutex>
+#include <QMutexLocker>
+
+#include <algorithm>
+#include <sstream>
+
+#ifdef __linux__
+#include <chrono>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <future>
+#include <linux/videodev2.h>
+#include <sys/ioctl.h>
+#include <thread>
+#include <unistd.h>
+#else
+#include <opencv2/opencv.hpp>
+#endif
+
+namespace {
+QMutex cacheMutex;                                          // protects the cache, enumerate() can be called from any thread
+bool cacheValid = false;
+std::vector<BmodeCameraEnumerator::CameraInfo> cache;
+
+#ifdef __linux__
+int xioctl(int fd, unsigned long request, void *arg)
+{
+    int status;
+    do { status = ioctl(fd, request, arg); } while (status == -1 && errno == EINTR);
+    return status;
+}
+
+// The highest frame rate the driver reports for a format and a size [Hz], 0 if it doesn't tell
+double maxFrameRate(int fd, uint32_t fourcc, int width, int height)
+{
+    double fps = 0.0;
+    v4l2_frmivalenum interval;
+    std::memset(&interval, 0, sizeof(interval));
+    interval.pixel_format = fourcc;
+    interval.width  = width;
+    interval.height = height;
+    for (interval.index = 0; xioctl(fd, VIDIOC_ENUM_FRAMEINTERVALS, &interval) == 0; interval.index++)
+    {
+        // the interval is in seconds (numerator/denominator), the shortest one is the highest rate
+        const v4l2_fract &shortest = (interval.type == V4L2_FRMIVAL_TYPE_DISCRETE) ? interval.discrete : interval.stepwise.min;
+        if (shortest.numerator > 0) fps = std::max(fps, static_cast<double>(shortest.denominator) / shortest.numerator);
+        if (interval.type != V4L2_FRMIVAL_TYPE_DISCRETE) break;
+    }
+    return fps;
+}
+#endif
+}
+
+#ifdef __linux__
+BmodeCameraEnumerator::CameraInfo BmodeCameraEnumerator::probeDevice(const std::string &path, int index)
+{
+    CameraInfo info;
+    int fd = open(path.c_str(), O_RDWR | O_NONBLOCK);
+    if (fd < 0) return info;
+
+    v4l2_capability capability;
+    std::memset(&capability, 0, sizeof(capability));
+    uint32_t caps = 0;
+    if (xioctl(fd, VIDIOC_QUERYCAP, &capability) == 0)
+        caps = (capability.capabilities & V4L2_CAP_DEVICE_CAPS) ? capability.device_caps : capability.capabilities;
+    if (!(caps & V4L2_CAP_VIDEO_CAPTURE))
+    {
+        close(fd);
+        return info;
+    }
+
+    info.index = index;
+    info.path  = path;
+    info.name  = reinterpret_cast<const char*>(capability.card);
+
+    // every pixel format, every size of the format, and the highest rate of every size
+    v4l2_fmtdesc format;
+    std::memset(&format, 0, sizeof(format));
+    format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    for (format.index = 0; xioctl(fd, VIDIOC_ENUM_FMT, &format) == 0; format.index++)
+    {
+        v4l2_frmsizeenum size;
+        std::memset(&size, 0, sizeof(size));
+        size.pixel_format = format.pixelformat;
+        for (size.index = 0; xioctl(fd, VIDIOC_ENUM_FRAMESIZES, &size) == 0; size.index++)
+        {
+            // a range of sizes (stepwise/continuous) is reported as its largest size
+            Mode mode;
+            mode.fourcc = format.pixelformat;
+            mode.width  = (size.type == V4L2_FRMSIZE_TYPE_DISCRETE) ? size.discrete.width  : size.stepwise.max_width;
+            mode.height = (size.type == V4L2_FRMSIZE_TYPE_DISCRETE) ? size.discrete.height : size.stepwise.max_height;
+            mode.fps    = maxFrameRate(fd, mode.fourcc, mode.width, mode.height);
+            info.modes.push_back(mode);
+            if (size.type != V4L2_FRMSIZE_TYPE_DISCRETE) break;
+        }
+    }
+
+    close(fd);
+    return info;
+}
+#else
+BmodeCameraEnumerator::CameraInfo BmodeCameraEnumerator::probeDevice(const std::string &path, int index)
+{
+    Q_UNUSED(path);
+    Q_UNUSED(index);
+    return CameraInfo();
+}
+#endif
+
+const BmodeCameraEnumerator::Mode* BmodeCameraEnumerator::CameraInfo::fastestMode() const
+{
+    const Mode *fastest = nullptr;
+    for (const Mode &mode : modes)
+    {
+        if (fastest == nullptr || mode.fps > fastest->fps ||
+            (mode.fps == fastest->fps && mode.width * mode.height > fastest->width * fastest->height))
+            fastest = &mode;
+    }
+    return fastest;
+}
+
+std::string BmodeCameraEnumerator::CameraInfo::toString() const
+{
+    std::stringstream ss;
+    ss << "Camera " << index << ":";
+    if (!name.empty()) ss << " " << name;
+
+    const Mode *mode = fastestMode();
+    if (mode != nullptr)
+    {
+        ss << (name.empty() ? " " : " (") << mode->width << "x" << mode->height;
+        if (mode->fourcc != 0) ss << " " << fourccToString(mode->fourcc);
+        if (mode->fps > 0) ss << " " << mode->fps << "fps";
+        if (!name.empty()) ss << ")";
+    }
+    return ss.str();
+}
+
+std::string BmodeCameraEnumerator::fourccToString(uint32_t fourcc)
+{
+    std::string text;
+    for (int i = 0; i < 4; i++)
+    {
+        char c = static_cast<char>((fourcc >> (8 * i)) & 0xFF);
+        if (c != ' ' && c != '\0') text += c;
+    }
+    return text;
+}
+
+std::vector<BmodeCameraEnumerator::CameraInfo> BmodeCameraEnumerator::enumerate(bool refresh, int timeout_ms)
+{
+    QMutexLocker locker(&cacheMutex);
+    if (!cacheValid || refresh)
+    {
+        cache = probeAll(timeout_ms);
+        cacheValid = true;
+    }
+    return cache;
+}
+
+#ifdef __linux__
+std::vector<BmodeCameraEnumerator::CameraInfo> BmodeCameraEnumerator::probeAll(int timeout_ms)
+{
+    // the device nodes /dev/videoN
+    std::vector<std::pair<std::string, int>> devices;
+    if (DIR *dir = opendir("/dev"))
+    {
+        while (dirent *entry = readdir(dir))
+        {
+            const char *name = entry->d_name;
+            if (std::strncmp(name, "video", 5) != 0 || name[5] == '\0') continue;
+            char *end = nullptr;
+            long index = std::strtol(name + 5, &end, 10);
+            if (*end != '\0') continue;
+            devices.emplace_back(std::string("/dev/") + name, static_cast<int>(index));
+        }
+        closedir(dir);
+    }
+
+    // Probe all of them at the same time. The threads are detached: a driver which hangs in an ioctl keeps its
+    // thread, but we don't wait for it longer than the timeout.
+    std::vector<std::future<CameraInfo>> results;
+    for (const auto &device : devices)
+    {
+        std::promise<CameraInfo> promise;
+        results.push_back(promise.get_future());
+        std::thread([device](std::promise<CameraInfo> promise) {
+            promise.set_value(probeDevice(device.first, device.second));
+        }, std::move(promise)).detach();
+    }
+
+    std::vector<CameraInfo> cameras;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    for (std::size_t i = 0; i < results.size(); i++)
+    {
+        if (results[i].wait_until(deadline) != std::future_status::ready)
+        {
+            qDebug() << "BmodeCameraEnumerator:" << QString::fromStdString(devices[i].first) << "didn't answer in" << timeout_ms << "ms";
+            continue;
+        }
+        CameraInfo info = results[i].get();
+        if (info.index >= 0) cameras.push_back(info);
+    }
+
+    std::sort(cameras.begin(), cameras.end(), [](const CameraInfo &a, const CameraInfo &b) { return a.index < b.index; });
+    return cameras;
+}
+#else
+std::vector<BmodeCameraEnumerator::CameraInfo> BmodeCameraEnumerator::probeAll(int timeout_ms)
+{
+    // No device nodes, we open the indices one after the other (OpenCV doesn't promise that opening several cameras
+    // from several threads is safe with every backend), and we only get the current mode. It is cached anyway.
+    Q_UNUSED(timeout_ms);
+    std::vector<CameraInfo> cameras;
+    for (int i = 0; i < MAX_CAMERAS; ++i)
+    {
+        cv::VideoCapture camera(i);
+        if (!camera.isOpened()) continue;
+
+        CameraInfo info;
+        info.index = i;
+        Mode mode;
+        mode.fourcc = static_cast<uint32_t>(camera.get(cv::CAP_PROP_FOURCC));
+        mode.width  = static_cast<int>(camera.get(cv::CAP_PROP_FRAME_WIDTH));
+        mode.height = static_cast<int>(camera.get(cv::CAP_PROP_FRAME_HEIGHT));
+        mode.fps    = camera.get(cv::CAP_PROP_FPS);
+        info.modes.push_back(mode);
+        camera.release();
+
+        cameras.push_back(info);
+    }
+    return cameras;
+}
+#endif
@@ -0,0 +1,93 @@
+#ifndef BMODECAMERAENUMERATOR_H
+#define BMODECAMERAENUMERATOR_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @class BmodeCameraEnumerator
+ * @brief Lists the cameras (frame grabbers) of the PC with their native capture modes, without opening them for capture.
+ *
+ * For the context. BmodeConnection::getAllCameraInfo() used to open a cv::VideoCapture on the indices 0..9, one after
+ * the other. Every index without a camera costs a failed open (hundreds of ms on Linux), so filling the camera combo
+ * box took seconds at startup, and we only got the current resolution, not what the camera can do.
+ *
+ * On Linux the cameras are the V4L2 device nodes (/dev/videoN, N is the index of cv::VideoCapture). They are all
+ * probed at the same time, each in its own thread, with ioctls only (the name, and every pixel format, frame size
+ * and frame rate the driver reports), nothing is streamed. A device which doesn't answer before the timeout is left
+ * out. The nodes which can't capture video (e.g. the metadata nodes of UVC cameras) are skipped.
+ *
+ * On the other systems there is no such interface in OpenCV, there we still open cv::VideoCapture on the indices, and
+ * only the current mode is reported.
+ *
+ * The list is cached after the first call, enumerate(true) probes again (e.g. after plugging a frame grabber).
+ *
+ */
+
+class BmodeCameraEnumerator
+{
+public:
+
+    /**
+     * @brief A capture mode: pixel format, frame size, and the highest frame rate for it
+     */
+    struct Mode
+    {
+        uint32_t fourcc = 0;    //!< The pixel format (e.g. YUYV, MJPG), see fourccToString()
+        int width = 0;          //!< [pixel]
+        int height = 0;         //!< [pixel]
+        double fps = 0.0;       //!< [Hz] The highest frame rate of this format and size, 0 if unknown
+    };
+
+    /**
+     * @brief A camera and everything it can do
+     */
+    struct CameraInfo
+    {
+        int index = -1;             //!< The index for cv::VideoCapture
+        std::string name;           //!< The name of the device (from the driver)
+        std::string path;           //!< The device node (Linux), empty otherwise
+        std::vector<Mode> modes;    //!< The native modes
+
+        /**
+         * @brief GET the mode with the highest frame rate (the largest one if several have the same rate), nullptr if none
+         */
+        const Mode* fastestMode() const;
+
+        /**
+         * @brief GET a short description for the user, e.g. "Camera 0: AV.io HDMI (1920x1080 YUYV 60fps)"
+         */
+        std::string toString() const;
+    };
+
+    /**
+     * @brief GET all the cameras, probed in parallel the first time (or if refresh), then from the cache.
+     *
+     * @param refresh     Probe again instead of using the cache
+     * @param timeout_ms  [ms] How long to wait for all the devices
+     */
+    static std::vector<CameraInfo> enumerate(bool refresh = false, int timeout_ms = 1000);
+
+    /**
+     * @brief GET everything about one device node (Linux), without the cache. index is -1 if it is not a video capture
+     * device, or on the other systems.
+     */
+    static CameraInfo probeDevice(const std::string &path, int index);
+
+    /**
+     * @brief GET the four characters of a pixel format, e.g. "YUYV"
+     */
+    static std::string fourccToString(uint32_t fourcc);
+
+    static const int MAX_CAMERAS = 10;  //!< The indices probed on the systems without V4L2
+
+private:
+
+    /**
+     * @brief Probe all the cameras, the platform specific part
+     */
+    static std::vector<CameraInfo> probeAll(int timeout_ms);
+};
+
+#endif // BMODECAMERAENUMERATOR_H
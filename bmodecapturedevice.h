@@ -0,0 +1,88 @@
+#ifndef BMODECAPTUREDEVICE_H
+#define BMODECAPTUREDEVICE_H
+
+#include <opencv2/core.hpp>
+
+#include <cstdint>
+#include <string>
+
+/**
+ * @class BmodeCaptureDevice
+ * @brief The interface of the ways BmodeGrabWorker can read the frame grabber (OpenCV, or V4L2 directly on Linux).
+ *
+ * For the context. BmodeGrabWorker only needs three things from the camera: wait for the next image and when it was
+ * captured, its gray region of interest (for the BmodeFrame), and once in a while the whole image in color (for
+ * BmodeRoiDetector). How the image gets there is the business of the backend: BmodeOpenCvCapture goes through
+ * cv::VideoCapture (every system, every format), BmodeV4l2Capture reads the mmap'd buffers of the driver and converts
+ * the roi straight from the raw pixels (Linux, uncompressed formats only).
+ *
+ * A device is only used from one thread (the worker thread).
+ *
+ */
+
+class BmodeCaptureDevice
+{
+public:
+
+    /**
+     * @brief The backends, BACKEND_AUTO is V4L2 if it can open the camera, OpenCV otherwise
+     */
+    enum Backend
+    {
+        BACKEND_AUTO = 0,
+        BACKEND_OPENCV,
+        BACKEND_V4L2
+    };
+
+    virtual ~BmodeCaptureDevice() {}
+
+    /**
+     * @brief Open the camera, index is the one of cv::VideoCapture (N of /dev/videoN on Linux)
+     */
+    virtual bool open(int index) = 0;
+
+    /**
+     * @brief Close the camera, nothing happens if it is not open
+     */
+    virtual void close() = 0;
+
+    /**
+     * @brief GET true if the camera is open
+     */
+    virtual bool isOpened() const = 0;
+
+    /**
+     * @brief Wait for the next image. timestamp is when it was captured [ns], host monotonic clock (steady_clock).
+     * The image stays valid until the next call of grab() or close().
+     */
+    virtual bool grab(int64_t &timestamp) = 0;
+
+    /**
+     * @brief GET true if the timestamp of grab() is when the device captured the image (the driver's timestamp), false
+     * if it is only when grab() returned. BmodeGrabWorker models the clock from the arrival times in that case.
+     */
+    virtual bool isCaptureTimestamp() const = 0;
+
+    /**
+     * @brief GET the size of the grabbed image [pixel]
+     */
+    virtual cv::Size size() const = 0;
+
+    /**
+     * @brief Write the gray image of roi of the grabbed image into output (CV_8UC1, the size of roi, already allocated),
+     * returns 1 if done, 0 otherwise (see BmodeGrayConverter)
+     */
+    virtual int retrieveGray(const cv::Rect &roi, cv::Mat &output) = 0;
+
+    /**
+     * @brief GET the whole grabbed image, BGR (or gray if the camera has no color), for BmodeRoiDetector
+     */
+    virtual bool retrieve(cv::Mat &image) = 0;
+
+    /**
+     * @brief GET the name of the backend and the format, for the log, e.g. "V4L2 YUYV 1920x1080"
+     */
+    virtual std::string description() const = 0;
+};
+
+#endif // BMODECAPTUREDEVICE_H
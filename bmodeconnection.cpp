@@ -1,100 +1,192 @@
-#include "BmodeConnection.h"
+#include "bmodeconnection.h"
+
+#include <QDebug>
+#include <algorithm>
+#include <chrono>
 
 BmodeConnection::BmodeConnection(QObject *parent) : QObject(parent) {
     // set the roi
     roi = cv::Rect(662, 0, 840, 900);
     // roi = cv::Rect(0, 0, 320, 480);
-    // declare a timer
-    frameTimer = new QTimer(this);
 
-    // connect the timer to processframe() function. If the camera is not open
-    // yet, this function basically does nothing.
-    connect(frameTimer, &QTimer::timeout, this, &BmodeConnection::processFrame);
+    // the frames are sent across threads, Qt needs to know the type
+    qRegisterMetaType<BmodeFramePtr>();
+
+    // The worker grabs the camera in its own thread. If the camera is not open yet, it basically does nothing.
+    worker_ = new BmodeGrabWorker(roi);
+    worker_->moveToThread(&m_workerThread);
+    connect(&m_workerThread, &QThread::finished, worker_, &QObject::deleteLater);
+    connect(worker_, &BmodeGrabWorker::frameAvailable, this, &BmodeConnection::onFrameAvailable, Qt::QueuedConnection);
+    connect(worker_, &BmodeGrabWorker::roiDetected, this, &BmodeConnection::onRoiDetected, Qt::QueuedConnection);
+    connect(worker_, &BmodeGrabWorker::errorOccurred, this, [this](const QString &message) {
+        qDebug() << "BmodeConnection:" << message;
+        stopImageStream();
+    }, Qt::QueuedConnection);
+    m_workerThread.start();
+
+    // the statistics are computed once per second while streaming
+    statisticsTimer = new QTimer(this);
+    connect(statisticsTimer, &QTimer::timeout, this, &BmodeConnection::updateStatistics);
 }
 
 std::string BmodeConnection::getCameraInfo(int index) {
-    cv::VideoCapture camera(index);
-
-    if (!camera.isOpened()) {
-        return "Not available";
+    // from the list of cameras, nothing is opened again
+    for (const BmodeCameraEnumerator::CameraInfo &camera : getCameras()) {
+        if (camera.index == index) return camera.toString();
     }
-
-    int width = static_cast<int>(camera.get(cv::CAP_PROP_FRAME_WIDTH));
-    int height = static_cast<int>(camera.get(cv::CAP_PROP_FRAME_HEIGHT));
-    double fps = camera.get(cv::CAP_PROP_FPS);
-
-    std::stringstream ss;
-    ss << width << "x" << height;
-
-    // std::stringstream ss;
-    // ss << width << "x" << height << "|" << std::fixed << std::setprecision(1) << fps << "fps";
-
-    // cv::Mat frame;
-    // if (camera.read(frame)) {
-    //     ss << "|" << frame.channels() << "ch|" << (8 * frame.elemSize1()) << "bit";
-    // }
-
-    camera.release();
-    return ss.str();
+    return "Not available";
 }
 
 std::vector<std::string> BmodeConnection::getAllCameraInfo()
 {
     std::vector<std::string> allCameraInfo;
-    const int MAX_CAMERAS = 10; // Adjust this value based on your system
-
-    for (int i = 0; i < MAX_CAMERAS; ++i) {
-        std::string cameraInfo = getCameraInfo(i);
-        if (cameraInfo != "Not available") {
-            std::stringstream ss;
-            ss << "Camera " << i << ": " << cameraInfo;
-            allCameraInfo.push_back(ss.str());
-        }
+    for (const BmodeCameraEnumerator::CameraInfo &camera : getCameras()) {
+        allCameraInfo.push_back(camera.toString());
     }
-
     return allCameraInfo;
 }
 
+std::vector<BmodeCameraEnumerator::CameraInfo> BmodeConnection::getCameras(bool refresh)
+{
+    return BmodeCameraEnumerator::enumerate(refresh);
+}
+
 BmodeConnection::~BmodeConnection() {
     stopImageStream();
     closeCamera();
+
+    // the worker is deleted when the thread finished
+    m_workerThread.quit();
+    m_workerThread.wait();
+}
+
+void BmodeConnection::setBackend(BmodeCaptureDevice::Backend backend) {
+    backend_ = backend;
 }
 
 bool BmodeConnection::openCamera(int cameraIndex) {
-    if(camera.open(cameraIndex)) {
-        return true;
-    }
-    return false;
+    // the camera belongs to the worker thread, so we ask the worker to open it and wait for the answer
+    stopImageStream();
+    bool status = false;
+    QMetaObject::invokeMethod(worker_, "openCamera", Qt::BlockingQueuedConnection,
+                              Q_RETURN_ARG(bool, status), Q_ARG(int, cameraIndex), Q_ARG(int, static_cast<int>(backend_)));
+    cameraopen_ = status;
+    return status;
 }
 
 void BmodeConnection::closeCamera() {
-    if(camera.isOpened()) {
-        camera.release();
-    }
+    if(!cameraopen_) return;
+    stopImageStream();
+    QMetaObject::invokeMethod(worker_, "closeCamera", Qt::BlockingQueuedConnection);
+    cameraopen_ = false;
 }
 
 void BmodeConnection::startImageStream() {
-    if(camera.isOpened()) {
-        frameTimer->start(30); // Set the interval in milliseconds (e.g., 30ms for ~33 fps)
-    }
+    if(!cameraopen_ || streaming_) return;
+
+    // The grab loop occupies the worker thread until stopImageStream(). The flag is set before the loop is queued, so
+    // that a stopImageStream() before the loop started is not lost.
+    statistics_ = Statistics();
+    latencysum_ = latencymax_ = 0.0;
+    nlatency_ = 0;
+    lastgrabbed_ = worker_->getFramesGrabbed();
+    lastprocessing_ = worker_->getProcessingTime();
+    lastupdate_ = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    worker_->start();
+    QMetaObject::invokeMethod(worker_, "grabLoop", Qt::QueuedConnection);
+    statisticsTimer->start(1000);
+    streaming_ = true;
 }
 
 void BmodeConnection::stopImageStream() {
-    if(frameTimer->isActive()) {
-        frameTimer->stop();
-    }
+    if(!streaming_) return;
+
+    // The loop sees the flag after the current image at the latest. The empty call is queued behind the loop, so when
+    // it returns the worker is not grabbing anymore.
+    worker_->stop();
+    QMetaObject::invokeMethod(worker_, []{}, Qt::BlockingQueuedConnection);
+    statisticsTimer->stop();
+    streaming_ = false;
 }
 
-void BmodeConnection::processFrame() {
-    cv::Mat frame;
-    if(camera.read(frame)) {
-        // Perform cropping and simple image processing here
-        frame = frame(roi);
+int64_t BmodeConnection::getImageTimestamp() const {
+    return timestamp_;
+}
+
+BmodeConnection::Statistics BmodeConnection::getStatistics() const {
+    return statistics_;
+}
+
+void BmodeConnection::setRoi(const cv::Rect &newroi) {
+    roi = newroi;
+    worker_->setRoi(roi);
+}
+
+cv::Rect BmodeConnection::getRoi() const {
+    return roi;
+}
 
-        // For example, convert to grayscale:
-        cv::cvtColor(frame, processedImage, cv::COLOR_BGR2GRAY);
+int BmodeConnection::loadRoi(const QString &filename) {
+    cv::Rect configroi = BmodeRoiDetector::loadFromPlusConfig(filename);
+    if(configroi.empty()) return 0;
 
-        // Emit the signal with the processed image
-        emit imageProcessed(processedImage);
+    qDebug() << "BmodeConnection: roi from the configuration" << configroi.x << configroi.y << configroi.width << configroi.height;
+    setRoi(configroi);
+    return 1;
+}
+
+void BmodeConnection::detectRoi() {
+    worker_->detectRoi();
+}
+
+void BmodeConnection::onRoiDetected(const QRect &detected) {
+    // the worker already uses it, we only keep it for getRoi()
+    if(detected.isEmpty()) {
+        qDebug() << "BmodeConnection: unable to detect the roi, keeping" << roi.x << roi.y << roi.width << roi.height;
+        return;
     }
+    roi = cv::Rect(detected.x(), detected.y(), detected.width(), detected.height());
+    qDebug() << "BmodeConnection: detected roi" << roi.x << roi.y << roi.width << roi.height;
+}
+
+void BmodeConnection::onFrameAvailable() {
+    // take the latest image, the next one may notify us again
+    worker_->acknowledgeFrame();
+    BmodeFramePtr frame;
+    if(!worker_->readLatest(frame)) return;
+
+    // the latency of the image, from the capture until it is handed to the consumers
+    int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    double latency = (now - frame->getTimestamp()) * 1.0e-6;
+    latencysum_ += latency;
+    latencymax_  = std::max(latencymax_, latency);
+    nlatency_++;
+
+    // Emit the signal with the processed image, every consumer gets the same frame
+    timestamp_ = frame->getTimestamp();
+    emit imageProcessed(frame);
+}
+
+void BmodeConnection::updateStatistics() {
+    int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    uint64_t grabbed = worker_->getFramesGrabbed();
+    int64_t processing = worker_->getProcessingTime();
+    double elapsed = (now - lastupdate_) * 1.0e-9;
+
+    statistics_.frameRate      = (elapsed > 0) ? (grabbed - lastgrabbed_) / elapsed : 0.0;
+    statistics_.latencyMean    = (nlatency_ > 0) ? latencysum_ / nlatency_ : 0.0;
+    statistics_.latencyMax     = latencymax_;
+    statistics_.processingTime = (grabbed > lastgrabbed_) ? (processing - lastprocessing_) * 1.0e-6 / (grabbed - lastgrabbed_) : 0.0;
+    statistics_.dropped        = worker_->getFramesDropped();
+    statistics_.failures       = worker_->getGrabFailures();
+    statistics_.allocations    = worker_->getAllocations();
+    statistics_.clock          = worker_->getClockEstimate();
+
+    lastgrabbed_ = grabbed;
+    lastprocessing_ = processing;
+    lastupdate_ = now;
+    latencysum_ = latencymax_ = 0.0;
+    nlatency_ = 0;
+
+    emit statisticsUpdated(statistics_);
 }
@@ -2,9 +2,13 @@
 #define BMODECONNECTION_H
 
 #include <QObject>
+#include <QThread>
 #include <QTimer>
 #include <opencv2/opencv.hpp>
 
+#include "bmodecameraenumerator.h"
+#include "bmodegrabworker.h"
+
 /**
  * @class BmodeConnection
  * @brief A class which handle the communcation with the B-mode machine.
@@ -15,12 +19,43 @@
  * ultrasound image. The code is practically the same as how we grab a frame from our webcam. So, for testing the
  * software, we can always choose the port to our webcam port, and the software will run just fine.
  *
+ * The camera itself is grabbed by BmodeGrabWorker in its own thread, at the rate of the frame grabber (60 fps for the
+ * Epiphan), so the GUI doesn't decode anything. Here we only take the latest image from the worker and emit it with
+ * imageProcessed(), the images in between are dropped. Every image has the time it was captured (getImageTimestamp()),
+ * and once per second the rate, the latency (from the capture until it is emitted here) and the dropped images are
+ * emitted with statisticsUpdated().
+ *
+ * By default the camera is read with cv::VideoCapture (BmodeOpenCvCapture) and the capture time is when the grab
+ * returned. On Linux, setBackend(BACKEND_V4L2) (or BACKEND_AUTO, V4L2 if the camera gives a raw format, OpenCV
+ * otherwise) reads it through V4L2 directly (BmodeV4l2Capture), then the capture time is the one of the driver and
+ * the latency is really from the capture to the signal. V4L2 stays opt-in until tools/v4l2test has passed with our
+ * frame grabbers.
+ *
+ * The region of interest (the part of the screen of the B-mode machine which is the image) can be loaded from the
+ * Plus configuration (loadRoi()), or detected from the first images of the stream (detectRoi()), see BmodeRoiDetector.
+ * If neither is done, or both fail, it is the one of our machine, set in the constructor.
+ *
  */
 
 class BmodeConnection : public QObject {
     Q_OBJECT
 
 public:
+    /**
+     * @brief The statistics of the stream, of the last second
+     */
+    struct Statistics
+    {
+        double frameRate = 0.0;         //!< [fps] Images grabbed per second
+        double latencyMean = 0.0;       //!< [ms] From the capture until imageProcessed() is emitted, mean
+        double latencyMax = 0.0;        //!< [ms] The same, maximum
+        double processingTime = 0.0;    //!< [ms] Crop and gray in the worker, mean
+        uint64_t dropped = 0;           //!< Images the GUI didn't take, since the camera was opened
+        uint64_t failures = 0;          //!< Failed grabs, since the camera was opened
+        uint64_t allocations = 0;       //!< Frames the pool had to allocate, since the camera was opened (0 unless recording)
+        ClockModel::Estimate clock;     //!< The clock of the frame grabber, see ClockModel (the minimum latency is the offset with the driver's timestamp)
+    };
+
     /**
      * @brief Default constructor function, it also initialize the area where we need to crop the B-mode machine screen.
      */
@@ -32,15 +67,25 @@ public:
     ~BmodeConnection();
 
     /**
-     * @brief GET the camera information given the index of the camera port
+     * @brief GET the camera information given the index of the camera port, "Not available" if there is no such camera
      */
     std::string getCameraInfo(int index);
 
     /**
-     * @brief GET all of the camera information, with n=MAX_CAMERAS
+     * @brief GET all of the camera information, one text for every camera (see BmodeCameraEnumerator)
      */
     std::vector<std::string> getAllCameraInfo();
 
+    /**
+     * @brief GET all the cameras with their native modes, cached after the first call (see BmodeCameraEnumerator)
+     */
+    std::vector<BmodeCameraEnumerator::CameraInfo> getCameras(bool refresh = false);
+
+    /**
+     * @brief SET how the camera is read (BmodeCaptureDevice::Backend), from the next openCamera() on
+     */
+    void setBackend(BmodeCaptureDevice::Backend backend);
+
     /**
      * @brief Opening the camera port
      */
@@ -61,26 +106,84 @@ public:
      */
     void stopImageStream();
 
+    /**
+     * @brief GET the time when the last emitted image was captured [ns], host monotonic clock (same as the A-mode frames)
+     */
+    int64_t getImageTimestamp() const;
+
+    /**
+     * @brief GET the statistics of the last second
+     */
+    Statistics getStatistics() const;
+
+    /**
+     * @brief SET the region of interest of the B-mode screen, it can be changed while streaming
+     */
+    void setRoi(const cv::Rect &roi);
+
+    /**
+     * @brief GET the region of interest of the B-mode screen
+     */
+    cv::Rect getRoi() const;
+
+    /**
+     * @brief Load the region of interest from a Plus configuration file (see BmodeRoiDetector::loadFromPlusConfig()),
+     * returns 1 if the file has one, 0 otherwise (the region of interest doesn't change)
+     */
+    int loadRoi(const QString &filename);
+
+    /**
+     * @brief Detect the region of interest from the next images of the stream, no image is emitted until it is done
+     */
+    void detectRoi();
+
 signals:
     /**
-     * @brief A signal which emits the processed image everytime we finish processing the image.
+     * @brief A signal which emits the processed image everytime we finish processing the image. The frame is shared by
+     * all the consumers (no copy), it is read-only, and it goes back to the pool when nobody holds it anymore.
      */
-    void imageProcessed(const cv::Mat &image);
+    void imageProcessed(const BmodeFramePtr &frame);
+
+    /**
+     * @brief Emitted once per second while streaming, with the statistics of the last second
+     */
+    void statisticsUpdated(const BmodeConnection::Statistics &statistics);
 
 private slots:
     /**
-     * @brief A slot which will be called everytime there is a new image arriving.
+     * @brief A slot which will be called everytime the worker has a new image.
+     */
+    void onFrameAvailable();
+
+    /**
+     * @brief Computes the statistics of the last second, called by statisticsTimer
      */
-    void processFrame();
+    void updateStatistics();
+
+    /**
+     * @brief Called when the worker is done detecting the region of interest, roi is empty if it found nothing
+     */
+    void onRoiDetected(const QRect &roi);
 
 private:
-    cv::VideoCapture camera;    //!< Stores the camera object
-    cv::Mat processedImage;     //!< Stores the image data
     cv::Rect roi;               //!< A region of interest (cv::Rect object) which defines the cropping of the B-mode screen
 
-    const int MAX_CAMERAS = 10; //!< The maximum number of camera that can be listed
-
-    QTimer *frameTimer;         //!< A timer, in which we will check the arriving image.
+    BmodeGrabWorker *worker_;   //!< Grabs the camera, lives in m_workerThread
+    QThread m_workerThread;     //!< The thread of the worker
+    bool cameraopen_ = false;   //!< True if the worker opened the camera
+    bool streaming_ = false;    //!< True while the worker is in its grab loop
+    BmodeCaptureDevice::Backend backend_ = BmodeCaptureDevice::BACKEND_OPENCV; //!< See setBackend()
+
+    int64_t timestamp_ = 0;     //!< [ns] The time the last emitted image was captured
+    double latencysum_ = 0.0;   //!< [ms] Sum of the latency in the current second
+    double latencymax_ = 0.0;   //!< [ms] Maximum of the latency in the current second
+    uint64_t nlatency_ = 0;     //!< Number of images in latencysum_
+    uint64_t lastgrabbed_ = 0;  //!< The number of grabbed images at the last updateStatistics()
+    int64_t lastprocessing_ = 0; //!< [ns] The processing time of the worker at the last updateStatistics()
+    int64_t lastupdate_ = 0;    //!< [ns] The time of the last updateStatistics()
+    Statistics statistics_;     //!< The statistics of the last second
+
+    QTimer *statisticsTimer;    //!< Fires every second while streaming, see updateStatistics()
 };
 
 #endif // BMODECONNECTION_H
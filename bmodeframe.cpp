@@ -0,0 +1,131 @@
+#include "bmodeframe.h"
+#include "bmodeframepool.h"
+
+BmodeFrame::BmodeFrame(int width, int height)
+    : image_(width, height, QImage::Format_Grayscale8)
+{
+    image_.fill(0);
+}
+
+BmodeFrame::~BmodeFrame()
+{
+}
+
+cv::Mat BmodeFrame::image() const
+{
+    // a header only, the pixels stay in image_ (OpenCV doesn't count the references of external data)
+    return cv::Mat(image_.height(), image_.width(), CV_8UC1, const_cast<uchar*>(image_.constBits()), image_.bytesPerLine());
+}
+
+QImage BmodeFrame::toQImage(const BmodeFramePtr &frame)
+{
+    // a copy of the QImage only counts one more reference of its pixels
+    if (!frame) return QImage();
+    return frame->image_;
+}
+
+const uint8_t* BmodeFrame::data() const
+{
+    return image_.constBits();
+}
+
+int BmodeFrame::getWidth() const
+{
+    return image_.width();
+}
+
+int BmodeFrame::getHeight() const
+{
+    return image_.height();
+}
+
+int BmodeFrame::getStep() const
+{
+    return static_cast<int>(image_.bytesPerLine());
+}
+
+int64_t BmodeFrame::getTimestamp() const
+{
+    return timestamp_ns_;
+}
+
+uint64_t BmodeFrame::getSequence() const
+{
+    return sequence_;
+}
+
+cv::Mat BmodeFrame::writableImage()
+{
+    // bits() detaches if a consumer still has a QImage of the previous content, otherwise it is the same pixels
+    return cv::Mat(image_.height(), image_.width(), CV_8UC1, image_.bits(), image_.bytesPerLine());
+}
+
+void BmodeFrame::setTimestamp(int64_t timestamp_ns)
+{
+    timestamp_ns_ = timestamp_ns;
+}
+
+void BmodeFrame::setSequence(uint64_t sequence)
+{
+    sequence_ = sequence;
+}
+
+
+BmodeFramePtr::BmodeFramePtr(BmodeFrame *frame)
+    : frame_(frame)
+{
+    if (frame_) frame_->refcount_.fetch_add(1, std::memory_order_relaxed);
+}
+
+BmodeFramePtr::BmodeFramePtr(const BmodeFramePtr& other)
+    : frame_(other.frame_)
+{
+    if (frame_) frame_->refcount_.fetch_add(1, std::memory_order_relaxed);
+}
+
+BmodeFramePtr::BmodeFramePtr(BmodeFramePtr&& other) noexcept
+    : frame_(other.frame_)
+{
+    other.frame_ = nullptr;
+}
+
+BmodeFramePtr& BmodeFramePtr::operator=(const BmodeFramePtr& other)
+{
+    if (frame_ != other.frame_)
+    {
+        BmodeFramePtr copy(other);
+        std::swap(frame_, copy.frame_);
+    }
+    return *this;
+}
+
+BmodeFramePtr& BmodeFramePtr::operator=(BmodeFramePtr&& other) noexcept
+{
+    if (this != &other)
+    {
+        reset();
+        frame_ = other.frame_;
+        other.frame_ = nullptr;
+    }
+    return *this;
+}
+
+BmodeFramePtr::~BmodeFramePtr()
+{
+    reset();
+}
+
+void BmodeFramePtr::reset()
+{
+    if (frame_ == nullptr) return;
+
+    // Same as AmodeFramePtr::reset(), the pool is moved out of the frame first, because giving back the last frame of
+    // a pool whose owner is already gone destroys the pool
+    BmodeFrame *frame = frame_;
+    frame_ = nullptr;
+    if (frame->refcount_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        std::shared_ptr<BmodeFramePool> pool = std::move(frame->pool_);
+        pool->recycle(frame);
+    }
+}
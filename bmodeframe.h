@@ -0,0 +1,143 @@
+#ifndef BMODEFRAME_H
+#define BMODEFRAME_H
+
+#include <QImage>
+#include <QMetaType>
+#include <opencv2/core.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+class BmodeFramePool;
+class BmodeFramePtr;
+
+/**
+ * @class BmodeFrame
+ * @brief One cropped gray B-mode image, shared by all the consumers without copying (the same idea as AmodeFrame).
+ *
+ * For the context. Previously every consumer of the B-mode stream made its own copy of every image: MHAWriter copied
+ * it (copyTo()) to keep it for the recording, Bmode3DVisualizer copied it again into a QImage for the texture, and the
+ * capture allocated new cv::Mat for every frame too.
+ *
+ * Now the grab thread (BmodeGrabWorker) writes the image once into a BmodeFrame taken from a BmodeFramePool, which
+ * has the size of the region of interest, and hands out a BmodeFramePtr. The 2d display, the 3d visualizer and the
+ * recorder all hold the same frame, read-only, and when the last BmodeFramePtr is gone the frame goes back to the pool.
+ *
+ * The pixels are a QImage (Format_Grayscale8), allocated once with the frame. image() gives a cv::Mat which points to
+ * them (no copy, no reference counting of OpenCV, so it is only valid as long as the frame is held), and toQImage()
+ * gives a copy of the QImage, which Qt shares (no copy of the pixels, and no allocation either, a QImage on external
+ * pixels would allocate its QImageData at every call). If a consumer still has such a QImage when the frame is filled
+ * again, writableImage() detaches the frame from it (Qt copies the pixels), so a QImage never changes under its owner.
+ * That only happens if a QImage outlives its BmodeFramePtr, hold the frame as long as the image is used.
+ *
+ * Every row starts at a multiple of 4 bytes (getStep()), QImage does that already.
+ *
+ */
+
+class BmodeFrame
+{
+public:
+
+    /**
+     * @brief GET the image, a cv::Mat header on the pixels (CV_8UC1). Don't write into it, valid as long as the frame is held.
+     */
+    cv::Mat image() const;
+
+    /**
+     * @brief GET the QImage (Format_Grayscale8) of the frame, shared (no copy, no allocation). Null without frame.
+     */
+    static QImage toQImage(const BmodeFramePtr &frame);
+
+    /**
+     * @brief GET the pixels, getHeight() rows of getStep() bytes
+     */
+    const uint8_t* data() const;
+
+    /**
+     * @brief GET the size of the image [pixel], and the number of bytes of every row
+     */
+    int getWidth() const;
+    int getHeight() const;
+    int getStep() const;
+
+    /**
+     * @brief GET the host monotonic time when the image was grabbed [ns] (the same clock as AmodeFrame::getTimestamp())
+     */
+    int64_t getTimestamp() const;
+
+    /**
+     * @brief GET the number of the image, counted by the producer
+     */
+    uint64_t getSequence() const;
+
+    /**
+     * @brief [Producer only] Fill the frame, before it is handed to anybody else. writableImage() once per image, it
+     * detaches the pixels from the QImage of a consumer that still has one (see the class description).
+     */
+    cv::Mat writableImage();
+    void setTimestamp(int64_t timestamp_ns);
+    void setSequence(uint64_t sequence);
+
+    ~BmodeFrame();
+
+private:
+    friend class BmodeFramePool;
+    friend class BmodeFramePtr;
+
+    /**
+     * @brief Constructor function, only the pool creates frames
+     */
+    BmodeFrame(int width, int height);
+
+    QImage image_;                          //!< The pixels, allocated once (unless a consumer keeps an old QImage)
+    int64_t timestamp_ns_ = 0;              //!< Grab time [ns]
+    uint64_t sequence_ = 0;                 //!< Image number from the producer
+
+    std::atomic<int> refcount_{0};          //!< The number of BmodeFramePtr pointing to this frame
+    std::shared_ptr<BmodeFramePool> pool_;  //!< Where the frame goes back, keeps the pool alive while the frame is out
+};
+
+/**
+ * @class BmodeFramePtr
+ * @brief Reference-counted pointer to a const BmodeFrame. Copying it is cheap (no copy of the pixels).
+ */
+class BmodeFramePtr
+{
+public:
+    BmodeFramePtr() = default;
+    BmodeFramePtr(const BmodeFramePtr& other);
+    BmodeFramePtr(BmodeFramePtr&& other) noexcept;
+    BmodeFramePtr& operator=(const BmodeFramePtr& other);
+    BmodeFramePtr& operator=(BmodeFramePtr&& other) noexcept;
+    ~BmodeFramePtr();
+
+    const BmodeFrame* get() const { return frame_; }
+    const BmodeFrame* operator->() const { return frame_; }
+    const BmodeFrame& operator*() const { return *frame_; }
+    explicit operator bool() const { return frame_ != nullptr; }
+
+    /**
+     * @brief Let go of the frame (it goes back to the pool if nobody else holds it)
+     */
+    void reset();
+
+    /**
+     * @brief [Producer only] Writable access, only before the pointer is shared with anybody.
+     */
+    BmodeFrame* writable() const { return frame_; }
+
+private:
+    friend class BmodeFramePool;
+
+    /**
+     * @brief Only the pool makes a pointer from a raw frame
+     */
+    explicit BmodeFramePtr(BmodeFrame *frame);
+
+    BmodeFrame *frame_ = nullptr;           //!< The frame, nullptr if none
+};
+
+Q_DECLARE_METATYPE(BmodeFramePtr)
+
+#endif // BMODEFRAME_H
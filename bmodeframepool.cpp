@@ -0,0 +1,87 @@
+#include "bmodeframepool.h"
+
+#include <algorithm>
+
+std::shared_ptr<BmodeFramePool> BmodeFramePool::create(int width, int height, int nframes)
+{
+    return std::shared_ptr<BmodeFramePool>(new BmodeFramePool(width, height, nframes));
+}
+
+BmodeFramePool::BmodeFramePool(int width, int height, int nframes)
+    : width_(std::max(width, 1)), height_(std::max(height, 1)), nframes_(std::max(nframes, 1))
+{
+    // Allocate everything now, recycle() never allocates because free_ already has the room for all frames
+    free_.reserve(nframes_);
+    for (int i = 0; i < nframes_; i++) free_.push_back(new BmodeFrame(width_, height_));
+    count_ = nframes_;
+}
+
+BmodeFramePool::~BmodeFramePool()
+{
+    // the frames which are out hold the pool, so when we are here every frame is back
+    for (BmodeFrame *frame : free_) delete frame;
+}
+
+BmodeFramePtr BmodeFramePool::acquire()
+{
+    BmodeFrame *frame = nullptr;
+    {
+        QMutexLocker locker(&mutex_);
+        if (!free_.empty())
+        {
+            frame = free_.back();
+            free_.pop_back();
+        }
+        else
+        {
+            count_++;
+        }
+    }
+
+    // All the frames are out (recording), allocate outside of the lock, the grab thread is the only one waiting for it
+    if (frame == nullptr)
+    {
+        frame = new BmodeFrame(width_, height_);
+        allocations_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    frame->pool_ = shared_from_this();
+    return BmodeFramePtr(frame);
+}
+
+void BmodeFramePool::recycle(BmodeFrame *frame)
+{
+    {
+        QMutexLocker locker(&mutex_);
+        if (static_cast<int>(free_.size()) < nframes_)
+        {
+            free_.push_back(frame);
+            return;
+        }
+        count_--;
+    }
+
+    // an extra frame from a recording, the pool is back to nframes_ free frames without it
+    delete frame;
+}
+
+int BmodeFramePool::getNframes() const
+{
+    QMutexLocker locker(&mutex_);
+    return count_;
+}
+
+uint64_t BmodeFramePool::getAllocations() const
+{
+    return allocations_.load(std::memory_order_relaxed);
+}
+
+int BmodeFramePool::getWidth() const
+{
+    return width_;
+}
+
+int BmodeFramePool::getHeight() const
+{
+    return height_;
+}
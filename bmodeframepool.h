@@ -0,0 +1,82 @@
+#ifndef BMODEFRAMEPOOL_H
+#define BMODEFRAMEPOOL_H
+
+#include <QMutex>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "bmodeframe.h"
+
+/**
+ * @class BmodeFramePool
+ * @brief Preallocated BmodeFrame objects of one image size, which are given out with acquire() and come back automatically.
+ *
+ * For the context. See BmodeFrame, this is the same as AmodeFramePool. The grab thread calls acquire() for every
+ * image, fills it, and shares the BmodeFramePtr. When the last BmodeFramePtr of a frame is gone, the frame comes back.
+ *
+ * The difference with AmodeFramePool is what happens if all the frames are out. The recorder (MHAWriter) keeps every
+ * image of a recording until the file is written, so here the pool always grows, it never returns an empty pointer.
+ * When those extra frames come back and the pool already has its nframes free frames, they are deleted, so after a
+ * recording the memory goes back to nframes images. Without recording, nframes is plenty (the display, the 3d
+ * visualizer and the latest slot of the grab thread hold one frame each), and nothing is allocated.
+ *
+ * The pool is always held by a std::shared_ptr (use create()), and every frame which is out holds the pool too.
+ *
+ */
+
+class BmodeFramePool : public std::enable_shared_from_this<BmodeFramePool>
+{
+public:
+
+    /**
+     * @brief Create a pool with nframes frames of width x height pixels.
+     */
+    static std::shared_ptr<BmodeFramePool> create(int width, int height, int nframes = 8);
+
+    ~BmodeFramePool();
+
+    /**
+     * @brief GET a free frame, a new one if there is none. Thread-safe.
+     */
+    BmodeFramePtr acquire();
+
+    /**
+     * @brief GET the number of frames which exist right now (free or out)
+     */
+    int getNframes() const;
+
+    /**
+     * @brief GET the number of times acquire() had to allocate a new frame, 0 in steady state without recording
+     */
+    uint64_t getAllocations() const;
+
+    int getWidth() const;
+    int getHeight() const;
+
+private:
+    friend class BmodeFramePtr;
+
+    /**
+     * @brief Constructor function, use create()
+     */
+    BmodeFramePool(int width, int height, int nframes);
+
+    /**
+     * @brief Will be called when the last BmodeFramePtr of a frame is gone. Thread-safe.
+     */
+    void recycle(BmodeFrame *frame);
+
+    int width_;                                         //!< The width of every frame [pixel]
+    int height_;                                        //!< The height of every frame [pixel]
+    int nframes_;                                       //!< The number of free frames the pool keeps
+
+    mutable QMutex mutex_;                              //!< Protects free_ and count_
+    std::vector<BmodeFrame*> free_;                     //!< The frames which are not used, owned by the pool, reserved up to nframes_
+    int count_ = 0;                                     //!< The number of frames which exist (free or out)
+
+    std::atomic<uint64_t> allocations_{0};              //!< Counting variable for new frames after the constructor
+};
+
+#endif // BMODEFRAMEPOOL_H
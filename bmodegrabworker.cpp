@@ -0,0 +1,237 @@
+#include "bmodegrabworker.h"
+#include "bmodeopencvcapture.h"
+#include "bmodev4l2capture.h"
+
+#include <QDebug>
+#include <QMutexLocker>
+#include <algorithm>
+#include <chrono>
+
+namespace {
+// Host monotonic time [ns], the same clock as AmodeAcquisitionWorker, so the B-mode and the A-mode can be compared
+int64_t steadyNanoseconds()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+}
+
+BmodeGrabWorker::BmodeGrabWorker(const cv::Rect &roi, int poolsize)
+    : QObject{nullptr}, roi_(roi), poolsize_(std::max(poolsize, 2))
+{
+}
+
+BmodeGrabWorker::~BmodeGrabWorker()
+{
+    closeCamera();
+}
+
+bool BmodeGrabWorker::openCamera(int cameraIndex, int backend)
+{
+    closeCamera();
+
+    // V4L2 directly if asked (or with auto, if the camera has a raw format), OpenCV otherwise
+    if (backend != BmodeCaptureDevice::BACKEND_OPENCV)
+    {
+        camera_.reset(new BmodeV4l2Capture());
+        if (!camera_->open(cameraIndex))
+        {
+            camera_.reset();
+            if (backend == BmodeCaptureDevice::BACKEND_V4L2) return false;
+        }
+    }
+    if (!camera_)
+    {
+        camera_.reset(new BmodeOpenCvCapture());
+        if (!camera_->open(cameraIndex))
+        {
+            camera_.reset();
+            return false;
+        }
+    }
+    qDebug() << "BmodeGrabWorker: camera" << cameraIndex << "opened," << QString::fromStdString(camera_->description());
+
+    // a new stream, new counters. The clock model in the units of the timestamp: ns of the host clock with the
+    // driver's timestamp, otherwise the number of the image (the scale is then the frame period). Our number doesn't
+    // count the images the driver dropped, the model finds them in the arrival times.
+    clockmodel_ = ClockModel(camera_->isCaptureTimestamp() ? 1.0 : 0.0);
+    clockmodel_.setReceivedCounter(!camera_->isCaptureTimestamp());
+    ngrabbed_ = 0;
+    {
+        QMutexLocker locker(&mutex_);
+        clockestimate_ = ClockModel::Estimate();
+    }
+    count_grabbed_.store(0, std::memory_order_relaxed);
+    count_dropped_.store(0, std::memory_order_relaxed);
+    count_failures_.store(0, std::memory_order_relaxed);
+    processingtime_ns_.store(0, std::memory_order_relaxed);
+    count_allocations_.store(0, std::memory_order_relaxed);
+    return true;
+}
+
+void BmodeGrabWorker::closeCamera()
+{
+    camera_.reset();
+}
+
+void BmodeGrabWorker::start()
+{
+    running_.store(true, std::memory_order_release);
+}
+
+void BmodeGrabWorker::stop()
+{
+    running_.store(false, std::memory_order_release);
+}
+
+void BmodeGrabWorker::setRoi(const cv::Rect &roi)
+{
+    QMutexLocker locker(&mutex_);
+    newroi_ = roi;
+    roipending_.store(true, std::memory_order_release);
+}
+
+void BmodeGrabWorker::detectRoi()
+{
+    detectroi_.store(true, std::memory_order_release);
+}
+
+void BmodeGrabWorker::acknowledgeFrame()
+{
+    notifypending_.store(false, std::memory_order_release);
+}
+
+void BmodeGrabWorker::grabLoop()
+{
+    if (!camera_ || !camera_->isOpened()) return;
+
+    int nfailure = 0;
+    while (running_.load(std::memory_order_acquire))
+    {
+        // grab() blocks until the next image of the frame grabber, timestamp is when it was captured
+        int64_t timestamp = 0;
+        bool ok = camera_->grab(timestamp);
+        int64_t grabbed = steadyNanoseconds();
+        if (!ok)
+        {
+            count_failures_.fetch_add(1, std::memory_order_relaxed);
+            if (++nfailure < MAX_FAILURES) continue;
+
+            qDebug() << "BmodeGrabWorker: the camera doesn't give images anymore, stop grabbing";
+            running_.store(false, std::memory_order_release);
+            emit errorOccurred("The camera doesn't give images anymore");
+            break;
+        }
+        nfailure = 0;
+
+        // The capture time. With the driver's timestamp it is already there, the model then only tells how long until
+        // here. Without, it is the model of the arrival times, image after image, which takes the jitter of grab() out.
+        ngrabbed_++;
+        int64_t modeled = clockmodel_.update(camera_->isCaptureTimestamp() ? timestamp : static_cast<int64_t>(ngrabbed_), grabbed);
+        if (!camera_->isCaptureTimestamp()) timestamp = modeled;
+        {
+            QMutexLocker locker(&mutex_);
+            clockestimate_ = clockmodel_.getEstimate();
+        }
+
+        // a new roi from the GUI thread
+        if (roipending_.exchange(false, std::memory_order_acq_rel))
+        {
+            QMutexLocker locker(&mutex_);
+            roi_ = newroi_;
+        }
+
+        // while detecting, the images only go to the detector
+        if (detectroi_.load(std::memory_order_acquire))
+        {
+            if (camera_->retrieve(raw_) && detector_.addFrame(raw_))
+            {
+                cv::Rect detected = detector_.detect();
+                detector_.reset();
+                if (!detected.empty()) roi_ = detected;
+                detectroi_.store(false, std::memory_order_release);
+                emit roiDetected(QRect(detected.x, detected.y, detected.width, detected.height));
+            }
+            continue;
+        }
+
+        // Crop the B-mode screen. The roi was set for the Epiphan (1920x1080), a webcam is smaller, then we keep
+        // whatever part of the roi is inside, or the whole image.
+        const cv::Size size = camera_->size();
+        cv::Rect roi = roi_ & cv::Rect(0, 0, size.width, size.height);
+        if (roi.empty()) roi = cv::Rect(0, 0, size.width, size.height);
+
+        // the pool has the size of the cropped image, it is only created again if the resolution of the camera changes
+        if (!pool_ || pool_->getWidth() != roi.width || pool_->getHeight() != roi.height)
+            pool_ = BmodeFramePool::create(roi.width, roi.height, poolsize_);
+
+        uint64_t allocations = pool_->getAllocations();
+        BmodeFramePtr frame = pool_->acquire();
+        if (pool_->getAllocations() != allocations) count_allocations_.fetch_add(1, std::memory_order_relaxed);
+
+        // crop and convert to gray directly into the frame, in one pass
+        cv::Mat image = frame.writable()->writableImage();
+        if (!camera_->retrieveGray(roi, image))
+        {
+            count_failures_.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+        frame.writable()->setTimestamp(timestamp);
+        frame.writable()->setSequence(count_grabbed_.fetch_add(1, std::memory_order_relaxed) + 1);
+
+        publish(std::move(frame));
+        processingtime_ns_.fetch_add(steadyNanoseconds() - grabbed, std::memory_order_relaxed);
+    }
+}
+
+void BmodeGrabWorker::publish(BmodeFramePtr &&frame)
+{
+    {
+        QMutexLocker locker(&mutex_);
+        if (latest_) count_dropped_.fetch_add(1, std::memory_order_relaxed);
+        latest_ = std::move(frame);
+    }
+
+    // only one notification in the queue of the GUI thread at a time
+    if (!notifypending_.exchange(true, std::memory_order_acq_rel))
+        emit frameAvailable();
+}
+
+bool BmodeGrabWorker::readLatest(BmodeFramePtr &frame)
+{
+    // the slot lets go of the frame, so that it goes back to the pool as soon as the consumers don't need it anymore
+    QMutexLocker locker(&mutex_);
+    if (!latest_) return false;
+    frame = std::move(latest_);
+    return true;
+}
+
+uint64_t BmodeGrabWorker::getFramesGrabbed() const
+{
+    return count_grabbed_.load(std::memory_order_relaxed);
+}
+
+uint64_t BmodeGrabWorker::getFramesDropped() const
+{
+    return count_dropped_.load(std::memory_order_relaxed);
+}
+
+uint64_t BmodeGrabWorker::getGrabFailures() const
+{
+    return count_failures_.load(std::memory_order_relaxed);
+}
+
+int64_t BmodeGrabWorker::getProcessingTime() const
+{
+    return processingtime_ns_.load(std::memory_order_relaxed);
+}
+
+uint64_t BmodeGrabWorker::getAllocations() const
+{
+    return count_allocations_.load(std::memory_order_relaxed);
+}
+
+ClockModel::Estimate BmodeGrabWorker::getClockEstimate() const
+{
+    QMutexLocker locker(&mutex_);
+    return clockestimate_;
+}
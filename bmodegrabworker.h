@@ -0,0 +1,186 @@
+#ifndef BMODEGRABWORKER_H
+#define BMODEGRABWORKER_H
+
+#include <QObject>
+#include <QMutex>
+#include <QRect>
+#include <opencv2/opencv.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+#include "bmodecapturedevice.h"
+#include "bmodeframepool.h"
+#include "bmoderoidetector.h"
+#include "clockmodel.h"
+
+/**
+ * @class BmodeGrabWorker
+ * @brief Owns the capture device of the frame grabber and grabs the B-mode images, lives in its own thread.
+ *
+ * For the context. Previously BmodeConnection read the camera from a QTimer (30 ms) on the GUI thread. That limits
+ * the stream to ~33 fps (the Epiphan gives 60 fps), the decoding blocks the GUI, and we don't know when an image was
+ * actually grabbed. BmodeConnection now moves this worker to its own QThread, and grabLoop() blocks on the grab of
+ * the capture device, so it runs at whatever rate the frame grabber gives.
+ *
+ * The capture device is a BmodeCaptureDevice, chosen when the camera is opened: BmodeV4l2Capture (Linux, the raw
+ * buffers of the driver, timestamped by the driver) or BmodeOpenCvCapture (cv::VideoCapture, timestamped when grab()
+ * returns). Either way the timestamp is the host monotonic clock (steady_clock, in ns, the same clock as the A-mode
+ * frames, see AmodeFrame::getTimestamp()). Then the image is cropped (the region of interest of the B-mode screen)
+ * and converted to gray directly into a BmodeFrame of the BmodeFramePool, which is created at the first image with
+ * the size of the (cropped) image. The frames go back to the pool when the consumers let go. The conversion is
+ * cv::cvtColor of a view of the roi, written into the frame (BmodeGrayConverter).
+ *
+ * The roi can be changed while grabbing (setRoi()), or detected from the next images (detectRoi(), see
+ * BmodeRoiDetector). Nothing is published during the detection (it takes ~0.5 s), so the consumers never get
+ * images of two sizes at the start of the stream.
+ *
+ * The images are published to a single slot (the latest image), if the GUI didn't take the previous one it is
+ * dropped and counted. Same as AmodeAcquisitionWorker, frameAvailable() is only emitted again after the GUI
+ * acknowledged the previous one (acknowledgeFrame()), so the event queue of the GUI never piles up.
+ *
+ * The loop runs from start() until stop() (an atomic flag, both can be called from any thread), it returns at the
+ * latest one frame later. The camera should only be opened/closed while the loop is not running, the slots are queued behind it anyway.
+ *
+ */
+
+class BmodeGrabWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    /**
+     * @brief Constructor function. roi is the area of the B-mode screen we keep, poolsize the number of frames of the pool
+     */
+    explicit BmodeGrabWorker(const cv::Rect &roi, int poolsize = 8);
+
+    /**
+     * @brief Destructor function, making sure the camera is released
+     */
+    ~BmodeGrabWorker();
+
+    /**
+     * @brief Take the latest image, returns false if there is nothing new since the last call. Thread-safe.
+     */
+    bool readLatest(BmodeFramePtr &frame);
+
+    /**
+     * @brief Called by the GUI thread when it handled frameAvailable(), the next image will emit it again
+     */
+    void acknowledgeFrame();
+
+    /**
+     * @brief Let grabLoop() run, call it before grabLoop() is queued. Thread-safe.
+     *
+     * The flag is set here and not by grabLoop(), otherwise a stop() between the queuing and the start of the loop
+     * would be overwritten, and the loop would never return.
+     */
+    void start();
+
+    /**
+     * @brief Ask grabLoop() to return, thread-safe
+     */
+    void stop();
+
+    /**
+     * @brief SET the region of interest, from the next image on. Thread-safe.
+     */
+    void setRoi(const cv::Rect &roi);
+
+    /**
+     * @brief Detect the region of interest from the next images (see BmodeRoiDetector), roiDetected() tells the result. Thread-safe.
+     */
+    void detectRoi();
+
+    /**
+     * @brief GET the counters since the camera was opened. Thread-safe.
+     *
+     * getFramesGrabbed()  the images grabbed and published
+     * getFramesDropped()  the images replaced by a newer one before the GUI took them
+     * getGrabFailures()   the grabs or conversions that failed
+     * getProcessingTime() the total time from the return of grab() until the image is published (crop, gray) [ns]
+     * getAllocations()    the frames the pool had to allocate after it was created (only while recording)
+     */
+    uint64_t getFramesGrabbed() const;
+    uint64_t getFramesDropped() const;
+    uint64_t getGrabFailures() const;
+    int64_t getProcessingTime() const;
+    uint64_t getAllocations() const;
+
+    /**
+     * @brief GET the clock model of the frame grabber (see ClockModel), the latest estimate. Thread-safe.
+     */
+    ClockModel::Estimate getClockEstimate() const;
+
+public slots:
+    /**
+     * @brief Open the camera with a BmodeCaptureDevice::Backend, it has to be called here so that the camera belongs to
+     * the worker thread. With BACKEND_AUTO, V4L2 is tried first and OpenCV if it fails.
+     */
+    bool openCamera(int cameraIndex, int backend);
+
+    /**
+     * @brief Release the camera
+     */
+    void closeCamera();
+
+    /**
+     * @brief Grab, timestamp, crop, and publish from start() until stop() is called or the camera fails. It returns right
+     * away if stop() came first.
+     */
+    void grabLoop();
+
+private:
+
+    /**
+     * @brief Put the frame into the latest slot and notify the GUI
+     */
+    void publish(BmodeFramePtr &&frame);
+
+    std::unique_ptr<BmodeCaptureDevice> camera_; //!< The frame grabber (or the webcam for testing), null if closed
+    cv::Rect roi_;                              //!< The region of interest of the B-mode screen
+    cv::Mat raw_;                               //!< The whole image for the roi detection, reused every frame
+    std::shared_ptr<BmodeFramePool> pool_;      //!< The cropped gray images, created at the first image
+    int poolsize_;                              //!< The number of frames of pool_
+
+    ClockModel clockmodel_;                     //!< The capture time from the arrival time, only used by the loop
+    uint64_t ngrabbed_ = 0;                     //!< Images grabbed since the camera was opened, the source time of clockmodel_ without a capture timestamp
+
+    mutable QMutex mutex_;                      //!< Protects latest_, newroi_ and clockestimate_
+    ClockModel::Estimate clockestimate_;        //!< The estimate of clockmodel_, for getClockEstimate()
+    BmodeFramePtr latest_;                      //!< The latest published image, empty if readLatest() took it already
+    cv::Rect newroi_;                           //!< The roi given by setRoi(), taken by the loop at the next image
+
+    BmodeRoiDetector detector_;                 //!< Detects the roi, only used by the loop
+
+    std::atomic<bool> running_{false};          //!< The loop runs while this is true, see stop()
+    std::atomic<bool> notifypending_{false};    //!< True if frameAvailable() was emitted and the GUI didn't take it yet
+    std::atomic<bool> roipending_{false};       //!< True if setRoi() gave a roi the loop didn't take yet
+    std::atomic<bool> detectroi_{false};        //!< True while the loop feeds the images to detector_ instead of publishing them
+    std::atomic<uint64_t> count_grabbed_{0};    //!< Images grabbed and published
+    std::atomic<uint64_t> count_dropped_{0};    //!< Images replaced before the GUI took them
+    std::atomic<uint64_t> count_failures_{0};   //!< grab() or retrieve() failed
+    std::atomic<int64_t> processingtime_ns_{0}; //!< Total time from grab() until published [ns]
+    std::atomic<uint64_t> count_allocations_{0}; //!< Frames the pool had to allocate
+
+    const int MAX_FAILURES = 100;               //!< After this many failures in a row the loop gives up
+
+signals:
+    /**
+     * @brief Emitted when there is a new image (at most one pending notification at a time)
+     */
+    void frameAvailable();
+
+    /**
+     * @brief Emitted when grabLoop() gives up because the camera doesn't give images anymore
+     */
+    void errorOccurred(const QString &message);
+
+    /**
+     * @brief Emitted when the detection of the roi is done, with the new roi, or an empty one if nothing was found (the roi didn't change)
+     */
+    void roiDetected(const QRect &roi);
+};
+
+#endif // BMODEGRABWORKER_H
@@ -0,0 +1,67 @@
+#include "bmodegrayconverter.h"
+
+#include <opencv2/imgproc.hpp>
+
+#include <cstdint>
+#include <cstring>
+
+namespace {
+// The luma of one row of n packed 4:2:2 pixels, every other byte
+void lumaRow(const uint8_t *src, uint8_t *dst, int n)
+{
+    for (int x = 0; x < n; x++, src += 2)
+        dst[x] = src[0];
+}
+
+// The checks of the raw formats, bytesperpixel is 2 for 4:2:2, 1 for a plane
+bool rawFits(const uint8_t *data, int width, int height, std::size_t stride, int bytesperpixel, const cv::Rect &roi, const cv::Mat &output)
+{
+    if (data == nullptr || width <= 0 || height <= 0 || stride < static_cast<std::size_t>(width) * bytesperpixel) return false;
+    if (roi.empty() || (roi & cv::Rect(0, 0, width, height)) != roi) return false;
+    return output.type() == CV_8UC1 && output.cols == roi.width && output.rows == roi.height;
+}
+}
+
+int BmodeGrayConverter::apply(const cv::Mat &input, const cv::Rect &roi, cv::Mat &output)
+{
+    const int cn = input.channels();
+    if (input.depth() != CV_8U || (cn != 1 && cn != 3 && cn != 4)) return 0;
+    if (roi.empty() || (roi & cv::Rect(0, 0, input.cols, input.rows)) != roi) return 0;
+    if (output.type() != CV_8UC1 || output.cols != roi.width || output.rows != roi.height) return 0;
+
+    // the size and the type of output are right, so cvtColor and copyTo write into its pixels (the BmodeFrame)
+    if (cn == 3)      cv::cvtColor(input(roi), output, cv::COLOR_BGR2GRAY);
+    else if (cn == 4) cv::cvtColor(input(roi), output, cv::COLOR_BGRA2GRAY);
+    else              input(roi).copyTo(output);
+
+    return 1;
+}
+
+int BmodeGrayConverter::applyPacked422(const uint8_t *data, int width, int height, std::size_t stride, int lumaoffset,
+                                       const cv::Rect &roi, cv::Mat &output)
+{
+    if ((lumaoffset != 0 && lumaoffset != 1) || !rawFits(data, width, height, stride, 2, roi, output)) return 0;
+
+    const int nstripe = (roi.height + ROWS_PER_STRIPE - 1) / ROWS_PER_STRIPE;
+    cv::parallel_for_(cv::Range(0, roi.height), [&](const cv::Range &range)
+    {
+        for (int r = range.start; r < range.end; r++)
+        {
+            const uint8_t *src = data + (roi.y + r) * stride + static_cast<std::size_t>(roi.x) * 2 + lumaoffset;
+            lumaRow(src, output.ptr<uint8_t>(r), roi.width);
+        }
+    }, nstripe);
+
+    return 1;
+}
+
+int BmodeGrayConverter::applyLuma(const uint8_t *data, int width, int height, std::size_t stride, const cv::Rect &roi, cv::Mat &output)
+{
+    if (!rawFits(data, width, height, stride, 1, roi, output)) return 0;
+
+    // only memcpy, one thread is enough (the threads would only wait for the memory)
+    for (int r = 0; r < roi.height; r++)
+        std::memcpy(output.ptr<uint8_t>(r), data + (roi.y + r) * stride + roi.x, roi.width);
+
+    return 1;
+}
@@ -0,0 +1,75 @@
+#include "bmodeopencvcapture.h"
+#include "bmodegrayconverter.h"
+
+#include <chrono>
+#include <sstream>
+
+namespace {
+// Host monotonic time [ns], the same clock as AmodeAcquisitionWorker, so the B-mode and the A-mode can be compared
+int64_t steadyNanoseconds()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+}
+
+BmodeOpenCvCapture::~BmodeOpenCvCapture()
+{
+    close();
+}
+
+bool BmodeOpenCvCapture::open(int index)
+{
+    return camera_.open(index);
+}
+
+void BmodeOpenCvCapture::close()
+{
+    if (camera_.isOpened()) camera_.release();
+}
+
+bool BmodeOpenCvCapture::isOpened() const
+{
+    return camera_.isOpened();
+}
+
+bool BmodeOpenCvCapture::grab(int64_t &timestamp)
+{
+    // grab() blocks until the next image of the frame grabber, that is the moment the image exists for us
+    bool ok = camera_.grab();
+    timestamp = steadyNanoseconds();
+
+    // the decoding happens here, into raw_, which keeps its buffer if the size doesn't change
+    if (ok) ok = camera_.retrieve(raw_);
+    return ok && !raw_.empty();
+}
+
+cv::Size BmodeOpenCvCapture::size() const
+{
+    return raw_.size();
+}
+
+int BmodeOpenCvCapture::retrieveGray(const cv::Rect &roi, cv::Mat &output)
+{
+    return BmodeGrayConverter::apply(raw_, roi, output);
+}
+
+bool BmodeOpenCvCapture::retrieve(cv::Mat &image)
+{
+    image = raw_;
+    return !image.empty();
+}
+
+bool BmodeOpenCvCapture::isCaptureTimestamp() const
+{
+    // OpenCV doesn't tell, the timestamp is when grab() returned
+    return false;
+}
+
+std::string BmodeOpenCvCapture::description() const
+{
+    if (!camera_.isOpened()) return "OpenCV";
+    std::stringstream ss;
+    ss << "OpenCV " << camera_.getBackendName() << " "
+       << static_cast<int>(camera_.get(cv::CAP_PROP_FRAME_WIDTH)) << "x" << static_cast<int>(camera_.get(cv::CAP_PROP_FRAME_HEIGHT));
+    return ss.str();
+}
@@ -0,0 +1,38 @@
+#ifndef BMODEOPENCVCAPTURE_H
+#define BMODEOPENCVCAPTURE_H
+
+#include <opencv2/opencv.hpp>
+
+#include "bmodecapturedevice.h"
+
+/**
+ * @class BmodeOpenCvCapture
+ * @brief The camera through cv::VideoCapture, the backend that works everywhere.
+ *
+ * For the context. This is what BmodeGrabWorker did before there were backends: grab() blocks in
+ * cv::VideoCapture::grab(), the image is timestamped when it returns (OpenCV doesn't give the capture time of the
+ * driver), then it is decoded into a BGR image, which is cropped and converted to gray by BmodeGrayConverter.
+ *
+ */
+
+class BmodeOpenCvCapture : public BmodeCaptureDevice
+{
+public:
+    ~BmodeOpenCvCapture();
+
+    bool open(int index) override;
+    void close() override;
+    bool isOpened() const override;
+    bool grab(int64_t &timestamp) override;
+    bool isCaptureTimestamp() const override;
+    cv::Size size() const override;
+    int retrieveGray(const cv::Rect &roi, cv::Mat &output) override;
+    bool retrieve(cv::Mat &image) override;
+    std::string description() const override;
+
+private:
+    cv::VideoCapture camera_;   //!< The frame grabber (or the webcam for testing)
+    cv::Mat raw_;               //!< The decoded image, reused every frame
+};
+
+#endif // BMODEOPENCVCAPTURE_H
@@ -0,0 +1,145 @@
+#include "bmoderoidetector.h"
+#include "bmodegrayconverter.h"
+
+#include <QFile>
+#include <QTextStream>
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include "rapidxml.hpp"
+
+BmodeRoiDetector::BmodeRoiDetector(int nframes, int motionthreshold, int colorthreshold)
+    : nframes_(std::max(nframes, 2)), motionthreshold_(motionthreshold), colorthreshold_(colorthreshold)
+{
+}
+
+void BmodeRoiDetector::reset()
+{
+    nadded_ = 0;
+}
+
+bool BmodeRoiDetector::addFrame(const cv::Mat &image)
+{
+    if (image.empty() || image.depth() != CV_8U) return isReady();
+
+    // a new size means a new screen, start again
+    if (image.size() != min_.size()) nadded_ = 0;
+
+    gray_.create(image.size(), CV_8UC1);
+    if (!BmodeGrayConverter::apply(image, cv::Rect(0, 0, image.cols, image.rows), gray_)) return isReady();
+
+    // the largest difference between the channels, max(|B-G|, |G-R|), zero for a gray image
+    if (image.channels() >= 3)
+    {
+        cv::split(image, channels_);
+        cv::absdiff(channels_[0], channels_[1], spread_);
+        cv::absdiff(channels_[1], channels_[2], diff_);
+        cv::max(spread_, diff_, spread_);
+    }
+    else
+    {
+        spread_.create(image.size(), CV_8UC1);
+        spread_.setTo(0);
+    }
+
+    if (nadded_ == 0)
+    {
+        gray_.copyTo(min_);
+        gray_.copyTo(max_);
+        spread_.copyTo(color_);
+    }
+    else
+    {
+        cv::min(min_, gray_, min_);
+        cv::max(max_, gray_, max_);
+        cv::max(color_, spread_, color_);
+    }
+    nadded_++;
+    return isReady();
+}
+
+bool BmodeRoiDetector::isReady() const
+{
+    return nadded_ >= nframes_;
+}
+
+cv::Rect BmodeRoiDetector::detect() const
+{
+    if (nadded_ < 2) return cv::Rect();
+
+    // the pixels that moved and never had color
+    cv::Mat motion = (max_ - min_) > motionthreshold_;
+    cv::Mat gray   = color_ <= colorthreshold_;
+    cv::Mat mask   = motion & gray;
+
+    // fill the holes of the image (dark areas barely change), then remove the small spots (e.g. a blinking cursor)
+    cv::morphologyEx(mask, mask, cv::MORPH_CLOSE, cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(CLOSE_SIZE, CLOSE_SIZE)));
+    cv::morphologyEx(mask, mask, cv::MORPH_OPEN, cv::getStructuringElement(cv::MORPH_RECT, cv::Size(5, 5)));
+
+    // the largest connected region
+    cv::Mat labels, stats, centroids;
+    int nlabel = cv::connectedComponentsWithStats(mask, labels, stats, centroids, 8, CV_32S);
+    int best = 0, bestarea = 0;
+    for (int i = 1; i < nlabel; i++)
+    {
+        int area = stats.at<int>(i, cv::CC_STAT_AREA);
+        if (area > bestarea) { best = i; bestarea = area; }
+    }
+    if (best == 0 || bestarea < MIN_AREA * mask.total()) return cv::Rect();
+
+    cv::Rect roi(stats.at<int>(best, cv::CC_STAT_LEFT), stats.at<int>(best, cv::CC_STAT_TOP),
+                 stats.at<int>(best, cv::CC_STAT_WIDTH), stats.at<int>(best, cv::CC_STAT_HEIGHT));
+    return roi & cv::Rect(0, 0, mask.cols, mask.rows);
+}
+
+cv::Rect BmodeRoiDetector::loadFromPlusConfig(const QString &filename)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        std::cerr << "Failed to open file" << std::endl;
+        return cv::Rect();
+    }
+
+    QTextStream in(&file);
+    std::string contentStr = in.readAll().toStdString();
+    file.close();
+
+    // rapidxml parses in place, it needs a null terminated buffer it can write into
+    std::vector<char> buffer(contentStr.begin(), contentStr.end());
+    buffer.push_back('\0');
+
+    rapidxml::xml_document<> doc;
+    try {
+        doc.parse<0>(&buffer[0]);
+    } catch (const rapidxml::parse_error& e) {
+        std::cerr << "XML Parse error: " << e.what() << std::endl;
+        return cv::Rect();
+    }
+
+    // The clip rectangle is an attribute of the video DataSource, which is a few levels deep
+    // (PlusConfiguration/DataCollection/Device/DataSources/DataSource), so we just look for it everywhere
+    std::vector<rapidxml::xml_node<>*> nodes;
+    for (rapidxml::xml_node<> *node = doc.first_node(); node; node = node->next_sibling())
+        nodes.push_back(node);
+    while (!nodes.empty())
+    {
+        rapidxml::xml_node<> *node = nodes.back();
+        nodes.pop_back();
+
+        rapidxml::xml_attribute<> *origin = node->first_attribute("ClipRectangleOrigin");
+        rapidxml::xml_attribute<> *size   = node->first_attribute("ClipRectangleSize");
+        if (origin && size)
+        {
+            int x = 0, y = 0, w = 0, h = 0;
+            std::istringstream originStream(origin->value());
+            std::istringstream sizeStream(size->value());
+            if ((originStream >> x >> y) && (sizeStream >> w >> h) && x >= 0 && y >= 0 && w > 0 && h > 0)
+                return cv::Rect(x, y, w, h);
+        }
+
+        for (rapidxml::xml_node<> *child = node->first_node(); child; child = child->next_sibling())
+            nodes.push_back(child);
+    }
+
+    return cv::Rect();
+}
@@ -0,0 +1,87 @@
+#ifndef BMODEROIDETECTOR_H
+#define BMODEROIDETECTOR_H
+
+#include <QString>
+#include <opencv2/opencv.hpp>
+
+#include <vector>
+
+/**
+ * @class BmodeRoiDetector
+ * @brief Finds the region of interest (the B-mode image) in the screen of the B-mode machine.
+ *
+ * For the context. The frame grabber gives the whole screen of the B-mode machine (1920x1080 for the Epiphan), with
+ * the menus, the settings, the logo etc., and we only want the image itself. Previously the region of interest was
+ * hard-coded in BmodeConnection (for our machine, with our layout). Now it comes, in this order, from:
+ *
+ * 1) The configuration. The Plus configuration file (the same file as the calibration, see Bmode3DVisualizer) can have
+ *    ClipRectangleOrigin="x y" and ClipRectangleSize="w h" on the video DataSource, that is how Plus crops the video
+ *    too. See loadFromPlusConfig().
+ * 2) The detection, once, from the first images of the stream. The B-mode image is the largest region of the screen
+ *    which is gray and moves (the speckle is never the same from one image to the next even if the probe doesn't move,
+ *    the menus and the text don't change, and the colored parts are overlays). addFrame() keeps, for every pixel, the
+ *    minimum and the maximum of the gray level and the largest difference between the color channels over the
+ *    images. detect() keeps the pixels that changed and have no color, fills the holes (the dark parts of the image
+ *    hardly change) and returns the bounding box of the largest connected region.
+ * 3) The hard-coded default of BmodeConnection, if both fail.
+ *
+ */
+
+class BmodeRoiDetector
+{
+public:
+
+    /**
+     * @brief Constructor function.
+     *
+     * @param nframes          The number of images used for the detection
+     * @param motionthreshold  A pixel moves if its gray level changed more than this over the images
+     * @param colorthreshold   A pixel is gray if its color channels never differed more than this
+     */
+    explicit BmodeRoiDetector(int nframes = 30, int motionthreshold = 12, int colorthreshold = 24);
+
+    /**
+     * @brief Forget the images added so far
+     */
+    void reset();
+
+    /**
+     * @brief Add an image of the frame grabber (CV_8UC3 BGR, CV_8UC4 BGRA or CV_8UC1). If the size changed, the images
+     * added before are forgotten. Returns true when there are enough images for detect().
+     */
+    bool addFrame(const cv::Mat &image);
+
+    /**
+     * @brief GET true if there are enough images for detect()
+     */
+    bool isReady() const;
+
+    /**
+     * @brief Detect the region of interest from the images added so far, empty if there is no region large enough
+     */
+    cv::Rect detect() const;
+
+    /**
+     * @brief Read the region of interest from a Plus configuration file (ClipRectangleOrigin and ClipRectangleSize), empty if there is none
+     */
+    static cv::Rect loadFromPlusConfig(const QString &filename);
+
+private:
+    int nframes_;                   //!< The number of images for the detection
+    int motionthreshold_;           //!< Gray levels, see the constructor
+    int colorthreshold_;            //!< Gray levels, see the constructor
+    int nadded_ = 0;                //!< The number of images added since reset()
+
+    cv::Mat gray_;                  //!< The gray level of the last image, reused
+    cv::Mat min_;                   //!< The minimum gray level of every pixel
+    cv::Mat max_;                   //!< The maximum gray level of every pixel
+    cv::Mat color_;                 //!< The largest difference between the color channels of every pixel
+    cv::Mat spread_;                //!< The difference between the color channels of the last image, reused
+    cv::Mat diff_;                  //!< Temporary for the difference of two channels, reused
+    std::vector<cv::Mat> channels_; //!< The channels of the last image, reused
+
+    const double MIN_AREA = 0.02;   //!< The region has to be at least this fraction of the screen
+    const int CLOSE_SIZE  = 25;     //!< [pixel] The size of the kernel which fills the holes of the region
+};
+
+#endif // BMODEROIDETECTOR_H
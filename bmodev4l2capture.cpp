@@ -0,0 +1,392 @@
+#include "bmodev4l2capture.h"
+#include "bmodecameraenumerator.h"
+#include "bmodegrayconverter.h"
+
+#include <QDebug>
+#include <QString>
+#include <sstream>
+
+#ifdef __linux__
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/videodev2.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace {
+// Host monotonic time [ns], the same clock as AmodeAcquisitionWorker, so the B-mode and the A-mode can be compared
+int64_t steadyNanoseconds()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int xioctl(int fd, unsigned long request, void *arg)
+{
+    int status;
+    do { status = ioctl(fd, request, arg); } while (status == -1 && errno == EINTR);
+    return status;
+}
+
+// The raw formats we can read, the cheapest first (bytes to read per pixel of the roi), -1 if not supported
+int formatRank(uint32_t fourcc)
+{
+    switch (fourcc)
+    {
+    case V4L2_PIX_FMT_GREY: return 0;
+    case V4L2_PIX_FMT_NV12: return 1;
+    case V4L2_PIX_FMT_YUYV: return 2;
+    case V4L2_PIX_FMT_UYVY: return 3;
+    default:                return -1;
+    }
+}
+
+// The fastest raw mode, then the largest, then the cheapest format, nullptr if the device has no raw mode
+const BmodeCameraEnumerator::Mode* chooseMode(const BmodeCameraEnumerator::CameraInfo &info)
+{
+    const BmodeCameraEnumerator::Mode *best = nullptr;
+    for (const BmodeCameraEnumerator::Mode &mode : info.modes)
+    {
+        if (formatRank(mode.fourcc) < 0) continue;
+        if (best == nullptr || mode.fps > best->fps ||
+            (mode.fps == best->fps && mode.width * mode.height > best->width * best->height) ||
+            (mode.fps == best->fps && mode.width * mode.height == best->width * best->height && formatRank(mode.fourcc) < formatRank(best->fourcc)))
+            best = &mode;
+    }
+    return best;
+}
+}
+
+BmodeV4l2Capture::~BmodeV4l2Capture()
+{
+    close();
+}
+
+bool BmodeV4l2Capture::open(int index)
+{
+    return openDevice("/dev/video" + std::to_string(index));
+}
+
+bool BmodeV4l2Capture::openDevice(const std::string &path)
+{
+    close();
+
+    const BmodeCameraEnumerator::CameraInfo info = BmodeCameraEnumerator::probeDevice(path, 0);
+    const BmodeCameraEnumerator::Mode *mode = chooseMode(info);
+    if (mode == nullptr)
+    {
+        qDebug() << "BmodeV4l2Capture:" << QString::fromStdString(path) << "has no raw format (GREY, NV12, YUYV, UYVY)";
+        return false;
+    }
+
+    fd_ = ::open(path.c_str(), O_RDWR | O_NONBLOCK);
+    if (fd_ < 0) return false;
+    path_ = path;
+
+    v4l2_capability capability;
+    std::memset(&capability, 0, sizeof(capability));
+    uint32_t caps = 0;
+    if (xioctl(fd_, VIDIOC_QUERYCAP, &capability) == 0)
+        caps = (capability.capabilities & V4L2_CAP_DEVICE_CAPS) ? capability.device_caps : capability.capabilities;
+    if (!(caps & V4L2_CAP_VIDEO_CAPTURE) || !(caps & V4L2_CAP_STREAMING))
+    {
+        qDebug() << "BmodeV4l2Capture:" << QString::fromStdString(path) << "can't stream";
+        close();
+        return false;
+    }
+
+    // the format, the driver may adjust the size and the stride, so we take what it answers
+    v4l2_format format;
+    std::memset(&format, 0, sizeof(format));
+    format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    format.fmt.pix.width       = mode->width;
+    format.fmt.pix.height      = mode->height;
+    format.fmt.pix.pixelformat = mode->fourcc;
+    format.fmt.pix.field       = V4L2_FIELD_NONE;
+    if (xioctl(fd_, VIDIOC_S_FMT, &format) != 0 || formatRank(format.fmt.pix.pixelformat) < 0)
+    {
+        qDebug() << "BmodeV4l2Capture: unable to set the format" << QString::fromStdString(BmodeCameraEnumerator::fourccToString(mode->fourcc));
+        close();
+        return false;
+    }
+    fourcc_ = format.fmt.pix.pixelformat;
+    width_  = static_cast<int>(format.fmt.pix.width);
+    height_ = static_cast<int>(format.fmt.pix.height);
+    const std::size_t minstride = static_cast<std::size_t>(width_) * (fourcc_ == V4L2_PIX_FMT_YUYV || fourcc_ == V4L2_PIX_FMT_UYVY ? 2 : 1);
+    stride_ = std::max<std::size_t>(format.fmt.pix.bytesperline, minstride);
+
+    // the frame rate, if the driver lets us choose it (not fatal, it is only a wish)
+    v4l2_streamparm parm;
+    std::memset(&parm, 0, sizeof(parm));
+    parm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (mode->fps > 0 && xioctl(fd_, VIDIOC_G_PARM, &parm) == 0 && (parm.parm.capture.capability & V4L2_CAP_TIMEPERFRAME))
+    {
+        parm.parm.capture.timeperframe.numerator   = 1000;
+        parm.parm.capture.timeperframe.denominator = static_cast<uint32_t>(std::lround(mode->fps * 1000));
+        xioctl(fd_, VIDIOC_S_PARM, &parm);
+    }
+
+    // the buffers of the driver, mapped
+    v4l2_requestbuffers request;
+    std::memset(&request, 0, sizeof(request));
+    request.count  = NBUFFERS;
+    request.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    request.memory = V4L2_MEMORY_MMAP;
+    if (xioctl(fd_, VIDIOC_REQBUFS, &request) != 0 || request.count < 2)
+    {
+        qDebug() << "BmodeV4l2Capture: unable to get the buffers of the driver";
+        close();
+        return false;
+    }
+    for (uint32_t i = 0; i < request.count; i++)
+    {
+        v4l2_buffer buffer;
+        std::memset(&buffer, 0, sizeof(buffer));
+        buffer.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buffer.memory = V4L2_MEMORY_MMAP;
+        buffer.index  = i;
+        if (xioctl(fd_, VIDIOC_QUERYBUF, &buffer) != 0)
+        {
+            close();
+            return false;
+        }
+        void *start = mmap(nullptr, buffer.length, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, buffer.m.offset);
+        if (start == MAP_FAILED)
+        {
+            close();
+            return false;
+        }
+        monotonic_ = (buffer.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) == V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC;
+        Buffer mapped;
+        mapped.start  = start;
+        mapped.length = buffer.length;
+        buffers_.push_back(mapped);
+    }
+
+    // all the buffers go to the driver, then it fills them one after the other
+    for (uint32_t i = 0; i < buffers_.size(); i++)
+    {
+        v4l2_buffer buffer;
+        std::memset(&buffer, 0, sizeof(buffer));
+        buffer.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buffer.memory = V4L2_MEMORY_MMAP;
+        buffer.index  = i;
+        if (xioctl(fd_, VIDIOC_QBUF, &buffer) != 0)
+        {
+            close();
+            return false;
+        }
+    }
+    v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (xioctl(fd_, VIDIOC_STREAMON, &type) != 0)
+    {
+        qDebug() << "BmodeV4l2Capture: unable to start the stream of" << QString::fromStdString(path);
+        close();
+        return false;
+    }
+    return true;
+}
+
+void BmodeV4l2Capture::close()
+{
+    if (fd_ < 0) return;
+
+    // stopping the stream takes all the buffers back from the driver, then they can be unmapped and freed
+    v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    xioctl(fd_, VIDIOC_STREAMOFF, &type);
+    for (const Buffer &buffer : buffers_)
+        munmap(buffer.start, buffer.length);
+    buffers_.clear();
+
+    v4l2_requestbuffers request;
+    std::memset(&request, 0, sizeof(request));
+    request.count  = 0;
+    request.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    request.memory = V4L2_MEMORY_MMAP;
+    xioctl(fd_, VIDIOC_REQBUFS, &request);
+
+    ::close(fd_);
+    fd_ = -1;
+    current_ = -1;
+    bytesused_ = 0;
+}
+
+bool BmodeV4l2Capture::isOpened() const
+{
+    return fd_ >= 0;
+}
+
+void BmodeV4l2Capture::requeue()
+{
+    if (current_ < 0) return;
+
+    v4l2_buffer buffer;
+    std::memset(&buffer, 0, sizeof(buffer));
+    buffer.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buffer.memory = V4L2_MEMORY_MMAP;
+    buffer.index  = static_cast<uint32_t>(current_);
+    xioctl(fd_, VIDIOC_QBUF, &buffer);
+    current_ = -1;
+    bytesused_ = 0;
+}
+
+bool BmodeV4l2Capture::grab(int64_t &timestamp)
+{
+    if (fd_ < 0) return false;
+
+    // we are done with the previous image, the driver can fill its buffer again
+    requeue();
+
+    pollfd descriptor;
+    descriptor.fd      = fd_;
+    descriptor.events  = POLLIN;
+    descriptor.revents = 0;
+    int status;
+    do { status = poll(&descriptor, 1, POLL_TIMEOUT_MS); } while (status == -1 && errno == EINTR);
+    if (status <= 0) return false;
+
+    v4l2_buffer buffer;
+    std::memset(&buffer, 0, sizeof(buffer));
+    buffer.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buffer.memory = V4L2_MEMORY_MMAP;
+    if (xioctl(fd_, VIDIOC_DQBUF, &buffer) != 0) return false;
+    int64_t dequeued = steadyNanoseconds();
+
+    // from here we hold the buffer, it goes back at the next grab() even if the image is no good
+    current_ = static_cast<int>(buffer.index);
+    bytesused_ = (buffer.bytesused > 0) ? buffer.bytesused : buffers_[current_].length;
+    if ((buffer.flags & V4L2_BUF_FLAG_ERROR) || bytesused_ < stride_ * height_) return false;
+
+    monotonic_ = (buffer.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) == V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC;
+    if (monotonic_)
+        timestamp = static_cast<int64_t>(buffer.timestamp.tv_sec) * 1000000000LL + static_cast<int64_t>(buffer.timestamp.tv_usec) * 1000LL;
+    else
+        timestamp = dequeued;
+    return true;
+}
+
+bool BmodeV4l2Capture::isCaptureTimestamp() const
+{
+    return monotonic_;
+}
+
+cv::Size BmodeV4l2Capture::size() const
+{
+    return cv::Size(width_, height_);
+}
+
+int BmodeV4l2Capture::retrieveGray(const cv::Rect &roi, cv::Mat &output)
+{
+    if (current_ < 0) return 0;
+    const uint8_t *data = static_cast<const uint8_t*>(buffers_[current_].start);
+
+    switch (fourcc_)
+    {
+    case V4L2_PIX_FMT_YUYV: return BmodeGrayConverter::applyPacked422(data, width_, height_, stride_, 0, roi, output);
+    case V4L2_PIX_FMT_UYVY: return BmodeGrayConverter::applyPacked422(data, width_, height_, stride_, 1, roi, output);
+    default:                return BmodeGrayConverter::applyLuma(data, width_, height_, stride_, roi, output);  // the Y plane comes first
+    }
+}
+
+bool BmodeV4l2Capture::retrieve(cv::Mat &image)
+{
+    if (current_ < 0) return false;
+    uint8_t *data = static_cast<uint8_t*>(buffers_[current_].start);
+
+    // the buffer goes back to the driver at the next grab(), so image gets its own copy
+    switch (fourcc_)
+    {
+    case V4L2_PIX_FMT_YUYV:
+        cv::cvtColor(cv::Mat(height_, width_, CV_8UC2, data, stride_), image, cv::COLOR_YUV2BGR_YUYV);
+        return true;
+    case V4L2_PIX_FMT_UYVY:
+        cv::cvtColor(cv::Mat(height_, width_, CV_8UC2, data, stride_), image, cv::COLOR_YUV2BGR_UYVY);
+        return true;
+    case V4L2_PIX_FMT_NV12:
+        // the interleaved chroma (half the height) follows the Y plane, with the same stride
+        if (bytesused_ < stride_ * height_ * 3 / 2) return false;
+        cv::cvtColor(cv::Mat(height_ * 3 / 2, width_, CV_8UC1, data, stride_), image, cv::COLOR_YUV2BGR_NV12);
+        return true;
+    default:
+        cv::Mat(height_, width_, CV_8UC1, data, stride_).copyTo(image);
+        return true;
+    }
+}
+
+std::string BmodeV4l2Capture::description() const
+{
+    std::stringstream ss;
+    ss << "V4L2 " << path_ << " " << BmodeCameraEnumerator::fourccToString(fourcc_) << " " << width_ << "x" << height_;
+    return ss.str();
+}
+#else
+BmodeV4l2Capture::~BmodeV4l2Capture()
+{
+}
+
+bool BmodeV4l2Capture::open(int index)
+{
+    Q_UNUSED(index);
+    return false;
+}
+
+bool BmodeV4l2Capture::openDevice(const std::string &path)
+{
+    Q_UNUSED(path);
+    return false;
+}
+
+void BmodeV4l2Capture::close()
+{
+}
+
+bool BmodeV4l2Capture::isOpened() const
+{
+    return false;
+}
+
+void BmodeV4l2Capture::requeue()
+{
+}
+
+bool BmodeV4l2Capture::grab(int64_t &timestamp)
+{
+    Q_UNUSED(timestamp);
+    return false;
+}
+
+bool BmodeV4l2Capture::isCaptureTimestamp() const
+{
+    return false;
+}
+
+cv::Size BmodeV4l2Capture::size() const
+{
+    return cv::Size();
+}
+
+int BmodeV4l2Capture::retrieveGray(const cv::Rect &roi, cv::Mat &output)
+{
+    Q_UNUSED(roi);
+    Q_UNUSED(output);
+    return 0;
+}
+
+bool BmodeV4l2Capture::retrieve(cv::Mat &image)
+{
+    Q_UNUSED(image);
+    return false;
+}
+
+std::string BmodeV4l2Capture::description() const
+{
+    return "V4L2 (not available)";
+}
+#endif
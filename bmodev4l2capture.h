@@ -0,0 +1,100 @@
+#ifndef BMODEV4L2CAPTURE_H
+#define BMODEV4L2CAPTURE_H
+
+#include <opencv2/core.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "bmodecapturedevice.h"
+
+/**
+ * @class BmodeV4l2Capture
+ * @brief The camera through V4L2 directly (Linux), with the buffers of the driver mapped in memory, no copy and no decoding.
+ *
+ * For the context. On our Linux acquisition PCs cv::VideoCapture is itself a V4L2 client, but it converts every
+ * image to BGR (a copy of the whole 1920x1080 screen at 60 fps) before we crop it and convert it back to gray, and it
+ * doesn't tell when the image was captured. The frame grabbers give raw YUV anyway, whose luma already is the gray
+ * image, so here we skip all of it:
+ *
+ * - open() picks the fastest raw mode of the device (GREY, NV12, YUYV or UYVY, see BmodeCameraEnumerator), asks the
+ *   driver for NBUFFERS buffers (VIDIOC_REQBUFS, V4L2_MEMORY_MMAP), maps them, queues them all, and starts the stream.
+ * - grab() waits for a filled buffer (poll, then VIDIOC_DQBUF) and gives back the previous one (VIDIOC_QBUF). The
+ *   timestamp is the one of the driver (v4l2_buffer::timestamp, when the image was captured), it is CLOCK_MONOTONIC,
+ *   which is the clock of std::chrono::steady_clock on Linux, so it is directly comparable with the A-mode frames. If
+ *   the driver doesn't use the monotonic clock, the image is timestamped when DQBUF returns, like the OpenCV backend.
+ * - retrieveGray() reads the luma of the roi straight from the mapped buffer into the BmodeFrame (BmodeGrayConverter),
+ *   the only pass over the pixels. retrieve() converts the whole image to BGR, only for the roi detection.
+ *
+ * The compressed formats (MJPG, H264) are not supported, for those open() fails and BmodeGrabWorker falls back to
+ * BmodeOpenCvCapture (with BACKEND_AUTO). BmodeConnection uses OpenCV unless it is told otherwise (setBackend()).
+ *
+ * To test without a frame grabber, the vivid virtual driver gives test patterns in all these formats
+ * (sudo modprobe vivid, then it is the next /dev/videoN). For a real B-mode recording, v4l2loopback makes a device fed
+ * from a file (sudo modprobe v4l2loopback video_nr=10, then
+ * ffmpeg -re -stream_loop -1 -i recording.mp4 -pix_fmt yuyv422 -f v4l2 /dev/video10), openDevice() takes any path.
+ * The latency from the capture until BmodeConnection emits the image is in BmodeConnection::Statistics, tools/v4l2test
+ * checks a device node and measures it.
+ *
+ * On the other systems open() always fails.
+ *
+ */
+
+class BmodeV4l2Capture : public BmodeCaptureDevice
+{
+public:
+    ~BmodeV4l2Capture();
+
+    /**
+     * @brief Open /dev/video<index>
+     */
+    bool open(int index) override;
+
+    /**
+     * @brief Open a device node, e.g. /dev/video10 (v4l2loopback)
+     */
+    bool openDevice(const std::string &path);
+
+    void close() override;
+    bool isOpened() const override;
+    bool grab(int64_t &timestamp) override;
+    bool isCaptureTimestamp() const override;
+    cv::Size size() const override;
+    int retrieveGray(const cv::Rect &roi, cv::Mat &output) override;
+    bool retrieve(cv::Mat &image) override;
+    std::string description() const override;
+
+private:
+
+    /**
+     * @brief A buffer of the driver, mapped in our memory
+     */
+    struct Buffer
+    {
+        void *start = nullptr;
+        std::size_t length = 0;
+    };
+
+    /**
+     * @brief Give the dequeued buffer back to the driver, if there is one
+     */
+    void requeue();
+
+    int fd_ = -1;                   //!< The device, -1 if closed
+    std::string path_;              //!< The device node
+    std::vector<Buffer> buffers_;   //!< The mapped buffers of the driver
+    int current_ = -1;              //!< The buffer we hold (dequeued), -1 if none
+    std::size_t bytesused_ = 0;     //!< The bytes of the image in the current buffer
+    uint32_t fourcc_ = 0;           //!< The pixel format of the stream
+    int width_ = 0;                 //!< [pixel]
+    int height_ = 0;                //!< [pixel]
+    std::size_t stride_ = 0;        //!< [byte] From one row to the next (of the Y plane for NV12)
+    bool monotonic_ = false;        //!< True if the driver timestamps the buffers with CLOCK_MONOTONIC
+
+    const int NBUFFERS = 4;         //!< The buffers we ask the driver for, the driver may give more
+    const int POLL_TIMEOUT_MS = 1000; //!< [ms] grab() fails if there is no image for this long
+};
+
+#endif // BMODEV4L2CAPTURE_H
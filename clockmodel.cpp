@@ -0,0 +1,188 @@
+#include "clockmodel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+ClockModel::ClockModel(double nominalscale, int window)
+    : nominalscale_(nominalscale), window_(std::max(window, MIN_SAMPLES))
+{
+    source_.resize(window_);
+    host_.resize(window_);
+}
+
+int64_t ClockModel::update(int64_t source, int64_t arrival_ns)
+{
+    // the source started over, the old frames don't belong to the same line anymore
+    if (hasreference_ && source < lastsource_) reset();
+
+    if (!hasreference_)
+    {
+        sourceref_ = source;
+        hostref_ = arrival_ns;
+        hasreference_ = true;
+    }
+    else if (source == lastsource_)
+    {
+        // the same frame again (e.g. a duplicate index of the A-mode), nothing new for the fit
+        return estimate_.valid ? toHost(source) : arrival_ns;
+    }
+    lastsource_ = source;
+
+    // a counter of the received frames doesn't count the lost ones, find them in the arrival times
+    if (receivedcounter_ && estimate_.valid) detectGap(source, arrival_ns);
+
+    source_[next_] = static_cast<double>(source + skipped_ - sourceref_);
+    host_[next_] = static_cast<double>(arrival_ns - hostref_);
+    next_ = (next_ + 1) % window_;
+    nsamples_ = std::min(nsamples_ + 1, window_);
+
+    // the fit goes over the whole window, not for every frame. In between, a frame which arrived faster than the
+    // line moves the line down right away, so the line stays under all the frames.
+    if (!estimate_.valid || --untilfit_ <= 0)
+    {
+        fit();
+        untilfit_ = REFIT_INTERVAL;
+    }
+    else
+    {
+        offset_ = std::min(offset_, host_[(next_ + window_ - 1) % window_] - scale_ * source_[(next_ + window_ - 1) % window_]);
+    }
+    return estimate_.valid ? toHost(source) : arrival_ns;
+}
+
+void ClockModel::fit()
+{
+    if (nsamples_ < MIN_SAMPLES) return;
+
+    // least squares slope of all the frames, on the centered values (the times are large, the differences small)
+    double scale = 0.0;
+    if (!fitSlope(scale)) return;
+
+    // the frames which arrived late don't say much about the slope (with the TCP bursts of the A-mode, a burst is a
+    // flat step), so the slope again, only with the frames at most the mean latency above the line
+    double minimum = lowestIntercept(scale);
+    double sum = 0.0;
+    for (int i = 0; i < nsamples_; i++) sum += host_[i] - scale * source_[i] - minimum;
+    double refined = scale;
+    if (fitSlope(refined, scale, minimum + sum / nsamples_)) scale = refined;
+
+    // the line goes under the frame which arrived the fastest, the others arrived that much later
+    minimum = lowestIntercept(scale);
+    double sumsquare = 0.0, maximum = 0.0;
+    sum = 0.0;
+    for (int i = 0; i < nsamples_; i++)
+    {
+        double latency = host_[i] - scale * source_[i] - minimum;
+        sum += latency;
+        sumsquare += latency * latency;
+        maximum = std::max(maximum, latency);
+    }
+    double mean = sum / nsamples_;
+
+    scale_ = scale;
+    offset_ = minimum;
+
+    estimate_.valid = true;
+    estimate_.samples = nsamples_;
+    estimate_.scale = scale;
+    estimate_.drift = (nominalscale_ > 0.0) ? (nominalscale_ / scale - 1.0) * 1e6 : 0.0;
+    estimate_.offset = (nominalscale_ > 0.0) ? (toHost(lastsource_) - static_cast<double>(lastsource_) * nominalscale_) * 1e-6 : 0.0;
+    estimate_.latencyMean = mean * 1e-6;
+    estimate_.latencyJitter = std::sqrt(std::max(sumsquare / nsamples_ - mean * mean, 0.0)) * 1e-6;
+    estimate_.latencyMax = maximum * 1e-6;
+}
+
+bool ClockModel::fitSlope(double &scale, double previousscale, double threshold) const
+{
+    double meansource = 0.0, meanhost = 0.0;
+    int n = 0;
+    for (int i = 0; i < nsamples_; i++)
+    {
+        if (host_[i] - previousscale * source_[i] > threshold) continue;
+        meansource += source_[i];
+        meanhost += host_[i];
+        n++;
+    }
+    if (n < MIN_SAMPLES) return false;
+    meansource /= n;
+    meanhost /= n;
+
+    double covariance = 0.0, variance = 0.0;
+    for (int i = 0; i < nsamples_; i++)
+    {
+        if (host_[i] - previousscale * source_[i] > threshold) continue;
+        double s = source_[i] - meansource;
+        covariance += s * (host_[i] - meanhost);
+        variance += s * s;
+    }
+    if (variance <= 0.0 || covariance <= 0.0) return false;
+    scale = covariance / variance;
+    return true;
+}
+
+void ClockModel::detectGap(int64_t source, int64_t arrival_ns)
+{
+    // how many periods above the line the frame arrived, less than half a period is jitter
+    double residual = static_cast<double>(arrival_ns - toHost(source));
+    int64_t periods = (scale_ > 0.0) ? std::llround(residual / scale_) : 0;
+    if (periods < 1)
+    {
+        gapframes_ = 0;
+        return;
+    }
+
+    // A single late frame (or a burst, where every frame is one period less late than the one before) is latency.
+    // After a gap all the frames are late by the same number of periods.
+    gapframes_ = (periods == gapperiods_) ? gapframes_ + 1 : 1;
+    gapperiods_ = periods;
+    if (gapframes_ < GAP_FRAMES) return;
+
+    // the frames before this one in the run came after the gap too, they move with it
+    skipped_ += periods;
+    estimate_.framesLost += static_cast<uint64_t>(periods);
+    for (int i = 1; i < GAP_FRAMES; i++) source_[(next_ + window_ - i) % window_] += static_cast<double>(periods);
+    gapframes_ = 0;
+    gapperiods_ = 0;
+}
+
+double ClockModel::lowestIntercept(double scale) const
+{
+    double minimum = host_[0] - scale * source_[0];
+    for (int i = 1; i < nsamples_; i++)
+        minimum = std::min(minimum, host_[i] - scale * source_[i]);
+    return minimum;
+}
+
+int64_t ClockModel::toHost(int64_t source) const
+{
+    return hostref_ + static_cast<int64_t>(std::llround(offset_ + scale_ * static_cast<double>(source + skipped_ - sourceref_)));
+}
+
+void ClockModel::setReceivedCounter(bool flag)
+{
+    receivedcounter_ = flag;
+}
+
+bool ClockModel::isValid() const
+{
+    return estimate_.valid;
+}
+
+ClockModel::Estimate ClockModel::getEstimate() const
+{
+    return estimate_;
+}
+
+void ClockModel::reset()
+{
+    nsamples_ = 0;
+    next_ = 0;
+    hasreference_ = false;
+    sourceref_ = hostref_ = lastsource_ = 0;
+    scale_ = offset_ = 0.0;
+    untilfit_ = 0;
+    skipped_ = gapperiods_ = 0;
+    gapframes_ = 0;
+    estimate_ = Estimate();
+}
@@ -0,0 +1,155 @@
+#ifndef CLOCKMODEL_H
+#define CLOCKMODEL_H
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+/**
+ * @class ClockModel
+ * @brief Maps the timestamps of a source onto the host monotonic clock (steady_clock), from the arrival times of its
+ * frames. Estimates the offset and the drift of the source clock online, and the latency on top of the fastest path.
+ *
+ * For the context. The three sources don't share a clock. Qualisys sends the QTM timestamp (its own clock, from the
+ * start of the measurement), the A-mode PC sends nothing but an index, and the frame grabber has the kernel timestamp
+ * with V4L2 (already the host clock) or nothing with OpenCV. What we have on the host is the arrival time of every
+ * frame, which is the capture time plus a latency: a fixed part (exposure, processing, the wire) and a part which
+ * changes every frame (network, the scheduler, TCP bursts of the A-mode). The arrival time alone is off by the
+ * varying part, which is easily one mocap frame.
+ *
+ * The source time and the host time are linear in each other, host = offset + scale * source, the scale is the
+ * drift of the source clock (or the frame period, if the source time is a frame counter). Every frame gives a pair
+ * (source, arrival). Over the last window pairs, the scale is the least squares slope (fitted again on the faster
+ * half of the frames), and the offset is put under the lowest pair, so that the line follows the frames which arrived
+ * the fastest (no frame can arrive before it was sent). toHost() is then the time at which the frame would arrive over the fastest path, without the varying
+ * latency. The fixed part can't be seen in the arrival times, so it is the same for every frame of a source and is
+ * not corrected here.
+ *
+ * The latency in getEstimate() is how much later than the fastest path the frames arrived, over the window.
+ *
+ * If the source time is only our own count of the frames we received (setReceivedCounter(), no index and no timestamp
+ * from the source), a lost frame doesn't show in the source time, and all the frames after it would be put one period
+ * too early. Then a frame that arrives more than half a period above the line is a suspect: if GAP_FRAMES frames in a
+ * row are the same number of periods late, that many frames were lost, and the count is moved on by that much (for
+ * the frames in the window too). Only the GAP_FRAMES - 1 frames before are handed out too early.
+ *
+ * Not thread-safe, the thread which receives the frames owns the model. getEstimate() is a copy to hand out.
+ *
+ */
+
+class ClockModel
+{
+public:
+
+    static constexpr int GAP_FRAMES = 3;        //!< Frames in a row the same number of periods late, to be a gap
+
+    /**
+     * @struct Estimate
+     * @brief The state of the model, for the statistics
+     */
+    struct Estimate {
+        bool valid = false;             //!< False until there are enough frames, toHost() gives the arrival time then
+        int samples = 0;                //!< The number of frames in the window
+        double scale = 0.0;             //!< [ns] Host time per tick of the source (1000 for microseconds, the period for a frame counter)
+        double drift = 0.0;             //!< [ppm] How much faster the source clock is than nominal, 0 without nominal scale
+        double offset = 0.0;            //!< [ms] toHost() minus the source time in nominal units, at the newest frame (the minimum latency, if the source uses the host clock)
+        double latencyMean = 0.0;       //!< [ms] Arrival after the fastest path, mean over the window
+        double latencyJitter = 0.0;     //!< [ms] The same, standard deviation
+        double latencyMax = 0.0;        //!< [ms] The same, maximum
+        uint64_t framesLost = 0;        //!< Lost frames found in the arrival times, only with setReceivedCounter()
+    };
+
+    /**
+     * @brief Constructor function.
+     *
+     * @param nominalscale  The nominal host time per tick of the source [ns], 1000 for microseconds, 0 if it isn't
+     *                      known (a frame counter), then there is no drift in the estimate.
+     * @param window        The number of the latest frames used for the fit
+     */
+    explicit ClockModel(double nominalscale = 1.0, int window = 2048);
+
+    /**
+     * @brief Add a frame, source is its timestamp in source ticks and arrival_ns when it arrived on the host.
+     * If the source time goes back (a new measurement, a reconnection), the model starts over.
+     *
+     * @return toHost(source), the host time of the frame [ns], or arrival_ns until the model is valid
+     */
+    int64_t update(int64_t source, int64_t arrival_ns);
+
+    /**
+     * @brief SET true if the source time is our count of the received frames, so the lost frames have to be found
+     * in the arrival times (see the class description). It stays over reset().
+     */
+    void setReceivedCounter(bool flag);
+
+    /**
+     * @brief GET the host time of the source time source [ns]. Only meaningful when the model is valid.
+     */
+    int64_t toHost(int64_t source) const;
+
+    /**
+     * @brief GET true if there are enough frames for the fit
+     */
+    bool isValid() const;
+
+    /**
+     * @brief GET the state of the model
+     */
+    Estimate getEstimate() const;
+
+    /**
+     * @brief Forget everything, e.g. when the source starts a new stream
+     */
+    void reset();
+
+private:
+
+    static constexpr int MIN_SAMPLES = 8;       //!< Frames needed for the first fit
+    static constexpr int REFIT_INTERVAL = 16;   //!< Frames between two fits, once valid
+
+    /**
+     * @brief Fit the line to the window and compute the estimate
+     */
+    void fit();
+
+    /**
+     * @brief The least squares slope of the window, only of the frames with host - previousscale * source at most
+     * threshold (all of them by default). False if there are too few frames.
+     */
+    bool fitSlope(double &scale, double previousscale = 0.0, double threshold = std::numeric_limits<double>::infinity()) const;
+
+    /**
+     * @brief The intercept of the line with slope scale under all the frames of the window
+     */
+    double lowestIntercept(double scale) const;
+
+    /**
+     * @brief [setReceivedCounter()] Check the new frame against the line, and move skipped_ on if it shows a gap
+     */
+    void detectGap(int64_t source, int64_t arrival_ns);
+
+    double nominalscale_;               //!< See the constructor
+    int window_;                        //!< See the constructor
+
+    std::vector<double> source_;        //!< The source times of the window, relative to sourceref_ [ticks]
+    std::vector<double> host_;          //!< The arrival times of the window, relative to hostref_ [ns]
+    int nsamples_ = 0;                  //!< The number of samples in the window
+    int next_ = 0;                      //!< Where the next sample goes in the window
+
+    bool hasreference_ = false;         //!< False until the first frame after the constructor or reset()
+    int64_t sourceref_ = 0;             //!< The source time of the first frame
+    int64_t hostref_ = 0;               //!< The arrival time of the first frame
+    int64_t lastsource_ = 0;            //!< The source time of the latest frame
+
+    bool receivedcounter_ = false;      //!< See setReceivedCounter()
+    int64_t skipped_ = 0;               //!< [setReceivedCounter()] The lost frames, added to the source time
+    int64_t gapperiods_ = 0;            //!< The number of periods the latest frames were late, 0 if not
+    int gapframes_ = 0;                 //!< How many frames in a row were gapperiods_ late
+
+    double scale_ = 0.0;                //!< The fit, host - hostref_ = offset_ + scale_ * (source - sourceref_)
+    double offset_ = 0.0;               //!< See scale_ [ns]
+    int untilfit_ = 0;                  //!< Frames until the next fit
+    Estimate estimate_;                 //!< The state after the latest fit
+};
+
+#endif // CLOCKMODEL_H
@@ -3,11 +3,11 @@
 
 #include <opencv2/imgproc.hpp>
 #include <QMessageBox>
+#include <QFileInfo>
 #include <QProcess>
 
 #include <regex>
-#include "qualisystransformationmanager.h"
-#include "amodedatamanipulator.h"
+#include "rigidbodyframe.h"
 #include "ultrasoundconfig.h"
 
 #include <Qt3DExtras/Qt3DWindow>
@@ -19,13 +19,6 @@ MainWindow::MainWindow(QWidget *parent)
 {
     ui->setupUi(this);
 
-    // Initialize d_vector and t_vector for plotting purposes
-    us_dvector_             = Eigen::VectorXd::LinSpaced(UltrasoundConfig::N_SAMPLE, 1, UltrasoundConfig::N_SAMPLE) * UltrasoundConfig::DS;             // [[mm]]
-    us_tvector_             = Eigen::VectorXd::LinSpaced(UltrasoundConfig::N_SAMPLE, 1, UltrasoundConfig::N_SAMPLE) * UltrasoundConfig::DT * 1000000;   // [[mu s]]
-    us_dvector_downsampled_ = AmodeDataManipulator::downsampleVector(us_dvector_, round((double)UltrasoundConfig::N_SAMPLE / downsample_ratio_));
-    us_tvector_downsampled_ = AmodeDataManipulator::downsampleVector(us_tvector_, round((double)UltrasoundConfig::N_SAMPLE / downsample_ratio_));
-    downsample_nsample_     = us_dvector_downsampled_.size();
-
     // test create a new QCustomPlot object
     amodePlot = new QCustomPlotIntervalWindow(this);
     amodePlot->setObjectName("amode_originalplot");
@@ -33,11 +26,17 @@ MainWindow::MainWindow(QWidget *parent)
     amodePlot->setInitialSpacing(3);
     amodePlot->xAxis->setLabel("Depth (mm)");
     amodePlot->yAxis->setLabel("Amplitude");
-    amodePlot->xAxis->setRange(0, us_dvector_downsampled_.coeff(us_dvector_downsampled_.size() - 1));
     amodePlot->yAxis->setRange(-500, 7500);
     amodePlot->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding);
     ui->gridLayout_amodeSignals->addWidget(amodePlot);
 
+    // Initialize d_vector and t_vector for plotting purposes, with the default number of samples until we connect
+    initializeAmodeAxis(UltrasoundConfig::N_SAMPLE);
+
+    // The A-mode frames reach the plots through this, at most once per screen refresh
+    myAmodeRenderScheduler = new AmodeRenderScheduler(this);
+    connect(myAmodeRenderScheduler, &AmodeRenderScheduler::renderRequested, this, &MainWindow::displayUSsignal);
+
     // Initalize scatter object, can also only be done programatically
     scatter = new Q3DScatter();
     scatter->setMinimumSize(QSize(2048, 2048));
@@ -76,13 +75,23 @@ MainWindow::MainWindow(QWidget *parent)
     // just opening a camera, so it happen locally.
     // Other reason is that i want to list all of the port available. I was planning to
     // list the name of the port, but apparently it is difficult as they are deep in
-    // Microsoft media API. So i just give info about the resolution.
+    // Microsoft media API. So i just give info about the resolution (on Linux we get the name and the
+    // fastest mode, see BmodeCameraEnumerator). The index of the camera is the data of the item, the
+    // indices don't have to be contiguous (e.g. /dev/video1 is often the metadata of /dev/video0).
     myBmodeConnection = new BmodeConnection();
-    std::vector<std::string> allCameraInfo = myBmodeConnection->getAllCameraInfo();
-    for(const std::string &str : allCameraInfo) {
-        ui->comboBox_camera->addItem(QString::fromStdString(str));
+    for(const BmodeCameraEnumerator::CameraInfo &camera : myBmodeConnection->getCameras()) {
+        ui->comboBox_camera->addItem(QString::fromStdString(camera.toString()), camera.index);
     }
 
+    // The b-mode statistics get their own place in the status bar, the a-mode statistics use the message
+    bmodeStatusLabel_ = new QLabel(this);
+    ui->statusbar->addPermanentWidget(bmodeStatusLabel_);
+    connect(myBmodeConnection, &BmodeConnection::statisticsUpdated, this, &MainWindow::displayBmodeStatistics);
+
+    // same for qualisys, it is filled once the qualisys connection exists
+    qualisysStatusLabel_ = new QLabel(this);
+    ui->statusbar->addPermanentWidget(qualisysStatusLabel_);
+
 }
 
 MainWindow::~MainWindow()
@@ -104,9 +113,9 @@ MainWindow::~MainWindow()
  * *****************************************************************************************
  * ***************************************************************************************** */
 
-void MainWindow::displayImage(const cv::Mat &image) {
-    // Convert the cv::Mat to a QImage
-    QImage qImage(image.data, image.cols, image.rows, image.step, QImage::Format_Grayscale8);
+void MainWindow::displayImage(const BmodeFramePtr &frame) {
+    // A QImage on the pixels of the frame, no copy
+    QImage qImage = BmodeFrame::toQImage(frame);
 
     // Convert the QImage to a QPixmap and scale it to fit the QLabel while maintaining the aspect ratio
     QPixmap pixmap = QPixmap::fromImage(qImage);
@@ -119,6 +128,24 @@ void MainWindow::displayImage(const cv::Mat &image) {
     ui->label_imageDisplay->setPixmap(pixmap_scaled);
 }
 
+void MainWindow::displayBmodeStatistics(const BmodeConnection::Statistics &statistics)
+{
+    // The rate should be the rate of the frame grabber (60 fps for the Epiphan). The latency is from the capture until the
+    // image is emitted to the GUI, the images dropped are the ones the GUI was too slow to take. The clock jitter is how
+    // late grab() returned after the fastest image (see ClockModel).
+    QString text = QString("B-mode: %1 fps | latency mean %2 ms, max %3 ms | processing %4 ms | dropped %5 | failed grabs %6 | allocated %7 | clock jitter %8 ms, max %9 ms")
+                       .arg(statistics.frameRate, 0, 'f', 1)
+                       .arg(statistics.latencyMean, 0, 'f', 2)
+                       .arg(statistics.latencyMax, 0, 'f', 2)
+                       .arg(statistics.processingTime, 0, 'f', 2)
+                       .arg(statistics.dropped)
+                       .arg(statistics.failures)
+                       .arg(statistics.allocations)
+                       .arg(statistics.clock.latencyJitter, 0, 'f', 2)
+                       .arg(statistics.clock.latencyMax, 0, 'f', 2);
+    bmodeStatusLabel_->setText(text);
+}
+
 /*
 void MainWindow::on_pushButton_startCamera_clicked()
 {
@@ -184,6 +211,7 @@ void MainWindow::on_pushButton_qualisysConnect_clicked()
     // <!> Better to just connect the signal and the slot outside the constructor
     // myBmode3Dvisualizer = new Bmode3DVisualizer(nullptr, myBmodeConnection, myQualisysConnection);
     myBmode3Dvisualizer = new Bmode3DVisualizer(nullptr);
+    myBmode3Dvisualizer->setPoseHistory(myQualisysConnection->getPoseHistory());
     connect(myBmodeConnection, &BmodeConnection::imageProcessed, myBmode3Dvisualizer, &Bmode3DVisualizer::onImageReceived);
     connect(myQualisysConnection, &QualisysConnection::dataReceived, myBmode3Dvisualizer, &Bmode3DVisualizer::onRigidBodyReceived);
 
@@ -196,28 +224,19 @@ void MainWindow::on_pushButton_qualisysConnect_clicked()
 }
 */
 
-void MainWindow::updateQualisysText(const QualisysTransformationManager &tmanager) {
+void MainWindow::updateQualisysText(const RigidBodyFramePtr &frame) {
     ui->textEdit_qualisysLog->clear(); // Clear the existing text
 
-    // get all the rigid body from QUalisys
-    QualisysTransformationManager T_all = tmanager;
+    // get all the rigid body from QUalisys, in the order of the settings
     Eigen::IOFormat txt_matrixformat(2, 0, ", ", "; ", "[", "]", "", "");
 
-    // std::vector<Eigen::Isometry3d> allTransforms = T_all.getAllTransformations();
-    // for (const auto& transform : allTransforms) {
-    //     std::cout << "Transformation Matrix:\n" << transform.matrix() << std::endl;
-    // }
-    // std::vector<std::string> allIds = T_all.getAllIds();
-    // for (const auto& id : allIds) {
-    //     std::cout << "ID: " << id << std::endl;
-    // }
-
-    std::vector<std::string> allIds = T_all.getAllIds();
     std::stringstream ss;
-    for (const auto& id : allIds) {
-        Eigen::Isometry3d T = T_all.getTransformationById(id);
-        ss << id << " : ";
-        ss << T.matrix().format(txt_matrixformat);
+    for (int i = 0; i < frame->getNbodies(); i++) {
+        ss << frame->getName(i) << " : ";
+        if (frame->isTracked(i))
+            ss << frame->getTransformation(i).matrix().format(txt_matrixformat);
+        else
+            ss << "not tracked";
         ss << std::endl;
     }
 
@@ -225,6 +244,24 @@ void MainWindow::updateQualisysText(const QualisysTransformationManager &tmanage
     ui->textEdit_qualisysLog->setPlainText(QString::fromStdString(ss.str())); // Add new text
 }
 
+void MainWindow::displayQualisysStatistics(const QualisysConnection::Statistics &statistics)
+{
+    // The rate should be the capture rate of QTM. The frames lost are counted from the frame number of QTM, so they
+    // are lost on the network or by us, the latency is only our side (from the packet until the signal).
+    // The clock is the QTM clock against ours: the drift, and how late the packets arrived after the fastest one.
+    QString text = QString("Qualisys: %1 Hz | latency mean %2 ms, max %3 ms | lost %4, skipped %5 | timeouts %6 | reconnects %7 | clock drift %8 ppm, jitter %9 ms")
+                       .arg(statistics.frameRate, 0, 'f', 1)
+                       .arg(statistics.latencyMean, 0, 'f', 3)
+                       .arg(statistics.latencyMax, 0, 'f', 3)
+                       .arg(statistics.framesLost)
+                       .arg(statistics.framesSkipped)
+                       .arg(statistics.timeouts)
+                       .arg(statistics.reconnects)
+                       .arg(statistics.clock.drift, 0, 'f', 1)
+                       .arg(statistics.clock.latencyJitter, 0, 'f', 2);
+    qualisysStatusLabel_->setText(text);
+}
+
 
 /* *****************************************************************************************
  * Somehting new
@@ -296,7 +333,13 @@ void MainWindow::on_pushButton_bmode2d3d_clicked()
             // Connect the imageProcessed signal to the displayImage slot
             connect(myBmodeConnection, &BmodeConnection::imageProcessed, this, &MainWindow::displayImage);
 
-            int cameraIndex = ui->comboBox_camera->currentIndex();
+            // The region of interest of the B-mode screen, from the calibration config if it has a clip rectangle,
+            // otherwise detected from the first images of the stream
+            if(!myBmodeConnection->loadRoi(ui->lineEdit_calibconfig->text())) {
+                myBmodeConnection->detectRoi();
+            }
+
+            int cameraIndex = ui->comboBox_camera->currentData().toInt();
             if(myBmodeConnection->openCamera(cameraIndex)) {
                 myBmodeConnection->startImageStream();
             } else {
@@ -309,6 +352,7 @@ void MainWindow::on_pushButton_bmode2d3d_clicked()
              * ********************************************************************************** */
 
             myQualisysConnection = new QualisysConnection(nullptr, qualisys_ipstr, qualisys_portushort);
+            connect(myQualisysConnection, &QualisysConnection::statisticsUpdated, this, &MainWindow::displayQualisysStatistics);
             myQualisysConnection->startStreaming();
             // connect(myQualisysConnection, &QualisysConnection::dataReceived, this, &MainWindow::updateQualisysText);
 
@@ -317,6 +361,7 @@ void MainWindow::on_pushButton_bmode2d3d_clicked()
             // <!> Better to just connect the signal and the slot outside the constructor
             // myBmode3Dvisualizer = new Bmode3DVisualizer(nullptr, myBmodeConnection, myQualisysConnection);
             myBmode3Dvisualizer = new Bmode3DVisualizer(nullptr, ui->lineEdit_calibconfig->text());
+            myBmode3Dvisualizer->setPoseHistory(myQualisysConnection->getPoseHistory());
             connect(myBmodeConnection, &BmodeConnection::imageProcessed, myBmode3Dvisualizer, &Bmode3DVisualizer::onImageReceived);
             connect(myQualisysConnection, &QualisysConnection::dataReceived, myBmode3Dvisualizer, &Bmode3DVisualizer::onRigidBodyReceived);
 
@@ -438,11 +483,16 @@ void MainWindow::on_pushButton_mhaRecord_clicked()
         // instantiate new mhawriter, with the file name from textfield
         myMHAWriter = new MHAWriter(nullptr, filepath, "SequenceRecording");
         myMHAWriter->setTransformationID("B_PROBE", "B_REF");
+        // pair every image with the poses at its grab time (nothing to pair without mocap, the old pairing then)
+        if (myQualisysConnection != nullptr) myMHAWriter->setPoseHistory(myQualisysConnection->getPoseHistory());
         // start record (for the moment, inside this function is just a bool indicating that we are recording)
         myMHAWriter->startRecord();
         // connect the bmode and qualisys signal data to the mhawriter data receiving slot
         connect(myBmodeConnection, &BmodeConnection::imageProcessed, myMHAWriter, &MHAWriter::onImageReceived);
         connect(myQualisysConnection, &QualisysConnection::dataReceived, myMHAWriter, &MHAWriter::onRigidBodyReceived);
+
+        // if the A-mode is streaming, record the raw A-mode frames to the same directory
+        if (myAmodeConnection != nullptr && myAmodeConnection->setDirectory(filepath)) myAmodeConnection->setRecord(true);
     }
     else
     {
@@ -454,6 +504,9 @@ void MainWindow::on_pushButton_mhaRecord_clicked()
         disconnect(myBmodeConnection, &BmodeConnection::imageProcessed, myMHAWriter, &MHAWriter::onImageReceived);
         disconnect(myQualisysConnection, &QualisysConnection::dataReceived, myMHAWriter, &MHAWriter::onRigidBodyReceived);
 
+        // finish the A-mode recording too (does nothing if it is not recording)
+        if (myAmodeConnection != nullptr) myAmodeConnection->setRecord(false);
+
         // tell the mhawriter object to stop recording and start writing it to the file
         int recordstatus = myMHAWriter->stopRecord();
         if(recordstatus==1)
@@ -701,8 +754,13 @@ void MainWindow::on_pushButton_amodeConnect_clicked()
         std::string amode_ipstr = amode_ip.toStdString();
         std::regex ipRegex("^(\\d{1,3}\\.){3}\\d{1,3}$");
 
+        // Instead of an ip, the user can put a file recorded by AmodeRecorder, then we play it back instead of
+        // connecting to the A-mode machine (for testing without the machine). In this case the port is the speed
+        // of the playback, 1 is real-time, 0 is as fast as possible.
+        bool isReplay = QFileInfo(amode_ip).isFile();
+
         // check if the input ip looks like an ip
-        if (!std::regex_match(amode_ipstr, ipRegex))
+        if (!isReplay && !std::regex_match(amode_ipstr, ipRegex))
         {
             // Inform the user about the invalid input
             QMessageBox::warning(this, "Invalid Input", "Please enter a valid ip address.");
@@ -711,25 +769,67 @@ void MainWindow::on_pushButton_amodeConnect_clicked()
 
         QString amode_port = ui->lineEdit_amodePort->text();
         bool ok; // Variable to check if the conversion was successful
-        unsigned short amode_portushort = amode_port.toUShort(&ok);
+        unsigned short amode_portushort = 0;
+        double amode_replayspeed = 0;
+        if (isReplay)
+            amode_replayspeed = amode_port.toDouble(&ok);
+        else
+            amode_portushort = amode_port.toUShort(&ok);
 
-        // check if string conversion to ushort is successful
+        // check if string conversion to ushort (or double for the replay) is successful
         if(!ok)
         {
             // Inform the user about the invalid input
-            QMessageBox::warning(this, "Invalid Input", "Please enter a valid port number (0-65535).");
+            if (isReplay)
+                QMessageBox::warning(this, "Invalid Input", "Please enter a valid playback speed (1 is real-time, 0 is as fast as possible).");
+            else
+                QMessageBox::warning(this, "Invalid Input", "Please enter a valid port number (0-65535).");
             return;
         }
 
+        // Instantiate amodeconnection class (or the replay)
+        AmodeReplaySource *myAmodeReplay = nullptr;
+        if (isReplay)
+        {
+            try {
+                myAmodeReplay = new AmodeReplaySource(nullptr, amode_ipstr);
+            } catch (const std::exception& e) {
+                QMessageBox::warning(this, "Invalid Recording", e.what());
+                return;
+            }
+            myAmodeReplay->setSpeed(amode_replayspeed);
+            myAmodeReplay->setLoop(true);
+            myAmodeConnection = myAmodeReplay;
+        }
+        else
+        {
+            // the number of probes comes from the config (if it is loaded), the number of samples is measured from the stream
+            int amode_nprobe = (myAmodeConfig != nullptr && myAmodeConfig->getNprobe() > 0) ? myAmodeConfig->getNprobe() : UltrasoundConfig::N_UST;
+            myAmodeConnection = new AmodeConnection(nullptr, amode_ipstr, amode_port.toStdString(), amode_nprobe);
+        }
+
+        // size the plots for what the source sends
+        initializeAmodeAxis(myAmodeConnection->getNsample());
+
         // Change the text of the button
         ui->pushButton_amodeConnect->setText("Disconnect");
         // Disable the loadconfig button, so the user don't mess up the process
         ui->pushButton_amodeConfig->setEnabled(false);
 
-        // Instantiate amodeconnection class
-        myAmodeConnection = new AmodeConnection(nullptr, amode_ipstr, amode_port.toStdString());
-        connect(myAmodeConnection, &AmodeConnection::dataReceived, this, &MainWindow::displayUSsignal);
+        // the peak tracker is connected before displayUSsignal, so the peaks are already marked when the plots are replotted
+        myAmodePeakTracker = new AmodePeakTracker(this);
+        if (myAmodeConfig != nullptr) myAmodePeakTracker->setWindows(myAmodeConfig->getAllWindows());
+        connect(myAmodeConnection, &AmodeConnection::dataReceived, myAmodePeakTracker, &AmodePeakTracker::onAmodeSignalReceived);
+        connect(myAmodePeakTracker, &AmodePeakTracker::peaksDetected, this, &MainWindow::displayUSpeaks);
+        updateEnvelopeUsage();
+
+        connect(myAmodeConnection, &AmodeConnection::dataReceived, myAmodeRenderScheduler, &AmodeRenderScheduler::submit);
         connect(myAmodeConnection, &AmodeConnection::errorOccured, this, &MainWindow::disconnectUSsignal);
+        connect(myAmodeConnection, &AmodeConnection::statisticsUpdated, this, &MainWindow::displayUSstatistics);
+        // check the index of every frame, so that we know if the A-mode PC or we can't keep up
+        myAmodeConnection->useDataIndex(true);
+        // the replay starts when everything is connected
+        if (myAmodeReplay != nullptr) myAmodeReplay->start();
 
         // Check if amode config already loaded. When myAmodeConfig is nullptr it means the config is not yet loaded.
         if (myAmodeConfig == nullptr)
@@ -765,8 +865,12 @@ void MainWindow::on_pushButton_amodeConnect_clicked()
         if(myAmodeConnection == nullptr) return;
 
         // disconnect the slots
-        disconnect(myAmodeConnection, &AmodeConnection::dataReceived, this, &MainWindow::displayUSsignal);
+        disconnect(myAmodeConnection, &AmodeConnection::dataReceived, myAmodeRenderScheduler, &AmodeRenderScheduler::submit);
         disconnect(myAmodeConnection, &AmodeConnection::errorOccured, this, &MainWindow::disconnectUSsignal);
+        myAmodeRenderScheduler->clear();
+        disconnect(myAmodeConnection, &AmodeConnection::statisticsUpdated, this, &MainWindow::displayUSstatistics);
+        delete myAmodePeakTracker;
+        myAmodePeakTracker = nullptr;
         // delete the amodeconnection object, and set the pointer to nullptr to prevent pointer dangling
         delete myAmodeConnection;        
         myAmodeConnection = nullptr;
@@ -788,6 +892,9 @@ void MainWindow::disconnectUSsignal()
     ui->pushButton_amodeConnect->setText("Connect");
     myAmodeConnection = nullptr;
     isAmodeStream = true;
+    myAmodeRenderScheduler->clear();
+    delete myAmodePeakTracker;
+    myAmodePeakTracker = nullptr;
 
     // ui->pushButton_amodeConnect->setText("Connect");
     // disconnect(myAmodeConnection, &AmodeConnection::dataReceived, this, &MainWindow::displayUSsignal);
@@ -800,60 +907,177 @@ void MainWindow::disconnectUSsignal()
     // myAmodeConnection = nullptr;
 }
 
-void MainWindow::displayUSsignal(const std::vector<uint16_t> &usdata_uint16_)
+void MainWindow::displayUSstatistics(const AmodeStreamStatistics::Summary &summary)
+{
+    // Show the statistics of the A-mode stream in the status bar, it tells us whether the A-mode PC (gaps in the index)
+    // or this software (dropped frames, long inter-arrival time) can't keep up. The frames skipped by the plots are
+    // expected when the stream is faster than the screen refresh.
+    QString text = QString("A-mode: %1 fps | %2 MB/s | inter-arrival mean %3 ms, p99 %4 ms | gaps %5 (%6 frames missing) | duplicates %7 | GUI dropped %8 (overruns %14) | plot skipped %10, paint %11 ms | envelope %9 ns/sample | clock period %12 ms, jitter %13 ms")
+                       .arg(summary.frameRate, 0, 'f', 1)
+                       .arg(summary.throughput, 0, 'f', 2)
+                       .arg(summary.interarrivalMean, 0, 'f', 2)
+                       .arg(summary.interarrivalP99, 0, 'f', 2)
+                       .arg(summary.gaps)
+                       .arg(summary.framesMissing)
+                       .arg(summary.duplicates)
+                       .arg(myAmodeConnection ? myAmodeConnection->getDroppedFrames() : 0)
+                       .arg(summary.envelopeTime, 0, 'f', 2)
+                       .arg(myAmodeRenderScheduler->getSkippedFrames())
+                       .arg(amodePaintTime_, 0, 'f', 2)
+                       .arg(summary.clock.scale * 1.0e-6, 0, 'f', 4)
+                       .arg(summary.clock.latencyJitter, 0, 'f', 2)
+                       .arg(myAmodeConnection ? myAmodeConnection->getOverrunFrames() : 0);
+    ui->statusbar->showMessage(text);
+}
+
+void MainWindow::displayUSpeaks(const AmodePeakTracker::PeakFrame &peaks)
+{
+    // mark the peak on the plot of every probe that is shown right now, displayUSsignal() does the replot
+    for (int k = 0; k < peaks.npeak; k++)
+    {
+        const AmodePeakTracker::Peak &peak = peaks.peaks[k];
+        for (size_t i = 0; i < amodeGroup_.size() && i < amodePlots.size(); i++)
+        {
+            if (amodeGroup_.at(i).number == peak.probe) amodePlots.at(i)->setPeak(peak.depth);
+        }
+    }
+}
+
+void MainWindow::updateAmodePeakWindow(QCustomPlotIntervalWindow *plot, int number)
+{
+    if (myAmodePeakTracker == nullptr) return;
+
+    // the lower and the upper line are the window, if one of them is outside of the plot there is no window
+    auto positions = plot->getLinePositions();
+    if (positions[0].has_value() && positions[2].has_value())
+    {
+        myAmodePeakTracker->setWindow(number, positions[0].value(), positions[2].value());
+    }
+    else
+    {
+        myAmodePeakTracker->removeWindow(number);
+        plot->clearPeak();
+    }
+    updateEnvelopeUsage();
+}
+
+void MainWindow::updateEnvelopeUsage()
 {
+    if (myAmodeConnection == nullptr) return;
+    bool needed = (myVolumeAmodeController != nullptr) || !amodeWaterfalls_.empty() || (myAmodePeakTracker != nullptr && myAmodePeakTracker->getNwindows() > 0);
+    myAmodeConnection->useEnvelope(needed);
+}
+
+void MainWindow::displayUSsignal(const AmodeFramePtr &frame)
+{
+    // How long the replot of the plots that are shown takes (QCustomPlot measures every replot, this is the average of
+    // the last ones), that is what one frame costs the GUI thread. Shown in the status bar.
+    double painttime = 0.0;
+    if (myAmodeConfig == nullptr) painttime = amodePlot ? amodePlot->replotTime(true) : 0.0;
+    else if (amodeGroupPlot_ != nullptr) painttime = amodeGroupPlot_->replotTime(true);
+    else for (QCustomPlotIntervalWindow *plot : amodePlots) painttime += plot->replotTime(true);
+    for (AmodeWaterfallPlot *waterfall : amodeWaterfalls_) painttime += waterfall->replotTime(true);
+    amodePaintTime_ = painttime;
+
     // Check if Amode config file is already loaded. Why matters? because i need to adjust the UI if the user load the config
     // When myAmodeConfig is nullptr it means the config is not yet loaded.
     if (myAmodeConfig == nullptr)
     {
-        // convert data to int
-        QVector<int16_t> usdata_qvint16_ (usdata_uint16_.begin(), usdata_uint16_.end());
-        // select row
-        QVector<int16_t> usdata_qvint16_rowsel = AmodeDataManipulator::getRow(usdata_qvint16_, ui->comboBox_amodeNumber->currentIndex(), myAmodeConnection->getNsample());
-        // down sample for display purposes
-        QVector<int16_t> usdata_qvint16_downsmp = AmodeDataManipulator::downsampleVector(usdata_qvint16_rowsel, downsample_nsample_);
-        // skip the data if we got all zeros, usually because of the TCP connection
-        if (usdata_qvint16_rowsel.size()==0) return;
-        // convert to double
-        QVector<double> usdata_qvdouble;
-        std::transform(usdata_qvint16_downsmp.begin(), usdata_qvint16_downsmp.end(), std::back_inserter(usdata_qvdouble), [] (double value) { return static_cast<double>(value); });
-
-        // create x-axis
-        QVector<double> x(us_dvector_downsampled_.data(), us_dvector_downsampled_.data() + us_dvector_downsampled_.size());
-        // draw the plot
-        amodePlot->graph(0)->setData(x, usdata_qvdouble);
-        amodePlot->replot();
+        if (!amodePlot) return;
+        // select row, this is just a view inside the frame (no copy)
+        AmodeFrame::ProbeView probe = frame->probe(ui->comboBox_amodeNumber->currentIndex());
+        // skip the data if the probe doesn't exist
+        if (probe.isEmpty()) return;
+        // down sample (for display purposes) directly to the data of the plot, then draw it
+        plotAmodeProbe(amodePlot, probe);
+        amodePlot->replot(QCustomPlot::rpQueuedReplot);
     }
 
     // If the config file is already loaded, do almost similar thing but with several signal at once.
+    else if (amodeGroupPlot_ != nullptr)
+    {
+        // a big group, all probes are in one plot
+        amodeGroupPlot_->plotFrame(frame);
+        amodeGroupPlot_->replot(QCustomPlot::rpQueuedReplot);
+    }
     else
     {
-        // convert data to int
-        QVector<int16_t> usdata_qvint16_ (usdata_uint16_.begin(), usdata_uint16_.end());
-        // get the current selected group
-        std::vector<AmodeConfig::Data> amode_group = myAmodeConfig->getDataByGroupName(ui->comboBox_amodeNumber->currentText().toStdString());
         // for every element in the selected group...
-        for (size_t i=0; i<amode_group.size(); i++)
+        for (size_t i=0; i<amodeGroup_.size() && i<amodePlots.size(); i++)
         {
-            // select row
-            QVector<int16_t> usdata_qvint16_rowsel = AmodeDataManipulator::getRow(usdata_qvint16_, amode_group.at(i).number-1, myAmodeConnection->getNsample());
-            // down sample for display purposes
-            QVector<int16_t> usdata_qvint16_downsmp = AmodeDataManipulator::downsampleVector(usdata_qvint16_rowsel, downsample_nsample_);
-            // skip the data if we got all zeros, usually because of the TCP connection
-            if (usdata_qvint16_rowsel.size()==0) return;
-            // convert to double
-            QVector<double> usdata_qvdouble;
-            std::transform(usdata_qvint16_downsmp.begin(), usdata_qvint16_downsmp.end(), std::back_inserter(usdata_qvdouble), [] (double value) { return static_cast<double>(value); });
-
-            // create x-axis
-            QVector<double> x(us_dvector_downsampled_.data(), us_dvector_downsampled_.data() + us_dvector_downsampled_.size());
-            // draw the plot
-            amodePlots.at(i)->graph(0)->setData(x, usdata_qvdouble);
-            amodePlots.at(i)->replot();
+            // select row, this is just a view inside the frame (no copy)
+            AmodeFrame::ProbeView probe = frame->probe(amodeGroup_.at(i).number-1);
+            // skip the data if the probe doesn't exist
+            if (probe.isEmpty()) return;
+            // down sample (for display purposes) directly to the data of the plot, then draw it
+            plotAmodeProbe(amodePlots.at(i), probe);
+            amodePlots.at(i)->replot(QCustomPlot::rpQueuedReplot);
+
+            // the newest row of the history (only the row is added, not the whole history)
+            if (i < amodeWaterfalls_.size())
+            {
+                amodeWaterfalls_.at(i)->addFrame(frame->envelope(amodeGroup_.at(i).number-1), frame->getTimestamp());
+                amodeWaterfalls_.at(i)->replot(QCustomPlot::rpQueuedReplot);
+            }
         }
     }
 }
 
+void MainWindow::initializeAmodeAxis(int nsample)
+{
+    amode_nsample_          = nsample;
+    us_dvector_             = Eigen::VectorXd::LinSpaced(nsample, 1, nsample) * UltrasoundConfig::DS;             // [[mm]]
+    us_tvector_             = Eigen::VectorXd::LinSpaced(nsample, 1, nsample) * UltrasoundConfig::DT * 1000000;   // [[mu s]]
+    amodeDecimators_.clear();
+
+    // The plots get the new x-axis, and their data is cleared so plotAmodeProbe() puts the new keys. amodePlot is gone
+    // (the QPointer is null) once on_comboBox_amodeNumber_textActivated() replaced it with the plots of a group.
+    std::vector<QCustomPlot*> plots(amodePlots.begin(), amodePlots.end());
+    if (amodePlot) plots.push_back(amodePlot);
+    for (QCustomPlot *plot : plots)
+    {
+        plot->xAxis->setRange(0, us_dvector_.coeff(us_dvector_.size() - 1));
+        plot->graph(0)->data()->clear();
+    }
+    if (amodeGroupPlot_ != nullptr) amodeGroupPlot_->setDepth(us_dvector_);
+    for (AmodeWaterfallPlot *waterfall : amodeWaterfalls_) waterfall->setDepth(us_dvector_);
+}
+
+void MainWindow::plotAmodeProbe(QCustomPlot *plot, const AmodeFrame::ProbeView &probe)
+{
+    // The plot can't show more than one value per pixel column, so we give it the minimum and the maximum of every
+    // column (the echoes don't disappear like when we picked every 4th sample). The decimator depends on the width,
+    // there is one for every width we have seen, so a resize doesn't throw away the one of the other plots.
+    int ncolumn = plot->axisRect()->width();
+    if (ncolumn <= 0) ncolumn = amode_nsample_ / 4;
+    auto it = amodeDecimators_.find(ncolumn);
+    if (it == amodeDecimators_.end())
+    {
+        // resizing the window goes through many widths, we don't need to keep all of them
+        if (amodeDecimators_.size() >= 8) amodeDecimators_.clear();
+        it = amodeDecimators_.emplace(ncolumn, AmodeMinMaxDecimator(amode_nsample_, ncolumn)).first;
+    }
+    AmodeMinMaxDecimator &decimator = it->second;
+    if (decimator.getNoutput() == 0) return;
+
+    // The x-axis only changes with the width, so we only put it then (or again if somebody cleared the data of the plot).
+    // After that we only overwrite the values inside the data container of the graph, nothing is allocated.
+    // QCPGraphDataContainer stores the QCPGraphData (key, value) contiguously, so the keys and the values are every
+    // sizeof(QCPGraphData)/sizeof(double) doubles.
+    const std::ptrdiff_t stride = sizeof(QCPGraphData) / sizeof(double);
+    QSharedPointer<QCPGraphDataContainer> data = plot->graph(0)->data();
+    if (data->size() != decimator.getNoutput())
+    {
+        QVector<QCPGraphData> points(decimator.getNoutput());
+        decimator.keys(us_dvector_.data(), &points[0].key, stride);
+        data->set(points, true);
+    }
+
+    // The values go directly into the data of the graph
+    if (probe.size != decimator.getNsample()) return;
+    decimator.apply(probe.data, &data->begin()->value, stride);
+}
+
 
 
 
@@ -909,11 +1133,27 @@ void MainWindow::on_comboBox_amodeNumber_textActivated(const QString &arg1)
     }
     // delete whatever there is inside the amodePlots
     amodePlots.clear();
+    amodeWaterfalls_.clear();
+    amodeGroupPlot_ = nullptr;
 
-    // get the a-mode groups
+    // get the a-mode groups, and keep it for displayUSsignal(), so that we don't look it up for every frame
     std::vector<AmodeConfig::Data> amode_group = myAmodeConfig->getDataByGroupName(arg1.toStdString());
+    amodeGroup_ = amode_group;
 
-    for(std::size_t i = 0; i < amode_group.size(); ++i)
+    // The grid below only has room for 4 plots. A bigger group goes into one plot with all the probes stacked (it is
+    // also much faster to paint one plot than 30), in that case there are no amodePlots.
+    std::size_t nplot = amode_group.size();
+    if (amode_group.size() > 4)
+    {
+        amodeGroupPlot_ = new AmodeGroupPlot(this);
+        amodeGroupPlot_->setObjectName("amode_groupplot");
+        amodeGroupPlot_->setGroup(amode_group);
+        amodeGroupPlot_->setDepth(us_dvector_);
+        ui->gridLayout_amodeSignals->addWidget(amodeGroupPlot_, 0,0, 2,2);
+        nplot = 0;
+    }
+
+    for(std::size_t i = 0; i < nplot; ++i)
     {
         // create a string for the plot name
         std::string str_num = "amode_plot" + std::to_string(amode_group.at(i).number);
@@ -924,7 +1164,7 @@ void MainWindow::on_comboBox_amodeNumber_textActivated(const QString &arg1)
         current_plot->setInitialSpacing(3);
         current_plot->xAxis->setLabel("Depth (mm)");
         current_plot->yAxis->setLabel("Amplitude");
-        current_plot->xAxis->setRange(0, us_dvector_downsampled_.coeff(us_dvector_downsampled_.size() - 1));
+        current_plot->xAxis->setRange(0, us_dvector_.coeff(us_dvector_.size() - 1));
         current_plot->yAxis->setRange(-500, 7500);
         current_plot->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding);
 
@@ -942,28 +1182,57 @@ void MainWindow::on_comboBox_amodeNumber_textActivated(const QString &arg1)
             current_plot->setInitialLines(window);
         }
 
+        // when the user moves the window, the peak tracker follows
+        int number = amode_group.at(i).number;
+        connect(current_plot, &QCustomPlotIntervalWindow::windowChanged, this, [this, current_plot, number]() { updateAmodePeakWindow(current_plot, number); });
+
         // store the plot to our vector, collection of plots
         amodePlots.push_back(current_plot);
 
+        // the waterfall goes below the plot, with the same depth axis, both of them go into the grid as one cell
+        QWidget *current_cell = current_plot;
+        if (ui->checkBox_amodeWaterfall->isChecked())
+        {
+            AmodeWaterfallPlot *current_waterfall = new AmodeWaterfallPlot(this);
+            current_waterfall->setObjectName(QString::fromStdString("amode_waterfall" + std::to_string(amode_group.at(i).number)));
+            current_waterfall->setDepth(us_dvector_);
+            amodeWaterfalls_.push_back(current_waterfall);
+
+            current_cell = new QWidget(this);
+            QVBoxLayout *cell_layout = new QVBoxLayout(current_cell);
+            cell_layout->setContentsMargins(0, 0, 0, 0);
+            cell_layout->addWidget(current_plot, 2);
+            cell_layout->addWidget(current_waterfall, 1);
+        }
+
         // this part is just for visualization organization, i want the organization is a bit more automatic
         // so that i could generate 00,01,10,11 according how many amode i want to plot
         short bit1 = (i >> 1) & 1;
         short bit2 = i & 1;
         if (amode_group.size()==1)
         {
-            ui->gridLayout_amodeSignals->addWidget(current_plot, 0,0, 2,2);
+            ui->gridLayout_amodeSignals->addWidget(current_cell, 0,0, 2,2);
         }
         if (amode_group.size()==2)
         {
             // ui->gridLayout_amodeSignals->addWidget(current_plot, bit1, bit2, 2,1);
-            ui->gridLayout_amodeSignals->addWidget(current_plot, bit2, bit1, 1,2);
+            ui->gridLayout_amodeSignals->addWidget(current_cell, bit2, bit1, 1,2);
         }
         if (amode_group.size()==3 || amode_group.size()==4)
         {
-            ui->gridLayout_amodeSignals->addWidget(current_plot, bit1, bit2, 1,1);
+            ui->gridLayout_amodeSignals->addWidget(current_cell, bit1, bit2, 1,1);
         }
     }
 
+    // the plots start again from the windows in the config, so does the peak tracker
+    if (myAmodePeakTracker != nullptr)
+    {
+        myAmodePeakTracker->clearWindows();
+        myAmodePeakTracker->setWindows(myAmodeConfig->getAllWindows());
+    }
+    // the waterfalls need the envelope
+    updateEnvelopeUsage();
+
     // I want to make this pushbutton, when changed, also change the 3d amode visualization
     if(myVolumeAmodeController == nullptr) return;
 
@@ -978,13 +1247,29 @@ void MainWindow::on_comboBox_amodeNumber_textActivated(const QString &arg1)
     myVolumeAmodeController = nullptr;
 
     // ...then reinitialize again. It's working. I don't care it is ugly. Bye.
-    myVolumeAmodeController = new VolumeAmodeController(nullptr, scatter, amode_group);
+    myVolumeAmodeController = new VolumeAmodeController(nullptr, scatter, amode_group, amode_nsample_);
+    myVolumeAmodeController->setPoseHistory(myQualisysConnection->getPoseHistory());
     connect(myQualisysConnection, &QualisysConnection::dataReceived, myVolumeAmodeController, &VolumeAmodeController::onRigidBodyReceived);
     connect(myAmodeConnection, &AmodeConnection::dataReceived, myVolumeAmodeController, &VolumeAmodeController::onAmodeSignalReceived);
 
 }
 
 
+void MainWindow::on_checkBox_amodeWaterfall_clicked(bool checked)
+{
+    Q_UNUSED(checked);
+
+    // the plots of the current group are created again, with or without the waterfalls. Without a config there is
+    // only amodePlot, the waterfalls are only for the groups.
+    if (myAmodeConfig == nullptr)
+    {
+        QMessageBox::warning(this, "Can't show waterfall", "To show the waterfall, please load the amode configuration file first.");
+        ui->checkBox_amodeWaterfall->setCheckState(Qt::Unchecked);
+        return;
+    }
+    on_comboBox_amodeNumber_textActivated(ui->comboBox_amodeNumber->currentText());
+}
+
 void MainWindow::on_pushButton_amodeWindow_clicked()
 {
     if(myAmodeConfig==nullptr)
@@ -997,6 +1282,13 @@ void MainWindow::on_pushButton_amodeWindow_clicked()
     // get the a-mode groups
     std::vector<AmodeConfig::Data> amode_group = myAmodeConfig->getDataByGroupName(ui->comboBox_amodeNumber->currentText().toStdString());
 
+    // the windows are drawn in amodePlots, the big groups (AmodeGroupPlot) don't have them
+    if(amodePlots.size() != amode_group.size())
+    {
+        QMessageBox::warning(this, "Cannot save window", "The windows can only be set for a group with 4 probes or less");
+        return;
+    }
+
     // loop for all member of groups
     for(std::size_t i = 0; i < amode_group.size(); ++i)
     {
@@ -1074,9 +1366,13 @@ void MainWindow::on_checkBox_volumeShow3DSignal_clicked(bool checked)
         // instantiate myVolumeAmodeController
         // for note: i declare intentionally the argument for amode_group as value not the reference (a pointer to amode_group)
         // because amode_group here declared locally, so the reference will be gone outside of this scope.
-        myVolumeAmodeController = new VolumeAmodeController(nullptr, scatter, amode_group);
+        myVolumeAmodeController = new VolumeAmodeController(nullptr, scatter, amode_group, amode_nsample_);
         myVolumeAmodeController->setSignalDisplayMode(ui->comboBox_volume3DSignalMode->currentIndex());
         myVolumeAmodeController->setActiveHolder(ui->comboBox_amodeNumber->currentText().toStdString());
+        myVolumeAmodeController->setPoseHistory(myQualisysConnection->getPoseHistory());
+
+        // the 3d signal shows the envelope, the source computes it for us
+        updateEnvelopeUsage();
 
         // connect necessary slots
         connect(myQualisysConnection, &QualisysConnection::dataReceived, myVolumeAmodeController, &VolumeAmodeController::onRigidBodyReceived);
@@ -1100,6 +1396,9 @@ void MainWindow::on_checkBox_volumeShow3DSignal_clicked(bool checked)
         delete myVolumeAmodeController;
         myVolumeAmodeController = nullptr;
 
+        // the envelope is only needed now if the peak tracker has windows
+        updateEnvelopeUsage();
+
         // enable changing the state of combo box for variation display mode for amode 3d signal
         ui->comboBox_volume3DSignalMode->setEnabled(false);
     }
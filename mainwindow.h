@@ -5,9 +5,16 @@
 #include <QLabel>
 #include <QComboBox>
 #include <QPushButton>
+#include <QPointer>
 
 #include "amodeconnection.h"
+#include "amodereplaysource.h"
 #include "amodeconfig.h"
+#include "amodegroupplot.h"
+#include "amodeminmaxdecimator.h"
+#include "amodepeaktracker.h"
+#include "amoderenderscheduler.h"
+#include "amodewaterfallplot.h"
 #include "bmodeconnection.h"
 #include "bmode3dvisualizer.h"
 #include "qcustomplot.h"
@@ -33,10 +40,14 @@ public:
     ~MainWindow();
 
 public slots:
-    void displayImage(const cv::Mat &image);
-    void displayUSsignal(const std::vector<uint16_t> &usdata_uint16_);
+    void displayImage(const BmodeFramePtr &frame);
+    void displayBmodeStatistics(const BmodeConnection::Statistics &statistics);
+    void displayUSsignal(const AmodeFramePtr &frame);
     void disconnectUSsignal();
-    void updateQualisysText(const QualisysTransformationManager &tmanager);
+    void displayUSstatistics(const AmodeStreamStatistics::Summary &summary);
+    void displayUSpeaks(const AmodePeakTracker::PeakFrame &peaks);
+    void updateQualisysText(const RigidBodyFramePtr &frame);
+    void displayQualisysStatistics(const QualisysConnection::Statistics &statistics);
 
     void volumeReconstructorCmdFinished();
     void volumeReconstructorCmdStandardOutput();
@@ -53,6 +64,7 @@ private slots:
     void on_pushButton_amodeConfig_clicked();
     void on_comboBox_amodeNumber_textActivated(const QString &arg1);
     void on_pushButton_amodeWindow_clicked();
+    void on_checkBox_amodeWaterfall_clicked(bool checked);
 
     void on_pushButton_volumeLoad_clicked();
     void on_pushButton_volumeReconstruct_clicked();
@@ -71,9 +83,31 @@ private:
     void slotConnect_Amode();
     void slotDisconnect_Amode();
 
+    /**
+     * @brief Compute the depth and time axis (and the downsampling) for nsample samples, and apply it to the 2d plots.
+     * Called once in the constructor and once every time the A-mode source is connected (the number of samples comes
+     * from the A-mode machine or the recording).
+     */
+    void initializeAmodeAxis(int nsample);
+
+    /**
+     * @brief Downsample one probe directly into the data of the first graph of plot (no allocation after the first call)
+     */
+    void plotAmodeProbe(QCustomPlot *plot, const AmodeFrame::ProbeView &probe);
+
+    /**
+     * @brief Give the window of a plot to myAmodePeakTracker, called when the user changed the window of the plot
+     */
+    void updateAmodePeakWindow(QCustomPlotIntervalWindow *plot, int number);
+
+    /**
+     * @brief Let the source compute the envelope only if somebody needs it (the 3d signal or the peak tracker)
+     */
+    void updateEnvelopeUsage();
+
     Ui::MainWindow *ui;
 
-    AmodeConnection *myAmodeConnection              = nullptr;
+    AmodeSource *myAmodeConnection                  = nullptr;
     AmodeConfig *myAmodeConfig                      = nullptr;
     BmodeConnection *myBmodeConnection              = nullptr;
     QualisysConnection *myQualisysConnection        = nullptr;
@@ -82,20 +116,27 @@ private:
     MHAReader *myMHAReader                          = nullptr;
     Volume3DController *myVolume3DController        = nullptr;
     VolumeAmodeController *myVolumeAmodeController  = nullptr;
+    AmodePeakTracker *myAmodePeakTracker            = nullptr;
+    AmodeRenderScheduler *myAmodeRenderScheduler    = nullptr;
 
     // for
     Q3DScatter *scatter;                        //!< For handling amode 3d plots and 3d volume visualization
     QProcess* process;                          //!< For invoking command prompt
 
+    QLabel *bmodeStatusLabel_ = nullptr;        //!< The statistics of the b-mode stream, on the right of the status bar
+    QLabel *qualisysStatusLabel_ = nullptr;     //!< The statistics of the qualisys stream, next to bmodeStatusLabel_
+
     // for amode 2d plots
-    QCustomPlotIntervalWindow *amodePlot;
+    QPointer<QCustomPlotIntervalWindow> amodePlot;     //!< The single probe plot before a config is loaded, deleted (null) once the groups of the config are shown
     std::vector<QCustomPlotIntervalWindow*> amodePlots; //!< For handling amode 2d plots visualization
+    std::vector<AmodeConfig::Data> amodeGroup_; //!< The a-mode group that is shown in amodePlots (selected in comboBox_amodeNumber)
+    AmodeGroupPlot *amodeGroupPlot_ = nullptr;  //!< Instead of amodePlots, for the groups with more than 4 probes
+    std::vector<AmodeWaterfallPlot*> amodeWaterfalls_; //!< The history of every probe of amodePlots, below its plot (if checkBox_amodeWaterfall)
+    double amodePaintTime_ = 0.0;               //!< [ms] Time to replot all the a-mode 2d plots for one frame (average)
     Eigen::VectorXd us_dvector_;                //!< Stores the array of distances, used by plots
-    Eigen::VectorXd us_dvector_downsampled_;    //!< Same as us_dvector_, but downsampled
     Eigen::VectorXd us_tvector_;                //!< Stores the array of time, used by plots
-    Eigen::VectorXd us_tvector_downsampled_;    //!< Same as us_tvector_, but downsampled
-    double downsample_ratio_ = 4.0;             //!< Downsample ratio, used to reduce the amount of data being visualized in 2d plots
-    int downsample_nsample_;                    //!< The real length of the downsampled array
+    int amode_nsample_;                         //!< The number of samples of each probe from the A-mode source
+    std::map<int, AmodeMinMaxDecimator> amodeDecimators_; //!< Min/max of every pixel column for the 2d plots, for every plot width
 
     bool isMHArecord            = true;         //!< Flag to inform whether we are ready for recording MHA or not
 
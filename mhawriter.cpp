@@ -2,6 +2,7 @@
 #include <opencv2/imgcodecs.hpp>
 #include <QThread>
 #include <QMessageBox>
+#include <limits>
 
 
 MHAWriter::MHAWriter(QObject *parent,  const std::string& filepath, const std::string& prefixname)
@@ -13,50 +14,93 @@ MHAWriter::MHAWriter(QObject *parent,  const std::string& filepath, const std::s
     if (!mhaFile_.is_open()) {
         throw std::runtime_error("Unable to open file: " + fullfilename_);
     }
-
-    // start the timestamp
-    timestamp.start();
 }
 
 void MHAWriter::setTransformationID(std::string bmodeprobe_transformationID, std::string bmoderef_transformationID)
 {
     bmodeprobe_transformationID_ = bmodeprobe_transformationID;
     bmoderef_transformationID_ = bmoderef_transformationID;
+    probeHandle_ = RigidBodyFrame::Handle(bmodeprobe_transformationID_);
+    refHandle_ = RigidBodyFrame::Handle(bmoderef_transformationID_);
 }
 
-void MHAWriter::onImageReceived(const cv::Mat &image) {
+void MHAWriter::setPoseHistory(std::shared_ptr<const PoseHistory> posehistory)
+{
+    posehistory_ = posehistory;
+}
+
+void MHAWriter::onImageReceived(const BmodeFramePtr &frame) {
+    // with the history, the image waits until the mocap caught up with its timestamp
+    if (posehistory_) {
+        pendingImages.push_back(frame);
+        pairPendingImages();
+        return;
+    }
+
     // if there is already data from mocap let's store
     // here i only check one of the data from mocap, they are coupled anyway, so..
     if (latestTransform_probe) {
-        storeDataPair(image, *latestTransform_probe, *latestTransform_ref);
+        storeDataPair(frame, *latestTransform_probe, *latestTransform_ref);
         resetData();
     } else {
-        latestImage = image;
+        latestImage = frame;
     }
 }
 
-void MHAWriter::onRigidBodyReceived(const QualisysTransformationManager &tmanager) {
+void MHAWriter::onRigidBodyReceived(const RigidBodyFramePtr &frame) {
+    // with the history, a new pose only means that the pending images might be ready now
+    if (posehistory_) {
+        pairPendingImages();
+        return;
+    }
+
+    // both of the bodies need to be in the settings of QTM, otherwise there is nothing to pair with
+    Eigen::Isometry3d transform_probe, transform_ref;
+    if (!frame->getTransformation(probeHandle_, transform_probe) || !frame->getTransformation(refHandle_, transform_ref)) return;
+
     if (latestImage) {
-        storeDataPair(*latestImage, tmanager.getTransformationById(bmodeprobe_transformationID_), tmanager.getTransformationById(bmoderef_transformationID_));
+        storeDataPair(latestImage, transform_probe, transform_ref);
         resetData();
     } else {
-        latestTransform_probe = tmanager.getTransformationById(bmodeprobe_transformationID_);
-        latestTransform_ref = tmanager.getTransformationById(bmoderef_transformationID_);
+        latestTransform_probe = transform_probe;
+        latestTransform_ref = transform_ref;
     }
 }
 
-void MHAWriter::storeDataPair(const cv::Mat& image, const Eigen::Isometry3d& transform_probe, const Eigen::Isometry3d& transform_ref) {
-    // make a complete copy of cv::Mat using copyTo() function, it is super necessary so that i am not referencing the streaming image
-    cv::Mat imageCopy;
-    image.copyTo(imageCopy);
+void MHAWriter::storeDataPair(const BmodeFramePtr& frame, const Eigen::Isometry3d& transform_probe, const Eigen::Isometry3d& transform_ref) {
+    // No copy of the image. The frame is read-only and nobody writes into it while we hold it (it only goes back to
+    // the pool of BmodeConnection when we let go), so holding it is the same as a copy.
     // make a copy of Eigen::Isometry3d, not like cv::Mat, assigning new object like this will not affect the original object
     Eigen::Isometry3d transformCopy_probe = transform_probe;
     Eigen::Isometry3d transformCopy_ref   = transform_ref;
 
-    allImages.push_back(imageCopy);
+    allImages.push_back(frame);
     allTransforms_probe.push_back(transformCopy_probe);
     allTransforms_ref.push_back(transformCopy_ref);
-    allTimestamps.push_back(timestamp.elapsed()/1000.0);
+    // the time of the image on the host clock (the same as the poses), in seconds from the first image of the recording
+    if (allImages.size() == 1) firsttimestamp_ = frame->getTimestamp();
+    allTimestamps.push_back((frame->getTimestamp() - firsttimestamp_) * 1.0e-9);
+}
+
+void MHAWriter::pairPendingImages() {
+    int64_t newest = posehistory_->getNewestTimestamp();
+    while (!pendingImages.empty()) {
+        const BmodeFramePtr &image = pendingImages.front();
+
+        // no pose after the image yet, wait for the next one (unless the mocap stopped streaming)
+        if (image->getTimestamp() >= newest && static_cast<int>(pendingImages.size()) <= MAX_PENDING) break;
+
+        // no pose for the image (the body is not tracked, or the image is older than the history), the image is
+        // still stored, with NaN which writeTransformations() marks INVALID
+        Eigen::Isometry3d transform_probe, transform_ref;
+        if (!posehistory_->poseAt(probeHandle_, image->getTimestamp(), transform_probe))
+            transform_probe.matrix().setConstant(std::numeric_limits<double>::quiet_NaN());
+        if (!posehistory_->poseAt(refHandle_, image->getTimestamp(), transform_ref))
+            transform_ref.matrix().setConstant(std::numeric_limits<double>::quiet_NaN());
+
+        storeDataPair(image, transform_probe, transform_ref);
+        pendingImages.pop_front();
+    }
 }
 
 void MHAWriter::resetData() {
@@ -74,6 +118,7 @@ int MHAWriter::stopRecord()
 {
     isRecording = false;
     resetData();
+    pendingImages.clear();
 
     if (!mhaFile_.is_open()) {
         std::cerr << "Error opening MHA file for writing." << std::endl;
@@ -90,7 +135,7 @@ int MHAWriter::stopRecord()
     header_.CompressedData             = false;                                 // Data is not compressed
     header_.Kinds                      = {"domain", "domain", "list"};
     header_.TransformMatrix            = {1, 0, 0, 0, 1, 0, 0, 0, 1};           // Initialize with an identity matrix (not used by Plus Toolkit, typical value is identity matrix)
-    header_.DimSize                    = { allImages.at(1).cols, allImages.at(1).rows, static_cast<int>(allImages.size())}; // Assuming a 2D image with one slice
+    header_.DimSize                    = { allImages.at(1)->getWidth(), allImages.at(1)->getHeight(), static_cast<int>(allImages.size())}; // Assuming a 2D image with one slice
     header_.Offset                     = {0, 0, 0};                             // Origin of the image (not used by Plus Toolkit, typical value is 0 0 0)
     header_.CenterOfRotation           = {0, 0, 0};                             // Center of rotation (not used by Plus Toolkit, typical value is 0 0 0)
     header_.AnatomicalOrientation      = "RAI";                                 // Anatomical orientation (not used by Plus Toolkit, typical value is RAI)
@@ -234,11 +279,21 @@ bool MHAWriter::writeImages()
     //     mhaFile_.flush();
     // }
 
+    // the rows of a frame are padded to 4 bytes (see BmodeFrame::getStep()), the file has them without padding
     for (size_t i = 0; i < allImages.size(); ++i) {
-        mhaFile_.write(reinterpret_cast<const char*>(allImages[i].data), allImages[i].total() * allImages[i].elemSize());
+        const BmodeFrame &image = *allImages[i];
+        if (image.getStep() == image.getWidth()) {
+            mhaFile_.write(reinterpret_cast<const char*>(image.data()), static_cast<std::streamsize>(image.getWidth()) * image.getHeight());
+        } else {
+            for (int row = 0; row < image.getHeight(); ++row)
+                mhaFile_.write(reinterpret_cast<const char*>(image.data() + static_cast<std::size_t>(row) * image.getStep()), image.getWidth());
+        }
         mhaFile_.flush();
     }
 
+    // the frames go back to the pool
+    allImages.clear();
+
     // mhaFile_.flush();
     // std::vector<uchar> rawData(allImages[0].data, allImages[0].data + allImages[0].total() * allImages[0].elemSize());
     // mhaFile_.write(reinterpret_cast<const char*>(rawData.data()), rawData.size());
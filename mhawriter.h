@@ -4,17 +4,20 @@
 #include <QObject>
 // #include <QRunnable>
 #include <QDateTime>
-#include <QElapsedTimer>
 
 #include <string>
 #include <vector>
+#include <deque>
+#include <memory>
 #include <fstream>
 
 #include <Eigen/Geometry>
 #include <opencv2/opencv.hpp>
 
+#include "bmodeframe.h"
+#include "posehistory.h"
 #include "qualisysconnection.h"
-#include "qualisystransformationmanager.h"
+#include "rigidbodyframe.h"
 
 
 /**
@@ -85,6 +88,12 @@ public:
      */
     void setTransformationID(std::string bmodeprobe_transformationID, std::string bmoderef_transformationID);
 
+    /**
+     * @brief SET the pose history of QualisysConnection (see QualisysConnection::getPoseHistory()). With it, every
+     * image is paired with the poses at the time it was grabbed, without it with the latest poses (the old way).
+     */
+    void setPoseHistory(std::shared_ptr<const PoseHistory> posehistory);
+
     /**
      * @brief GET the full path of the Sequence Image file
      */
@@ -95,12 +104,12 @@ public slots:
     /**
      * @brief slot function, will be called when an image is received, needs to be connected to signal from BmodeConnection::imageProcessed
      */
-    void onImageReceived(const cv::Mat &image);
+    void onImageReceived(const BmodeFramePtr &frame);
 
     /**
      * @brief slot function, will be called when transformations in a timestamp are received, needs to be connected to signal from QualisysConnection::dataReceived class
      */
-    void onRigidBodyReceived(const QualisysTransformationManager &tmanager);
+    void onRigidBodyReceived(const RigidBodyFramePtr &frame);
 
 private:
 
@@ -127,13 +136,19 @@ private:
     /**
      * @brief handles pair of data (soft-synchronization)
      */
-    void storeDataPair(const cv::Mat& image, const Eigen::Isometry3d& transform_probe, const Eigen::Isometry3d& transform_ref);
+    void storeDataPair(const BmodeFramePtr& frame, const Eigen::Isometry3d& transform_probe, const Eigen::Isometry3d& transform_ref);
 
     /**
      * @brief reset the pair of data (soft-synchronization)
      */
     void resetData();
 
+    /**
+     * @brief pairs the images of pendingImages with the poses at their timestamps, as soon as the history has a pose
+     * after the timestamp (so it's interpolated, not the newest pose held)
+     */
+    void pairPendingImages();
+
 
     // variables for naming file
     std::string fullfilename_;          //!< Stores the full path and file name of the sequence image (.mha) file.
@@ -142,19 +157,24 @@ private:
 
     // variables for storing data
     bool isRecording;                                           //!< An indicator that whether we are recording or not.
-    std::optional<cv::Mat> latestImage;                         //!< The latest image comes from streaming. Using std::optional so it is optional that this variable is empty or not.
+    BmodeFramePtr latestImage;                                  //!< The latest image comes from streaming. Empty if there is none.
     std::optional<Eigen::Isometry3d> latestTransform_probe;     //!< The latest probe transformation. Similar to latestImage.
     std::optional<Eigen::Isometry3d> latestTransform_ref;       //!< The latest of reference transformation. Similar to latestTransform_probe.
+    std::shared_ptr<const PoseHistory> posehistory_;            //!< The poses from QualisysConnection, nullptr for the old pairing
+    std::deque<BmodeFramePtr> pendingImages;                    //!< With posehistory_, the images waiting for a pose after their timestamp
+    static const int MAX_PENDING = 64;                          //!< More pending images than this, the mocap is gone, store the oldest without pose
 
-    std::vector<cv::Mat>           allImages;                   //!< Stores all the images had been streamed.
+    std::vector<BmodeFramePtr>     allImages;                   //!< Stores all the images had been streamed. They are the frames of the stream (no copy), held until the file is written.
     std::vector<Eigen::Isometry3d> allTransforms_probe;         //!< Stores all probe transformation had been streamed.
     std::vector<Eigen::Isometry3d> allTransforms_ref;           //!< Stores all reference transformation had been stream. (Reference transformation is the marker from Calibration Phantom, somehow it is used by the volume reconstructor module from fCal)
     std::vector<double>            allTimestamps;               //!< Stores all the timestamps of the data streamed.
-    QElapsedTimer timestamp;                                    //!< Stores the timestamp has been elapsed.
+    int64_t firsttimestamp_ = 0;                                //!< The timestamp of the first image [ns], the timestamps in the file start from it
 
     // variables that is used to grab the necessary rigid bodies
     std::string bmodeprobe_transformationID_ = "B_PROBE";       //!< Default indentifier for B-mode probe rigid body transformation from the Mocap system
     std::string bmoderef_transformationID_   = "B_REF";         //!< Default indentifier for Reference rigid body transformation from the Mocap system
+    RigidBodyFrame::Handle probeHandle_{"B_PROBE"};             //!< Where bmodeprobe_transformationID_ is in the frames of QualisysConnection
+    RigidBodyFrame::Handle refHandle_{"B_REF"};                 //!< Where bmoderef_transformationID_ is in the frames of QualisysConnection
 
 signals:
 };
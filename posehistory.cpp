@@ -0,0 +1,198 @@
+#include "posehistory.h"
+
+#include <algorithm>
+
+PoseHistory::PoseHistory(int capacity)
+{
+    // a power of 2, so that the row of frame k is k & mask_
+    uint64_t size = 2;
+    while (size < static_cast<uint64_t>(std::max(capacity, 2))) size <<= 1;
+    rows_.reset(new Row[size]);
+    mask_ = size - 1;
+    for (uint64_t i = 0; i < size; i++)
+    {
+        for (auto &value : rows_[i].poses) value.store(0.0, std::memory_order_relaxed);
+    }
+}
+
+void PoseHistory::push(const RigidBodyFrame &frame)
+{
+    uint64_t k = head_.load(std::memory_order_relaxed);
+    if (k > 0 && frame.getTimestamp() <= rows_[(k - 1) & mask_].timestamp.load(std::memory_order_relaxed)) return;
+
+    // new settings, the names first so that a reader which sees the new version finds them
+    if (frame.getSettingsVersion() != settings_.load(std::memory_order_relaxed))
+    {
+        QMutexLocker locker(&mutex_);
+        names_.clear();
+        for (int i = 0; i < frame.getNbodies(); i++) names_.push_back(frame.getName(i));
+        settings_.store(frame.getSettingsVersion(), std::memory_order_release);
+    }
+
+    // odd sequence number while the row is written, a reader which sees it (or sees it change) drops what it read
+    Row &row = rows_[k & mask_];
+    row.sequence.store(2 * k + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    row.timestamp.store(frame.getTimestamp(), std::memory_order_relaxed);
+    row.settings.store(frame.getSettingsVersion(), std::memory_order_relaxed);
+    for (int i = 0; i < frame.getNbodies(); i++)
+    {
+        std::atomic<double> *pose = &row.poses[i * POSE_SIZE];
+        const Eigen::Isometry3d &T = frame.getTransformation(i);
+        bool tracked = frame.isTracked(i);
+
+        // the rotation as a quaternion, that's what SLERP wants. An untracked body has NaN, don't convert that.
+        Eigen::Quaterniond q = tracked ? Eigen::Quaterniond(T.linear()).normalized() : Eigen::Quaterniond::Identity();
+        pose[0].store(q.w(), std::memory_order_relaxed);
+        pose[1].store(q.x(), std::memory_order_relaxed);
+        pose[2].store(q.y(), std::memory_order_relaxed);
+        pose[3].store(q.z(), std::memory_order_relaxed);
+        pose[4].store(T.translation().x(), std::memory_order_relaxed);
+        pose[5].store(T.translation().y(), std::memory_order_relaxed);
+        pose[6].store(T.translation().z(), std::memory_order_relaxed);
+        pose[7].store(tracked ? 1.0 : 0.0, std::memory_order_relaxed);
+    }
+    for (int i = frame.getNbodies(); i < RigidBodyFrame::MAX_BODIES; i++)
+        row.poses[i * POSE_SIZE + 7].store(0.0, std::memory_order_relaxed);
+
+    row.sequence.store(2 * k + 2, std::memory_order_release);
+    head_.store(k + 1, std::memory_order_release);
+}
+
+int PoseHistory::poseAt(RigidBodyFrame::Handle &handle, int64_t timestamp_ns, Eigen::Isometry3d &T) const
+{
+    // the index of the body, only searched when the settings changed
+    uint32_t settings = settings_.load(std::memory_order_acquire);
+    if (settings == 0) return 0;
+    if (handle.settings != settings)
+    {
+        QMutexLocker locker(&mutex_);
+        auto it = std::find(names_.begin(), names_.end(), handle.name);
+        handle.index = (it == names_.end() || it - names_.begin() >= RigidBodyFrame::MAX_BODIES) ? -1 : static_cast<int>(it - names_.begin());
+        handle.settings = settings_.load(std::memory_order_relaxed);
+    }
+    if (handle.index < 0) return 0;
+
+    // the writer only overwrites the oldest rows, so if it happens it's rare, and it's fine to just try again
+    for (int attempt = 0; attempt < 4; attempt++)
+    {
+        int status = lookup(handle.index, handle.settings, timestamp_ns, T);
+        if (status >= 0) return status;
+    }
+    return 0;
+}
+
+int PoseHistory::lookup(int index, uint32_t settings, int64_t timestamp_ns, Eigen::Isometry3d &T) const
+{
+    uint64_t head = head_.load(std::memory_order_acquire);
+    if (head == 0) return 0;
+
+    // the row after the newest is the one the writer writes next, it's not part of the history
+    uint64_t newest = head - 1;
+    uint64_t oldest = head > mask_ ? head - mask_ : 0;
+
+    int64_t t_newest, t_oldest;
+    if (!readTimestamp(newest, t_newest)) return -1;
+
+    Sample before, after;
+    if (timestamp_ns >= t_newest)
+    {
+        // nothing newer yet, the newest pose if it's recent enough
+        if (timestamp_ns - t_newest > maxhold_ns_.load(std::memory_order_relaxed)) return 0;
+        if (!readSample(newest, index, before)) return -1;
+        if (before.settings != settings || !before.tracked) return 0;
+        T = Eigen::Isometry3d::Identity();
+        T.linear() = before.rotation.toRotationMatrix();
+        T.translation() = before.translation;
+        return 1;
+    }
+
+    if (!readTimestamp(oldest, t_oldest)) return -1;
+    if (timestamp_ns < t_oldest) return 0;
+
+    // binary search for the last frame at or before timestamp_ns, t[lo] <= timestamp_ns < t[hi]
+    uint64_t lo = oldest, hi = newest;
+    while (hi - lo > 1)
+    {
+        uint64_t mid = lo + (hi - lo) / 2;
+        int64_t t_mid;
+        if (!readTimestamp(mid, t_mid)) return -1;
+        if (t_mid <= timestamp_ns) lo = mid;
+        else hi = mid;
+    }
+
+    if (!readSample(lo, index, before) || !readSample(hi, index, after)) return -1;
+    if (before.settings != settings || after.settings != settings) return 0;
+    if (!before.tracked || !after.tracked) return 0;
+
+    // SLERP for the rotation (Eigen takes the short way), linear for the translation
+    double alpha = static_cast<double>(timestamp_ns - before.timestamp) / static_cast<double>(after.timestamp - before.timestamp);
+    T = Eigen::Isometry3d::Identity();
+    T.linear() = before.rotation.slerp(alpha, after.rotation).toRotationMatrix();
+    T.translation() = before.translation + alpha * (after.translation - before.translation);
+    return 1;
+}
+
+bool PoseHistory::readTimestamp(uint64_t k, int64_t &timestamp) const
+{
+    const Row &row = rows_[k & mask_];
+    uint64_t sequence = row.sequence.load(std::memory_order_acquire);
+    if (sequence != 2 * k + 2) return false;
+    timestamp = row.timestamp.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return row.sequence.load(std::memory_order_relaxed) == sequence;
+}
+
+bool PoseHistory::readSample(uint64_t k, int index, Sample &sample) const
+{
+    const Row &row = rows_[k & mask_];
+    uint64_t sequence = row.sequence.load(std::memory_order_acquire);
+    if (sequence != 2 * k + 2) return false;
+
+    const std::atomic<double> *pose = &row.poses[index * POSE_SIZE];
+    sample.timestamp = row.timestamp.load(std::memory_order_relaxed);
+    sample.settings = row.settings.load(std::memory_order_relaxed);
+    sample.rotation = Eigen::Quaterniond(pose[0].load(std::memory_order_relaxed), pose[1].load(std::memory_order_relaxed),
+                                         pose[2].load(std::memory_order_relaxed), pose[3].load(std::memory_order_relaxed));
+    sample.translation = Eigen::Vector3d(pose[4].load(std::memory_order_relaxed), pose[5].load(std::memory_order_relaxed),
+                                         pose[6].load(std::memory_order_relaxed));
+    sample.tracked = pose[7].load(std::memory_order_relaxed) != 0.0;
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return row.sequence.load(std::memory_order_relaxed) == sequence;
+}
+
+int64_t PoseHistory::getNewestTimestamp() const
+{
+    for (int attempt = 0; attempt < 4; attempt++)
+    {
+        uint64_t head = head_.load(std::memory_order_acquire);
+        if (head == 0) return 0;
+        int64_t timestamp;
+        if (readTimestamp(head - 1, timestamp)) return timestamp;
+    }
+    return 0;
+}
+
+int64_t PoseHistory::getOldestTimestamp() const
+{
+    for (int attempt = 0; attempt < 4; attempt++)
+    {
+        uint64_t head = head_.load(std::memory_order_acquire);
+        if (head == 0) return 0;
+        int64_t timestamp;
+        if (readTimestamp(head > mask_ ? head - mask_ : 0, timestamp)) return timestamp;
+    }
+    return 0;
+}
+
+void PoseHistory::setMaxHold(int64_t maxhold_ns)
+{
+    maxhold_ns_.store(maxhold_ns, std::memory_order_relaxed);
+}
+
+int PoseHistory::getCapacity() const
+{
+    return static_cast<int>(mask_ + 1);
+}
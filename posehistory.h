@@ -0,0 +1,136 @@
+#ifndef POSEHISTORY_H
+#define POSEHISTORY_H
+
+#include <QMutex>
+#include <Eigen/Geometry>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "rigidbodyframe.h"
+
+/**
+ * @class PoseHistory
+ * @brief The poses of the rigid bodies of the last frames from Qualisys, so that we can ask for the pose of a body at
+ * any time, interpolated between the two frames around it.
+ *
+ * For the context. The consumers used to pair the latest image (or A-mode frame) with the latest pose, using ready
+ * flags. The pose could be one mocap period older than the image, plus whatever waited in the queues before the
+ * slots were called, and when the probe moves this is a few millimeters. Now QualisysConnection writes every frame
+ * here before emitting it, and a consumer asks poseAt() with the timestamp of its own frame (BmodeFrame::getTimestamp(),
+ * AmodeFrame::getTimestamp(), the same host monotonic clock as RigidBodyFrame::getTimestamp()). The rotation is
+ * interpolated with SLERP, the translation linearly.
+ *
+ * There is one writer (the streaming thread of QualisysConnection) and any number of readers in any thread, without a
+ * lock: the frames are in a ring of rows, each row has a sequence number which is odd while the writer is writing
+ * it. A reader checks the sequence number before and after reading a row, if it changed the row was overwritten in
+ * the meantime and the reader tries again (a seqlock). The writer never waits for the readers. Only when the bodies
+ * change (QualisysConnection read the settings again) the names are replaced under a mutex, and resolving a Handle
+ * takes that mutex, which is once per settings, like RigidBodyFrame::resolve().
+ *
+ * The capacity is in frames, at 1000 Hz the default (512) is half a second of history, at 100 Hz five seconds.
+ *
+ */
+
+class PoseHistory
+{
+public:
+
+    /**
+     * @brief Constructor function, keeps the last capacity frames (rounded up to a power of 2)
+     */
+    explicit PoseHistory(int capacity = 512);
+
+    /**
+     * @brief [Writer only] Add the poses of a frame. The timestamps have to increase, a frame which is not newer than
+     * the newest one is ignored.
+     */
+    void push(const RigidBodyFrame &frame);
+
+    /**
+     * @brief GET the pose of the body of handle at timestamp_ns (host monotonic time [ns]), interpolated between the
+     * frames before and after it. After the newest frame, the newest pose is given if it is at most the hold time
+     * old (see setMaxHold()). Thread-safe.
+     *
+     * @return 1 success, 0 if there is no such body, it is not tracked in the frames around timestamp_ns, or the
+     * timestamp is not in the history anymore (or not yet).
+     */
+    int poseAt(RigidBodyFrame::Handle &handle, int64_t timestamp_ns, Eigen::Isometry3d &T) const;
+
+    /**
+     * @brief GET the timestamp of the newest frame [ns], 0 if there is none. Thread-safe.
+     */
+    int64_t getNewestTimestamp() const;
+
+    /**
+     * @brief GET the timestamp of the oldest frame still in the history [ns], 0 if there is none. Thread-safe.
+     */
+    int64_t getOldestTimestamp() const;
+
+    /**
+     * @brief SET how long after the newest frame poseAt() still gives the newest pose [ns]. Default 50 ms.
+     */
+    void setMaxHold(int64_t maxhold_ns);
+
+    /**
+     * @brief GET the capacity, in frames
+     */
+    int getCapacity() const;
+
+private:
+
+    static constexpr int POSE_SIZE = 8;     //!< Values per body in a row: quaternion w x y z, translation x y z, tracked
+
+    /**
+     * @struct Row
+     * @brief One frame. Every field is atomic, the readers read them while the writer may overwrite them, the
+     * sequence number tells whether what they read is consistent.
+     */
+    struct Row {
+        std::atomic<uint64_t> sequence{0};  //!< 2k+1 while frame k is written, 2k+2 when it is complete
+        std::atomic<int64_t> timestamp{0};  //!< Host monotonic time of the frame [ns]
+        std::atomic<uint32_t> settings{0};  //!< RigidBodyFrame::getSettingsVersion() of the frame
+        std::atomic<double> poses[RigidBodyFrame::MAX_BODIES * POSE_SIZE];   //!< The poses, POSE_SIZE values per body
+    };
+
+    /**
+     * @struct Sample
+     * @brief The pose of one body in one row, as read by readSample()
+     */
+    struct Sample {
+        int64_t timestamp = 0;
+        uint32_t settings = 0;
+        Eigen::Quaterniond rotation;
+        Eigen::Vector3d translation;
+        bool tracked = false;
+    };
+
+    /**
+     * @brief Read the timestamp of frame k, false if frame k is not (or not anymore) in the ring
+     */
+    bool readTimestamp(uint64_t k, int64_t &timestamp) const;
+
+    /**
+     * @brief Read the pose of the body number index in frame k, false if frame k is not (or not anymore) in the ring
+     */
+    bool readSample(uint64_t k, int index, Sample &sample) const;
+
+    /**
+     * @brief The lookup of poseAt(), once. Returns -1 if a row was overwritten while reading (poseAt() tries again).
+     */
+    int lookup(int index, uint32_t settings, int64_t timestamp_ns, Eigen::Isometry3d &T) const;
+
+    std::unique_ptr<Row[]> rows_;           //!< The ring
+    uint64_t mask_;                         //!< The capacity - 1, to get the row of a frame
+    std::atomic<uint64_t> head_{0};         //!< The number of frames written, the newest is head_ - 1
+    std::atomic<int64_t> maxhold_ns_{50000000}; //!< See setMaxHold()
+
+    mutable QMutex mutex_;                  //!< Protects names_
+    std::vector<std::string> names_;        //!< The names of the bodies of the settings settings_
+    std::atomic<uint32_t> settings_{0};     //!< The settings version of the newest frame
+};
+
+#endif // POSEHISTORY_H
@@ -25,6 +25,26 @@ QCustomPlotIntervalWindow::QCustomPlotIntervalWindow(QWidget *parent) : QCustomP
     shadeRect->setPen(Qt::NoPen);
     shadeRect->setBrush(QBrush(QColor(0, 0, 255, 50)));
     shadeRect->setVisible(false);
+
+    // Create the marker of the peak, it sits on the graph so it follows the signal
+    peakTracer = new QCPItemTracer(this);
+    peakTracer->setGraph(graph(0));
+    peakTracer->setInterpolating(true);
+    peakTracer->setStyle(QCPItemTracer::tsCircle);
+    peakTracer->setPen(QPen(Qt::red, 2));
+    peakTracer->setSize(8);
+    peakTracer->setVisible(false);
+}
+
+void QCustomPlotIntervalWindow::setPeak(double x)
+{
+    peakTracer->setGraphKey(x);
+    peakTracer->setVisible(true);
+}
+
+void QCustomPlotIntervalWindow::clearPeak()
+{
+    peakTracer->setVisible(false);
 }
 
 void QCustomPlotIntervalWindow::setShadeColor(const QColor& color)
@@ -56,6 +76,8 @@ void QCustomPlotIntervalWindow::setInitialLines(std::array<std::optional<double>
     updateShading();
     updateLabels();
     replot();
+
+    emit windowChanged();
 }
 
 void QCustomPlotIntervalWindow::onMousePress(QMouseEvent *event)
@@ -90,6 +112,8 @@ void QCustomPlotIntervalWindow::onMousePress(QMouseEvent *event)
         updateLabels();
     }
     replot();
+
+    emit windowChanged();
 }
 
 void QCustomPlotIntervalWindow::updateLines(double centerX)
@@ -43,6 +43,22 @@ public:
      */
     std::array<std::optional<double>, 3> getLinePositions() const;
 
+    /**
+     * @brief Show a marker on the graph at x (the peak found inside the window, see AmodePeakTracker)
+     */
+    void setPeak(double x);
+
+    /**
+     * @brief Hide the marker of setPeak()
+     */
+    void clearPeak();
+
+signals:
+    /**
+     * @brief Emitted when the user changed (or cleared) the window with the mouse, or setInitialLines() was called
+     */
+    void windowChanged();
+
 private slots:
     void onMousePress(QMouseEvent *event);
 
@@ -72,6 +88,7 @@ private:
     std::array<QCPItemLine*, 3> verticalLines;          //!< Stores the vertical lines (QCPItemLine) for the interval window.
     std::array<QPointer<QCPItemText>, 3> xValueLabels;  //!< Stores the labels (text for x-positions of the lines) (QCPItemText) for the interval window.
     QCPItemRect *shadeRect;                             //!< Stores shading object (QCPItemRect) for the interval window.
+    QCPItemTracer *peakTracer;                          //!< Marks the peak inside the window on the graph
 
     double lineSpacing = 0.1;       //!< Initial line spacing.
     double centerX = 0;             //!< Initial centerX.
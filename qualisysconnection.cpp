@@ -1,12 +1,28 @@
 #include "qualisysconnection.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <iostream>
 
+namespace {
+// Host monotonic time [ns], the same clock as the A-mode and the B-mode frames
+int64_t steadyNanoseconds()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+}
+
 QualisysConnection::QualisysConnection(QObject *parent, std::string ip, unsigned short port)
     : QObject{parent}, ip_{ip}, port_{port}
 {
-    if(!this->connectTCP()) return;
-    if(!this->readMarkerSettings()) return;
-    if(!this->startStreamFrames()) return;
+    // the statistics and the frames are sent across threads, Qt needs to know the types
+    qRegisterMetaType<QualisysConnection::Statistics>();
+    qRegisterMetaType<RigidBodyFramePtr>();
+    pool_ = RigidBodyFramePool::create();
+    posehistory_ = std::make_shared<PoseHistory>();
+
+    // if it fails here, the receive loop tries again once it is started
+    if(this->connectTCP() && this->readMarkerSettings()) this->startStreamFrames();
 
     // // Setup timer for frame updates
     // timer = new QTimer(this);
@@ -40,9 +56,8 @@ int QualisysConnection::connectTCP()
         // ...let's make connection
         if (!poRTProtocol_.Connect((char*)ip_.data(), port_, &udpPort, majorVersion, minorVersion, bigEndian))
         {
-            // if fails, print the error message and return -1;
+            // if fails, print the error message and return 0 (streamData() waits before it tries again)
             myprintFormat(QualisysConnection::MESSAGE_WARNING, poRTProtocol_.GetErrorString());
-            sleep(1);
             return 0;
         }
     }
@@ -88,6 +103,12 @@ int QualisysConnection::readMarkerSettings()
         }
     }
 
+    // the frames only get a pointer to the names, the version tells the consumers to look their bodies up again
+    if (nBodies > RigidBodyFrame::MAX_BODIES)
+        myprintFormat(QualisysConnection::MESSAGE_WARNING, "Too many rigid bodies, only the first " + std::to_string(RigidBodyFrame::MAX_BODIES) + " are streamed.");
+    bodynames_ = std::make_shared<const std::vector<std::string>>(rigidbodyName_);
+    settingsversion_++;
+
     // print notification for user
     myprintFormat(QualisysConnection::MESSAGE_OK, "Recieved 6DoF settings from Qualisys.");
     return 1;
@@ -99,6 +120,7 @@ int QualisysConnection::startStreamFrames()
     {
         char strbuffer[100];
         sprintf(strbuffer, "Start stream fails: %s.", poRTProtocol_.GetErrorString());
+        myprintFormat(QualisysConnection::MESSAGE_WARNING, strbuffer);
         return 0;
     }
 
@@ -107,45 +129,48 @@ int QualisysConnection::startStreamFrames()
     return 1;
 }
 
-void QualisysConnection::receiveData() {
-    // variable to capture packettype (error/packetdata/end)
-    CRTPacket::EPacketType ePacketType;
-
-    // check if receiving data is a success
-    if (poRTProtocol_.Receive(ePacketType, true) != CNetwork::ResponseType::success)
-    {
-        return;
-    }
-
-    // check if packet type is packet data
-    if (ePacketType != CRTPacket::PacketData)
-    {
-        return;
-    }
+int QualisysConnection::reconnect()
+{
+    // start from scratch, the settings (the rigid bodies) may have changed in QTM in between
+    if (poRTProtocol_.Connected()) poRTProtocol_.Disconnect();
+    rigidbodyName_.clear();
+    clockmodel_.reset();
+    if (connectTCP() && readMarkerSettings() && startStreamFrames()) return 1;
+
+    // half way is no good either, Receive() would only time out
+    if (poRTProtocol_.Connected()) poRTProtocol_.Disconnect();
+    return 0;
+}
 
-    // get a packet
-    CRTPacket* rtPacket = poRTProtocol_.GetRTPacket();
+int QualisysConnection::readFrame(CRTPacket *rtPacket, int64_t arrival, RigidBodyFramePtr &frame)
+{
+    frame = pool_->acquire();
+    if (!frame) return 0;
+
+    RigidBodyFrame *writable = frame.writable();
+    writable->setBodies(bodynames_, settingsversion_);
+    writable->setFrameNumber(rtPacket->GetFrameNumber());
+    writable->setQtmTimestamp(rtPacket->GetTimeStamp());
+    writable->setArrivalTimestamp(arrival);
+    // the time of the frame on our clock, from the QTM timestamp, without the jitter of the network and the thread
+    writable->setTimestamp(clockmodel_.update(static_cast<int64_t>(rtPacket->GetTimeStamp()), arrival));
+    writable->setSequence(++sequence_);
 
     // variable for 6DOF value (translation and rotation)
     float tmp_tX, tmp_tY, tmp_tZ;
     float tmp_R[9];
 
-    // clear the transformation manager
-    tmanager.clearTransformations();
-
-    // loop for all rigid body detected
-    for (unsigned int i = 0; i < rtPacket->Get6DOFBodyCount(); i++)
+    // loop for all rigid body detected (the packet and the settings should agree, but QTM may change in between)
+    int nBodies = std::min(static_cast<int>(rtPacket->Get6DOFBodyCount()), writable->getNbodies());
+    for (int i = 0; i < nBodies; i++)
     {
         // get the rigid body values
         if(!rtPacket->Get6DOFBody(i, tmp_tX, tmp_tY, tmp_tZ, tmp_R))
         {
-            return;
+            frame.reset();
+            return 0;
         }
 
-        // do something with the values
-        const char* name_6DOF = poRTProtocol_.Get6DOFBodyName(i);
-        std::string str(name_6DOF);
-
         // // print values, for debugging purposes
         // std::cout << name_6DOF;
         // std::cout << std::fixed << std::setprecision(2);
@@ -158,10 +183,6 @@ void QualisysConnection::receiveData() {
         Eigen::Matrix3d R;
         Eigen::Vector3d t;
 
-        // Copy the data from your arrays to the Eigen objects
-        // R << tmp_R[0], tmp_R[1], tmp_R[2],
-        //      tmp_R[3], tmp_R[4], tmp_R[5],
-        //      tmp_R[6], tmp_R[7], tmp_R[8];
         // The element of rotation matrix (tmp_R) from qualisys is defined like below
         // the first three element of tmp_R defined as first column of the matrix, not first row
         R << tmp_R[0], tmp_R[3], tmp_R[6],
@@ -174,123 +195,162 @@ void QualisysConnection::receiveData() {
         T.linear() = R;
         T.translation() = t;
 
-        // store the transformation matrix with the transformation manager
-        tmanager.addTransformation(name_6DOF, T);
+        // store the transformation matrix in the frame, QTM gives NaN for a body it doesn't see
+        writable->setTransformation(i, T, !std::isnan(tmp_tX));
+    }
+
+    // the bodies missing from the packet are not tracked
+    for (int i = nBodies; i < writable->getNbodies(); i++)
+        writable->setTransformation(i, Eigen::Isometry3d::Identity(), false);
+    return 1;
+}
+
+void QualisysConnection::receiveData() {
+    // variable to capture packettype (error/packetdata/end)
+    CRTPacket::EPacketType ePacketType;
+
+    // check if receiving data is a success
+    if (poRTProtocol_.Receive(ePacketType, true, RECEIVE_TIMEOUT_US) != CNetwork::ResponseType::success)
+    {
+        return;
     }
 
-    // std::cout << std::endl << std::flush;
+    // check if packet type is packet data
+    if (ePacketType != CRTPacket::PacketData)
+    {
+        return;
+    }
 
     // Once the task is finished, emit the signal
-    emit dataReceived(tmanager);
+    RigidBodyFramePtr frame;
+    if (!readFrame(poRTProtocol_.GetRTPacket(), steadyNanoseconds(), frame)) return;
+    posehistory_->push(*frame);
+    emit dataReceived(frame);
 }
 
 void QualisysConnection::startStreaming()
 {
-    QMutexLocker locker(&m_mutex);
-    if (!m_isRunning) {
-        m_isRunning = true;
-        m_workerThread.start();
-    }
+    if (m_isRunning.exchange(true, std::memory_order_acq_rel)) return;
+
+    // The loop starts with the thread. If the thread runs already (stopped, then started again), the loop is queued
+    // in its event loop.
+    if (!m_workerThread.isRunning()) m_workerThread.start();
+    else QMetaObject::invokeMethod(this, "streamData", Qt::QueuedConnection);
 }
 
 void QualisysConnection::stopStreaming()
+{
+    m_isRunning.store(false, std::memory_order_release);
+}
+
+QualisysConnection::Statistics QualisysConnection::getStatistics()
 {
     QMutexLocker locker(&m_mutex);
-    m_isRunning = false;
-    m_condition.wakeOne();
+    return statistics_;
+}
+
+std::shared_ptr<const PoseHistory> QualisysConnection::getPoseHistory() const
+{
+    return posehistory_;
 }
 
 void QualisysConnection::streamData()
 {
-    while (true)
+    Statistics statistics;
+    bool hasprevious = false;                   // false until the first frame number (and after a reconnection)
+    int backoff_ms = RECONNECT_MIN_MS;          // the wait before the next reconnection
+    double latencysum = 0.0;                    // [ms] of the current second
+    double latencymax = 0.0;                    // [ms] of the current second
+    uint64_t nframes = 0;                       // data packets of the current second
+    int64_t lastupdate = steadyNanoseconds();
+
+    while (m_isRunning.load(std::memory_order_acquire))
     {
-        // create new scope for QMutexLocker Object
+        // blocks until a packet arrives, or the timeout, so that we check the flag regularly. Without connection
+        // (it failed in the constructor, or a reconnection failed) there is nothing to wait for.
+        CRTPacket::EPacketType ePacketType = CRTPacket::PacketNone;
+        CNetwork::ResponseType response = poRTProtocol_.Connected() ? poRTProtocol_.Receive(ePacketType, true, RECEIVE_TIMEOUT_US)
+                                                                    : CNetwork::ResponseType::disconnect;
+        int64_t arrival = steadyNanoseconds();
+
+        if (response == CNetwork::ResponseType::timeout)
         {
-            QMutexLocker locker(&m_mutex);
-            while (!m_isRunning) {
-                m_condition.wait(&m_mutex);
-            }
-            if (!m_isRunning) {
-                break;
-            }
+            statistics.timeouts++;
         }
-
-        // variable to capture packettype (error/packetdata/end)
-        CRTPacket::EPacketType ePacketType;
-
-        // check if receiving data is a success
-        if (poRTProtocol_.Receive(ePacketType, true) != CNetwork::ResponseType::success)
+        else if (response != CNetwork::ResponseType::success)
         {
-            return;
-        }
+            // the connection is gone, try again, waiting a bit longer every time (and still listening to stopStreaming())
+            myprintFormat(QualisysConnection::MESSAGE_WARNING, "No connection, trying again in " + std::to_string(backoff_ms) + " ms.");
+            for (int waited = 0; waited < backoff_ms && m_isRunning.load(std::memory_order_acquire); waited += 50)
+                QThread::msleep(50);
+            if (!m_isRunning.load(std::memory_order_acquire)) break;
 
-        // check if packet type is packet data
-        if (ePacketType != CRTPacket::PacketData)
+            if (reconnect())
+            {
+                statistics.reconnects++;
+                hasprevious = false;
+                backoff_ms = RECONNECT_MIN_MS;
+            }
+            else
+            {
+                backoff_ms = std::min(backoff_ms * 2, RECONNECT_MAX_MS);
+            }
+        }
+        else if (ePacketType == CRTPacket::PacketData)
         {
-            return;
+            CRTPacket* rtPacket = poRTProtocol_.GetRTPacket();
+
+            // QTM numbers every frame, with RateAllFrames every frame is sent, so a jump is a loss. If it goes back,
+            // the measurement was restarted in QTM, that is not a loss.
+            unsigned int framenumber = rtPacket->GetFrameNumber();
+            if (hasprevious && framenumber > statistics.lastFrameNumber)
+                statistics.framesLost += framenumber - statistics.lastFrameNumber - 1;
+            hasprevious = true;
+            statistics.lastFrameNumber = framenumber;
+            statistics.framesReceived++;
+
+            RigidBodyFramePtr frame;
+            if (!readFrame(rtPacket, arrival, frame))
+            {
+                statistics.framesSkipped++;
+            }
+            else
+            {
+                // Once the task is finished, emit the signal. The history first, a consumer which gets the frame
+                // expects to find it in there too.
+                posehistory_->push(*frame);
+                emit dataReceived(frame);
+
+                double latency = (steadyNanoseconds() - arrival) * 1.0e-6;
+                latencysum += latency;
+                latencymax  = std::max(latencymax, latency);
+                nframes++;
+            }
         }
+        // the other packets (events, QTM stopped the measurement, etc.) are skipped, the stream goes on
 
-        // get a packet
-        CRTPacket* rtPacket = poRTProtocol_.GetRTPacket();
-
-        // variable for 6DOF value (translation and rotation)
-        float tmp_tX, tmp_tY, tmp_tZ;
-        float tmp_R[9];
-
-        // clear the transformation manager
-        tmanager.clearTransformations();
-
-        // loop for all rigid body detected
-        for (unsigned int i = 0; i < rtPacket->Get6DOFBodyCount(); i++)
+        // the statistics of the last second
+        if (arrival - lastupdate >= 1000000000LL)
         {
-            // get the rigid body values
-            if(!rtPacket->Get6DOFBody(i, tmp_tX, tmp_tY, tmp_tZ, tmp_R))
+            double elapsed = (arrival - lastupdate) * 1.0e-9;
+            statistics.frameRate   = nframes / elapsed;
+            statistics.latencyMean = (nframes > 0) ? latencysum / nframes : 0.0;
+            statistics.latencyMax  = latencymax;
+            statistics.clock       = clockmodel_.getEstimate();
             {
-                return;
+                QMutexLocker locker(&m_mutex);
+                statistics_ = statistics;
             }
+            emit statisticsUpdated(statistics);
 
-            // do something with the values
-            const char* name_6DOF = poRTProtocol_.Get6DOFBodyName(i);
-            std::string str(name_6DOF);
-
-            // Create the Eigen objects for rotation and translation
-            Eigen::Matrix3d R;
-            Eigen::Vector3d t;
-
-            // Copy the data from your arrays to the Eigen objects
-            // R << tmp_R[0], tmp_R[1], tmp_R[2],
-            //     tmp_R[3], tmp_R[4], tmp_R[5],
-            //     tmp_R[6], tmp_R[7], tmp_R[8];
-            // t << tmp_tX, tmp_tY, tmp_tZ;
-            // The element of rotation matrix (tmp_R) from qualisys is defined like below
-            // the first three element of tmp_R defined as first column of the matrix, not first row
-            R << tmp_R[0], tmp_R[3], tmp_R[6],
-                 tmp_R[1], tmp_R[4], tmp_R[7],
-                 tmp_R[2], tmp_R[5], tmp_R[8];
-            t << tmp_tX, tmp_tY, tmp_tZ;
-
-            // Create an Isometry3d object and set its rotation and translation components
-            Eigen::Isometry3d T = Eigen::Isometry3d::Identity();
-            T.linear() = R;
-            T.translation() = t;
-
-            // store the transformation matrix with the transformation manager
-            tmanager.addTransformation(name_6DOF, T);
+            latencysum = latencymax = 0.0;
+            nframes = 0;
+            lastupdate = arrival;
         }
-
-        // Once the task is finished, emit the signal
-        emit dataReceived(tmanager);
-
-        // Add a small delay to prevent excessive CPU usage
-        QThread::msleep(1);
     }
 }
 
 
-QualisysTransformationManager QualisysConnection::getTManager(){
-    return tmanager;
-}
-
 void QualisysConnection::myprintFormat(QualisysConnection::enumMessageType messagetype, std::string message)
 {
     std::string header = "[Qualisys]";
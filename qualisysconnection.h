@@ -9,7 +9,9 @@
 
 #include "RTProtocol.h"
 #include "RTPacket.h"
-#include "qualisystransformationmanager.h"
+#include "clockmodel.h"
+#include "posehistory.h"
+#include "rigidbodyframepool.h"
 
 #include "Eigen/Dense"
 
@@ -17,7 +19,9 @@
 #include <QTimer>
 #include <QThread>
 #include <QMutex>
-#include <QWaitCondition>
+
+#include <atomic>
+#include <cstdint>
 
 /**
  * @class QualisysConnection
@@ -29,6 +33,16 @@
  * handled by the SDK, however, we still need to make our own program to call the functions, configure the settings,
  * grab the data, etc.
  *
+ * The object lives in its own thread (m_workerThread). streamData() is the receive loop, it blocks on the socket
+ * with a timeout (RECEIVE_TIMEOUT_US), so it wakes up as soon as a packet arrives and checks the run flag at least
+ * every timeout. The run flag is atomic, the loop doesn't lock anything per packet. If the connection fails (QTM
+ * closed, cable, etc.) the loop connects again, waiting longer after every failed attempt (RECONNECT_MIN_MS up to
+ * RECONNECT_MAX_MS). The packets which are not data (events, QTM stopped the measurement) are skipped, they don't
+ * stop the stream anymore.
+ *
+ * Every data packet is counted: the frames lost according to the QTM frame number, and the time from the return of
+ * Receive() until dataReceived() is emitted. Once per second the loop emits statisticsUpdated().
+ *
  */
 
 class QualisysConnection : public QObject
@@ -50,6 +64,23 @@ public:
         MESSAGE_RUNNING
     };
 
+    /**
+     * @brief The statistics of the stream, the rate and the latency are of the last second
+     */
+    struct Statistics
+    {
+        double frameRate = 0.0;             //!< [Hz] Data packets per second
+        double latencyMean = 0.0;           //!< [ms] From the return of Receive() until dataReceived() is emitted, mean
+        double latencyMax = 0.0;            //!< [ms] The same, maximum
+        uint64_t framesReceived = 0;        //!< Data packets, since startStreaming()
+        uint64_t framesLost = 0;            //!< Frames missing according to the QTM frame number, since startStreaming()
+        uint64_t framesSkipped = 0;         //!< Frames not emitted because the consumers hold all the frames of the pool
+        uint64_t timeouts = 0;              //!< Receive() without any packet for RECEIVE_TIMEOUT_US, since startStreaming()
+        uint64_t reconnects = 0;            //!< Successful reconnections, since startStreaming()
+        unsigned int lastFrameNumber = 0;   //!< The QTM frame number of the latest packet
+        ClockModel::Estimate clock;         //!< The QTM clock against ours, see ClockModel
+    };
+
     explicit QualisysConnection(QObject *parent = nullptr, std::string ip = "", unsigned short port = 22222);
     ~QualisysConnection();
 
@@ -60,23 +91,27 @@ public:
      */
     void myprintFormat(QualisysConnection::enumMessageType messagetype, std::string message);
 
-    /**
-     * @brief A get function of the current transformation.
-     *
-     * @return An object of QualisysTransformationManager which stores the current transformation.
-     */
-    QualisysTransformationManager getTManager();
-
     /**
      * @brief Start qualisys streaming with QThread
      */
     void startStreaming();
 
     /**
-     * @brief Stop qualisys streaming with QThread
+     * @brief Stop qualisys streaming with QThread, the loop returns within RECEIVE_TIMEOUT_US. Thread-safe.
      */
     void stopStreaming();
 
+    /**
+     * @brief GET the latest statistics of the stream (see statisticsUpdated())
+     */
+    Statistics getStatistics();
+
+    /**
+     * @brief GET the history of the poses, every frame is in it before dataReceived() is emitted. Give it to the
+     * consumers which want the pose at the time of their own frames (see PoseHistory::poseAt()).
+     */
+    std::shared_ptr<const PoseHistory> getPoseHistory() const;
+
 protected:
     /**
      * @brief Initializing connection to Qualisys, called in constructor.
@@ -100,6 +135,20 @@ protected:
     */
     int startStreamFrames();
 
+    /**
+     * @brief Disconnect, then connect, read the settings and start the stream again
+     *
+     * @return 1 success, 0 error occured.
+     */
+    int reconnect();
+
+    /**
+     * @brief Fill a frame of the pool with the rigid bodies of the packet, arrival is when it arrived [ns]
+     *
+     * @return 1 success, 0 if the pool is empty or a rigid body can't be read.
+     */
+    int readFrame(CRTPacket *rtPacket, int64_t arrival, RigidBodyFramePtr &frame);
+
 
 private slots:
 
@@ -130,20 +179,37 @@ private:
 
     std::vector<std::string> rigidbodyName_;    //!< Contains list of rigidbody names.
     std::vector<double> rigidbodyData_;         //!< Contains value of rigidbodies.
-    QualisysTransformationManager tmanager;     //!< manage the rigid body transformation tracked by qualisys
+    std::shared_ptr<const std::vector<std::string>> bodynames_; //!< The names again, shared by all the frames (see RigidBodyFrame)
+    uint32_t settingsversion_ = 0;              //!< Counts readMarkerSettings(), see RigidBodyFrame::getSettingsVersion()
+    std::shared_ptr<RigidBodyFramePool> pool_;  //!< The frames emitted by dataReceived()
+    std::shared_ptr<PoseHistory> posehistory_;  //!< The poses of the last frames, written by the streaming thread only
+    uint64_t sequence_ = 0;                     //!< The number of frames emitted
+    ClockModel clockmodel_{1000.0};             //!< The QTM timestamp [us] to the host clock, only used by the streaming thread
     QTimer *timer;                              //!< A timer, in which we check the data from Qualisys
 
     // variables that handles multithreading for streaming qualisys data
     QThread m_workerThread;                     //!< The worker thread to run streaming data from qualisys function
-    QMutex m_mutex;                             //!< Mutex variable that keep m_isRunning variable to be accessed by one thread at a time
-    QWaitCondition m_condition;                 //!< Allows thread to sleep when idle and wake up on demand
-    bool m_isRunning = false;                   //!< A flag that tells that the thread is running or not
+    std::atomic<bool> m_isRunning{false};       //!< The receive loop runs while this is true, see stopStreaming()
+    QMutex m_mutex;                             //!< Protects statistics_, only taken once per second
+    Statistics statistics_;                     //!< The latest statistics, see statisticsUpdated()
+
+    const int RECEIVE_TIMEOUT_US = 100000;      //!< [us] Receive() waits at most this long for a packet
+    const int RECONNECT_MIN_MS   = 250;         //!< [ms] The first wait before connecting again
+    const int RECONNECT_MAX_MS   = 5000;        //!< [ms] The wait doubles after every failed attempt, up to this
 
 signals:
     /**
-     * @brief Emits a tmanager, which consists of transformations of rigid body that is detected by Qualisys
+     * @brief Emits a frame, which consists of transformations of rigid body that is detected by Qualisys. The frame
+     * is shared by all the consumers (no copy), it is read-only, and it goes back to the pool when nobody holds it.
      */
-    void dataReceived(const QualisysTransformationManager &tmanager);
+    void dataReceived(const RigidBodyFramePtr &frame);
+
+    /**
+     * @brief Emitted once per second while streaming, with the statistics of the stream
+     */
+    void statisticsUpdated(const QualisysConnection::Statistics &statistics);
 };
 
+Q_DECLARE_METATYPE(QualisysConnection::Statistics)
+
 #endif // QUALISYSCONNECTION_H
@@ -0,0 +1,193 @@
+#include "rigidbodyframe.h"
+#include "rigidbodyframepool.h"
+
+#include <algorithm>
+
+namespace {
+const Eigen::Isometry3d identityPose = Eigen::Isometry3d::Identity();
+const std::string noName;
+}
+
+RigidBodyFrame::RigidBodyFrame()
+{
+    poses_.fill(Eigen::Isometry3d::Identity());
+    tracked_.fill(false);
+}
+
+int RigidBodyFrame::resolve(Handle &handle) const
+{
+    if (handle.settings != settings_)
+    {
+        handle.index = findBody(handle.name);
+        handle.settings = settings_;
+    }
+    return handle.index;
+}
+
+bool RigidBodyFrame::getTransformation(Handle &handle, Eigen::Isometry3d &T) const
+{
+    int index = resolve(handle);
+    if (index < 0 || index >= nbodies_) return false;
+    T = poses_[index];
+    return true;
+}
+
+int RigidBodyFrame::findBody(const std::string &name) const
+{
+    for (int i = 0; i < nbodies_; i++)
+    {
+        if ((*names_)[i] == name) return i;
+    }
+    return -1;
+}
+
+const Eigen::Isometry3d& RigidBodyFrame::getTransformation(int index) const
+{
+    if (index < 0 || index >= nbodies_) return identityPose;
+    return poses_[index];
+}
+
+bool RigidBodyFrame::isTracked(int index) const
+{
+    return index >= 0 && index < nbodies_ && tracked_[index];
+}
+
+const std::string& RigidBodyFrame::getName(int index) const
+{
+    if (index < 0 || index >= nbodies_) return noName;
+    return (*names_)[index];
+}
+
+int RigidBodyFrame::getNbodies() const
+{
+    return nbodies_;
+}
+
+uint32_t RigidBodyFrame::getSettingsVersion() const
+{
+    return settings_;
+}
+
+unsigned int RigidBodyFrame::getFrameNumber() const
+{
+    return framenumber_;
+}
+
+uint64_t RigidBodyFrame::getQtmTimestamp() const
+{
+    return qtmtimestamp_us_;
+}
+
+int64_t RigidBodyFrame::getTimestamp() const
+{
+    return timestamp_ns_;
+}
+
+int64_t RigidBodyFrame::getArrivalTimestamp() const
+{
+    return arrival_ns_;
+}
+
+uint64_t RigidBodyFrame::getSequence() const
+{
+    return sequence_;
+}
+
+void RigidBodyFrame::setBodies(const std::shared_ptr<const std::vector<std::string>> &names, uint32_t settings)
+{
+    // only the pointer is copied, the names are shared by all the frames of the same settings
+    names_ = names;
+    nbodies_ = names_ ? std::min(static_cast<int>(names_->size()), MAX_BODIES) : 0;
+    settings_ = settings;
+}
+
+void RigidBodyFrame::setTransformation(int index, const Eigen::Isometry3d &T, bool tracked)
+{
+    if (index < 0 || index >= nbodies_) return;
+    poses_[index] = T;
+    tracked_[index] = tracked;
+}
+
+void RigidBodyFrame::setFrameNumber(unsigned int framenumber)
+{
+    framenumber_ = framenumber;
+}
+
+void RigidBodyFrame::setQtmTimestamp(uint64_t timestamp_us)
+{
+    qtmtimestamp_us_ = timestamp_us;
+}
+
+void RigidBodyFrame::setTimestamp(int64_t timestamp_ns)
+{
+    timestamp_ns_ = timestamp_ns;
+}
+
+void RigidBodyFrame::setArrivalTimestamp(int64_t arrival_ns)
+{
+    arrival_ns_ = arrival_ns;
+}
+
+void RigidBodyFrame::setSequence(uint64_t sequence)
+{
+    sequence_ = sequence;
+}
+
+RigidBodyFramePtr::RigidBodyFramePtr(RigidBodyFrame *frame)
+    : frame_(frame)
+{
+    if (frame_) frame_->refcount_.fetch_add(1, std::memory_order_relaxed);
+}
+
+RigidBodyFramePtr::RigidBodyFramePtr(const RigidBodyFramePtr& other)
+    : frame_(other.frame_)
+{
+    if (frame_) frame_->refcount_.fetch_add(1, std::memory_order_relaxed);
+}
+
+RigidBodyFramePtr::RigidBodyFramePtr(RigidBodyFramePtr&& other) noexcept
+    : frame_(other.frame_)
+{
+    other.frame_ = nullptr;
+}
+
+RigidBodyFramePtr& RigidBodyFramePtr::operator=(const RigidBodyFramePtr& other)
+{
+    if (frame_ != other.frame_)
+    {
+        RigidBodyFramePtr copy(other);
+        std::swap(frame_, copy.frame_);
+    }
+    return *this;
+}
+
+RigidBodyFramePtr& RigidBodyFramePtr::operator=(RigidBodyFramePtr&& other) noexcept
+{
+    if (this != &other)
+    {
+        reset();
+        frame_ = other.frame_;
+        other.frame_ = nullptr;
+    }
+    return *this;
+}
+
+RigidBodyFramePtr::~RigidBodyFramePtr()
+{
+    reset();
+}
+
+void RigidBodyFramePtr::reset()
+{
+    if (frame_ == nullptr) return;
+
+    // Same as AmodeFramePtr: the pool is moved out of the frame first, giving back the last frame of a pool whose
+    // owner is already gone destroys the pool (and this frame with it).
+    RigidBodyFrame *frame = frame_;
+    frame_ = nullptr;
+    if (frame->refcount_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        std::shared_ptr<RigidBodyFramePool> pool = std::move(frame->pool_);
+        pool->recycle(frame);
+    }
+}
@@ -0,0 +1,201 @@
+#ifndef RIGIDBODYFRAME_H
+#define RIGIDBODYFRAME_H
+
+#include <QMetaType>
+#include <Eigen/Geometry>
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+class RigidBodyFramePool;
+
+/**
+ * @class RigidBodyFrame
+ * @brief The poses of all the rigid bodies of one Qualisys frame, shared by all the consumers without copying.
+ *
+ * For the context. Previously every packet cleared and refilled a QualisysTransformationManager (an unordered_map
+ * from the name to the pose, a std::string per body), and dataReceived() sent it by value, so every packet meant
+ * several allocations, and a deep copy of the map for every receiver. Looking up a body hashed its name every time.
+ *
+ * Now the poses are in a fixed array, indexed like the 6DOF settings of QTM (the order of
+ * QualisysConnection::readMarkerSettings()). The names are read once with the settings and shared by all the frames
+ * of the same settings (getSettingsVersion() changes when they are read again, e.g. after a reconnection). A
+ * consumer keeps a Handle with the name of its body, resolve() finds the index the first time (and again if the
+ * settings changed), after that the lookup is only an index.
+ *
+ * Like AmodeFrame, the frames come from a RigidBodyFramePool and are handed out as RigidBodyFramePtr, read-only, and
+ * they go back to the pool when nobody holds them anymore. So in steady state there is no allocation at all.
+ *
+ * A body which QTM doesn't see in the frame has NaN in its pose, isTracked() is false for it.
+ *
+ */
+
+class RigidBodyFrame
+{
+public:
+
+    static constexpr int MAX_BODIES = 32;   //!< The bodies after this are ignored
+
+    /**
+     * @struct Handle
+     * @brief The name of a body and where it is in the frames, see resolve()
+     */
+    struct Handle {
+        std::string name;               //!< The name of the body in QTM
+        int index = -1;                 //!< The index of the body, -1 if there is none with this name
+        uint32_t settings = 0;          //!< The settings version index belongs to, 0 if never resolved
+
+        explicit Handle(const std::string &bodyname = "") : name(bodyname) {}
+    };
+
+    /**
+     * @brief GET the index of the body of handle, -1 if there is none. Only searches the names if the settings changed
+     * since the last call with this handle.
+     */
+    int resolve(Handle &handle) const;
+
+    /**
+     * @brief GET the pose of the body of handle, returns false (and T doesn't change) if there is no such body
+     */
+    bool getTransformation(Handle &handle, Eigen::Isometry3d &T) const;
+
+    /**
+     * @brief GET the index of the body with this name, -1 if none. Searches the names, use resolve() for every frame.
+     */
+    int findBody(const std::string &name) const;
+
+    /**
+     * @brief GET the pose of the body number index (starting from 0), identity if index is out of range
+     */
+    const Eigen::Isometry3d& getTransformation(int index) const;
+
+    /**
+     * @brief GET true if QTM saw the body number index in this frame
+     */
+    bool isTracked(int index) const;
+
+    /**
+     * @brief GET the name of the body number index, empty if index is out of range
+     */
+    const std::string& getName(int index) const;
+
+    /**
+     * @brief GET the number of bodies
+     */
+    int getNbodies() const;
+
+    /**
+     * @brief GET the version of the settings (the names) of this frame, it changes every time they are read
+     */
+    uint32_t getSettingsVersion() const;
+
+    /**
+     * @brief GET the frame number of QTM
+     */
+    unsigned int getFrameNumber() const;
+
+    /**
+     * @brief GET the timestamp of QTM [us], QTM's clock (from the start of the measurement)
+     */
+    uint64_t getQtmTimestamp() const;
+
+    /**
+     * @brief GET the host monotonic time of the frame [ns], the same clock as the A-mode and B-mode frames. It is the
+     * QTM timestamp mapped to the host clock (see ClockModel), so without the jitter of the network.
+     */
+    int64_t getTimestamp() const;
+
+    /**
+     * @brief GET the host monotonic time when the packet arrived [ns]
+     */
+    int64_t getArrivalTimestamp() const;
+
+    /**
+     * @brief GET the number of the frame, counted by the producer
+     */
+    uint64_t getSequence() const;
+
+    /**
+     * @brief [Producer only] Fill the frame, before it is handed to anybody else. setBodies() first, it sets the
+     * number of bodies (at most MAX_BODIES).
+     */
+    void setBodies(const std::shared_ptr<const std::vector<std::string>> &names, uint32_t settings);
+    void setTransformation(int index, const Eigen::Isometry3d &T, bool tracked);
+    void setFrameNumber(unsigned int framenumber);
+    void setQtmTimestamp(uint64_t timestamp_us);
+    void setTimestamp(int64_t timestamp_ns);
+    void setArrivalTimestamp(int64_t arrival_ns);
+    void setSequence(uint64_t sequence);
+
+private:
+    friend class RigidBodyFramePool;
+    friend class RigidBodyFramePtr;
+
+    /**
+     * @brief Constructor function, only the pool creates frames
+     */
+    RigidBodyFrame();
+
+    std::array<Eigen::Isometry3d, MAX_BODIES> poses_;       //!< The poses, in the order of the settings
+    std::array<bool, MAX_BODIES> tracked_;                  //!< True if QTM saw the body
+    std::shared_ptr<const std::vector<std::string>> names_; //!< The names of the bodies, shared by the frames of the same settings
+    int nbodies_ = 0;                                       //!< The number of bodies
+    uint32_t settings_ = 0;                                 //!< The version of the settings
+    unsigned int framenumber_ = 0;                          //!< Frame number of QTM
+    uint64_t qtmtimestamp_us_ = 0;                          //!< Timestamp of QTM [us]
+    int64_t timestamp_ns_ = 0;                              //!< Host time of the frame [ns]
+    int64_t arrival_ns_ = 0;                                //!< Arrival time [ns]
+    uint64_t sequence_ = 0;                                 //!< Frame number from the producer
+
+    std::atomic<int> refcount_{0};                          //!< The number of RigidBodyFramePtr pointing to this frame
+    std::shared_ptr<RigidBodyFramePool> pool_;              //!< Where the frame goes back, keeps the pool alive while the frame is out
+};
+
+/**
+ * @class RigidBodyFramePtr
+ * @brief Reference-counted pointer to a const RigidBodyFrame. Copying it is cheap (no copy of the poses).
+ */
+
+class RigidBodyFramePtr
+{
+public:
+    RigidBodyFramePtr() = default;
+    RigidBodyFramePtr(const RigidBodyFramePtr& other);
+    RigidBodyFramePtr(RigidBodyFramePtr&& other) noexcept;
+    RigidBodyFramePtr& operator=(const RigidBodyFramePtr& other);
+    RigidBodyFramePtr& operator=(RigidBodyFramePtr&& other) noexcept;
+    ~RigidBodyFramePtr();
+
+    const RigidBodyFrame* get() const { return frame_; }
+    const RigidBodyFrame* operator->() const { return frame_; }
+    const RigidBodyFrame& operator*() const { return *frame_; }
+    explicit operator bool() const { return frame_ != nullptr; }
+
+    /**
+     * @brief Let go of the frame (it goes back to the pool if nobody else holds it)
+     */
+    void reset();
+
+    /**
+     * @brief [Producer only] Writable access, only before the pointer is shared with anybody.
+     */
+    RigidBodyFrame* writable() const { return frame_; }
+
+private:
+    friend class RigidBodyFramePool;
+
+    /**
+     * @brief Only the pool makes a pointer from a raw frame
+     */
+    explicit RigidBodyFramePtr(RigidBodyFrame *frame);
+
+    RigidBodyFrame *frame_ = nullptr;       //!< The frame, nullptr if none
+};
+
+Q_DECLARE_METATYPE(RigidBodyFramePtr)
+
+#endif // RIGIDBODYFRAME_H
@@ -0,0 +1,68 @@
+#include "rigidbodyframepool.h"
+
+#include <algorithm>
+
+std::shared_ptr<RigidBodyFramePool> RigidBodyFramePool::create(int nframes, int maxframes)
+{
+    return std::shared_ptr<RigidBodyFramePool>(new RigidBodyFramePool(nframes, maxframes));
+}
+
+RigidBodyFramePool::RigidBodyFramePool(int nframes, int maxframes)
+    : maxframes_(std::max(maxframes, nframes))
+{
+    // Allocate everything now, recycle() never allocates because free_ already has the room for all frames
+    frames_.reserve(maxframes_);
+    free_.reserve(maxframes_);
+    for (int i = 0; i < nframes; i++)
+    {
+        frames_.emplace_back(new RigidBodyFrame());
+        free_.push_back(frames_.back().get());
+    }
+}
+
+RigidBodyFramePtr RigidBodyFramePool::acquire()
+{
+    RigidBodyFrame *frame = nullptr;
+    {
+        QMutexLocker locker(&mutex_);
+        if (free_.empty())
+        {
+            // All the frames are out, grow if we still may
+            if (static_cast<int>(frames_.size()) >= maxframes_)
+            {
+                exhausted_.fetch_add(1, std::memory_order_relaxed);
+                return RigidBodyFramePtr();
+            }
+            frames_.emplace_back(new RigidBodyFrame());
+            free_.push_back(frames_.back().get());
+            allocations_.fetch_add(1, std::memory_order_relaxed);
+        }
+        frame = free_.back();
+        free_.pop_back();
+    }
+
+    frame->pool_ = shared_from_this();
+    return RigidBodyFramePtr(frame);
+}
+
+void RigidBodyFramePool::recycle(RigidBodyFrame *frame)
+{
+    QMutexLocker locker(&mutex_);
+    free_.push_back(frame);
+}
+
+int RigidBodyFramePool::getNframes() const
+{
+    QMutexLocker locker(&mutex_);
+    return static_cast<int>(frames_.size());
+}
+
+uint64_t RigidBodyFramePool::getAllocations() const
+{
+    return allocations_.load(std::memory_order_relaxed);
+}
+
+uint64_t RigidBodyFramePool::getExhausted() const
+{
+    return exhausted_.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,77 @@
+#ifndef RIGIDBODYFRAMEPOOL_H
+#define RIGIDBODYFRAMEPOOL_H
+
+#include <QMutex>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "rigidbodyframe.h"
+
+/**
+ * @class RigidBodyFramePool
+ * @brief Preallocated RigidBodyFrame objects, which are given out with acquire() and come back automatically.
+ *
+ * For the context. See RigidBodyFrame, this is the same as AmodeFramePool. QualisysConnection calls acquire() for
+ * every packet, fills the frame, and emits the RigidBodyFramePtr. When the last RigidBodyFramePtr of a frame is gone,
+ * the frame comes back here. The pool grows up to maxframes if the consumers hold on to a lot of frames (e.g. a pose
+ * history), after that acquire() returns an empty pointer and the packet is skipped.
+ *
+ * The pool is always held by a std::shared_ptr (use create()), and every frame which is out holds the pool too.
+ *
+ */
+
+class RigidBodyFramePool : public std::enable_shared_from_this<RigidBodyFramePool>
+{
+public:
+
+    /**
+     * @brief Create a pool with nframes frames, it can grow up to maxframes.
+     */
+    static std::shared_ptr<RigidBodyFramePool> create(int nframes = 16, int maxframes = 256);
+
+    /**
+     * @brief GET a free frame, or an empty pointer if there is none. Thread-safe.
+     */
+    RigidBodyFramePtr acquire();
+
+    /**
+     * @brief GET the number of frames allocated by the pool
+     */
+    int getNframes() const;
+
+    /**
+     * @brief GET the number of times acquire() had to allocate a new frame, 0 in steady state after the start
+     */
+    uint64_t getAllocations() const;
+
+    /**
+     * @brief GET the number of times acquire() returned an empty pointer
+     */
+    uint64_t getExhausted() const;
+
+private:
+    friend class RigidBodyFramePtr;
+
+    /**
+     * @brief Constructor function, use create()
+     */
+    RigidBodyFramePool(int nframes, int maxframes);
+
+    /**
+     * @brief Will be called when the last RigidBodyFramePtr of a frame is gone. Thread-safe.
+     */
+    void recycle(RigidBodyFrame *frame);
+
+    int maxframes_;                                         //!< The pool doesn't grow beyond this
+
+    mutable QMutex mutex_;                                  //!< Protects frames_ and free_
+    std::vector<std::unique_ptr<RigidBodyFrame>> frames_;   //!< All the frames, owned by the pool
+    std::vector<RigidBodyFrame*> free_;                     //!< The frames which are not used, reserved up to maxframes_
+
+    std::atomic<uint64_t> allocations_{0};                  //!< Counting variable for new frames after the constructor
+    std::atomic<uint64_t> exhausted_{0};                    //!< Counting variable for the empty acquire()
+};
+
+#endif // RIGIDBODYFRAMEPOOL_H
@@ -0,0 +1,19 @@
+QT = core gui
+
+CONFIG += c++17 cmdline
+
+# Counts the heap allocations of the B-mode frame path, see main.cpp. It returns 1 if a check fails.
+
+INCLUDEPATH += ../..
+
+SOURCES += \
+    main.cpp \
+    ../../bmodeframe.cpp \
+    ../../bmodeframepool.cpp
+
+HEADERS += \
+    ../../bmodeframe.h \
+    ../../bmodeframepool.h
+
+INCLUDEPATH += C:\opencv-4.9.0\opencv\build\include
+LIBS += C:\opencv-4.9.0\opencv\build\install\x64\mingw\bin\libopencv_core490.dll
@@ -0,0 +1,135 @@
+#include <QImage>
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <vector>
+
+#include "bmodeframepool.h"
+
+// Counts the heap allocations of the B-mode frame path in steady state, it must be 0. Every operator new of the
+// process is counted, so anything that allocates per image (the pool, the handoff, a QImage that copies or wraps
+// the pixels) shows up.
+//
+// The loop does what the application does with every image, on one thread so that nothing else allocates in between:
+//  - BmodeGrabWorker: acquire() a frame of the pool, write the image into it, publish it into the latest slot
+//  - BmodeConnection: take the latest image (readLatest()), show it through toQImage()
+//  - Bmode3DVisualizer: keep the latest image and a QImage of it as texture
+//  - MHAWriter: keep the latest image, let go of it now and then
+// Then a recording keeps many frames (the pool grows and shrinks again), and the pool owner goes before the frames.
+//
+// Returns 0 if all the checks pass, 1 otherwise.
+
+static std::atomic<long> allocations{0};
+
+void* operator new(std::size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    void *p = std::malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+void* operator new[](std::size_t size) { return operator new(size); }
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::size_t) noexcept { std::free(p); }
+
+static int failures = 0;
+
+static void check(bool ok, const char *what)
+{
+    std::printf("%s | %s\n", ok ? "ok  " : "FAIL", what);
+    if (!ok) failures++;
+}
+
+int main()
+{
+    const int width = 840, height = 900;    // the roi of the Epiphan image
+    const int warmup = 100, nframes = 20000;
+
+    std::shared_ptr<BmodeFramePool> pool = BmodeFramePool::create(width, height, 8);
+    QMutex mutex;                           // the slot of BmodeGrabWorker
+    BmodeFramePtr latest, visualizer, recorder;
+    QImage texture;
+
+    long before = 0;
+    uint64_t poolbefore = 0;
+    for (int i = 0; i < warmup + nframes; i++)
+    {
+        if (i == warmup)
+        {
+            before = allocations.load();
+            poolbefore = pool->getAllocations();
+        }
+
+        // the worker
+        BmodeFramePtr frame = pool->acquire();
+        cv::Mat image = frame.writable()->writableImage();
+        std::memset(image.data, i & 255, image.step * image.rows);
+        frame.writable()->setTimestamp(i);
+        frame.writable()->setSequence(i + 1);
+        {
+            QMutexLocker locker(&mutex);
+            latest = std::move(frame);
+        }
+
+        // the GUI
+        BmodeFramePtr taken;
+        {
+            QMutexLocker locker(&mutex);
+            taken = std::move(latest);
+        }
+        {
+            QImage display = BmodeFrame::toQImage(taken);
+        }
+        visualizer = taken;
+        texture = BmodeFrame::toQImage(visualizer);
+        recorder = taken;
+        if (i % 3 == 0) recorder.reset();
+    }
+    long steady = allocations.load() - before;
+    std::printf("steady state: %ld allocations over %d frames, pool of %d frames\n", steady, nframes, pool->getNframes());
+    check(steady == 0, "no heap allocation per frame in steady state");
+    check(pool->getAllocations() == poolbefore, "the pool doesn't allocate in steady state");
+
+    // the consumers let go, every frame is back in the pool
+    texture = QImage();
+    visualizer.reset();
+    recorder.reset();
+
+    // a recording (MHAWriter) keeps the frames, the pool grows, and goes back to its size afterwards
+    std::vector<BmodeFramePtr> recording;
+    recording.reserve(500);
+    for (int i = 0; i < 500; i++) recording.push_back(pool->acquire());
+    check(pool->getNframes() >= 500, "the pool grows while recording");
+    recording.clear();
+    check(pool->getNframes() == 8, "the pool is back to its 8 frames after the recording");
+
+    // a QImage kept after its frame went back to the pool doesn't change when the frame is filled again
+    BmodeFramePtr shown = pool->acquire();
+    std::memset(shown.writable()->writableImage().data, 7, shown->getStep() * shown->getHeight());
+    QImage kept = BmodeFrame::toQImage(shown);
+    shown.reset();
+    for (int i = 0; i < 8; i++)
+    {
+        BmodeFramePtr frame = pool->acquire();
+        std::memset(frame.writable()->writableImage().data, 9, frame->getStep() * frame->getHeight());
+        recording.push_back(std::move(frame));
+    }
+    check(kept.constBits()[0] == 7, "a QImage kept after its frame keeps its pixels");
+    kept = QImage();
+    recording.clear();
+
+    // the owner of the pool goes before the frames (BmodeGrabWorker with a new resolution)
+    BmodeFramePtr keep = pool->acquire();
+    std::weak_ptr<BmodeFramePool> owner = pool;
+    pool.reset();
+    check(!owner.expired(), "a frame which is out keeps its pool");
+    keep.reset();
+    check(owner.expired(), "the pool goes away with its last frame");
+
+    return failures ? 1 : 0;
+}
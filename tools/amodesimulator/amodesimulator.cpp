@@ -0,0 +1,213 @@
+#include "amodesimulator.h"
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QtEndian>
+#include <cmath>
+
+AmodeSimulator::AmodeSimulator(const Settings& settings, QObject *parent)
+    : QObject{parent}, settings_(settings), random_(settings.seed)
+{
+    prepareFrames();
+
+    connect(&server_, &QTcpServer::newConnection, this, &AmodeSimulator::onNewConnection);
+
+    // 1 ms is fine even for 10x the real rate, every tick sends all the frames which are due
+    ticker_.setTimerType(Qt::PreciseTimer);
+    ticker_.setInterval(1);
+    connect(&ticker_, &QTimer::timeout, this, &AmodeSimulator::onTick);
+
+    statisticsTimer_.setInterval(1000);
+    connect(&statisticsTimer_, &QTimer::timeout, this, &AmodeSimulator::printStatistics);
+}
+
+bool AmodeSimulator::listen()
+{
+    if (!server_.listen(QHostAddress::Any, settings_.port))
+    {
+        qDebug() << "Unable to listen on port" << settings_.port << ":" << server_.errorString();
+        return false;
+    }
+
+    qDebug() << "A-mode simulator listening on port" << settings_.port << "|" << settings_.probes << "probes x"
+             << settings_.samples << "samples |" << settings_.rate << "fps |" << framesize_ << "bytes per frame";
+
+    clock_.start();
+    ticker_.start();
+    statisticsTimer_.start();
+    return true;
+}
+
+void AmodeSimulator::onNewConnection()
+{
+    while (QTcpSocket *client = server_.nextPendingConnection())
+    {
+        qDebug() << "Client connected:" << client->peerAddress().toString();
+        client->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+        clients_.append(client);
+        connect(client, &QTcpSocket::disconnected, this, [this, client]() {
+            qDebug() << "Client disconnected";
+            clients_.removeOne(client);
+            client->deleteLater();
+        });
+    }
+}
+
+void AmodeSimulator::prepareFrames()
+{
+    // Just to clarify, here is how a frame looks like:
+    // [arrayheader][separator][index][data]
+    const std::vector<uint16_t> separator = {10083, 10084, 10065, 10082, 10084};
+    separatorsize_ = separator.size() * sizeof(uint16_t);
+    separatorpos_  = 4;
+    indexpos_      = separatorpos_ + separatorsize_;
+    int nwords     = separator.size() + 1 + settings_.probes * settings_.samples;
+    framesize_     = separatorpos_ + nwords * sizeof(uint16_t);
+
+    // A few frames with the echoes at slightly different depth, so that the plots move a bit.
+    // The signal is a gaussian burst at 7.5 MHz (like the probes) sampled at 50 MHz, stored as int16 like the machine.
+    const int npool = 8;
+    for (int f = 0; f < npool; f++)
+    {
+        QByteArray frame(framesize_, 0);
+        char *bytes = frame.data();
+
+        // The array header is the length of the array (in words), LabView writes it big endian
+        qToBigEndian<qint32>(nwords, bytes);
+
+        for (std::size_t i = 0; i < separator.size(); i++)
+            qToLittleEndian<quint16>(separator[i], bytes + separatorpos_ + i * sizeof(uint16_t));
+
+        char *data = bytes + indexpos_ + sizeof(uint16_t);
+        for (int p = 0; p < settings_.probes; p++)
+        {
+            double depth = settings_.samples * (0.25 + 0.5 * p / std::max(settings_.probes, 1)) + 10.0 * std::sin(2 * M_PI * f / npool);
+            for (int s = 0; s < settings_.samples; s++)
+            {
+                double envelope = 3000.0 * std::exp(-0.5 * std::pow((s - depth) / 15.0, 2));
+                double value    = envelope * std::sin(2 * M_PI * 7.5 / 50.0 * s) + random_.bounded(-50, 50);
+                qToLittleEndian<qint16>(static_cast<qint16>(value), data + (p * settings_.samples + s) * sizeof(uint16_t));
+            }
+        }
+        frames_.push_back(frame);
+    }
+
+    garbagebytes_.resize(256);
+    for (char& c : garbagebytes_) c = static_cast<char>(random_.bounded(256));
+}
+
+void AmodeSimulator::onTick()
+{
+    if (settings_.duration > 0 && clock_.elapsed() >= settings_.duration * 1000LL)
+    {
+        printStatistics();
+        QCoreApplication::quit();
+        return;
+    }
+
+    // How many frames should be sent until now. The frames are sent in groups of burst frames.
+    framesdue_ = static_cast<uint64_t>(clock_.nsecsElapsed() * settings_.rate / 1e9);
+    uint64_t burst = std::max(settings_.burst, 1);
+    while (framessent_ + burst <= framesdue_)
+    {
+        for (uint64_t i = 0; i < burst; i++) sendFrame();
+    }
+}
+
+void AmodeSimulator::sendFrame()
+{
+    QByteArray& frame = frames_[framessent_ % frames_.size()];
+    framessent_++;
+
+    // The index, sometimes it jumps (the A-mode PC lost some frames)
+    if (chance(settings_.skipIndex))
+    {
+        index_ += 1 + random_.bounded(4);
+        stat_skipped_++;
+    }
+    qToLittleEndian<quint16>(index_++, frame.data() + indexpos_);
+
+    // Decide the faults, the same for all the clients
+    int size = framesize_;
+    if (chance(settings_.truncateFrame))
+    {
+        // cut somewhere after the separator, so that the parser finds this separator but not the next one
+        size = random_.bounded(indexpos_, framesize_);
+        stat_truncated_++;
+    }
+    int garbage = 0;
+    if (chance(settings_.garbage))
+    {
+        garbage = random_.bounded(1, garbagebytes_.size());
+        stat_garbage_++;
+    }
+    int split = 0;
+    if (chance(settings_.splitSeparator))
+    {
+        split = separatorpos_ + random_.bounded(1, separatorsize_);
+        stat_split_++;
+    }
+
+    for (QTcpSocket *client : clients_)
+    {
+        // The client can't keep up, don't pile up the frames in the memory
+        if (client->bytesToWrite() > 16LL * framesize_)
+        {
+            stat_backlogged_++;
+            continue;
+        }
+
+        if (garbage > 0) client->write(garbagebytes_.constData(), garbage);
+
+        if (split > 0 && split < size)
+        {
+            // two separate writes, the first one ends in the middle of the separator
+            writeChunked(client, frame.constData(), split);
+            client->flush();
+            writeChunked(client, frame.constData() + split, size - split);
+        }
+        else
+        {
+            writeChunked(client, frame.constData(), size);
+        }
+    }
+
+    stat_frames_++;
+    stat_bytes_ += size + garbage;
+}
+
+void AmodeSimulator::writeChunked(QTcpSocket *client, const char *bytes, int size)
+{
+    if (settings_.chunksize <= 0)
+    {
+        client->write(bytes, size);
+        return;
+    }
+
+    // flush after every chunk, so that every chunk goes to the OS separately
+    for (int pos = 0; pos < size; pos += settings_.chunksize)
+    {
+        client->write(bytes + pos, std::min(settings_.chunksize, size - pos));
+        client->flush();
+    }
+}
+
+bool AmodeSimulator::chance(double probability)
+{
+    return probability > 0 && random_.generateDouble() < probability;
+}
+
+void AmodeSimulator::printStatistics()
+{
+    qDebug().noquote() << QString("%1 clients | %2 fps | %3 MB/s | split %4 | truncated %5 | garbage %6 | skipped index %7 | backlogged %8")
+                              .arg(clients_.size())
+                              .arg(stat_frames_)
+                              .arg(stat_bytes_ / (1024.0 * 1024.0), 0, 'f', 1)
+                              .arg(stat_split_)
+                              .arg(stat_truncated_)
+                              .arg(stat_garbage_)
+                              .arg(stat_skipped_)
+                              .arg(stat_backlogged_);
+
+    stat_frames_ = stat_bytes_ = stat_split_ = stat_truncated_ = stat_garbage_ = stat_skipped_ = stat_backlogged_ = 0;
+}
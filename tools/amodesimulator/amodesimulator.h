@@ -0,0 +1,140 @@
+#ifndef AMODESIMULATOR_H
+#define AMODESIMULATOR_H
+
+#include <QObject>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QRandomGenerator>
+
+#include <vector>
+
+/**
+ * @class AmodeSimulator
+ * @brief A TCP server which pretends to be the A-mode PC, it sends exactly the same bytes as the LabView program.
+ *
+ * For the context. To test AmodeConnection (and everything behind it) we always needed the A-mode machine. This
+ * server produces the same stream as testgarbage_v21_streamWithPeaks.vi does:
+ * ...[arrayheader 4 bytes][separator 10 bytes][index 2 bytes][data probes*samples words]...
+ * The separator is START+10000 in words (10083,10084,10065,10082,10084), everything after the array header is
+ * little endian words, like AmodeConnection::initializeData() expects.
+ *
+ * The frame rate, the number of probes and samples, and how the frames are chopped into TCP writes can be set, so
+ * we can push AmodeConnection far beyond the real rate. On top of that, some faults can be injected on purpose:
+ *  - split separator : the frame is written in two parts, the cut is in the middle of the separator
+ *  - truncated frame : only a part of the frame is sent, then the next frame starts
+ *  - garbage         : random bytes between two frames
+ *  - skipped index   : the index jumps, as if the A-mode PC lost a frame
+ *  - burst           : the frames are sent in groups of N at once, instead of one by one
+ *
+ * Every connected client receives the same stream. If a client can't keep up (too many bytes waiting in the socket),
+ * the frame is not sent to that client and it is counted, so the server never eats all the memory.
+ *
+ */
+
+class AmodeSimulator : public QObject
+{
+    Q_OBJECT
+
+public:
+
+    /**
+     * @struct Settings
+     * @brief Everything that can be set from the command line, see main.cpp
+     */
+    struct Settings {
+        quint16 port        = 6340;     //!< Port where the server listens (the same as the default of MainWindow)
+        int probes          = 30;       //!< The number of probes
+        int samples         = 3500;     //!< The number of samples of each probe
+        double rate         = 30.0;     //!< Frames per second
+        int chunksize       = 0;        //!< Bytes of every TCP write, 0 means one write per frame
+        int burst           = 1;        //!< The number of frames sent at once
+        double splitSeparator = 0.0;    //!< Probability [0-1] of a frame written with the cut in the separator
+        double truncateFrame  = 0.0;    //!< Probability [0-1] of a truncated frame
+        double garbage        = 0.0;    //!< Probability [0-1] of garbage bytes before a frame
+        double skipIndex      = 0.0;    //!< Probability [0-1] of a jump in the index
+        quint32 seed        = 1;        //!< Seed of the random generator, so a run can be repeated
+        int duration        = 0;        //!< Stop after this many seconds, 0 means forever
+    };
+
+    /**
+     * @brief Constructor function, prepares the frames. Call listen() to start.
+     */
+    explicit AmodeSimulator(const Settings& settings, QObject *parent = nullptr);
+
+    /**
+     * @brief Start the server
+     *
+     * @return true if the port is open
+     */
+    bool listen();
+
+private slots:
+    /**
+     * @brief Will be called whenever a client connects
+     */
+    void onNewConnection();
+
+    /**
+     * @brief Will be called by the timer, sends all the frames that are due
+     */
+    void onTick();
+
+    /**
+     * @brief Prints what was sent in the last second
+     */
+    void printStatistics();
+
+private:
+
+    /**
+     * @brief Builds the pool of frames (header, separator, zero index, and some fake echoes)
+     */
+    void prepareFrames();
+
+    /**
+     * @brief Sends one frame (with the faults, if we are unlucky) to all the clients
+     */
+    void sendFrame();
+
+    /**
+     * @brief Writes bytes to a client, chopped into chunksize writes
+     */
+    void writeChunked(QTcpSocket *client, const char *bytes, int size);
+
+    /**
+     * @brief true with the given probability
+     */
+    bool chance(double probability);
+
+    Settings settings_;                     //!< What the user wants
+    QTcpServer server_;                     //!< The server
+    QList<QTcpSocket*> clients_;            //!< All the connected clients
+    QTimer ticker_;                         //!< Wakes us up to send the frames
+    QTimer statisticsTimer_;                //!< Wakes us up to print the statistics
+    QElapsedTimer clock_;                   //!< Clock for the frame timing
+    QRandomGenerator random_;               //!< For the faults and the noise
+
+    int framesize_     = 0;                 //!< header + separator + index + data [bytes]
+    int separatorpos_  = 4;                 //!< Where the separator starts in a frame [bytes]
+    int separatorsize_ = 10;                //!< The number of bytes of the separator
+    int indexpos_      = 14;                //!< Where the index starts in a frame [bytes]
+    std::vector<QByteArray> frames_;        //!< Prepared frames, sent one after another (only the index changes)
+    QByteArray garbagebytes_;               //!< Random bytes, a part of it is sent as garbage
+
+    uint64_t framesdue_   = 0;              //!< The number of frames that should be sent until now
+    uint64_t framessent_  = 0;              //!< The number of frames sent until now
+    uint16_t index_       = 0;              //!< The index of the next frame
+
+    // statistics of the last second
+    uint64_t stat_frames_     = 0;          //!< Frames sent
+    uint64_t stat_bytes_      = 0;          //!< Bytes sent (per client)
+    uint64_t stat_split_      = 0;          //!< Frames with a split separator
+    uint64_t stat_truncated_  = 0;          //!< Truncated frames
+    uint64_t stat_garbage_    = 0;          //!< Garbage inserted
+    uint64_t stat_skipped_    = 0;          //!< Jumps in the index
+    uint64_t stat_backlogged_ = 0;          //!< Frames not sent because the client couldn't keep up
+};
+
+#endif // AMODESIMULATOR_H
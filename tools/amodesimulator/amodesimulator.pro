@@ -0,0 +1,19 @@
+QT = core network
+
+CONFIG += c++17 cmdline
+
+# A stand-in for the A-mode PC, see amodesimulator.h
+# Example, 10x the real rate with some faults:
+#   amodesimulator --rate 300 --chunk 1460 --split-separator 0.01 --truncate 0.01 --garbage 0.01
+
+SOURCES += \
+    amodesimulator.cpp \
+    main.cpp
+
+HEADERS += \
+    amodesimulator.h
+
+# Default rules for deployment.
+qnx: target.path = /tmp/$${TARGET}/bin
+else: unix:!android: target.path = /opt/$${TARGET}/bin
+!isEmpty(target.path): INSTALLS += target
@@ -0,0 +1,55 @@
+#include "amodesimulator.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("amodesimulator");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Pretends to be the A-mode PC, streams frames with the same protocol as the LabView program.");
+    parser.addHelpOption();
+
+    AmodeSimulator::Settings settings;
+    QCommandLineOption portOption("port", "Port to listen on (default 6340).", "port", QString::number(settings.port));
+    QCommandLineOption probesOption("probes", "Number of probes (default 30).", "n", QString::number(settings.probes));
+    QCommandLineOption samplesOption("samples", "Number of samples of each probe (default 3500).", "n", QString::number(settings.samples));
+    QCommandLineOption rateOption("rate", "Frames per second (default 30).", "fps", QString::number(settings.rate));
+    QCommandLineOption chunkOption("chunk", "Bytes of every TCP write, 0 is one write per frame (default 0).", "bytes", "0");
+    QCommandLineOption burstOption("burst", "Send the frames in groups of n (default 1).", "n", "1");
+    QCommandLineOption splitOption("split-separator", "Probability of a write boundary inside the separator.", "p", "0");
+    QCommandLineOption truncateOption("truncate", "Probability of a truncated frame.", "p", "0");
+    QCommandLineOption garbageOption("garbage", "Probability of garbage bytes before a frame.", "p", "0");
+    QCommandLineOption skipOption("skip-index", "Probability of a jump in the frame index.", "p", "0");
+    QCommandLineOption seedOption("seed", "Seed of the random generator (default 1).", "seed", "1");
+    QCommandLineOption durationOption("duration", "Stop after n seconds, 0 is forever (default 0).", "s", "0");
+    parser.addOptions({portOption, probesOption, samplesOption, rateOption, chunkOption, burstOption,
+                       splitOption, truncateOption, garbageOption, skipOption, seedOption, durationOption});
+    parser.process(a);
+
+    settings.port           = parser.value(portOption).toUShort();
+    settings.probes         = parser.value(probesOption).toInt();
+    settings.samples        = parser.value(samplesOption).toInt();
+    settings.rate           = parser.value(rateOption).toDouble();
+    settings.chunksize      = parser.value(chunkOption).toInt();
+    settings.burst          = parser.value(burstOption).toInt();
+    settings.splitSeparator = parser.value(splitOption).toDouble();
+    settings.truncateFrame  = parser.value(truncateOption).toDouble();
+    settings.garbage        = parser.value(garbageOption).toDouble();
+    settings.skipIndex      = parser.value(skipOption).toDouble();
+    settings.seed           = parser.value(seedOption).toUInt();
+    settings.duration       = parser.value(durationOption).toInt();
+
+    if (settings.probes <= 0 || settings.samples <= 0 || settings.rate <= 0)
+    {
+        qCritical("The number of probes, samples, and the rate must be positive.");
+        return 1;
+    }
+
+    AmodeSimulator simulator(settings);
+    if (!simulator.listen()) return 1;
+
+    return a.exec();
+}
@@ -0,0 +1,82 @@
+#include "benchmarks.h"
+#include "amodeenvelopedetector.h"
+#include "amodeframepool.h"
+
+#include <QDebug>
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+int benchAmodeEnvelope(const BenchOptions &options)
+{
+    // A full frame, 30 probes of 3500 samples. Every probe has an echo (a 7.5 MHz burst, like the transducers) at a
+    // different depth on top of some noise, so that we can check the envelope peaks where the echo is.
+    const int nprobe  = UltrasoundConfig::N_UST;
+    const int nsample = UltrasoundConfig::N_SAMPLE;
+    std::shared_ptr<AmodeFramePool> pool = AmodeFramePool::create(nprobe, nsample, 1, 1);
+    AmodeFramePtr frame = pool->acquire();
+    if (!frame) return 1;
+
+    std::mt19937 random(1);
+    std::normal_distribution<double> noise(0.0, 20.0);
+    std::vector<int> echoes(nprobe);
+    int16_t *data = frame.writable()->writableData();
+    for (int p = 0; p < nprobe; p++)
+    {
+        echoes[p] = 500 + p * 90;
+        for (int i = 0; i < nsample; i++)
+        {
+            double t = (i - echoes[p]) / static_cast<double>(UltrasoundConfig::FREQ);
+            double burst = 3000.0 * std::exp(-std::pow(t / 0.2e-6, 2)) * std::cos(2 * M_PI * 7.5e6 * t);
+            data[static_cast<std::size_t>(p) * nsample + i] = static_cast<int16_t>(std::lround(burst + noise(random)));
+        }
+    }
+
+    // one thread (what a single core costs) and as many as OpenMP gives us (what the worker does)
+    int maxthreads = 1;
+#ifdef _OPENMP
+    maxthreads = omp_get_max_threads();
+#endif
+    bool ok = true;
+    for (int nthreads : {1, maxthreads})
+    {
+        AmodeEnvelopeDetector detector;
+        detector.setThreads(nthreads);
+        detector.prepare(nsample);
+        detector.process(frame.writable());
+
+        // the envelope must peak at the echo of every probe
+        for (int p = 0; p < nprobe; p++)
+        {
+            AmodeFrame::ProbeView envelope = frame->envelope(p);
+            int peak = static_cast<int>(std::max_element(envelope.data, envelope.data + envelope.size) - envelope.data);
+            if (std::abs(peak - echoes[p]) > 5)
+            {
+                qDebug() << "envelope | probe" << p << "peaks at" << peak << "instead of" << echoes[p];
+                ok = false;
+            }
+        }
+
+        uint64_t n = 0;
+        auto start = std::chrono::steady_clock::now();
+        do
+        {
+            detector.process(frame.writable());
+            n++;
+        } while (secondsSince(start) < options.seconds);
+        double seconds = secondsSince(start) / n;
+
+        qDebug().noquote() << QString("envelope | %1 thread(s) | %2 ms per frame of %3x%4 | %5 ns/sample")
+                                  .arg(nthreads)
+                                  .arg(seconds * 1e3, 0, 'f', 3)
+                                  .arg(nprobe)
+                                  .arg(nsample)
+                                  .arg(seconds * 1e9 / (static_cast<double>(nprobe) * nsample), 0, 'f', 2);
+        if (maxthreads == 1) break;
+    }
+    return ok ? 0 : 1;
+}
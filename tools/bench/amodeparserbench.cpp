@@ -0,0 +1,161 @@
+#include "benchmarks.h"
+#include "amodeframeparser.h"
+
+#include <QDebug>
+#include <QFile>
+#include <QtEndian>
+#include <algorithm>
+#include <cstring>
+
+// The same as AmodeConnection::initializeData()
+static const std::vector<uint16_t> SEPARATOR = {10083, 10084, 10065, 10082, 10084};
+static const int HEADERSIZE = 4;
+static const int INDEXSIZE  = 2;
+
+std::vector<char> makeAmodeStream(int probes, int samples, int frames)
+{
+    const int nwords = static_cast<int>(SEPARATOR.size()) + 1 + probes * samples;
+    std::vector<char> stream;
+    stream.reserve(static_cast<std::size_t>(frames) * (HEADERSIZE + nwords * 2 + 16));
+
+    uint32_t random = 1;
+    for (int f = 0; f < frames; f++)
+    {
+        // some garbage now and then, the parser loses the lock and has to search
+        if (f % 16 == 15)
+        {
+            for (int i = 0; i < 13; i++) stream.push_back(static_cast<char>(i * 37));
+        }
+
+        char word[4];
+        qToBigEndian<qint32>(nwords, word);
+        stream.insert(stream.end(), word, word + 4);
+        for (uint16_t s : SEPARATOR)
+        {
+            qToLittleEndian<quint16>(s, word);
+            stream.insert(stream.end(), word, word + 2);
+        }
+        qToLittleEndian<quint16>(static_cast<quint16>(f), word);
+        stream.insert(stream.end(), word, word + 2);
+
+        // noise, small enough to never look like the separator
+        for (int i = 0; i < probes * samples; i++)
+        {
+            random = random * 1664525u + 1013904223u;
+            qToLittleEndian<qint16>(static_cast<qint16>((random >> 16) % 2001) - 1000, word);
+            stream.insert(stream.end(), word, word + 2);
+        }
+    }
+    return stream;
+}
+
+std::vector<char> loadAmodeCapture(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        qDebug() << "Unable to open the capture" << path << ":" << file.errorString();
+        return {};
+    }
+    QByteArray bytes = file.readAll();
+
+    // not a recording, the raw bytes of the socket
+    if (!bytes.startsWith("AMODEREC")) return std::vector<char>(bytes.begin(), bytes.end());
+
+    // A recording: the file header, then chunks of records (see AmodeRecorder). Every record becomes a frame again.
+    const char *data = bytes.constData();
+    const std::size_t size = bytes.size();
+    const uint32_t nprobe = qFromLittleEndian<quint32>(data + 12);
+    const uint32_t nsample = qFromLittleEndian<quint32>(data + 16);
+    const uint32_t recordsize = qFromLittleEndian<quint32>(data + 20);
+    const std::size_t datasize = static_cast<std::size_t>(nprobe) * nsample * 2;
+    const int nwords = static_cast<int>(SEPARATOR.size()) + 1 + static_cast<int>(nprobe * nsample);
+
+    std::vector<char> stream;
+    std::size_t pos = 64;
+    while (pos + 16 <= size && std::memcmp(data + pos, "CHNK", 4) == 0)
+    {
+        uint32_t nframes = qFromLittleEndian<quint32>(data + pos + 4);
+        pos += 16;
+        for (uint32_t i = 0; i < nframes && pos + recordsize <= size; i++, pos += recordsize)
+        {
+            char word[4];
+            qToBigEndian<qint32>(nwords, word);
+            stream.insert(stream.end(), word, word + 4);
+            for (uint16_t s : SEPARATOR)
+            {
+                qToLittleEndian<quint16>(s, word);
+                stream.insert(stream.end(), word, word + 2);
+            }
+            stream.insert(stream.end(), data + pos + 8, data + pos + 10);      // the index
+            stream.insert(stream.end(), data + pos + 16, data + pos + 16 + datasize);
+        }
+    }
+    return stream;
+}
+
+int benchAmodeParser(const BenchOptions &options)
+{
+    std::vector<char> stream = options.capture.isEmpty() ? makeAmodeStream(30, 3500, 256) : loadAmodeCapture(options.capture);
+    if (stream.empty())
+    {
+        qDebug() << "The capture is empty";
+        return 1;
+    }
+
+    // The frame size is measured from the stream, like AmodeAcquisitionWorker::measureDataSize() does
+    AmodeFrameParser parser(SEPARATOR, HEADERSIZE, INDEXSIZE, 30 * 3500 * 2);
+    parser.append(stream.data(), std::min(stream.size(), parser.writableBytes()));
+    std::size_t datasize = parser.measureDataSize();
+    if (datasize == 0)
+    {
+        qDebug() << "No A-mode frames in the capture";
+        return 1;
+    }
+    parser.setDataSize(static_cast<int>(datasize));
+
+    // Replay the whole stream again and again, the socket reads are memcpy into writePointer(), like
+    // AmodeAcquisitionWorker::readData() does with QTcpSocket::read()
+    const std::size_t chunk = static_cast<std::size_t>(std::max(options.chunk, 1));
+    uint64_t passes = 0, bytes = 0, frames = 0, checksum = 0;
+    uint64_t dropped = parser.getBytesDropped();
+    auto start = std::chrono::steady_clock::now();
+    do
+    {
+        parser.reset();
+        std::size_t pos = 0;
+        while (pos < stream.size())
+        {
+            char *dst = parser.writePointer();
+            std::size_t n = std::min({chunk, stream.size() - pos, parser.writableBytes()});
+            std::memcpy(dst, stream.data() + pos, n);
+            parser.commitWrite(n);
+            pos += n;
+
+            AmodeFrameParser::FrameView view;
+            while (parser.nextFrame(view))
+            {
+                checksum += view.index + static_cast<unsigned char>(view.data[view.datasize - 1]);
+                frames++;
+            }
+        }
+        bytes += stream.size();
+        passes++;
+    } while (secondsSince(start) < options.seconds);
+    double elapsed = secondsSince(start);
+    dropped = parser.getBytesDropped() - dropped;
+
+    qDebug().noquote() << QString("parser | %1 | %2 MB, frame %3 bytes, reads of %4 bytes | %5 passes")
+                              .arg(options.capture.isEmpty() ? QString("synthetic 30x3500") : options.capture)
+                              .arg(stream.size() / 1.0e6, 0, 'f', 1)
+                              .arg(parser.getFrameSize())
+                              .arg(chunk)
+                              .arg(passes);
+    qDebug().noquote() << QString("parser | %1 GB/s | %2 frames/s | %3 frames per pass | dropped %4 bytes per pass | (checksum %5)")
+                              .arg(bytes / elapsed / 1.0e9, 0, 'f', 2)
+                              .arg(frames / elapsed, 0, 'f', 0)
+                              .arg(frames / passes)
+                              .arg(dropped / passes)
+                              .arg(checksum % 1000);
+    return 0;
+}
@@ -0,0 +1,70 @@
+#include "benchmarks.h"
+#include "amodeseparatorscanner.h"
+
+#include <QDebug>
+#include <algorithm>
+#include <cstring>
+
+int benchAmodeScanner(const BenchOptions &options)
+{
+    // Two frames of 30x3500, the search starts right after the first separator and goes through a whole frame
+    // (~210 KB) until the next one, that is what the parser does after it lost the lock
+    std::vector<char> stream = makeAmodeStream(30, 3500, 2);
+    const std::vector<char> separator = {char(0x63), char(0x27), char(0x64), char(0x27), char(0x51), char(0x27),
+                                         char(0x62), char(0x27), char(0x64), char(0x27)};
+    const char *data = stream.data() + 5;
+    const std::size_t size = stream.size() - 5;
+
+    // the reference, a generic byte search like QByteArray::indexOf() was
+    std::size_t expected = std::search(data, data + size, separator.begin(), separator.end()) - data;
+    if (expected == size)
+    {
+        qDebug() << "No separator in the synthetic stream";
+        return 1;
+    }
+
+    struct Result { const char *name; double seconds; };
+    std::vector<Result> results;
+    auto measure = [&](const char *name, auto find) {
+        uint64_t n = 0;
+        auto start = std::chrono::steady_clock::now();
+        do
+        {
+            for (int i = 0; i < 64; i++, n++)
+            {
+                if (find() != expected) { qDebug() << name << "found the separator at the wrong place"; return false; }
+            }
+        } while (secondsSince(start) < options.seconds / 4);
+        results.push_back({name, secondsSince(start) / n});
+        return true;
+    };
+
+    // what the constructor picked, from its own timing run
+    const char *automatic = AmodeSeparatorScanner(separator).getImplementationName();
+
+    bool ok = measure("std::search", [&]() { return static_cast<std::size_t>(std::search(data, data + size, separator.begin(), separator.end()) - data); });
+    AmodeSeparatorScanner scanner(separator);
+    for (auto implementation : {AmodeSeparatorScanner::Scalar, AmodeSeparatorScanner::SSE2, AmodeSeparatorScanner::AVX2})
+    {
+        scanner.setImplementation(implementation);
+        if (scanner.getImplementation() != implementation)
+        {
+            qDebug() << "scanner |" << "not supported by this CPU, skipped";
+            continue;
+        }
+        ok = ok && measure(scanner.getImplementationName(), [&]() { return scanner.find(data, size); });
+    }
+
+    for (const Result &result : results)
+    {
+        qDebug().noquote() << QString("scanner | %1 | %2 us per frame of %3 bytes | %4 GB/s | %5x std::search, %6x Scalar")
+                                  .arg(result.name, -11)
+                                  .arg(result.seconds * 1e6, 0, 'f', 1)
+                                  .arg(expected)
+                                  .arg(expected / result.seconds / 1e9, 0, 'f', 2)
+                                  .arg(results[0].seconds / result.seconds, 0, 'f', 1)
+                                  .arg(results.size() > 1 ? results[1].seconds / result.seconds : 1.0, 0, 'f', 1);
+    }
+    qDebug().noquote() << QString("scanner | automatic choice: %1").arg(automatic);
+    return ok ? 0 : 1;
+}
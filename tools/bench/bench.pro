@@ -0,0 +1,40 @@
+QT = core
+
+CONFIG += c++17 cmdline
+
+# Benchmarks of the hot paths, see main.cpp. The sources are the ones of the application, build it in release.
+# Example, replay a capture of the A-mode stream:
+#   bench parser --capture session.amode --chunk 1460
+
+INCLUDEPATH += \
+    ../.. \
+    "C:/eigen-3.4.0"
+
+# OpenMP, like the application (AmodeEnvelopeDetector)
+QMAKE_CXXFLAGS += -fopenmp
+LIBS += -fopenmp
+
+SOURCES += \
+    amodeenvelopebench.cpp \
+    amodeparserbench.cpp \
+    amodescannerbench.cpp \
+    bmodegraybench.cpp \
+    main.cpp \
+    posehistorybench.cpp \
+    ../../amodeenvelopedetector.cpp \
+    ../../amodeframe.cpp \
+    ../../amodeframeparser.cpp \
+    ../../amodeframepool.cpp \
+    ../../amodeseparatorscanner.cpp \
+    ../../bmodegrayconverter.cpp \
+    ../../posehistory.cpp \
+    ../../rigidbodyframe.cpp \
+    ../../rigidbodyframepool.cpp
+
+HEADERS += \
+    benchmarks.h
+
+# OpenCV, like the application (BmodeGrayConverter)
+INCLUDEPATH += C:\opencv-4.9.0\opencv\build\include
+LIBS += C:\opencv-4.9.0\opencv\build\install\x64\mingw\bin\libopencv_core490.dll
+LIBS += C:\opencv-4.9.0\opencv\build\install\x64\mingw\bin\libopencv_imgproc490.dll
@@ -0,0 +1,48 @@
+#ifndef BENCHMARKS_H
+#define BENCHMARKS_H
+
+#include <QString>
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief The options of all the benchmarks, see main.cpp. Every benchmark only looks at the ones it needs.
+ */
+struct BenchOptions {
+    QString capture;            //!< A-mode capture to replay (raw socket bytes or an AmodeRecorder file), empty for a synthetic one
+    int chunk = 65536;          //!< Bytes per socket read, when a stream is replayed
+    double seconds = 2.0;       //!< How long every measurement runs (at least one pass)
+};
+
+/**
+ * @brief The seconds since start, for the measurements
+ */
+inline double secondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * @brief A synthetic A-mode stream, the same bytes as tools/amodesimulator sends ([arrayheader][separator][index][data]
+ * per frame), with a few garbage bytes every 16 frames so that the parser has to search the separator again.
+ */
+std::vector<char> makeAmodeStream(int probes, int samples, int frames);
+
+/**
+ * @brief Loads an A-mode capture as the bytes the socket delivered. A file of AmodeRecorder is turned back into the
+ * stream, anything else is taken as raw socket bytes (e.g. saved with netcat). Empty if the file can't be read.
+ */
+std::vector<char> loadAmodeCapture(const QString &path);
+
+/**
+ * @brief The benchmarks, they print their results and return 0, or 1 if something went wrong
+ */
+int benchAmodeEnvelope(const BenchOptions &options);
+int benchAmodeParser(const BenchOptions &options);
+int benchAmodeScanner(const BenchOptions &options);
+int benchBmodeGray(const BenchOptions &options);
+int benchPoseHistory(const BenchOptions &options);
+
+#endif // BENCHMARKS_H
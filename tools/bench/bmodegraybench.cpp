@@ -0,0 +1,72 @@
+#include "benchmarks.h"
+#include "bmodegrayconverter.h"
+
+#include <QDebug>
+#include <opencv2/imgproc.hpp>
+
+#include <cstdlib>
+#include <functional>
+#include <random>
+
+int benchBmodeGray(const BenchOptions &options)
+{
+    // A 1080p image of the frame grabber (BGR, noise, so nothing is predictable) and the roi of the B-mode screen
+    cv::Mat input(1080, 1920, CV_8UC3);
+    std::mt19937 random(1);
+    for (int r = 0; r < input.rows; r++)
+    {
+        uint8_t *row = input.ptr<uint8_t>(r);
+        for (int c = 0; c < input.cols * 3; c++) row[c] = static_cast<uint8_t>(random());
+    }
+    const cv::Rect roi(662, 0, 840, 900);
+    cv::Mat output(roi.height, roi.width, CV_8UC1);
+
+    // the output must be the weights of cv::COLOR_BGR2GRAY, rounded, up to one gray level
+    if (!BmodeGrayConverter::apply(input, roi, output))
+    {
+        qDebug() << "gray | the converter refused the roi";
+        return 1;
+    }
+    int maxdiff = 0;
+    for (int r = 0; r < roi.height; r++)
+    {
+        const uint8_t *in = input.ptr<uint8_t>(roi.y + r) + roi.x * 3;
+        const uint8_t *out = output.ptr<uint8_t>(r);
+        for (int c = 0; c < roi.width; c++, in += 3)
+        {
+            int expected = static_cast<int>(0.114 * in[0] + 0.587 * in[1] + 0.299 * in[2] + 0.5);
+            maxdiff = std::max(maxdiff, std::abs(out[c] - expected));
+        }
+    }
+    bool ok = maxdiff <= 1;
+    if (!ok) qDebug() << "gray | differs from the reference by" << maxdiff << "gray levels";
+
+    auto measure = [&](const QString &name, const cv::Rect &area, const std::function<void()> &convert) {
+        uint64_t n = 0;
+        auto start = std::chrono::steady_clock::now();
+        do
+        {
+            convert();
+            n++;
+        } while (secondsSince(start) < options.seconds / 4);
+        double seconds = secondsSince(start) / n;
+        qDebug().noquote() << QString("gray | %1 | %2 ms per frame | %3 Mpixel/s")
+                                  .arg(name, -30)
+                                  .arg(seconds * 1e3, 0, 'f', 3)
+                                  .arg(static_cast<double>(area.width) * area.height / seconds / 1e6, 0, 'f', 0);
+    };
+
+    // What BmodeGrabWorker does: cvtColor of a view of the roi into the pooled frame
+    measure("roi 840x900, into the frame", roi, [&]() { BmodeGrayConverter::apply(input, roi, output); });
+
+    // cvtColor into a cv::Mat of its own, to see that writing into the frame costs nothing
+    cv::Mat gray;
+    measure("roi 840x900, own cv::Mat", roi, [&]() { cv::cvtColor(input(roi), gray, cv::COLOR_BGR2GRAY); });
+
+    // the whole 1080p image, a camera without a roi
+    cv::Mat full(input.rows, input.cols, CV_8UC1);
+    const cv::Rect whole(0, 0, input.cols, input.rows);
+    measure("whole 1920x1080, into the frame", whole, [&]() { BmodeGrayConverter::apply(input, whole, full); });
+
+    return ok ? 0 : 1;
+}
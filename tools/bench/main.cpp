@@ -0,0 +1,55 @@
+#include "benchmarks.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDebug>
+
+#include <functional>
+#include <map>
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("bench");
+
+    // name -> benchmark, "all" runs them one after another
+    const std::map<QString, std::function<int(const BenchOptions&)>> benchmarks = {
+        {"envelope", benchAmodeEnvelope},
+        {"gray", benchBmodeGray},
+        {"parser", benchAmodeParser},
+        {"pose", benchPoseHistory},
+        {"scanner", benchAmodeScanner},
+    };
+    QStringList names;
+    for (const auto &benchmark : benchmarks) names << benchmark.first;
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Benchmarks of the hot paths of the acquisition. Build it in release.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("benchmark", "One of: " + names.join(", ") + ", or all (default).");
+
+    BenchOptions options;
+    QCommandLineOption captureOption("capture", "A-mode capture to replay, raw socket bytes or an AmodeRecorder file (default synthetic).", "file");
+    QCommandLineOption chunkOption("chunk", "Bytes per socket read when a stream is replayed (default 65536).", "bytes", QString::number(options.chunk));
+    QCommandLineOption secondsOption("seconds", "Seconds per measurement (default 2).", "s", QString::number(options.seconds));
+    parser.addOptions({captureOption, chunkOption, secondsOption});
+    parser.process(a);
+
+    options.capture = parser.value(captureOption);
+    options.chunk   = parser.value(chunkOption).toInt();
+    options.seconds = parser.value(secondsOption).toDouble();
+
+    QString name = parser.positionalArguments().value(0, "all");
+    if (name != "all" && benchmarks.find(name) == benchmarks.end())
+    {
+        qCritical().noquote() << "Unknown benchmark" << name << ", one of:" << names.join(", ");
+        return 1;
+    }
+
+    int status = 0;
+    for (const auto &benchmark : benchmarks)
+    {
+        if (name == "all" || name == benchmark.first) status |= benchmark.second(options);
+    }
+    return status;
+}
@@ -0,0 +1,135 @@
+#include "benchmarks.h"
+#include "posehistory.h"
+#include "rigidbodyframepool.h"
+
+#include <QDebug>
+#include <cmath>
+#include <random>
+
+namespace {
+
+// The probe on a synthetic trajectory (t in s): it turns 90 deg/s about a tilted axis and moves 100 mm/s, with a 2 Hz
+// wobble on both, about what a hand does when scanning quickly
+Eigen::Isometry3d trajectory(double t)
+{
+    Eigen::Isometry3d T = Eigen::Isometry3d::Identity();
+    T.linear() = Eigen::AngleAxisd(M_PI / 2 * t + 0.3 * std::sin(2 * M_PI * 2 * t), Eigen::Vector3d(1, 2, 3).normalized()).toRotationMatrix();
+    T.translation() = Eigen::Vector3d(100 * t, 20 * std::sin(2 * M_PI * 2 * t), 5);
+    return T;
+}
+
+double distanceMm(const Eigen::Isometry3d &a, const Eigen::Isometry3d &b)
+{
+    return (a.translation() - b.translation()).norm();
+}
+
+double angleDeg(const Eigen::Isometry3d &a, const Eigen::Isometry3d &b)
+{
+    return Eigen::AngleAxisd(a.linear().transpose() * b.linear()).angle() * 180.0 / M_PI;
+}
+
+}
+
+int benchPoseHistory(const BenchOptions &options)
+{
+    std::shared_ptr<RigidBodyFramePool> pool = RigidBodyFramePool::create();
+    auto names = std::make_shared<const std::vector<std::string>>(std::vector<std::string>{"B_REF", "B_PROBE"});
+    const int64_t start = 1000000000LL;
+    bool ok = true;
+
+    for (double rate : {100.0, 300.0, 1000.0})
+    {
+        // two seconds of mocap frames, 50 us of jitter on the timestamps
+        PoseHistory history(4096);
+        const int64_t period = static_cast<int64_t>(1e9 / rate);
+        auto timestamp = [&](int64_t k) { return start + k * period + (k % 3) * 50000; };
+        const int nframes = static_cast<int>(2 * rate);
+        for (int k = 0; k < nframes; k++)
+        {
+            RigidBodyFramePtr frame = pool->acquire();
+            frame.writable()->setBodies(names, 1);
+            frame.writable()->setTimestamp(timestamp(k));
+            frame.writable()->setTransformation(0, Eigen::Isometry3d::Identity(), true);
+            frame.writable()->setTransformation(1, trajectory(timestamp(k) * 1e-9), true);
+            history.push(*frame);
+        }
+
+        // Images at random times inside the history. The error of the interpolated pose against the trajectory, and
+        // of the latest pose that arrived before the image (how the images were paired before PoseHistory).
+        RigidBodyFrame::Handle probe("B_PROBE");
+        Eigen::Isometry3d pose;
+        std::mt19937 random(1);
+        const int64_t oldest = history.getOldestTimestamp(), newest = history.getNewestTimestamp();
+        std::uniform_int_distribution<int64_t> when(oldest, newest - 1);
+        double sum = 0, max = 0, maxangle = 0, latestsum = 0, latestmax = 0, latestmaxangle = 0;
+        int n = 0;
+        for (int i = 0; i < 2000; i++)
+        {
+            int64_t t = when(random);
+            if (!history.poseAt(probe, t, pose)) continue;
+            Eigen::Isometry3d truth = trajectory(t * 1e-9);
+            double error = distanceMm(pose, truth);
+            sum += error;
+            max = std::max(max, error);
+            maxangle = std::max(maxangle, angleDeg(pose, truth));
+
+            int64_t k = (t - start) / period;
+            int64_t latest = (timestamp(k) <= t) ? timestamp(k) : timestamp(k - 1);
+            double latesterror = distanceMm(trajectory(latest * 1e-9), truth);
+            latestsum += latesterror;
+            latestmax = std::max(latestmax, latesterror);
+            latestmaxangle = std::max(latestmaxangle, angleDeg(trajectory(latest * 1e-9), truth));
+            n++;
+        }
+        if (n == 0 || sum >= latestsum)
+        {
+            qDebug() << "pose | the interpolated poses are not better than the latest pose at" << rate << "Hz";
+            ok = false;
+        }
+
+        // the cost of a lookup (random times, so the search isn't always the same) and of a push
+        uint64_t nlookup = 0, nfound = 0;
+        auto begin = std::chrono::steady_clock::now();
+        do
+        {
+            for (int i = 0; i < 1024; i++, nlookup++)
+            {
+                nfound += history.poseAt(probe, oldest + static_cast<int64_t>((nlookup * 7919) % (newest - oldest)), pose);
+            }
+        } while (secondsSince(begin) < options.seconds / 8);
+        double lookup = secondsSince(begin) / nlookup;
+        if (nfound < nlookup / 2)
+        {
+            qDebug() << "pose | poseAt found only" << nfound << "of" << nlookup << "poses at" << rate << "Hz";
+            ok = false;
+        }
+
+        RigidBodyFramePtr frame = pool->acquire();
+        frame.writable()->setBodies(names, 1);
+        int64_t t = newest;
+        uint64_t npush = 0;
+        begin = std::chrono::steady_clock::now();
+        do
+        {
+            for (int i = 0; i < 1024; i++, npush++)
+            {
+                t += period;
+                frame.writable()->setTimestamp(t);
+                history.push(*frame);
+            }
+        } while (secondsSince(begin) < options.seconds / 8);
+        double push = secondsSince(begin) / npush;
+
+        qDebug().noquote() << QString("pose | %1 Hz | interpolated mean %2 max %3 mm, max %4 deg | latest pose mean %5 max %6 mm, max %7 deg | poseAt %8 ns, push %9 ns")
+                                  .arg(rate, 4, 'f', 0)
+                                  .arg(sum / std::max(n, 1), 0, 'f', 4)
+                                  .arg(max, 0, 'f', 4)
+                                  .arg(maxangle, 0, 'f', 4)
+                                  .arg(latestsum / std::max(n, 1), 0, 'f', 3)
+                                  .arg(latestmax, 0, 'f', 3)
+                                  .arg(latestmaxangle, 0, 'f', 3)
+                                  .arg(lookup * 1e9, 0, 'f', 0)
+                                  .arg(push * 1e9, 0, 'f', 0);
+    }
+    return ok ? 0 : 1;
+}
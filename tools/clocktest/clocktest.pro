@@ -0,0 +1,14 @@
+QT =
+
+CONFIG += c++17 cmdline
+
+# Checks ClockModel on simulated frames (drops, jitter, TCP bursts), see main.cpp. It returns 1 if a check fails.
+
+INCLUDEPATH += ../..
+
+SOURCES += \
+    main.cpp \
+    ../../clockmodel.cpp
+
+HEADERS += \
+    ../../clockmodel.h
@@ -0,0 +1,125 @@
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "clockmodel.h"
+
+// Checks ClockModel with a frame counter as source time (the frame grabber without timestamps, the A-mode without
+// index), where the frames are simulated: captured every period, arriving after a fixed latency plus a jitter.
+// The model must give back the capture time (plus the fixed latency) within a millisecond, also when frames were
+// lost, which our counter doesn't see:
+//  - 60 fps, 0.5 ms jitter, no loss
+//  - the same with one frame lost, with and without setReceivedCounter() (without it all the frames after the loss
+//    are one period early, that is the case it is there for)
+//  - two frames lost at once
+//  - frames arriving in bursts of 4 (like the A-mode over TCP), which must not look like a loss
+//
+// Returns 0 if all the checks pass, 1 otherwise.
+
+static int failures = 0;
+
+static void check(bool ok, const char *what)
+{
+    std::printf("%s | %s\n", ok ? "ok  " : "FAIL", what);
+    if (!ok) failures++;
+}
+
+struct Scenario {
+    int nframes = 6000;                 //!< Frames captured
+    double period_ms = 1000.0 / 60.0;   //!< Capture period
+    double latency_ms = 2.0;            //!< Fixed latency
+    double jitter_ms = 0.5;             //!< Standard deviation of the varying latency (only the positive half)
+    std::vector<int> lost;              //!< Captured frames which never arrive
+    int burst = 1;                      //!< Frames arriving together, at the arrival of the last one
+    bool receivedcounter = true;        //!< ClockModel::setReceivedCounter()
+};
+
+struct Result {
+    double before_ms = 0.0;             //!< Largest error before the first loss (after the model is valid)
+    double after_ms = 0.0;              //!< Largest error after the first loss (but the frames of the detection)
+    uint64_t framesLost = 0;            //!< What the model found
+};
+
+static Result run(const Scenario &scenario)
+{
+    std::mt19937 random(1);
+    std::normal_distribution<double> jitter(0.0, scenario.jitter_ms);
+
+    ClockModel model(0.0);
+    model.setReceivedCounter(scenario.receivedcounter);
+
+    const int firstlost = scenario.lost.empty() ? scenario.nframes : scenario.lost.front();
+    const int64_t start_ns = 1000000000;
+    std::vector<int64_t> capture, arrival;  // of the frames of the current burst
+    int64_t counter = 0;
+    Result result;
+    for (int i = 0; i < scenario.nframes; i++)
+    {
+        bool lost = false;
+        for (int l : scenario.lost) lost = lost || (l == i);
+        if (!lost)
+        {
+            capture.push_back(start_ns + std::llround(i * scenario.period_ms * 1e6));
+            arrival.push_back(capture.back() + std::llround((scenario.latency_ms + std::fabs(jitter(random))) * 1e6));
+        }
+        if (static_cast<int>(capture.size()) < scenario.burst && i + 1 < scenario.nframes) continue;
+
+        // the burst arrives at the arrival of its last frame
+        for (std::size_t k = 0; k < capture.size(); k++)
+        {
+            int64_t modeled = model.update(++counter, arrival.back());
+            if (!model.isValid() || counter < 64) continue;
+
+            // the frames of the detection are still early, by design
+            double error_ms = std::fabs((modeled - capture[k]) * 1e-6 - scenario.latency_ms);
+            if (i < firstlost) result.before_ms = std::max(result.before_ms, error_ms);
+            else if (i >= firstlost + ClockModel::GAP_FRAMES + scenario.burst) result.after_ms = std::max(result.after_ms, error_ms);
+        }
+        capture.clear();
+        arrival.clear();
+    }
+    result.framesLost = model.getEstimate().framesLost;
+    return result;
+}
+
+static void print(const char *name, const Result &result)
+{
+    std::printf("     | %-32s error before %6.3f ms, after %6.3f ms, lost %llu\n", name, result.before_ms,
+                result.after_ms, static_cast<unsigned long long>(result.framesLost));
+}
+
+int main()
+{
+    Scenario steady;
+    Result r = run(steady);
+    print("no loss", r);
+    check(r.before_ms < 1.0 && r.framesLost == 0, "no loss: within 1 ms, nothing found");
+
+    Scenario drop = steady;
+    drop.lost = {3000};
+    drop.receivedcounter = false;
+    r = run(drop);
+    print("one lost, plain counter", r);
+    check(r.after_ms > 0.5 * drop.period_ms, "one lost, plain counter: the frames after it are a period early");
+
+    drop.receivedcounter = true;
+    r = run(drop);
+    print("one lost, setReceivedCounter()", r);
+    check(r.before_ms < 1.0 && r.after_ms < 1.0 && r.framesLost == 1, "one lost: within 1 ms after it, 1 found");
+
+    Scenario drop2 = steady;
+    drop2.lost = {3000, 3001};
+    r = run(drop2);
+    print("two lost at once", r);
+    check(r.after_ms < 1.0 && r.framesLost == 2, "two lost at once: within 1 ms after it, 2 found");
+
+    Scenario bursts = steady;
+    bursts.burst = 4;
+    r = run(bursts);
+    print("bursts of 4", r);
+    check(r.before_ms < 1.0 && r.framesLost == 0, "bursts of 4: within 1 ms, nothing found");
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,180 @@
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QGridLayout>
+#include <QDebug>
+
+#include <cmath>
+#include <functional>
+#include <random>
+
+#include "amodeframepool.h"
+#include "amodegroupplot.h"
+#include "amodeminmaxdecimator.h"
+#include "qcustomplotintervalwindow.h"
+#include "ultrasoundconfig.h"
+
+// Paint time of the A-mode plots, for a group with many probes. The same plots as MainWindow, fed with synthetic
+// frames as fast as they can paint, in a window of the size of the A-mode area:
+//  - per-probe : one QCustomPlotIntervalWindow for every probe, what a group got before AmodeGroupPlot
+//  - group     : AmodeGroupPlot, one QCustomPlot for all the probes (in a frame buffer object with CONFIG+=amode_opengl)
+// For every plot it prints the paint time per frame (replotTime(), averaged, the time the GUI thread spends) and the
+// time per frame of the whole loop (with the event processing and the swap).
+
+namespace {
+
+struct Result {
+    QString name;
+    double painttime = 0.0;     //!< [ms] The average replotTime() of the plot(s)
+    double frametime = 0.0;     //!< [ms] Wall time per frame
+};
+
+// Frames with an echo per probe that moves a bit from frame to frame, on top of noise, so every frame is different
+std::vector<AmodeFramePtr> makeFrames(const std::shared_ptr<AmodeFramePool> &pool, int nprobe, int nsample, int nframes)
+{
+    std::mt19937 random(1);
+    std::normal_distribution<double> noise(0.0, 50.0);
+    std::vector<AmodeFramePtr> frames;
+    for (int f = 0; f < nframes; f++)
+    {
+        AmodeFramePtr frame = pool->acquire();
+        int16_t *data = frame.writable()->writableData();
+        for (int p = 0; p < nprobe; p++)
+        {
+            double echo = 500 + (p * 97) % 2500 + 40.0 * std::sin(0.2 * f + p);
+            for (int i = 0; i < nsample; i++)
+            {
+                double t = (i - echo) / static_cast<double>(UltrasoundConfig::FREQ);
+                double burst = 3000.0 * std::exp(-std::pow(t / 0.2e-6, 2)) * std::cos(2 * M_PI * 7.5e6 * t);
+                data[static_cast<std::size_t>(p) * nsample + i] = static_cast<int16_t>(std::lround(burst + noise(random)));
+            }
+        }
+        frame.writable()->setSequence(f + 1);
+        frames.push_back(frame);
+    }
+    return frames;
+}
+
+// Shows the widget, then plots the frames one after another for the given time
+Result run(const QString &name, QWidget *widget, const std::function<void(const AmodeFramePtr&)> &plot,
+           const std::function<double()> &painttime, const std::vector<AmodeFramePtr> &frames, double seconds)
+{
+    widget->resize(1200, 900);
+    widget->show();
+    for (int i = 0; i < 10; i++) QApplication::processEvents();
+
+    // a few frames first, the first paints allocate the buffers (and compile the shaders)
+    for (int i = 0; i < 20; i++)
+    {
+        plot(frames[i % frames.size()]);
+        QApplication::processEvents();
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    uint64_t n = 0;
+    while (timer.elapsed() < seconds * 1000.0)
+    {
+        plot(frames[n % frames.size()]);
+        QApplication::processEvents();
+        n++;
+    }
+
+    Result result;
+    result.name = name;
+    result.frametime = timer.nsecsElapsed() * 1e-6 / n;
+    result.painttime = painttime();
+    widget->hide();
+    return result;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    QApplication a(argc, argv);
+    QApplication::setApplicationName("plotbench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Paint time of the A-mode plots for a big group. Build it in release.");
+    parser.addHelpOption();
+    QCommandLineOption probesOption("probes", "Number of probes of the group (default 30).", "n", "30");
+    QCommandLineOption secondsOption("seconds", "Seconds per plot (default 5).", "s", "5");
+    parser.addOptions({probesOption, secondsOption});
+    parser.process(a);
+
+    const int nprobe = std::max(parser.value(probesOption).toInt(), 1);
+    const int nsample = UltrasoundConfig::N_SAMPLE;
+    const double seconds = parser.value(secondsOption).toDouble();
+
+    std::shared_ptr<AmodeFramePool> pool = AmodeFramePool::create(nprobe, nsample, 16, 16);
+    std::vector<AmodeFramePtr> frames = makeFrames(pool, nprobe, nsample, 16);
+    Eigen::VectorXd depth = Eigen::VectorXd::LinSpaced(nsample, 1, nsample) * UltrasoundConfig::DS;
+    std::vector<AmodeConfig::Data> group;
+    for (int p = 0; p < nprobe; p++) group.push_back({p + 1, 0, "bench", {}, {}});
+
+    std::vector<Result> results;
+
+    // per-probe: one plot for every probe, decimated like MainWindow::plotAmodeProbe()
+    {
+        QWidget window;
+        QGridLayout *layout = new QGridLayout(&window);
+        std::vector<QCustomPlotIntervalWindow*> plots;
+        const int ncols = static_cast<int>(std::ceil(std::sqrt(nprobe)));
+        for (int p = 0; p < nprobe; p++)
+        {
+            QCustomPlotIntervalWindow *plot = new QCustomPlotIntervalWindow(&window);
+            plot->xAxis->setRange(0, depth.coeff(nsample - 1));
+            plot->yAxis->setRange(-500, 7500);
+            layout->addWidget(plot, p / ncols, p % ncols);
+            plots.push_back(plot);
+        }
+        AmodeMinMaxDecimator decimator;
+        auto plotframe = [&](const AmodeFramePtr &frame) {
+            const std::ptrdiff_t stride = sizeof(QCPGraphData) / sizeof(double);
+            for (int p = 0; p < nprobe; p++)
+            {
+                QCustomPlotIntervalWindow *plot = plots[p];
+                int ncolumn = std::min(std::max(plot->axisRect()->width(), 1), nsample);
+                if (decimator.getNcolumn() != ncolumn) decimator = AmodeMinMaxDecimator(nsample, ncolumn);
+                QSharedPointer<QCPGraphDataContainer> data = plot->graph(0)->data();
+                if (data->size() != decimator.getNoutput())
+                {
+                    QVector<QCPGraphData> points(decimator.getNoutput());
+                    decimator.keys(depth.data(), &points[0].key, stride);
+                    data->set(points, true);
+                }
+                decimator.apply(frame->probe(p).data, &data->begin()->value, stride);
+                plot->replot(QCustomPlot::rpImmediateRefresh);
+            }
+        };
+        auto painttime = [&]() {
+            double sum = 0.0;
+            for (QCustomPlotIntervalWindow *plot : plots) sum += plot->replotTime(true);
+            return sum;
+        };
+        results.push_back(run("per-probe", &window, plotframe, painttime, frames, seconds));
+    }
+
+    // group: all the probes in one QCustomPlot
+    {
+        AmodeGroupPlot plot;
+        plot.setGroup(group);
+        plot.setDepth(depth);
+        auto plotframe = [&](const AmodeFramePtr &frame) {
+            plot.plotFrame(frame);
+            plot.replot(QCustomPlot::rpImmediateRefresh);
+        };
+        results.push_back(run(plot.openGl() ? "group (fbo)" : "group", &plot, plotframe, [&]() { return plot.replotTime(true); }, frames, seconds));
+    }
+
+    for (const Result &result : results)
+    {
+        qDebug().noquote() << QString("plot | %1 | %2 probes | paint %3 ms per frame | %4 ms per frame with the event loop")
+                                  .arg(result.name, -11)
+                                  .arg(nprobe)
+                                  .arg(result.painttime, 0, 'f', 3)
+                                  .arg(result.frametime, 0, 'f', 3);
+    }
+    return 0;
+}
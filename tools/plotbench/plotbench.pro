@@ -0,0 +1,32 @@
+QT += core gui widgets printsupport
+
+CONFIG += c++17
+
+# Paint time of the A-mode plots for a big group (30 probes), see main.cpp. Build it in release, once as it is and
+# once with CONFIG+=amode_opengl (like the application), and compare.
+# Example:
+#   plotbench --probes 30 --seconds 5
+
+INCLUDEPATH += \
+    ../.. \
+    "C:/eigen-3.4.0"
+
+SOURCES += \
+    main.cpp \
+    ../../amodeframe.cpp \
+    ../../amodeframepool.cpp \
+    ../../amodegroupplot.cpp \
+    ../../amodeminmaxdecimator.cpp \
+    ../../qcustomplot.cpp \
+    ../../qcustomplotintervalwindow.cpp
+
+HEADERS += \
+    ../../amodegroupplot.h \
+    ../../qcustomplotintervalwindow.h
+
+# The same switch as the application
+amode_opengl {
+    DEFINES += QCUSTOMPLOT_USE_OPENGL
+    greaterThan(QT_MAJOR_VERSION, 5): QT += opengl
+    win32: LIBS += -lopengl32
+}
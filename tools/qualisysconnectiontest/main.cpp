@@ -0,0 +1,118 @@
+#include "qualisysconnection.h"
+#include "qualisyssimulator.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QEventLoop>
+#include <QSemaphore>
+#include <QThread>
+#include <QTimer>
+
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+
+// Runs QualisysConnection, with the Qualisys SDK, against QualisysSimulator in the same process: the simulator has its
+// own thread (the SDK blocks in Connect() until the simulator answers), QualisysConnection streams in its thread like
+// in the application. It checks what the application depends on:
+//  - Connect() on the little endian port, version 1.19
+//  - Read6DOFSettings(): the names of the bodies
+//  - StreamFrames over UDP for a few seconds: every frame arrives (but the ones the simulator loses on purpose), the
+//    lost ones are counted from the frame numbers, the poses are there, no reconnection
+//  - the ClockModel finds the drift of the simulated QTM clock
+//
+// Returns 0 if all the checks pass, 1 otherwise.
+
+static int failures = 0;
+
+static void check(bool ok, const char *what)
+{
+    std::printf("%s | %s\n", ok ? "ok  " : "FAIL", what);
+    if (!ok) failures++;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("qualisysconnectiontest");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Runs QualisysConnection against QualisysSimulator and checks the stream.");
+    parser.addHelpOption();
+    QCommandLineOption portOption("port", "Base port of the simulator (default 22222).", "port", "22222");
+    QCommandLineOption rateOption("rate", "Frames per second (default 300).", "fps", "300");
+    QCommandLineOption secondsOption("seconds", "Time to stream (default 5).", "s", "5");
+    QCommandLineOption lossOption("loss", "Probability of a lost frame (default 0.01).", "p", "0.01");
+    QCommandLineOption driftOption("drift", "How much faster the QTM clock runs, in ppm (default 50).", "ppm", "50");
+    parser.addOptions({portOption, rateOption, secondsOption, lossOption, driftOption});
+    parser.process(a);
+
+    QualisysSimulator::Settings settings;
+    settings.port  = parser.value(portOption).toUShort();
+    settings.rate  = parser.value(rateOption).toDouble();
+    settings.loss  = parser.value(lossOption).toDouble();
+    settings.drift = parser.value(driftOption).toDouble();
+    const double seconds = parser.value(secondsOption).toDouble();
+
+    // the simulator lives and dies in its thread, its sockets and timers belong to the event loop there
+    QSemaphore started;
+    std::atomic<bool> listening{false};
+    QThread *simulatorThread = QThread::create([&]() {
+        QualisysSimulator simulator(settings);
+        listening = simulator.listen();
+        started.release();
+        if (listening) QEventLoop().exec();
+    });
+    simulatorThread->start();
+    started.acquire();
+    check(listening, "simulator listening");
+    if (!listening)
+    {
+        simulatorThread->wait();
+        delete simulatorThread;
+        return 1;
+    }
+
+    // the constructor connects, reads the settings and starts the stream, like in the application
+    QualisysConnection *connection = new QualisysConnection(nullptr, "127.0.0.1", settings.port);
+
+    // what the consumers see, counted in the streaming thread
+    std::atomic<uint64_t> frames{0}, tracked{0}, namesok{0};
+    QObject::connect(connection, &QualisysConnection::dataReceived, connection, [&](const RigidBodyFramePtr &frame) {
+        frames++;
+        bool names = frame->getNbodies() == 2 && frame->getName(0) == "B_PROBE" && frame->getName(1) == "B_REF";
+        if (names) namesok++;
+        if (names && frame->isTracked(0) && std::isfinite(frame->getTransformation(0).translation().norm())) tracked++;
+    }, Qt::DirectConnection);
+
+    connection->startStreaming();
+    QTimer::singleShot(static_cast<int>(seconds * 1000.0), &a, &QCoreApplication::quit);
+    a.exec();
+
+    // the statistics are of the last full second
+    QualisysConnection::Statistics statistics = connection->getStatistics();
+    connection->stopStreaming();
+    delete connection;
+    simulatorThread->quit();
+    simulatorThread->wait();
+    delete simulatorThread;
+
+    std::printf("     | %llu frames (%.1f Hz), %llu lost, %llu timeouts, %llu reconnects, drift %.1f ppm, latency %.3f ms (max %.3f)\n",
+                static_cast<unsigned long long>(frames.load()), statistics.frameRate,
+                static_cast<unsigned long long>(statistics.framesLost), static_cast<unsigned long long>(statistics.timeouts),
+                static_cast<unsigned long long>(statistics.reconnects), statistics.clock.drift,
+                statistics.clock.latencyMean, statistics.clock.latencyMax);
+
+    // a second of slack for the connection and the statistics, which are up to a second behind
+    const double expected = settings.rate * (1.0 - settings.loss);
+    const double received = static_cast<double>(statistics.framesReceived), lost = static_cast<double>(statistics.framesLost);
+    check(frames.load() >= expected * (seconds - 1.0), "connect, 6D settings, StreamFrames over UDP: the frames arrive");
+    check(namesok.load() == frames.load() && frames.load() > 0, "the names of the bodies are those of the settings");
+    check(tracked.load() * 100 >= frames.load() * 99, "the poses are in the frames");
+    check(statistics.frameRate > 0.9 * expected && statistics.frameRate < 1.1 * settings.rate, "the rate of the last second");
+    check(settings.loss == 0.0 ? lost == 0.0 : (lost > 0.0 && lost / (received + lost) < 3.0 * settings.loss), "the lost frames are counted");
+    check(statistics.reconnects == 0, "no reconnection");
+    check(statistics.clock.valid && std::fabs(statistics.clock.drift - settings.drift) < 25.0, "the clock model finds the drift");
+
+    return failures ? 1 : 0;
+}
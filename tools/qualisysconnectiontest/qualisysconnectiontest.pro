@@ -0,0 +1,39 @@
+QT = core network
+
+CONFIG += c++17 cmdline
+
+# Runs QualisysConnection (with the Qualisys SDK) against QualisysSimulator, see main.cpp. It returns 1 if a check
+# fails. The paths of the SDK and Eigen are the ones of AmodeBmodeQualisys.pro, unless they are given to qmake, e.g.
+#   qmake QUALISYS_SDK=$HOME/qualisys_cpp_sdk EIGEN=/usr/include/eigen3 && make && ./qualisysconnectiontest
+
+isEmpty(QUALISYS_SDK): QUALISYS_SDK = "C:/qualisys_cpp_sdk"
+isEmpty(EIGEN): EIGEN = "C:/eigen-3.4.0"
+
+INCLUDEPATH += \
+    ../.. \
+    ../qualisyssimulator \
+    $$QUALISYS_SDK \
+    $$EIGEN
+
+SOURCES += \
+    main.cpp \
+    ../qualisyssimulator/qualisyssimulator.cpp \
+    ../../clockmodel.cpp \
+    ../../posehistory.cpp \
+    ../../qualisysconnection.cpp \
+    ../../rigidbodyframe.cpp \
+    ../../rigidbodyframepool.cpp \
+    $$QUALISYS_SDK/Markup.cpp \
+    $$QUALISYS_SDK/Network.cpp \
+    $$QUALISYS_SDK/RTPacket.cpp \
+    $$QUALISYS_SDK/RTProtocol.cpp
+
+HEADERS += \
+    ../qualisyssimulator/qualisyssimulator.h \
+    ../../clockmodel.h \
+    ../../posehistory.h \
+    ../../qualisysconnection.h \
+    ../../rigidbodyframe.h \
+    ../../rigidbodyframepool.h
+
+win32: LIBS += -lws2_32 -liphlpapi
@@ -0,0 +1,58 @@
+#include "qualisyssimulator.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("qualisyssimulator");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Pretends to be QTM, streams the 6DOF poses of rigid bodies with the QTM RT protocol.");
+    parser.addHelpOption();
+
+    QualisysSimulator::Settings settings;
+    QCommandLineOption portOption("port", "Base port, like QTM (default 22222).", "port", QString::number(settings.port));
+    QCommandLineOption bodiesOption("bodies", "Number of rigid bodies of the script (default 2).", "n", QString::number(settings.bodies));
+    QCommandLineOption namesOption("names", "Names of the bodies, comma separated (default B_PROBE,B_REF).", "names", settings.names.join(","));
+    QCommandLineOption rateOption("rate", "Frames per second, 100 to 1000 (default 100).", "fps", QString::number(settings.rate));
+    QCommandLineOption recordingOption("recording", "Play back a 6D TSV export of QTM instead of the script.", "file");
+    QCommandLineOption lossOption("loss", "Probability of a lost frame.", "p", "0");
+    QCommandLineOption occlusionOption("occlusion", "Probability of a body not tracked in a frame.", "p", "0");
+    QCommandLineOption driftOption("drift", "How much faster the QTM clock runs, in ppm (default 0).", "ppm", "0");
+    QCommandLineOption seedOption("seed", "Seed of the random generator (default 1).", "seed", "1");
+    QCommandLineOption durationOption("duration", "Stop after n seconds, 0 is forever (default 0).", "s", "0");
+    parser.addOptions({portOption, bodiesOption, namesOption, rateOption, recordingOption, lossOption,
+                       occlusionOption, driftOption, seedOption, durationOption});
+    parser.process(a);
+
+    settings.port       = parser.value(portOption).toUShort();
+    settings.bodies     = parser.value(bodiesOption).toInt();
+    settings.names      = parser.value(namesOption).split(',', Qt::SkipEmptyParts);
+    settings.rate       = parser.value(rateOption).toDouble();
+    settings.recording  = parser.value(recordingOption);
+    settings.loss       = parser.value(lossOption).toDouble();
+    settings.occlusion  = parser.value(occlusionOption).toDouble();
+    settings.drift      = parser.value(driftOption).toDouble();
+    settings.seed       = parser.value(seedOption).toUInt();
+    settings.duration   = parser.value(durationOption).toInt();
+
+    // the base port and the two above it, like QTM
+    if (settings.port == 0 || settings.port > 65533)
+    {
+        qCritical("The base port must be between 1 and 65533.");
+        return 1;
+    }
+    // more bodies than QualisysConnection takes is fine, that's a test too, but keep the packet in one datagram
+    if (settings.bodies <= 0 || settings.bodies > 256 || settings.rate < 100 || settings.rate > 1000)
+    {
+        qCritical("The number of bodies must be between 1 and 256, and the rate between 100 and 1000.");
+        return 1;
+    }
+
+    QualisysSimulator simulator(settings);
+    if (!simulator.listen()) return 1;
+
+    return a.exec();
+}
@@ -0,0 +1,557 @@
+#include "qualisyssimulator.h"
+
+#include <QCoreApplication>
+#include <QDataStream>
+#include <QDebug>
+#include <QFile>
+#include <QRegularExpression>
+#include <QTextStream>
+#include <QtEndian>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// The packet types of the RT protocol, the same numbers as CRTPacket::EPacketType
+static const quint32 PACKET_ERROR   = 0;
+static const quint32 PACKET_COMMAND = 1;
+static const quint32 PACKET_XML     = 2;
+static const quint32 PACKET_DATA    = 3;
+
+// The component type of 6D in a data packet, the same number as CRTPacket::EComponentType
+static const quint32 COMPONENT_6D   = 5;
+
+// The newest version we answer to, the layout of the data packet didn't change for 6D since 1.8
+static const int MAX_MINOR_VERSION  = 25;
+
+QualisysSimulator::QualisysSimulator(const Settings& settings, QObject *parent)
+    : QObject{parent}, settings_(settings), random_(settings.seed)
+{
+    // 1 ms is fine even for 1000 Hz, every tick sends all the frames which are due
+    ticker_.setTimerType(Qt::PreciseTimer);
+    ticker_.setInterval(1);
+    connect(&ticker_, &QTimer::timeout, this, &QualisysSimulator::onTick);
+
+    statisticsTimer_.setInterval(1000);
+    connect(&statisticsTimer_, &QTimer::timeout, this, &QualisysSimulator::printStatistics);
+}
+
+bool QualisysSimulator::listen()
+{
+    if (!settings_.recording.isEmpty())
+    {
+        if (!loadRecording(settings_.recording)) return false;
+    }
+    else
+    {
+        for (int i = 0; i < settings_.bodies; i++)
+            names_.append(i < settings_.names.size() ? settings_.names[i] : QString("BODY_%1").arg(i + 1));
+    }
+    poses_.resize(names_.size());
+
+    // the same ports as QTM, see the header
+    const bool bigEndian[3] = {true, false, true};
+    for (int i = 0; i < 3; i++)
+    {
+        quint16 port = settings_.port + i;
+        if (!servers_[i].listen(QHostAddress::Any, port))
+        {
+            qDebug() << "Unable to listen on port" << port << ":" << servers_[i].errorString();
+            return false;
+        }
+        QTcpServer *server = &servers_[i];
+        bool big = bigEndian[i], legacy = (i == 0);
+        connect(server, &QTcpServer::newConnection, this, [this, server, big, legacy]() { onNewConnection(server, big, legacy); });
+    }
+
+    qDebug().noquote() << QString("Qualisys simulator listening on ports %1 (1.0), %2 (little endian), %3 (big endian) | %4 bodies (%5) | %6 Hz | %7")
+                              .arg(settings_.port).arg(settings_.port + 1).arg(settings_.port + 2)
+                              .arg(names_.size()).arg(names_.join(", "))
+                              .arg(settings_.rate)
+                              .arg(recording_.empty() ? QString("scripted") : QString("recording of %1 frames at %2 Hz").arg(recording_.size()).arg(recordingRate_));
+
+    clock_.start();
+    ticker_.start();
+    statisticsTimer_.start();
+    return true;
+}
+
+void QualisysSimulator::onNewConnection(QTcpServer *server, bool bigEndian, bool legacy)
+{
+    while (QTcpSocket *socket = server->nextPendingConnection())
+    {
+        qDebug() << "Client connected:" << socket->peerAddress().toString() << "on port" << server->serverPort();
+        socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+
+        // until "Version", the base port is 1.0, the others 1.1 (that's what the SDK assumes too)
+        Client *client = new Client;
+        client->socket = socket;
+        client->bigEndian = bigEndian;
+        client->minor = legacy ? 0 : 1;
+        clients_.append(client);
+
+        connect(socket, &QTcpSocket::readyRead, this, [this, client]() { onReadyRead(client); });
+        connect(socket, &QTcpSocket::disconnected, this, [this, client]() {
+            qDebug() << "Client disconnected";
+            clients_.removeOne(client);
+            client->socket->deleteLater();
+        });
+        // the client goes with its socket, a frame which is being sent may still use it until then
+        connect(socket, &QObject::destroyed, this, [client]() { delete client; });
+
+        sendString(client, PACKET_COMMAND, "QTM RT Interface connected");
+    }
+}
+
+void QualisysSimulator::onReadyRead(Client *client)
+{
+    client->buffer.append(client->socket->readAll());
+
+    // [size][type][payload], the size includes the header
+    while (client->buffer.size() >= 8)
+    {
+        const char *bytes = client->buffer.constData();
+        quint32 size = client->bigEndian ? qFromBigEndian<quint32>(bytes) : qFromLittleEndian<quint32>(bytes);
+        quint32 type = client->bigEndian ? qFromBigEndian<quint32>(bytes + 4) : qFromLittleEndian<quint32>(bytes + 4);
+
+        // not our protocol (or the wrong byte order), there is no way to find the next packet
+        if (size < 8 || size > 65536)
+        {
+            qDebug() << "Packet size" << size << "from the client is wrong, disconnecting";
+            client->socket->abort();
+            return;
+        }
+        if (static_cast<quint32>(client->buffer.size()) < size) break;
+
+        QByteArray payload = client->buffer.mid(8, size - 8);
+        client->buffer.remove(0, size);
+
+        if (type == PACKET_COMMAND)
+        {
+            // the string ends with a 0 (the SDK sends it), but don't count on it
+            int end = payload.indexOf('\0');
+            handleCommand(client, QString::fromLatin1(end < 0 ? payload : payload.left(end)).trimmed());
+        }
+        else
+        {
+            sendString(client, PACKET_ERROR, "Only command packets are simulated");
+        }
+    }
+}
+
+void QualisysSimulator::handleCommand(Client *client, const QString &command)
+{
+    stat_commands_++;
+    QStringList arguments = command.split(QRegularExpression("\\s+"), Qt::SkipEmptyParts);
+    if (arguments.isEmpty())
+    {
+        sendString(client, PACKET_ERROR, "Parse error");
+        return;
+    }
+    QString name = arguments[0].toLower();
+
+    if (name == "version")
+    {
+        if (arguments.size() == 1)
+        {
+            sendString(client, PACKET_COMMAND, QString("Version is %1.%2").arg(client->major).arg(client->minor).toLatin1());
+            return;
+        }
+        QStringList version = arguments[1].split('.');
+        bool okmajor = false, okminor = false;
+        int major = version.value(0).toInt(&okmajor);
+        int minor = version.value(1).toInt(&okminor);
+        if (!okmajor || !okminor || major != 1 || minor < 0 || minor > MAX_MINOR_VERSION)
+        {
+            sendString(client, PACKET_ERROR, "Version NOT supported");
+            return;
+        }
+        client->major = major;
+        client->minor = minor;
+        sendString(client, PACKET_COMMAND, QString("Version set to %1.%2").arg(major).arg(minor).toLatin1());
+    }
+    else if (name == "byteorder")
+    {
+        // only meaningful for the version 1.0, the other ports have their byte order
+        if (arguments.size() > 1) client->bigEndian = (arguments[1].toLower() == "bigendian");
+        sendString(client, PACKET_COMMAND, client->bigEndian ? "Byte order is big endian" : "Byte order is little endian");
+    }
+    else if (name == "qtmversion")
+    {
+        sendString(client, PACKET_COMMAND, "QTM Version is 2.17 (simulator)");
+    }
+    else if (name == "getparameters")
+    {
+        sendString(client, PACKET_XML, settingsXml(client));
+    }
+    else if (name == "getcurrentframe")
+    {
+        if (!arguments.contains("6D", Qt::CaseInsensitive))
+        {
+            sendString(client, PACKET_ERROR, "Only the 6D component is simulated");
+            return;
+        }
+        client->socket->write(dataPacket(client->bigEndian, client->minor > 7));
+    }
+    else if (name == "streamframes")
+    {
+        if (!handleStreamFrames(client, arguments)) sendString(client, PACKET_ERROR, "Parse error");
+    }
+    else if (name == "stop")
+    {
+        // there is no measurement to stop, but the streaming to this client stops
+        client->streaming = false;
+        sendString(client, PACKET_COMMAND, "Stopping measurement");
+    }
+    else if (name == "takecontrol")
+    {
+        sendString(client, PACKET_COMMAND, "You are now master");
+    }
+    else if (name == "releasecontrol")
+    {
+        sendString(client, PACKET_COMMAND, "You are now a regular client");
+    }
+    else
+    {
+        qDebug() << "Command not simulated:" << command;
+        sendString(client, PACKET_ERROR, "Parse error");
+    }
+}
+
+bool QualisysSimulator::handleStreamFrames(Client *client, const QStringList &arguments)
+{
+    if (arguments.size() < 2) return false;
+
+    // "StreamFrames Stop" has no answer, like QTM
+    if (arguments[1].toLower() == "stop")
+    {
+        client->streaming = false;
+        return true;
+    }
+
+    // StreamFrames AllFrames|Frequency:n|FrequencyDivisor:n [UDP[:address]:port] components...
+    int divisor = 1;
+    bool udp = false, has6d = false;
+    QHostAddress address = client->socket->peerAddress();
+    quint16 port = 0;
+    for (int i = 1; i < arguments.size(); i++)
+    {
+        QString argument = arguments[i].toLower();
+        if (argument == "allframes")
+        {
+            divisor = 1;
+        }
+        else if (argument.startsWith("frequency:"))
+        {
+            double frequency = argument.mid(10).toDouble();
+            if (frequency <= 0) return false;
+            divisor = std::max(1, static_cast<int>(std::lround(settings_.rate / frequency)));
+        }
+        else if (argument.startsWith("frequencydivisor:"))
+        {
+            divisor = argument.mid(17).toInt();
+            if (divisor <= 0) return false;
+        }
+        else if (argument.startsWith("udp:"))
+        {
+            // UDP:port or UDP:address:port, without address it goes back to the client
+            QStringList parts = arguments[i].split(':');
+            if (parts.size() == 3) address = QHostAddress(parts[1]);
+            port = parts.last().toUShort();
+            if (port == 0 || address.isNull()) return false;
+            udp = true;
+        }
+        else if (argument == "6d")
+        {
+            has6d = true;
+        }
+        else
+        {
+            qDebug() << "Component not simulated, ignored:" << arguments[i];
+        }
+    }
+    if (!has6d) return false;
+
+    client->divisor = divisor;
+    client->udp = udp;
+    client->udpAddress = address;
+    client->udpPort = port;
+    client->streaming = true;
+    qDebug().noquote() << QString("Client streams 6D every %1 frame(s) over %2").arg(divisor)
+                              .arg(udp ? QString("UDP to %1:%2").arg(address.toString()).arg(port) : QString("TCP"));
+    return true;
+}
+
+void QualisysSimulator::sendString(Client *client, quint32 type, const QByteArray &string)
+{
+    QByteArray packet;
+    QDataStream out(&packet, QIODevice::WriteOnly);
+    out.setByteOrder(client->bigEndian ? QDataStream::BigEndian : QDataStream::LittleEndian);
+    out << static_cast<quint32>(8 + string.size() + 1) << type;
+    out.writeRawData(string.constData(), string.size() + 1);   // with the 0 at the end
+    client->socket->write(packet);
+}
+
+QByteArray QualisysSimulator::settingsXml(const Client *client) const
+{
+    QString xml;
+    QTextStream out(&xml);
+    out << QString("<QTM_Parameters_Ver_%1.%2>\n").arg(client->major).arg(client->minor);
+    out << "    <The_6D>\n";
+    out << "        <Bodies>" << names_.size() << "</Bodies>\n";
+
+    // four markers in a square, nobody looks at them, but the SDK wants them
+    const float points[4][3] = {{0, 0, 0}, {50, 0, 0}, {50, 50, 0}, {0, 50, 0}};
+    for (int i = 0; i < names_.size(); i++)
+    {
+        out << "        <Body>\n";
+        out << "            <Name>" << names_[i].toHtmlEscaped() << "</Name>\n";
+        if (client->minor <= 20)
+        {
+            // the layout until 1.20
+            out << "            <RGBColor>" << (255 << (8 * (i % 3))) << "</RGBColor>\n";
+            for (const auto &point : points)
+                out << "            <Point><X>" << point[0] << "</X><Y>" << point[1] << "</Y><Z>" << point[2] << "</Z></Point>\n";
+        }
+        else
+        {
+            // the layout since 1.21
+            out << "            <Enabled>true</Enabled>\n";
+            out << QString("            <Color R=\"%1\" G=\"%2\" B=\"%3\"/>\n").arg(i % 3 == 0 ? 255 : 0).arg(i % 3 == 1 ? 255 : 0).arg(i % 3 == 2 ? 255 : 0);
+            out << "            <MaximumResidual>10</MaximumResidual>\n";
+            out << "            <MinimumMarkersInBody>3</MinimumMarkersInBody>\n";
+            out << "            <BoneLengthTolerance>5</BoneLengthTolerance>\n";
+            out << "            <Filter Preset=\"No filter\"/>\n";
+            out << "            <Points>\n";
+            for (int p = 0; p < 4; p++)
+                out << QString("                <Point X=\"%1\" Y=\"%2\" Z=\"%3\" Virtual=\"0\" PhysicalId=\"0\" Name=\"%4\"/>\n")
+                           .arg(points[p][0]).arg(points[p][1]).arg(points[p][2]).arg(p + 1);
+            out << "            </Points>\n";
+            out << "            <Data_origin X=\"0\" Y=\"0\" Z=\"0\" Relative_body=\"-1\">0</Data_origin>\n";
+            out << "            <Data_orientation R11=\"1\" R12=\"0\" R13=\"0\" R21=\"0\" R22=\"1\" R23=\"0\" R31=\"0\" R32=\"0\" R33=\"1\" Relative_body=\"-1\">0</Data_orientation>\n";
+        }
+        out << "        </Body>\n";
+    }
+    out << "    </The_6D>\n";
+    out << QString("</QTM_Parameters_Ver_%1.%2>\n").arg(client->major).arg(client->minor);
+    out.flush();
+    return xml.toUtf8();
+}
+
+QByteArray QualisysSimulator::dataPacket(bool bigEndian, bool droprates) const
+{
+    // Just to clarify, here is how the packet looks like:
+    // [size][type][timestamp][frame][components] [size][type][bodies][drop rate][out of sync rate] [x y z R0..R8]...
+    const quint32 componentsize = (droprates ? 16 : 12) + 48 * poses_.size();
+    const quint32 size = 24 + componentsize;
+
+    QByteArray packet;
+    packet.reserve(size);
+    QDataStream out(&packet, QIODevice::WriteOnly);
+    out.setByteOrder(bigEndian ? QDataStream::BigEndian : QDataStream::LittleEndian);
+    out.setFloatingPointPrecision(QDataStream::SinglePrecision);
+
+    out << size << PACKET_DATA << timestamp_ << frame_ << static_cast<quint32>(1);
+    out << componentsize << COMPONENT_6D << static_cast<quint32>(poses_.size());
+    if (droprates) out << static_cast<quint16>(0) << static_cast<quint16>(0);
+
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    for (const Pose &pose : poses_)
+    {
+        out << (pose.tracked ? pose.x : nan) << (pose.tracked ? pose.y : nan) << (pose.tracked ? pose.z : nan);
+        for (float r : pose.R) out << (pose.tracked ? r : nan);
+    }
+    return packet;
+}
+
+void QualisysSimulator::onTick()
+{
+    if (settings_.duration > 0 && clock_.elapsed() >= settings_.duration * 1000LL)
+    {
+        printStatistics();
+        QCoreApplication::quit();
+        return;
+    }
+
+    // How many frames should be done until now. Behind (e.g. the timer was late), all of them go out at once,
+    // with their own timestamps, like QTM does when the network was stuck.
+    framesdue_ = static_cast<uint64_t>(clock_.nsecsElapsed() * settings_.rate / 1e9);
+    while (framessent_ < framesdue_)
+    {
+        // the QTM timestamp is the capture time on the QTM clock, which runs drift ppm faster than ours
+        double t = framessent_ / settings_.rate;
+        framessent_++;
+        frame_ = static_cast<quint32>(framessent_);
+        timestamp_ = static_cast<quint64>(std::llround(t * 1e6 * (1.0 + settings_.drift * 1e-6)));
+        updatePoses(t);
+        stat_frames_++;
+
+        // lost for all the clients, the frame number jumps
+        if (chance(settings_.loss))
+        {
+            stat_lost_++;
+            continue;
+        }
+
+        // built once per frame for each byte order and layout
+        QByteArray packets[2][2];
+        const QList<Client*> clients = clients_;
+        for (Client *client : clients)
+        {
+            if (!client->streaming || frame_ % client->divisor != 0) continue;
+
+            bool droprates = client->minor > 7;
+            QByteArray &packet = packets[client->bigEndian][droprates];
+            if (packet.isEmpty()) packet = dataPacket(client->bigEndian, droprates);
+
+            if (client->udp)
+            {
+                udp_.writeDatagram(packet, client->udpAddress, client->udpPort);
+            }
+            else
+            {
+                // The client can't keep up, don't pile up the frames in the memory
+                if (client->socket->bytesToWrite() > 64LL * packet.size())
+                {
+                    stat_backlogged_++;
+                    continue;
+                }
+                client->socket->write(packet);
+            }
+            stat_packets_++;
+        }
+    }
+}
+
+void QualisysSimulator::updatePoses(double t)
+{
+    if (!recording_.empty())
+    {
+        // played back at its own frequency, in a loop
+        poses_ = recording_[static_cast<uint64_t>(t * recordingRate_) % recording_.size()];
+    }
+    else
+    {
+        // Every body goes around an ellipse (200 x 100 mm, once in 4 s, about the speed of a B-mode sweep) and turns
+        // back and forth around z and x, with a different phase, so the bodies don't move together.
+        const double pi = 3.14159265358979323846;
+        for (std::size_t i = 0; i < poses_.size(); i++)
+        {
+            Pose &pose = poses_[i];
+            double phase = 0.7 * i;
+            pose.x = static_cast<float>(300.0 * i + 100.0 * std::cos(2 * pi * 0.25 * t + phase));
+            pose.y = static_cast<float>(50.0 * std::sin(2 * pi * 0.25 * t + phase));
+            pose.z = static_cast<float>(1000.0 + 20.0 * std::sin(2 * pi * 0.5 * t + phase));
+
+            // R = Rz(a) Rx(b), column by column
+            double a = (30.0 * pi / 180.0) * std::sin(2 * pi * 0.2 * t + phase);
+            double b = (15.0 * pi / 180.0) * std::sin(2 * pi * 0.3 * t + phase);
+            double ca = std::cos(a), sa = std::sin(a), cb = std::cos(b), sb = std::sin(b);
+            const double R[9] = {ca, sa, 0.0, -sa * cb, ca * cb, sb, sa * sb, -ca * sb, cb};
+            for (int k = 0; k < 9; k++) pose.R[k] = static_cast<float>(R[k]);
+            pose.tracked = true;
+        }
+    }
+
+    for (Pose &pose : poses_)
+    {
+        if (pose.tracked && chance(settings_.occlusion))
+        {
+            pose.tracked = false;
+            stat_occluded_++;
+        }
+    }
+}
+
+bool QualisysSimulator::loadRecording(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        qDebug() << "Unable to open the recording" << path << ":" << file.errorString();
+        return false;
+    }
+
+    // The header is KEY<tab>value lines, then (maybe) the line of the column names, then a line per frame:
+    // [Frame][Time] and per body X Y Z Roll Pitch Yaw Residual Rot[0]..Rot[8]
+    QTextStream in(&file);
+    int nbodies = -1;
+    while (!in.atEnd())
+    {
+        QStringList fields = in.readLine().split('\t');
+        if (fields.isEmpty() || fields[0].trimmed().isEmpty()) continue;
+
+        QString key = fields[0].trimmed();
+        if (key == "NO_OF_BODIES") nbodies = fields.value(1).toInt();
+        else if (key == "FREQUENCY") recordingRate_ = fields.value(1).toDouble();
+        else if (key == "BODY_NAMES") names_ = fields.mid(1);
+
+        bool isnumber = false;
+        key.toDouble(&isnumber);
+        if (!isnumber) continue;
+
+        // a frame, the last 16 columns of every body (Frame and Time are optional in the export)
+        if (nbodies < 0) nbodies = names_.size();
+        int offset = fields.size() - 16 * nbodies;
+        if (nbodies <= 0 || offset < 0)
+        {
+            qDebug() << "The recording" << path << "is not a 6D TSV export of QTM (line with" << fields.size() << "columns for" << nbodies << "bodies)";
+            return false;
+        }
+
+        std::vector<Pose> frame(nbodies);
+        for (int i = 0; i < nbodies; i++)
+        {
+            const int column = offset + 16 * i;
+            Pose &pose = frame[i];
+            bool okx = false, oky = false, okz = false;
+            pose.x = fields[column].toFloat(&okx);
+            pose.y = fields[column + 1].toFloat(&oky);
+            pose.z = fields[column + 2].toFloat(&okz);
+            bool okrotation = true;
+            for (int k = 0; k < 9; k++)
+            {
+                bool ok = false;
+                pose.R[k] = fields[column + 7 + k].toFloat(&ok);
+                okrotation = okrotation && ok && !std::isnan(pose.R[k]);
+            }
+            // QTM writes NaN (or nothing) for a body it didn't see
+            pose.tracked = okx && oky && okz && okrotation && !std::isnan(pose.x);
+        }
+        recording_.push_back(std::move(frame));
+    }
+
+    if (recording_.empty() || recordingRate_ <= 0)
+    {
+        qDebug() << "The recording" << path << "has no frames or no FREQUENCY";
+        return false;
+    }
+
+    // the names are the ones of the recording, BODY_n if it has none
+    for (int i = names_.size(); i < nbodies; i++) names_.append(QString("BODY_%1").arg(i + 1));
+    names_ = names_.mid(0, nbodies);
+    for (QString &name : names_) name = name.trimmed();
+    return true;
+}
+
+bool QualisysSimulator::chance(double probability)
+{
+    return probability > 0 && random_.generateDouble() < probability;
+}
+
+void QualisysSimulator::printStatistics()
+{
+    int streaming = 0;
+    for (const Client *client : clients_) streaming += client->streaming ? 1 : 0;
+
+    qDebug().noquote() << QString("%1 clients (%2 streaming) | %3 fps | %4 packets | lost %5 | occluded %6 | backlogged %7 | commands %8")
+                              .arg(clients_.size())
+                              .arg(streaming)
+                              .arg(stat_frames_)
+                              .arg(stat_packets_)
+                              .arg(stat_lost_)
+                              .arg(stat_occluded_)
+                              .arg(stat_backlogged_)
+                              .arg(stat_commands_);
+
+    stat_frames_ = stat_packets_ = stat_lost_ = stat_occluded_ = stat_backlogged_ = stat_commands_ = 0;
+}
@@ -0,0 +1,201 @@
+#ifndef QUALISYSSIMULATOR_H
+#define QUALISYSSIMULATOR_H
+
+#include <QObject>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QUdpSocket>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QRandomGenerator>
+#include <QStringList>
+
+#include <vector>
+
+/**
+ * @class QualisysSimulator
+ * @brief A TCP server which pretends to be QTM, it speaks the part of the QTM RT protocol that QualisysConnection
+ * uses (CRTProtocol::Connect, Read6DOFSettings, StreamFrames with 6D) and streams 6DOF poses of rigid bodies.
+ *
+ * For the context. To test QualisysConnection (and the pose history, the clock model, the recording behind it) we
+ * always needed QTM and the cameras. This server answers the Qualisys SDK like QTM does:
+ *  - the ports are like QTM: base+1 is little endian, base+2 big endian (the SDK adds 1 or 2 to the port it is
+ *    given, unless the version is 1.0), the base port is the old protocol 1.0, big endian until "ByteOrder"
+ *  - on connection it sends "QTM RT Interface connected", then answers "Version", "ByteOrder", "QTMVersion",
+ *    "GetParameters 6D" (XML, in the layout of the version the client asked for), "GetCurrentFrame",
+ *    "StreamFrames ... 6D" and "StreamFrames Stop", "Stop"
+ *  - the frames go over TCP, or over UDP if StreamFrames asked for "UDP:port" (like QualisysConnection does)
+ *
+ * A packet is [size 4 bytes][type 4 bytes][payload], the size includes the header. A data packet is
+ * [timestamp 8 bytes, us][frame number 4][components 4] and then the 6D component:
+ * [size 4][type 5][bodies 4][2D drop rate 2][2D out of sync rate 2] and per body x, y, z [mm] and the rotation
+ * matrix (9 floats, column by column), all NaN when the body is not tracked.
+ *
+ * The poses come from a script (every body goes around an ellipse and turns back and forth, a bit different for
+ * every body) or from a recording, the 6D TSV export of QTM (BODY_NAMES in the header, then per frame Frame, Time
+ * and per body X Y Z Roll Pitch Yaw Residual Rot[0]..Rot[8]), which is played back in a loop at its own frequency.
+ *
+ * The frame rate, the number of bodies, and some faults can be set:
+ *  - lost frame : the frame is not sent at all, the frame number jumps (like a lost UDP packet)
+ *  - occlusion  : a body is not tracked in a frame (NaN)
+ *  - drift      : the QTM clock runs this much faster than ours [ppm], for the ClockModel
+ *
+ * Every streaming client receives the same frames. If a TCP client can't keep up, the frame is not sent to that
+ * client and it is counted, so the server never eats all the memory.
+ *
+ */
+
+class QualisysSimulator : public QObject
+{
+    Q_OBJECT
+
+public:
+
+    /**
+     * @struct Settings
+     * @brief Everything that can be set from the command line, see main.cpp
+     */
+    struct Settings {
+        quint16 port        = 22222;    //!< Base port, the same as the default of QualisysConnection
+        int bodies          = 2;        //!< The number of rigid bodies of the script
+        QStringList names   = {"B_PROBE", "B_REF"};    //!< Names of the bodies, BODY_n for the rest
+        double rate         = 100.0;    //!< Frames per second
+        QString recording;              //!< QTM 6D TSV export to play back instead of the script, empty for the script
+        double loss         = 0.0;      //!< Probability [0-1] of a lost frame
+        double occlusion    = 0.0;      //!< Probability [0-1] of a body not tracked in a frame
+        double drift        = 0.0;      //!< [ppm] How much faster the QTM clock runs than ours
+        quint32 seed        = 1;        //!< Seed of the random generator, so a run can be repeated
+        int duration        = 0;        //!< Stop after this many seconds, 0 means forever
+    };
+
+    /**
+     * @brief Constructor function, prepares the bodies. Call listen() to start.
+     */
+    explicit QualisysSimulator(const Settings& settings, QObject *parent = nullptr);
+
+    /**
+     * @brief Load the recording (if there is one) and start the servers
+     *
+     * @return true if the recording is fine and the ports are open
+     */
+    bool listen();
+
+private slots:
+    /**
+     * @brief Will be called by the timer, sends all the frames that are due
+     */
+    void onTick();
+
+    /**
+     * @brief Prints what was sent in the last second
+     */
+    void printStatistics();
+
+private:
+
+    /**
+     * @struct Pose
+     * @brief The pose of one body in one frame, like in the packet
+     */
+    struct Pose {
+        float x = 0, y = 0, z = 0;      //!< [mm]
+        float R[9] = {1, 0, 0, 0, 1, 0, 0, 0, 1};  //!< Rotation matrix, column by column
+        bool tracked = true;            //!< False gives NaN in the packet
+    };
+
+    /**
+     * @struct Client
+     * @brief One connection and what it asked for
+     */
+    struct Client {
+        QTcpSocket *socket = nullptr;   //!< The connection
+        QByteArray buffer;              //!< Received bytes which are not a complete packet yet
+        bool bigEndian = false;         //!< Byte order of the port, or of "ByteOrder" for the version 1.0
+        int major = 1;                  //!< Version set by "Version"
+        int minor = 0;                  //!< See major, the port alone means 1.0
+        bool streaming = false;         //!< True after "StreamFrames ... 6D"
+        int divisor = 1;                //!< Every divisor-th frame, from "FrequencyDivisor:" or "Frequency:"
+        bool udp = false;               //!< The frames go over UDP
+        QHostAddress udpAddress;        //!< Where the UDP frames go (the address of the client, if not given)
+        quint16 udpPort = 0;            //!< See udpAddress
+    };
+
+    /**
+     * @brief Will be called whenever a client connects to the port with the given byte order
+     */
+    void onNewConnection(QTcpServer *server, bool bigEndian, bool legacy);
+
+    /**
+     * @brief Will be called whenever a client sent something, handles all the complete packets
+     */
+    void onReadyRead(Client *client);
+
+    /**
+     * @brief Handles one command of a client
+     */
+    void handleCommand(Client *client, const QString &command);
+
+    /**
+     * @brief Handles "StreamFrames ...", false if the command is not understood
+     */
+    bool handleStreamFrames(Client *client, const QStringList &arguments);
+
+    /**
+     * @brief Sends a packet to a client over TCP: command (1), error (0) or XML (2), the string with its 0
+     */
+    void sendString(Client *client, quint32 type, const QByteArray &string);
+
+    /**
+     * @brief The XML of "GetParameters 6D", in the layout the SDK expects for the version of the client
+     */
+    QByteArray settingsXml(const Client *client) const;
+
+    /**
+     * @brief Builds the data packet of the current frame (poses_, frame_, timestamp_) for a client
+     */
+    QByteArray dataPacket(bool bigEndian, bool droprates) const;
+
+    /**
+     * @brief Computes poses_ for the frame at time t [s]
+     */
+    void updatePoses(double t);
+
+    /**
+     * @brief Reads the QTM 6D TSV export, false (and why) if it isn't one
+     */
+    bool loadRecording(const QString &path);
+
+    /**
+     * @brief true with the given probability
+     */
+    bool chance(double probability);
+
+    Settings settings_;                     //!< What the user wants
+    QTcpServer servers_[3];                 //!< The base port (1.0), base+1 (little endian), base+2 (big endian)
+    QUdpSocket udp_;                        //!< Sends the UDP frames
+    QList<Client*> clients_;                //!< All the connected clients
+    QTimer ticker_;                         //!< Wakes us up to send the frames
+    QTimer statisticsTimer_;                //!< Wakes us up to print the statistics
+    QElapsedTimer clock_;                   //!< Clock for the frame timing, the measurement starts with listen()
+    QRandomGenerator random_;               //!< For the faults and the script
+
+    QStringList names_;                     //!< The names of the bodies
+    std::vector<Pose> poses_;               //!< The poses of the current frame
+    std::vector<std::vector<Pose>> recording_;  //!< The frames of the recording, empty for the script
+    double recordingRate_ = 0.0;            //!< FREQUENCY of the recording
+
+    uint64_t framesdue_  = 0;               //!< The number of frames that should be sent until now
+    uint64_t framessent_ = 0;               //!< The number of frames done until now (sent or lost)
+    quint32 frame_       = 0;               //!< The frame number of the current frame
+    quint64 timestamp_   = 0;               //!< The QTM timestamp of the current frame [us]
+
+    // statistics of the last second
+    uint64_t stat_frames_     = 0;          //!< Frames done (sent or lost)
+    uint64_t stat_packets_    = 0;          //!< Packets sent, all the clients
+    uint64_t stat_lost_       = 0;          //!< Frames lost on purpose
+    uint64_t stat_occluded_   = 0;          //!< Bodies not tracked on purpose
+    uint64_t stat_backlogged_ = 0;          //!< Packets not sent because the client couldn't keep up
+    uint64_t stat_commands_   = 0;          //!< Commands received
+};
+
+#endif // QUALISYSSIMULATOR_H
@@ -0,0 +1,19 @@
+QT = core network
+
+CONFIG += c++17 cmdline
+
+# A stand-in for QTM, see qualisyssimulator.h
+# Example, 1000 Hz with three bodies, some lost frames and a drifting QTM clock:
+#   qualisyssimulator --rate 1000 --bodies 3 --loss 0.01 --occlusion 0.001 --drift 50
+
+SOURCES += \
+    main.cpp \
+    qualisyssimulator.cpp
+
+HEADERS += \
+    qualisyssimulator.h
+
+# Default rules for deployment.
+qnx: target.path = /tmp/$${TARGET}/bin
+else: unix:!android: target.path = /opt/$${TARGET}/bin
+!isEmpty(target.path): INSTALLS += target
@@ -0,0 +1,153 @@
+#include "bmodeconnection.h"
+#include "bmodeframepool.h"
+#include "bmodev4l2capture.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QRegularExpression>
+#include <QTimer>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+// Checks the V4L2 backend with a real device node, before it is used for the B-mode: the vivid virtual driver
+// (sudo modprobe vivid) or v4l2loopback fed from a B-mode recording (see BmodeV4l2Capture). Two parts:
+//  - BmodeV4l2Capture::openDevice() on the node, then grab() and retrieveGray() of every image into a BmodeFrame of
+//    the pool, like BmodeGrabWorker: every grab works, the timestamps increase and are not in the future (the driver
+//    clock is the one of steady_clock), and the latency from the capture until the frame is filled.
+//  - if the node is /dev/videoN, BmodeConnection with BACKEND_V4L2 on camera N, streaming like in the application:
+//    the images arrive, and the latency from the capture until imageProcessed() is received (capture to signal).
+//
+// Returns 0 if all the checks pass, 1 otherwise.
+
+static int failures = 0;
+
+static void check(bool ok, const char *what)
+{
+    std::printf("%s | %s\n", ok ? "ok  " : "FAIL", what);
+    if (!ok) failures++;
+}
+
+static int64_t steadyNanoseconds()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Prints mean, median, 99th percentile and maximum of latencies [ms], returns the 99th percentile
+static double printLatency(const char *what, std::vector<double> latencies)
+{
+    if (latencies.empty()) return 0.0;
+    std::sort(latencies.begin(), latencies.end());
+    double sum = 0.0;
+    for (double latency : latencies) sum += latency;
+    const double p99 = latencies[(latencies.size() - 1) * 99 / 100];
+    std::printf("     | %s: mean %.3f ms, median %.3f, p99 %.3f, max %.3f (%zu images)\n", what, sum / latencies.size(),
+                latencies[latencies.size() / 2], p99, latencies.back(), latencies.size());
+    return p99;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("v4l2test");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Checks BmodeV4l2Capture and BmodeConnection (BACKEND_V4L2) on a V4L2 device node.");
+    parser.addHelpOption();
+    QCommandLineOption deviceOption("device", "The device node, vivid or v4l2loopback (default /dev/video0).", "path", "/dev/video0");
+    QCommandLineOption framesOption("frames", "Images grabbed through openDevice() (default 300).", "n", "300");
+    QCommandLineOption secondsOption("seconds", "Time to stream through BmodeConnection (default 5).", "s", "5");
+    parser.addOptions({deviceOption, framesOption, secondsOption});
+    parser.process(a);
+
+    const std::string device = parser.value(deviceOption).toStdString();
+    const int nframes = parser.value(framesOption).toInt();
+    const double seconds = parser.value(secondsOption).toDouble();
+
+    // 1) the capture alone, through openDevice()
+    BmodeV4l2Capture capture;
+    bool opened = capture.openDevice(device);
+    check(opened, "openDevice(): a raw format, the buffers mapped, the stream on");
+    if (!opened) return 1;
+    std::printf("     | %s, %s\n", capture.description().c_str(),
+                capture.isCaptureTimestamp() ? "timestamps of the driver (CLOCK_MONOTONIC)" : "timestamped when DQBUF returns");
+
+    std::shared_ptr<BmodeFramePool> pool;
+    std::vector<double> latencies;
+    latencies.reserve(nframes);
+    int grabfailures = 0, retrievefailures = 0, backwards = 0;
+    int64_t first = 0, last = 0;
+    for (int i = 0; i < nframes; i++)
+    {
+        int64_t timestamp = 0;
+        if (!capture.grab(timestamp))
+        {
+            grabfailures++;
+            continue;
+        }
+        const cv::Size size = capture.size();
+        if (!pool) pool = BmodeFramePool::create(size.width, size.height);
+
+        // what BmodeGrabWorker does with every image, the latency is until the frame could be published
+        BmodeFramePtr frame = pool->acquire();
+        cv::Mat gray = frame.writable()->writableImage();
+        if (!capture.retrieveGray(cv::Rect(0, 0, size.width, size.height), gray)) retrievefailures++;
+        latencies.push_back((steadyNanoseconds() - timestamp) / 1.0e6);
+
+        if (first == 0) first = timestamp;
+        else if (timestamp <= last) backwards++;
+        last = timestamp;
+    }
+    const cv::Size size = capture.size();
+    const double rate = (latencies.size() > 1 && last > first) ? (latencies.size() - 1) * 1.0e9 / (last - first) : 0.0;
+    capture.close();
+
+    std::printf("     | %dx%d at %.1f fps\n", size.width, size.height, rate);
+    const double capturep99 = printLatency("capture to frame", latencies);
+    check(grabfailures == 0 && retrievefailures == 0 && !latencies.empty(), "grab() and retrieveGray() of every image");
+    check(backwards == 0, "the timestamps increase");
+    check(!latencies.empty() && *std::min_element(latencies.begin(), latencies.end()) >= 0.0,
+          "the timestamps are not in the future (the clock of steady_clock)");
+    check(rate > 0.0 && capturep99 < 3000.0 / rate, "capture to frame within 3 frame periods (p99)");
+
+    // 2) the whole path of the application, the camera index is the N of /dev/videoN
+    QRegularExpressionMatch match = QRegularExpression("^/dev/video(\\d+)$").match(QString::fromStdString(device));
+    if (!match.hasMatch())
+    {
+        std::printf("     | %s is not /dev/videoN, BmodeConnection can't open it, skipped\n", device.c_str());
+        return failures ? 1 : 0;
+    }
+
+    BmodeConnection connection;
+    connection.setBackend(BmodeCaptureDevice::BACKEND_V4L2);
+    connection.setRoi(cv::Rect(0, 0, size.width, size.height));
+    bool cameraopen = connection.openCamera(match.captured(1).toInt());
+    check(cameraopen, "BmodeConnection opens the camera with BACKEND_V4L2");
+    if (!cameraopen) return 1;
+
+    // imageProcessed() is emitted in this thread, the latency is taken when the slot gets it
+    std::vector<double> signal;
+    signal.reserve(static_cast<std::size_t>(seconds * std::max(rate, 1.0) * 2.0));
+    QObject::connect(&connection, &BmodeConnection::imageProcessed, &connection, [&](const BmodeFramePtr &frame) {
+        signal.push_back((steadyNanoseconds() - frame->getTimestamp()) / 1.0e6);
+    });
+
+    connection.startImageStream();
+    QTimer::singleShot(static_cast<int>(seconds * 1000.0), &a, &QCoreApplication::quit);
+    a.exec();
+    BmodeConnection::Statistics statistics = connection.getStatistics();
+    connection.stopImageStream();
+    connection.closeCamera();
+
+    std::printf("     | last second: %.1f fps, latency %.3f ms (max %.3f), processing %.3f ms, %llu dropped, %llu failures\n",
+                statistics.frameRate, statistics.latencyMean, statistics.latencyMax, statistics.processingTime,
+                static_cast<unsigned long long>(statistics.dropped), static_cast<unsigned long long>(statistics.failures));
+    const double signalp99 = printLatency("capture to imageProcessed()", signal);
+    check(signal.size() >= 0.9 * rate * (seconds - 1.0), "the images arrive at the rate of the device (a second of slack)");
+    check(statistics.failures == 0, "no failed grab while streaming");
+    check(!signal.empty() && signalp99 < 3000.0 / rate, "capture to imageProcessed() within 3 frame periods (p99)");
+
+    return failures ? 1 : 0;
+}
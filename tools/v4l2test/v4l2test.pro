@@ -0,0 +1,39 @@
+QT = core gui
+
+CONFIG += c++17 cmdline
+
+# Checks the V4L2 backend of the B-mode on a device node (vivid or v4l2loopback), see main.cpp. Linux only. It returns
+# 1 if a check fails.
+
+INCLUDEPATH += ../..
+
+SOURCES += \
+    main.cpp \
+    ../../bmodecameraenumerator.cpp \
+    ../../bmodeconnection.cpp \
+    ../../bmodeframe.cpp \
+    ../../bmodeframepool.cpp \
+    ../../bmodegrabworker.cpp \
+    ../../bmodegrayconverter.cpp \
+    ../../bmodeopencvcapture.cpp \
+    ../../bmoderoidetector.cpp \
+    ../../bmodev4l2capture.cpp \
+    ../../clockmodel.cpp
+
+HEADERS += \
+    ../../bmodecameraenumerator.h \
+    ../../bmodecapturedevice.h \
+    ../../bmodeconnection.h \
+    ../../bmodeframe.h \
+    ../../bmodeframepool.h \
+    ../../bmodegrabworker.h \
+    ../../bmodegrayconverter.h \
+    ../../bmodeopencvcapture.h \
+    ../../bmoderoidetector.h \
+    ../../bmodev4l2capture.h \
+    ../../clockmodel.h
+
+# OpenCV and rapidxml (BmodeRoiDetector) of the system
+CONFIG += link_pkgconfig
+PKGCONFIG += opencv4
+INCLUDEPATH += /usr/include/rapidxml
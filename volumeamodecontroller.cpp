@@ -1,38 +1,41 @@
 #include <filesystem>
+#include <algorithm>
 #include <cmath>
 #include <cstdlib>
 #include <iostream>
 
 #include "volumeamodecontroller.h"
-#include "amodedatamanipulator.h"
 #include "ultrasoundconfig.h"
 
-VolumeAmodeController::VolumeAmodeController(QObject *parent, Q3DScatter *scatter, std::vector<AmodeConfig::Data> amodegroupdata)
-    : QObject{parent}, scatter_(scatter), amodegroupdata_(amodegroupdata)
+VolumeAmodeController::VolumeAmodeController(QObject *parent, Q3DScatter *scatter, std::vector<AmodeConfig::Data> amodegroupdata, int nsample)
+    : QObject{parent}, scatter_(scatter), nsample_(nsample), amodegroupdata_(amodegroupdata)
 {
     // Calculate necessary constants
-    us_dvector_             = Eigen::VectorXd::LinSpaced(UltrasoundConfig::N_SAMPLE, 1, UltrasoundConfig::N_SAMPLE) * UltrasoundConfig::DS;             // [[mm]]
-    us_tvector_             = Eigen::VectorXd::LinSpaced(UltrasoundConfig::N_SAMPLE, 1, UltrasoundConfig::N_SAMPLE) * UltrasoundConfig::DT * 1000000;   // [[mu s]]
+    us_dvector_             = Eigen::VectorXd::LinSpaced(nsample_, 1, nsample_) * UltrasoundConfig::DS;             // [[mm]]
+    us_tvector_             = Eigen::VectorXd::LinSpaced(nsample_, 1, nsample_) * UltrasoundConfig::DT * 1000000;   // [[mu s]]
 
     // I added option to downsample, for visualization performance
     if (isDownsample)
     {
-        // downsample the us_dvector and get the length of the vector
-        Eigen::VectorXd us_dvector_downsampled = AmodeDataManipulator::downsampleVector(us_dvector_, round((double)UltrasoundConfig::N_SAMPLE / downsample_ratio));
-        downsample_nsample_ = us_dvector_downsampled.size();
+        // Picking every n-th sample loses the echoes that fall in between (they are only a few samples wide). So the
+        // samples are divided into columns of 2 x downsample_ratio samples, and every column gives two points, its
+        // minimum and its maximum (see AmodeMinMaxDecimator), both at the depth of the middle of the column. The same
+        // number of points as before.
+        decimator_ = AmodeMinMaxDecimator(nsample_, std::max<int>(std::lround(nsample_ / downsample_ratio / 2.0), 1));
+        downsample_nsample_ = decimator_.getNoutput();
 
         // first resize the amode3dsignal matrix according to nsample_downsample_ (not nsample_)
         amode3dsignal_.resize(Eigen::NoChange, downsample_nsample_);
         // initialize the amode3dsignal
         amode3dsignal_.row(0).setZero();     // x-coordinate
-        amode3dsignal_.row(1) = us_dvector_downsampled; // y-coordinate
+        decimator_.keys(us_dvector_.data(), amode3dsignal_.data() + 1, amode3dsignal_.outerStride()); // y-coordinate
         amode3dsignal_.row(2).setZero();     // z-coordinate
         amode3dsignal_.row(3).setOnes();     // 1 (homogeneous)
     }
     else
     {
         // first resize the amode3dsignal matrix according to nsample_ of amode signal
-        amode3dsignal_.resize(Eigen::NoChange, UltrasoundConfig::N_SAMPLE);
+        amode3dsignal_.resize(Eigen::NoChange, nsample_);
         // initialize the amode3dsignal
         amode3dsignal_.row(0).setZero();     // x-coordinate
         amode3dsignal_.row(1) = us_dvector_; // y-coordinate
@@ -40,6 +43,9 @@ VolumeAmodeController::VolumeAmodeController(QObject *parent, Q3DScatter *scatte
         amode3dsignal_.row(3).setOnes();     // 1 (homogeneous)
     }
 
+    // without downsampling, the probe just goes into amode3dsignal_
+    if (!isDownsample) downsampler_ = AmodeDownsampler(nsample_, nsample_);
+
     // initialize transformations
     currentT_holder_camera = Eigen::Isometry3d::Identity();
     for(std::size_t i = 0; i < amodegroupdata_.size(); ++i)
@@ -151,6 +157,12 @@ void VolumeAmodeController::setSignalDisplayMode(int mode)
 void VolumeAmodeController::setActiveHolder(std::string T_id)
 {
     transformation_id = T_id;
+    holderHandle_ = RigidBodyFrame::Handle(T_id);
+}
+
+void VolumeAmodeController::setPoseHistory(std::shared_ptr<const PoseHistory> posehistory)
+{
+    posehistory_ = posehistory;
 }
 
 void VolumeAmodeController::newObject(std::string path, std::string name)
@@ -219,11 +231,18 @@ void VolumeAmodeController::updateTransformations(Eigen::Isometry3d currentT_hol
 }
 
 
-void VolumeAmodeController::onAmodeSignalReceived(const std::vector<uint16_t> &usdata_uint16_)
+void VolumeAmodeController::onAmodeSignalReceived(const AmodeFramePtr &frame)
 {
-    // get the amode data
-    QVector<int16_t> tmp(usdata_uint16_.begin(), usdata_uint16_.end());
-    amodesignal_ = tmp;
+    // keep the frame (no copy, we only hold the pointer until the next frame arrives)
+    amodeframe_ = frame;
+
+    // with the history, the pose of the holder when the frame arrived, no need to wait for the next pose
+    if (posehistory_)
+    {
+        if (transformation_id.empty() || !posehistory_->poseAt(holderHandle_, frame->getTimestamp(), currentT_holder_camera)) return;
+        visualize3DSignal();
+        return;
+    }
 
     // set the flag to be true...
     amodesignalReady = true;
@@ -233,22 +252,21 @@ void VolumeAmodeController::onAmodeSignalReceived(const std::vector<uint16_t> &u
     }
 }
 
-void VolumeAmodeController::onRigidBodyReceived(const QualisysTransformationManager &tmanager)
+void VolumeAmodeController::onRigidBodyReceived(const RigidBodyFramePtr &frame)
 {
+    // the A-mode frames take their pose from the history, see onAmodeSignalReceived()
+    if (posehistory_) return;
+
     if(transformation_id.empty())
     {
         std::cerr << "Tranformation id is empty, please use initialize it using setActiveHolder()" << std::endl;
         return;
     }
 
-    try
-    {
-        // temporary code, i should get the transformation based on the group amodegroupdata_->at(0).groupname
-        currentT_holder_camera = tmanager.getTransformationById(transformation_id);
-    }
-    catch (const std::exception& e)
+    // temporary code, i should get the transformation based on the group amodegroupdata_->at(0).groupname
+    if (!frame->getTransformation(holderHandle_, currentT_holder_camera))
     {
-        std::cerr << "An exception occurred: " << e.what() << std::endl;
+        std::cerr << "Transformation id " << transformation_id << " is not streamed by Qualisys" << std::endl;
         return;
     }
 
@@ -297,57 +315,24 @@ void VolumeAmodeController::visualize3DSignal()
     // So i will need a loop for how much signal i have
     for(std::size_t i = 0; i < amodegroupdata_.size(); ++i)
     {
-        // select the row from the whole amode data
-        QVector<int16_t> amodesignal_rowsel = AmodeDataManipulator::getRow(amodesignal_, amodegroupdata_.at(i).number-1, UltrasoundConfig::N_SAMPLE);
-
-        // if we decided to downsample, we need to downsample the amodesignal_rowsel first
-        // before we assign to amode3dsignal_ so that the dimension will match
-        Eigen::VectorXd amodesignal_rowsel_eigenVector;
-        int idx = 175;
-        if(isDownsample)
-        {
-            // downsample
-            QVector<int16_t> usdata_qvint16_downsmp = AmodeDataManipulator::downsampleVector(amodesignal_rowsel, round((double)UltrasoundConfig::N_SAMPLE / downsample_ratio));
-
-            /*
-            // Let's check if the size of usdata_qvint16_downsmp different than amode3dsignal_.row(0), if it is different,
-            // it will be a disaster when i want to assign the value of usdata_qvint16_downsmp to amode3dsignal_.row(0)
-            //
-            // And why the hell, you ask, do we need to do this whereas we downsample the same value to both usdata_qvint16_downsmp and amode3dsignal_.row(0)?
-            // The answer is i don't fucking know. It annoys me so much.
-            // What i can say, most probably, it because the implementation of downsampleVector() for QVector<int16_t> is for speed, not for downsampling accuracy.
-            // This block of code is super ugly, but who cares. It works. That's all we need. Bye.
-            if (usdata_qvint16_downsmp.size() != amode3dsignal_.row(0).size())
-            {
-                int diff = usdata_qvint16_downsmp.size() - amode3dsignal_.row(0).size();
-                if (diff > 0)
-                    for (int j=0; j<abs(diff); j++) usdata_qvint16_downsmp.removeLast();
-                else
-                {
-                    for (int j=0; j<abs(diff); j++) usdata_qvint16_downsmp.append(usdata_qvint16_downsmp.last());
-                }
-            }
-            */
-
-            // convert to Eigen::VectorXd
-            amodesignal_rowsel_eigenVector = Eigen::Map<const Eigen::Matrix<int16_t, Eigen::Dynamic, 1>>(usdata_qvint16_downsmp.constData(), usdata_qvint16_downsmp.size()).cast<double>();
-            // remove the near field disturbance
-            int idx_new = round(double(idx) / downsample_ratio);
-            amodesignal_rowsel_eigenVector.head(idx_new).setZero();
-        }
-        else
-        {
-            // convert to Eigen::VectorXd
-            amodesignal_rowsel_eigenVector = Eigen::Map<const Eigen::Matrix<int16_t, Eigen::Dynamic, 1>>(amodesignal_rowsel.constData(), amodesignal_rowsel.size()).cast<double>();
-            // remove the near field disturbance
-            amodesignal_rowsel_eigenVector.head(idx).setZero();
-        }
+        // select the row from the whole amode data, this is just a view inside the frame (no copy).
+        // If the source computed the envelope (MainWindow asks for it), we show the envelope instead of the raw signal
+        int probenumber = amodegroupdata_.at(i).number-1;
+        AmodeFrame::ProbeView probe = amodeframe_->hasEnvelope() ? amodeframe_->envelope(probenumber) : amodeframe_->probe(probenumber);
+        if (probe.size != nsample_) continue;
+
+        // if we decided to downsample, the minimum and the maximum of every column go directly from the probe into
+        // amode3dsignal_.row(0), so that the dimension always matches. Without downsampling all the samples go there.
+        // The row is every outerStride() doubles.
+        int arraysize = amode3dsignal_.cols();
+        if (isDownsample) decimator_.apply(probe.data, amode3dsignal_.data(), amode3dsignal_.outerStride(), 0.001); // x-coordinate
+        else downsampler_.apply(probe.data, amode3dsignal_.data(), amode3dsignal_.outerStride(), 0.001);
 
-        // store it to our amode3dsignal_
-        amode3dsignal_.row(0) = amodesignal_rowsel_eigenVector * 0.001; // x-coordinate
+        // remove the near field disturbance, the first 175 samples. By the depth (y-coordinate), which is the same
+        // with and without downsampling.
+        const double nearfield = us_dvector_(std::min(175, nsample_ - 1));
+        for (int k = 0; k < arraysize && amode3dsignal_(1, k) < nearfield; k++) amode3dsignal_(0, k) = 0.0;
 
-        // Get the size of the data (that is the samples in the signal)
-        int arraysize = amode3dsignal_.cols();
         // Since we provided several display mode for visualizing amode 3d signal, we need to provide
         // a variable to place all of those display modes
         Eigen::Matrix<double, 4, Eigen::Dynamic> current_amode3dsignal_display(4, arraysize * n_signaldisplay);
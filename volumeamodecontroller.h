@@ -7,8 +7,13 @@
 #include <QtDataVisualization>
 
 #include "amodeconfig.h"
+#include "amodedownsampler.h"
+#include "amodeframe.h"
+#include "amodeminmaxdecimator.h"
 #include "qualisysconnection.h"
-#include "qualisystransformationmanager.h"
+#include "posehistory.h"
+#include "rigidbodyframe.h"
+#include "ultrasoundconfig.h"
 
 /**
  * @class VolumeAmodeController
@@ -34,8 +39,9 @@ public:
 
     /**
      * @brief Constructor function. Requres the A-mode group data, which helds the local transformation information of every individual A-mode.
+     * nsample is the number of samples of each probe, from the A-mode source (AmodeSource::getNsample()).
      */
-    VolumeAmodeController(QObject *parent = nullptr, Q3DScatter *scatter = nullptr, std::vector<AmodeConfig::Data> amodegroupdata = std::vector<AmodeConfig::Data>());
+    VolumeAmodeController(QObject *parent = nullptr, Q3DScatter *scatter = nullptr, std::vector<AmodeConfig::Data> amodegroupdata = std::vector<AmodeConfig::Data>(), int nsample = UltrasoundConfig::N_SAMPLE);
 
     /**
      * @brief Destructor function.
@@ -76,17 +82,23 @@ public:
      */
     void setActiveHolder(std::string T_id);
 
+    /**
+     * @brief SET the pose history of QualisysConnection (see QualisysConnection::getPoseHistory()). With it, every
+     * A-mode frame is shown with the pose of the holder at the time the frame arrived, without it with the latest pose.
+     */
+    void setPoseHistory(std::shared_ptr<const PoseHistory> posehistory);
+
 public slots:
 
     /**
      * @brief slot function, will be called when an amode signal is received, needs to be connected to signal from AmodeConnection::dataReceived
      */
-    void onAmodeSignalReceived(const std::vector<uint16_t> &usdata_uint16_);
+    void onAmodeSignalReceived(const AmodeFramePtr &frame);
 
     /**
      * @brief slot function, will be called when transformations in a timestamp are received, needs to be connected to signal from QualisysConnection::dataReceived class
      */
-    void onRigidBodyReceived(const QualisysTransformationManager &tmanager);
+    void onRigidBodyReceived(const RigidBodyFramePtr &frame);
 
 private:
 
@@ -114,12 +126,15 @@ private:
     std::vector<QScatter3DSeries> all_series_;                  //!< Stores multiple series (which contains a-mode 3d signal data).
 
     // all variables related to amode signal
+    int nsample_;                                               //!< the number of sample of each probe, from the A-mode source
     int downsample_nsample_;                                    //!< the number of sample after downsampling. used when we do downsample
+    AmodeMinMaxDecimator decimator_;                            //!< the minimum and the maximum of every column of samples for amode3dsignal_, if we downsample
+    AmodeDownsampler downsampler_;                              //!< takes all the samples for amode3dsignal_, if we don't downsample
     double downsample_ratio = 2.0;                              //!< specifiy the ratio of the downsampling. the default is half less.
     bool isDownsample       = true;                             //!< a flag to signify the class that we are doing downsampling.
 
     std::vector<AmodeConfig::Data> amodegroupdata_;                             //!< Stores the configuration of a-mode group. We need the local transformations.
-    QVector<int16_t> amodesignal_;                                              //!< A-mode signal but in QVector. The datatype is required byAmodeDataManipulator class
+    AmodeFramePtr amodeframe_;                                                  //!< The latest A-mode frame, shared with everybody else (no copy)
     Eigen::Matrix<double, 4, Eigen::Dynamic> amode3dsignal_;                    //!< A-mode signal but in Eigen::Matrix. For transformation manupulation, easier with this class.
     std::vector<Eigen::Matrix<double, 4, Eigen::Dynamic>> all_amode3dsignal_;   //!< all amode3dsignal_ in a holder
 
@@ -140,6 +155,8 @@ private:
     int n_signaldisplay = 1;                                    //!< controls the visualization of the 3d signal. See setSignalDisplayMode() description for detail.
     std::vector<Eigen::Matrix4d> rotation_signaldisplay;        //!< controls the visualization of the 3d signal.
     std::string transformation_id = "";                         //!< The name of the current holder being visualized (relates to its transformation).
+    RigidBodyFrame::Handle holderHandle_;                       //!< Where transformation_id is in the frames of QualisysConnection
+    std::shared_ptr<const PoseHistory> posehistory_;            //!< The poses from QualisysConnection, nullptr to pair with the latest pose
 
 signals:
 };